@@ -0,0 +1,1261 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * A hardware-free stand-in for the UHD shared library. It implements the subset of the UHD C API that UHDr loads and
+ * simulates a number of networked USRP N210 devices with one UBX daughterboard each. Rx streams deliver a synthetic
+ * tone per channel, paced by the device clock, tx streams consume samples at the sample rate and report bursts,
+ * underflows and late bursts through async messages. Settings are stored and read back like on a real device.
+ *
+ * The behaviour is configured through environment variables that are read when a USRP is made:
+ *
+ * NTLAB_MOCK_UHD_NUM_DEVICES               Number of devices found, 2 by default
+ * NTLAB_MOCK_UHD_REALTIME                  If 0, samples are delivered and consumed as fast as possible, 1 by default
+ * NTLAB_MOCK_UHD_CALL_LATENCY_MS           Delay added to each settings call to simulate the network round trip
+ * NTLAB_MOCK_UHD_RX_LATENCY_MS             Delay between the time of the last sample and its delivery
+ * NTLAB_MOCK_UHD_RX_BUFFER_SAMPLES         Samples buffered on the device before an rx overflow, 1 << 20 by default
+ * NTLAB_MOCK_UHD_OVERFLOW_EVERY_N_RECVS    Injects an rx overflow every n receive calls, 0 disables it
+ * NTLAB_MOCK_UHD_OVERFLOW_NUM_SAMPLES      Number of samples dropped by an injected overflow, 1000 by default
+ * NTLAB_MOCK_UHD_UNDERFLOW_EVERY_N_SENDS   Injects a tx underflow every n send calls, 0 disables it
+ *
+ * See README.md for how to build it and use it in place of the real library.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined (_WIN32)
+ #define MOCK_UHD_EXPORT extern "C" __declspec (dllexport)
+#else
+ #define MOCK_UHD_EXPORT extern "C" __attribute__ ((visibility ("default")))
+#endif
+
+//==============================================================================
+// The types of the UHD C API, their layout has to match the declarations in UHDReplacement.h
+
+typedef int uhd_error;
+
+enum
+{
+    UHD_ERROR_NONE           = 0,
+    UHD_ERROR_INVALID_DEVICE = 1,
+    UHD_ERROR_INDEX          = 10,
+    UHD_ERROR_KEY            = 11,
+    UHD_ERROR_VALUE          = 43
+};
+
+enum
+{
+    RX_ERROR_NONE       = 0x0,
+    RX_ERROR_TIMEOUT    = 0x1,
+    RX_ERROR_LATE       = 0x2,
+    RX_ERROR_OVERFLOW   = 0x8
+};
+
+enum
+{
+    ASYNC_BURST_ACK  = 0x1,
+    ASYNC_UNDERFLOW  = 0x2,
+    ASYNC_TIME_ERROR = 0x8
+};
+
+enum
+{
+    STREAM_MODE_START_CONTINUOUS   = 97,
+    STREAM_MODE_STOP_CONTINUOUS    = 111,
+    STREAM_MODE_NUM_SAMPS_AND_DONE = 100,
+    STREAM_MODE_NUM_SAMPS_AND_MORE = 109
+};
+
+struct uhd_tune_request_t
+{
+    double target_freq;
+    int rf_freq_policy;
+    double rf_freq;
+    int dsp_freq_policy;
+    double dsp_freq;
+    char* args;
+};
+
+struct uhd_tune_result_t
+{
+    double clipped_rf_freq;
+    double target_rf_freq;
+    double actual_rf_freq;
+    double target_dsp_freq;
+    double actual_dsp_freq;
+};
+
+struct uhd_stream_args_t
+{
+    char* cpu_format;
+    char* otw_format;
+    char* args;
+    size_t* channel_list;
+    int n_channels;
+};
+
+struct uhd_stream_cmd_t
+{
+    int stream_mode;
+    size_t num_samps;
+    bool stream_now;
+    time_t time_spec_full_secs;
+    double time_spec_frac_secs;
+};
+
+//==============================================================================
+namespace ntlab
+{
+namespace MockUHD
+{
+    static const double masterClockRate = 100e6;
+    static const size_t allChannels = static_cast<size_t> (-1);
+    static const size_t allMboards  = static_cast<size_t> (-1);
+
+    static long long getEnvInt (const char* name, long long defaultValue)
+    {
+        if (auto* value = std::getenv (name))
+            return std::atoll (value);
+
+        return defaultValue;
+    }
+
+    static double getEnvDouble (const char* name, double defaultValue)
+    {
+        if (auto* value = std::getenv (name))
+            return std::atof (value);
+
+        return defaultValue;
+    }
+
+    static std::string getMockAddress (int deviceIdx) { return "192.168.10." + std::to_string (2 + deviceIdx); }
+
+    static std::string getMockSerial (int deviceIdx)
+    {
+        char serial[16];
+        std::snprintf (serial, sizeof (serial), "MOCK%04d", deviceIdx);
+        return serial;
+    }
+
+    static void copyToStringBuffer (const std::string& string, char* buffer, size_t bufferLength)
+    {
+        if (bufferLength == 0)
+            return;
+
+        std::strncpy (buffer, string.c_str(), bufferLength - 1);
+        buffer[bufferLength - 1] = '\0';
+    }
+
+    static void splitTimeSpec (double time, time_t& fullSecs, double& fracSecs)
+    {
+        fullSecs = static_cast<time_t> (std::floor (time));
+        fracSecs = time - static_cast<double> (fullSecs);
+    }
+
+    struct Config
+    {
+        int numDevices              = static_cast<int> (getEnvInt ("NTLAB_MOCK_UHD_NUM_DEVICES", 2));
+        bool realtime               = getEnvInt ("NTLAB_MOCK_UHD_REALTIME", 1) != 0;
+        double callLatency          = getEnvDouble ("NTLAB_MOCK_UHD_CALL_LATENCY_MS", 0.0) * 1e-3;
+        double rxLatency            = getEnvDouble ("NTLAB_MOCK_UHD_RX_LATENCY_MS", 0.0) * 1e-3;
+        long long rxBufferSamples   = getEnvInt ("NTLAB_MOCK_UHD_RX_BUFFER_SAMPLES", 1 << 20);
+        long long overflowInterval  = getEnvInt ("NTLAB_MOCK_UHD_OVERFLOW_EVERY_N_RECVS", 0);
+        long long overflowSamples   = getEnvInt ("NTLAB_MOCK_UHD_OVERFLOW_NUM_SAMPLES", 1000);
+        long long underflowInterval = getEnvInt ("NTLAB_MOCK_UHD_UNDERFLOW_EVERY_N_SENDS", 0);
+    };
+
+    /** The settings of a single rx or tx channel */
+    struct ChannelSettings
+    {
+        double sampleRate = 1e6;
+        double frequency  = 0.0;
+        double bandwidth  = 40e6;
+        std::string antenna;
+        std::map<std::string, double> gains;
+    };
+
+    /** The state shared by a USRP handle and the streamers created from it */
+    class Device
+    {
+    public:
+        Device (const Config& config, int numMboards)
+          : config (config),
+            numMboards (numMboards),
+            startTime (std::chrono::steady_clock::now()),
+            rxFrontendsPerMboard (static_cast<size_t> (numMboards), 1),
+            txFrontendsPerMboard (static_cast<size_t> (numMboards), 1)
+        {}
+
+        const Config config;
+        const int numMboards;
+
+        /** All motherboards share one clock, as if they were synchronized through a MIMO cable or a PPS signal */
+        double getTimeNow() const
+        {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+            return timeOffset.load() + elapsed.count();
+        }
+
+        void setTimeNow (double newTime)
+        {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+            timeOffset = newTime - elapsed.count();
+        }
+
+        /** Blocks until the device time reaches the time passed, returns false if that would exceed the timeout */
+        bool waitUntil (double time, double timeout) const
+        {
+            if (!config.realtime)
+                return true;
+
+            const auto timeToWait = time - getTimeNow();
+
+            if (timeToWait <= 0.0)
+                return true;
+
+            if (timeToWait > timeout)
+            {
+                std::this_thread::sleep_for (std::chrono::duration<double> (timeout));
+                return false;
+            }
+
+            std::this_thread::sleep_for (std::chrono::duration<double> (timeToWait));
+            return true;
+        }
+
+        /** Simulates the network round trip of a settings call. The lock is not held meanwhile */
+        void simulateCallLatency() const
+        {
+            if (config.callLatency > 0.0)
+                std::this_thread::sleep_for (std::chrono::duration<double> (config.callLatency));
+        }
+
+        size_t getNumChannels (bool rx) const
+        {
+            std::lock_guard<std::mutex> scopedLock (lock);
+
+            auto& frontendsPerMboard = rx ? rxFrontendsPerMboard : txFrontendsPerMboard;
+            size_t numChannels = 0;
+            for (auto n : frontendsPerMboard)
+                numChannels += n;
+
+            return numChannels;
+        }
+
+        void setSubdevSpec (bool rx, const std::string& markup, size_t mboard)
+        {
+            // each frontend of a subdev spec is separated by a space, like "A:0 A:1"
+            std::istringstream stream (markup);
+            std::string frontend;
+            size_t numFrontends = 0;
+            while (stream >> frontend)
+                ++numFrontends;
+
+            std::lock_guard<std::mutex> scopedLock (lock);
+
+            auto& frontendsPerMboard = rx ? rxFrontendsPerMboard : txFrontendsPerMboard;
+            for (size_t m = 0; m < frontendsPerMboard.size(); ++m)
+                if ((mboard == allMboards) || (mboard == m))
+                    frontendsPerMboard[m] = std::max<size_t> (1, numFrontends);
+        }
+
+        /** Calls the function passed with the settings of one or all channels while holding the lock */
+        template <typename FunctionType>
+        bool accessChannels (bool rx, size_t channel, FunctionType function)
+        {
+            const auto numChannels = getNumChannels (rx);
+            if ((channel != allChannels) && (channel >= numChannels))
+                return false;
+
+            std::lock_guard<std::mutex> scopedLock (lock);
+
+            auto& settings = rx ? rxSettings : txSettings;
+            for (size_t c = 0; c < numChannels; ++c)
+                if ((channel == allChannels) || (channel == c))
+                    function (settings[c]);
+
+            return true;
+        }
+
+        std::atomic<long long> numRecvCalls {0};
+        std::atomic<long long> numSendCalls {0};
+
+    private:
+        std::chrono::steady_clock::time_point startTime;
+        std::atomic<double> timeOffset {0.0};
+
+        mutable std::mutex lock;
+        std::vector<size_t> rxFrontendsPerMboard;
+        std::vector<size_t> txFrontendsPerMboard;
+        std::map<size_t, ChannelSettings> rxSettings;
+        std::map<size_t, ChannelSettings> txSettings;
+    };
+
+    enum class SampleFormat { fc32, sc16, sc8 };
+
+    static SampleFormat getSampleFormat (const char* name)
+    {
+        if (name != nullptr)
+        {
+            if (std::strcmp (name, "sc16") == 0) return SampleFormat::sc16;
+            if (std::strcmp (name, "sc8")  == 0) return SampleFormat::sc8;
+        }
+
+        return SampleFormat::fc32;
+    }
+
+    /** Generates a tone per channel and writes it in the cpu format of the stream */
+    class ToneGenerator
+    {
+    public:
+        void prepare (size_t numChannels)
+        {
+            rotators.clear();
+            phasors.assign (numChannels, std::complex<double> (amplitude, 0.0));
+
+            // each channel gets its own frequency so that mixed up channels can be told apart
+            for (size_t c = 0; c < numChannels; ++c)
+                rotators.push_back (std::polar (1.0, 2.0 * 3.14159265358979323846 * static_cast<double> (c + 1) / 64.0));
+        }
+
+        void generate (void** buffs, size_t numSamples, size_t offset, SampleFormat format)
+        {
+            for (size_t c = 0; c < phasors.size(); ++c)
+            {
+                auto& phasor = phasors[c];
+
+                for (size_t i = 0; i < numSamples; ++i)
+                {
+                    write (buffs[c], offset + i, phasor, format);
+                    phasor *= rotators[c];
+                }
+
+                // keep the amplitude from drifting away due to rounding errors
+                phasor *= amplitude / std::abs (phasor);
+            }
+        }
+
+        void advance (size_t numSamples)
+        {
+            for (size_t c = 0; c < phasors.size(); ++c)
+                phasors[c] *= std::pow (rotators[c], static_cast<double> (numSamples));
+        }
+
+    private:
+        static constexpr double amplitude = 0.5;
+
+        std::vector<std::complex<double>> phasors, rotators;
+
+        static void write (void* buffer, size_t idx, std::complex<double> value, SampleFormat format)
+        {
+            switch (format)
+            {
+                case SampleFormat::fc32:
+                    static_cast<std::complex<float>*> (buffer)[idx] = std::complex<float> (static_cast<float> (value.real()), static_cast<float> (value.imag()));
+                    break;
+                case SampleFormat::sc16:
+                    static_cast<int16_t*> (buffer)[2 * idx]     = static_cast<int16_t> (std::lround (value.real() * 32767.0));
+                    static_cast<int16_t*> (buffer)[2 * idx + 1] = static_cast<int16_t> (std::lround (value.imag() * 32767.0));
+                    break;
+                case SampleFormat::sc8:
+                    static_cast<int8_t*> (buffer)[2 * idx]     = static_cast<int8_t> (std::lround (value.real() * 127.0));
+                    static_cast<int8_t*> (buffer)[2 * idx + 1] = static_cast<int8_t> (std::lround (value.imag() * 127.0));
+                    break;
+            }
+        }
+    };
+
+    /** Samples per packet of an N210 with a frame size of 1472 bytes */
+    static size_t getMaxNumSamplesPerPacket (const char* otwFormat)
+    {
+        return getSampleFormat (otwFormat) == SampleFormat::sc8 ? 726 : 363;
+    }
+}
+}
+
+using namespace ntlab::MockUHD;
+
+//==============================================================================
+// The handles, the first members of uhd_usrp have to match UHDr::USRPstruct
+
+struct uhd_usrp
+{
+    size_t usrp_index;
+    std::string last_error;
+    std::shared_ptr<Device> device;
+};
+
+struct uhd_rx_metadata
+{
+    int errorCode = RX_ERROR_NONE;
+    bool hasTimeSpec = false;
+    double time = 0.0;
+    bool outOfSequence = false;
+    std::string last_error;
+};
+
+struct uhd_tx_metadata
+{
+    bool hasTimeSpec;
+    double time;
+    bool startOfBurst;
+    bool endOfBurst;
+    std::string last_error;
+};
+
+struct uhd_async_metadata
+{
+    int eventCode = 0;
+    std::string last_error;
+};
+
+struct uhd_rx_streamer
+{
+    std::shared_ptr<Device> device;
+    std::vector<size_t> channels;
+    SampleFormat cpuFormat = SampleFormat::fc32;
+    size_t maxNumSamples = 363;
+    double sampleRate = 1e6;
+
+    ToneGenerator toneGenerator;
+
+    bool streaming = false;
+    long long numSamplesRequested = -1; // -1 for continuous streaming
+    double streamStartTime = 0.0;
+    long long nextSampleIdx = 0;
+    bool startIsLate = false;
+    bool lastRecvWasOverflow = false;
+    std::string last_error;
+};
+
+struct uhd_tx_streamer
+{
+    std::shared_ptr<Device> device;
+    std::vector<size_t> channels;
+    size_t maxNumSamples = 363;
+    double sampleRate = 1e6;
+
+    bool inBurst = false;
+    double nextSampleTime = 0.0;
+
+    std::mutex asyncLock;
+    std::condition_variable asyncEventAdded;
+    std::deque<int> asyncEvents;
+    std::string last_error;
+
+    void addAsyncEvent (int eventCode)
+    {
+        {
+            std::lock_guard<std::mutex> scopedLock (asyncLock);
+
+            // like on the device, events are lost if nobody reads them
+            if (asyncEvents.size() < 1000)
+                asyncEvents.push_back (eventCode);
+        }
+
+        asyncEventAdded.notify_one();
+    }
+};
+
+struct uhd_subdev_spec
+{
+    std::string markup;
+    std::string last_error;
+};
+
+struct uhd_string_vector
+{
+    std::vector<std::string> strings;
+    std::string last_error;
+};
+
+typedef uhd_usrp*           uhd_usrp_handle;
+typedef uhd_rx_streamer*    uhd_rx_streamer_handle;
+typedef uhd_tx_streamer*    uhd_tx_streamer_handle;
+typedef uhd_rx_metadata*    uhd_rx_metadata_handle;
+typedef uhd_tx_metadata*    uhd_tx_metadata_handle;
+typedef uhd_async_metadata* uhd_async_metadata_handle;
+typedef uhd_subdev_spec*    uhd_subdev_spec_handle;
+typedef uhd_string_vector*  uhd_string_vector_handle;
+
+//==============================================================================
+/** Not part of UHD, lets unit tests find out if the library loaded is this mock */
+MOCK_UHD_EXPORT int ntlab_mock_uhd_is_loaded()
+{
+    return 1;
+}
+
+//==============================================================================
+// Construction and deletion of handles
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_find (const char*, uhd_string_vector_handle* stringsOut)
+{
+    Config config;
+
+    for (int d = 0; d < config.numDevices; ++d)
+        (*stringsOut)->strings.push_back ("type=usrp2,addr=" + getMockAddress (d) + ",name=,serial=" + getMockSerial (d));
+
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_make (uhd_usrp_handle* h, const char* args)
+{
+    *h = new uhd_usrp;
+    (*h)->usrp_index = 0;
+
+    Config config;
+    int numMboards = 0;
+
+    // args look like "addr0=192.168.10.2,addr1=192.168.10.3" or "addr=192.168.10.2"
+    std::istringstream stream (args != nullptr ? args : "");
+    std::string pair;
+    while (std::getline (stream, pair, ','))
+    {
+        auto separator = pair.find ('=');
+        if ((separator == std::string::npos) || (pair.compare (0, 4, "addr") != 0))
+            continue;
+
+        auto address = pair.substr (separator + 1);
+        bool found = false;
+        for (int d = 0; d < config.numDevices; ++d)
+            found |= (address == getMockAddress (d));
+
+        if (!found)
+        {
+            (*h)->last_error = "LookupError: KeyError: No devices found for ----->\nDevice Address:\n    addr: " + address;
+            return UHD_ERROR_KEY;
+        }
+
+        ++numMboards;
+    }
+
+    if (numMboards == 0)
+    {
+        (*h)->last_error = "LookupError: KeyError: No devices found";
+        return UHD_ERROR_KEY;
+    }
+
+    (*h)->device = std::make_shared<Device> (config, numMboards);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_free (uhd_usrp_handle* h)
+{
+    delete *h;
+    *h = nullptr;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_streamer_make (uhd_rx_streamer_handle* h)
+{
+    *h = new uhd_rx_streamer;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_streamer_free (uhd_rx_streamer_handle* h)
+{
+    delete *h;
+    *h = nullptr;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_tx_streamer_make (uhd_tx_streamer_handle* h)
+{
+    *h = new uhd_tx_streamer;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_tx_streamer_free (uhd_tx_streamer_handle* h)
+{
+    delete *h;
+    *h = nullptr;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_metadata_make (uhd_rx_metadata_handle* h)
+{
+    *h = new uhd_rx_metadata;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_metadata_free (uhd_rx_metadata_handle* h)
+{
+    delete *h;
+    *h = nullptr;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_tx_metadata_make (uhd_tx_metadata_handle* h, bool hasTimeSpec, time_t fullSecs, double fracSecs, bool startOfBurst, bool endOfBurst)
+{
+    *h = new uhd_tx_metadata { hasTimeSpec, static_cast<double> (fullSecs) + fracSecs, startOfBurst, endOfBurst, {} };
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_tx_metadata_free (uhd_tx_metadata_handle* h)
+{
+    delete *h;
+    *h = nullptr;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_tx_metadata_last_error (uhd_tx_metadata_handle h, char* errorOut, size_t bufferLength)
+{
+    copyToStringBuffer (h->last_error, errorOut, bufferLength);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_async_metadata_make (uhd_async_metadata_handle* h)
+{
+    *h = new uhd_async_metadata;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_async_metadata_free (uhd_async_metadata_handle* h)
+{
+    delete *h;
+    *h = nullptr;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_async_metadata_event_code (uhd_async_metadata_handle h, int* eventCodeOut)
+{
+    *eventCodeOut = h->eventCode;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_subdev_spec_make (uhd_subdev_spec_handle* h, const char* markup)
+{
+    *h = new uhd_subdev_spec;
+    (*h)->markup = markup != nullptr ? markup : "";
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_subdev_spec_free (uhd_subdev_spec_handle* h)
+{
+    delete *h;
+    *h = nullptr;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_string_vector_make (uhd_string_vector_handle* h)
+{
+    *h = new uhd_string_vector;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_string_vector_free (uhd_string_vector_handle* h)
+{
+    delete *h;
+    *h = nullptr;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_string_vector_size (uhd_string_vector_handle h, size_t* sizeOut)
+{
+    *sizeOut = h->strings.size();
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_string_vector_at (uhd_string_vector_handle h, size_t index, char* valueOut, size_t bufferLength)
+{
+    if (index >= h->strings.size())
+        return UHD_ERROR_INDEX;
+
+    copyToStringBuffer (h->strings[index], valueOut, bufferLength);
+    return UHD_ERROR_NONE;
+}
+
+//==============================================================================
+// Settings, each of them costs a simulated round trip to the device
+
+static uhd_error channelNotFound (uhd_usrp_handle h, size_t channel)
+{
+    h->last_error = "IndexError: multi_usrp: channel " + std::to_string (channel) + " out of range";
+    return UHD_ERROR_INDEX;
+}
+
+/** Like the UHD C API, each setter clears the error string of the handle before it talks to the device */
+static void beginSettingsCall (uhd_usrp_handle h)
+{
+    h->last_error.clear();
+    h->device->simulateCallLatency();
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_rx_num_channels (uhd_usrp_handle h, size_t* numChannelsOut)
+{
+    *numChannelsOut = h->device->getNumChannels (true);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_tx_num_channels (uhd_usrp_handle h, size_t* numChannelsOut)
+{
+    *numChannelsOut = h->device->getNumChannels (false);
+    return UHD_ERROR_NONE;
+}
+
+static uhd_error setSampleRate (uhd_usrp_handle h, bool rx, double rate, size_t channel)
+{
+    beginSettingsCall (h);
+
+    if (rate <= 0.0)
+    {
+        h->last_error = "ValueError: invalid sample rate";
+        return UHD_ERROR_VALUE;
+    }
+
+    // like on the device, the rate is coerced to an integer decimation or interpolation of the master clock
+    const auto actualRate = masterClockRate / std::max (1.0, std::round (masterClockRate / rate));
+
+    if (!h->device->accessChannels (rx, channel, [=] (ChannelSettings& s) { s.sampleRate = actualRate; }))
+        return channelNotFound (h, channel);
+
+    return UHD_ERROR_NONE;
+}
+
+static uhd_error getSampleRate (uhd_usrp_handle h, bool rx, size_t channel, double* rateOut)
+{
+    h->device->simulateCallLatency();
+
+    if (!h->device->accessChannels (rx, channel, [=] (ChannelSettings& s) { *rateOut = s.sampleRate; }))
+        return channelNotFound (h, channel);
+
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_rx_rate (uhd_usrp_handle h, double rate, size_t channel)     { return setSampleRate (h, true,  rate, channel); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_tx_rate (uhd_usrp_handle h, double rate, size_t channel)     { return setSampleRate (h, false, rate, channel); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_rx_rate (uhd_usrp_handle h, size_t channel, double* rateOut) { return getSampleRate (h, true,  channel, rateOut); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_tx_rate (uhd_usrp_handle h, size_t channel, double* rateOut) { return getSampleRate (h, false, channel, rateOut); }
+
+static uhd_error setGain (uhd_usrp_handle h, bool rx, double gain, size_t channel, const char* gainName)
+{
+    beginSettingsCall (h);
+
+    const std::string name = gainName != nullptr ? gainName : "";
+
+    if (!h->device->accessChannels (rx, channel, [&] (ChannelSettings& s) { s.gains[name.empty() ? "PGA0" : name] = gain; }))
+        return channelNotFound (h, channel);
+
+    return UHD_ERROR_NONE;
+}
+
+static uhd_error getGain (uhd_usrp_handle h, bool rx, size_t channel, const char* gainName, double* gainOut)
+{
+    h->device->simulateCallLatency();
+
+    const std::string name = gainName != nullptr ? gainName : "";
+    *gainOut = 0.0;
+
+    if (!h->device->accessChannels (rx, channel, [&] (ChannelSettings& s)
+        {
+            if (name.empty())
+            {
+                for (auto& g : s.gains)
+                    *gainOut += g.second;
+            }
+            else
+            {
+                *gainOut = s.gains[name];
+            }
+        }))
+        return channelNotFound (h, channel);
+
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_rx_gain (uhd_usrp_handle h, double gain, size_t channel, const char* gainName)        { return setGain (h, true,  gain, channel, gainName); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_tx_gain (uhd_usrp_handle h, double gain, size_t channel, const char* gainName)        { return setGain (h, false, gain, channel, gainName); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_rx_gain (uhd_usrp_handle h, size_t channel, const char* gainName, double* gainOut)    { return getGain (h, true,  channel, gainName, gainOut); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_tx_gain (uhd_usrp_handle h, size_t channel, const char* gainName, double* gainOut)    { return getGain (h, false, channel, gainName, gainOut); }
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_rx_gain_names (uhd_usrp_handle h, size_t channel, uhd_string_vector_handle* namesOut)
+{
+    if (channel >= h->device->getNumChannels (true))
+        return channelNotFound (h, channel);
+
+    (*namesOut)->strings = { "PGA0", "ADC-digital", "ADC-fine" };
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_tx_gain_names (uhd_usrp_handle h, size_t channel, uhd_string_vector_handle* namesOut)
+{
+    if (channel >= h->device->getNumChannels (false))
+        return channelNotFound (h, channel);
+
+    (*namesOut)->strings = { "PGA0" };
+    return UHD_ERROR_NONE;
+}
+
+static uhd_error setFrequency (uhd_usrp_handle h, bool rx, uhd_tune_request_t* request, size_t channel, uhd_tune_result_t* result)
+{
+    beginSettingsCall (h);
+
+    // the UBX covers 10 MHz to 6 GHz, the LO hits every frequency exactly
+    const auto frequency = std::min (6e9, std::max (10e6, request->target_freq));
+
+    if (!h->device->accessChannels (rx, channel, [=] (ChannelSettings& s) { s.frequency = frequency; }))
+        return channelNotFound (h, channel);
+
+    *result = { frequency, frequency, frequency, 0.0, 0.0 };
+    return UHD_ERROR_NONE;
+}
+
+static uhd_error getFrequency (uhd_usrp_handle h, bool rx, size_t channel, double* frequencyOut)
+{
+    h->device->simulateCallLatency();
+
+    if (!h->device->accessChannels (rx, channel, [=] (ChannelSettings& s) { *frequencyOut = s.frequency; }))
+        return channelNotFound (h, channel);
+
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_rx_freq (uhd_usrp_handle h, uhd_tune_request_t* request, size_t channel, uhd_tune_result_t* result) { return setFrequency (h, true,  request, channel, result); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_tx_freq (uhd_usrp_handle h, uhd_tune_request_t* request, size_t channel, uhd_tune_result_t* result) { return setFrequency (h, false, request, channel, result); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_rx_freq (uhd_usrp_handle h, size_t channel, double* frequencyOut) { return getFrequency (h, true,  channel, frequencyOut); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_tx_freq (uhd_usrp_handle h, size_t channel, double* frequencyOut) { return getFrequency (h, false, channel, frequencyOut); }
+
+static uhd_error setBandwidth (uhd_usrp_handle h, bool rx, double, size_t channel)
+{
+    beginSettingsCall (h);
+
+    // the UBX bandwidth is fixed
+    if (!h->device->accessChannels (rx, channel, [] (ChannelSettings& s) { s.bandwidth = 40e6; }))
+        return channelNotFound (h, channel);
+
+    return UHD_ERROR_NONE;
+}
+
+static uhd_error getBandwidth (uhd_usrp_handle h, bool rx, size_t channel, double* bandwidthOut)
+{
+    h->device->simulateCallLatency();
+
+    if (!h->device->accessChannels (rx, channel, [=] (ChannelSettings& s) { *bandwidthOut = s.bandwidth; }))
+        return channelNotFound (h, channel);
+
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_rx_bandwidth (uhd_usrp_handle h, double bandwidth, size_t channel)        { return setBandwidth (h, true,  bandwidth, channel); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_tx_bandwidth (uhd_usrp_handle h, double bandwidth, size_t channel)        { return setBandwidth (h, false, bandwidth, channel); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_rx_bandwidth (uhd_usrp_handle h, size_t channel, double* bandwidthOut)    { return getBandwidth (h, true,  channel, bandwidthOut); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_tx_bandwidth (uhd_usrp_handle h, size_t channel, double* bandwidthOut)    { return getBandwidth (h, false, channel, bandwidthOut); }
+
+static std::vector<std::string> getAntennas (bool rx)
+{
+    if (rx)
+        return { "TX/RX", "RX2", "CAL" };
+
+    return { "TX/RX", "CAL" };
+}
+
+static uhd_error setAntenna (uhd_usrp_handle h, bool rx, const char* antenna, size_t channel)
+{
+    beginSettingsCall (h);
+
+    const std::string name = antenna != nullptr ? antenna : "";
+    auto antennas = getAntennas (rx);
+
+    if (std::find (antennas.begin(), antennas.end(), name) == antennas.end())
+    {
+        h->last_error = "ValueError: Invalid antenna " + name;
+        return UHD_ERROR_VALUE;
+    }
+
+    if (!h->device->accessChannels (rx, channel, [&] (ChannelSettings& s) { s.antenna = name; }))
+        return channelNotFound (h, channel);
+
+    return UHD_ERROR_NONE;
+}
+
+static uhd_error getAntenna (uhd_usrp_handle h, bool rx, size_t channel, char* antennaOut, size_t bufferLength)
+{
+    h->device->simulateCallLatency();
+
+    std::string antenna;
+
+    if (!h->device->accessChannels (rx, channel, [&] (ChannelSettings& s) { antenna = s.antenna.empty() ? getAntennas (rx)[0] : s.antenna; }))
+        return channelNotFound (h, channel);
+
+    copyToStringBuffer (antenna, antennaOut, bufferLength);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_rx_antenna (uhd_usrp_handle h, const char* antenna, size_t channel) { return setAntenna (h, true,  antenna, channel); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_tx_antenna (uhd_usrp_handle h, const char* antenna, size_t channel) { return setAntenna (h, false, antenna, channel); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_rx_antenna (uhd_usrp_handle h, size_t channel, char* antennaOut, size_t bufferLength) { return getAntenna (h, true,  channel, antennaOut, bufferLength); }
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_tx_antenna (uhd_usrp_handle h, size_t channel, char* antennaOut, size_t bufferLength) { return getAntenna (h, false, channel, antennaOut, bufferLength); }
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_rx_antennas (uhd_usrp_handle h, size_t channel, uhd_string_vector_handle* antennasOut)
+{
+    if (channel >= h->device->getNumChannels (true))
+        return channelNotFound (h, channel);
+
+    (*antennasOut)->strings = getAntennas (true);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_tx_antennas (uhd_usrp_handle h, size_t channel, uhd_string_vector_handle* antennasOut)
+{
+    if (channel >= h->device->getNumChannels (false))
+        return channelNotFound (h, channel);
+
+    (*antennasOut)->strings = getAntennas (false);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_rx_subdev_spec (uhd_usrp_handle h, uhd_subdev_spec_handle spec, size_t mboard)
+{
+    h->device->simulateCallLatency();
+    h->device->setSubdevSpec (true, spec->markup, mboard);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_tx_subdev_spec (uhd_usrp_handle h, uhd_subdev_spec_handle spec, size_t mboard)
+{
+    h->device->simulateCallLatency();
+    h->device->setSubdevSpec (false, spec->markup, mboard);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_clock_source (uhd_usrp_handle h, const char*, size_t)
+{
+    h->device->simulateCallLatency();
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_time_source (uhd_usrp_handle h, const char*, size_t)
+{
+    h->device->simulateCallLatency();
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_time_unknown_pps (uhd_usrp_handle h, time_t fullSecs, double fracSecs)
+{
+    // the real device waits for the next PPS edge, which takes up to a second
+    h->device->simulateCallLatency();
+    h->device->setTimeNow (static_cast<double> (fullSecs) + fracSecs);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_time_now (uhd_usrp_handle h, time_t fullSecs, double fracSecs, size_t)
+{
+    h->device->simulateCallLatency();
+    h->device->setTimeNow (static_cast<double> (fullSecs) + fracSecs);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_time_now (uhd_usrp_handle h, size_t, time_t* fullSecsOut, double* fracSecsOut)
+{
+    h->device->simulateCallLatency();
+    splitTimeSpec (h->device->getTimeNow(), *fullSecsOut, *fracSecsOut);
+    return UHD_ERROR_NONE;
+}
+
+// The settings take effect immediately as the synthetic signal doesn't depend on them
+MOCK_UHD_EXPORT uhd_error uhd_usrp_set_command_time (uhd_usrp_handle h, time_t, double, size_t)
+{
+    h->device->simulateCallLatency();
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_clear_command_time (uhd_usrp_handle h, size_t)
+{
+    h->device->simulateCallLatency();
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_master_clock_rate (uhd_usrp_handle, size_t, double* rateOut)
+{
+    *rateOut = masterClockRate;
+    return UHD_ERROR_NONE;
+}
+
+//==============================================================================
+// Streaming
+
+static uhd_error setUpStreamer (uhd_usrp_handle h, bool rx, uhd_stream_args_t* args, std::vector<size_t>& channels, double& sampleRate)
+{
+    const auto numChannels = h->device->getNumChannels (rx);
+    channels.clear();
+
+    for (int i = 0; i < args->n_channels; ++i)
+    {
+        auto channel = args->channel_list[i];
+        if (channel >= numChannels)
+            return channelNotFound (h, channel);
+
+        channels.push_back (channel);
+    }
+
+    if (!channels.empty())
+        h->device->accessChannels (rx, channels.front(), [&] (ChannelSettings& s) { sampleRate = s.sampleRate; });
+
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_rx_stream (uhd_usrp_handle h, uhd_stream_args_t* args, uhd_rx_streamer_handle streamer)
+{
+    h->device->simulateCallLatency();
+
+    auto error = setUpStreamer (h, true, args, streamer->channels, streamer->sampleRate);
+    if (error != UHD_ERROR_NONE)
+        return error;
+
+    streamer->device = h->device;
+    streamer->cpuFormat = getSampleFormat (args->cpu_format);
+    streamer->maxNumSamples = getMaxNumSamplesPerPacket (args->otw_format);
+    streamer->toneGenerator.prepare (streamer->channels.size());
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_usrp_get_tx_stream (uhd_usrp_handle h, uhd_stream_args_t* args, uhd_tx_streamer_handle streamer)
+{
+    h->device->simulateCallLatency();
+
+    auto error = setUpStreamer (h, false, args, streamer->channels, streamer->sampleRate);
+    if (error != UHD_ERROR_NONE)
+        return error;
+
+    streamer->device = h->device;
+    streamer->maxNumSamples = getMaxNumSamplesPerPacket (args->otw_format);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_streamer_max_num_samps (uhd_rx_streamer_handle h, size_t* maxNumSamplesOut)
+{
+    *maxNumSamplesOut = h->maxNumSamples;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_tx_streamer_max_num_samps (uhd_tx_streamer_handle h, size_t* maxNumSamplesOut)
+{
+    *maxNumSamplesOut = h->maxNumSamples;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_streamer_issue_stream_cmd (uhd_rx_streamer_handle h, const uhd_stream_cmd_t* cmd)
+{
+    if (h->device == nullptr)
+        return UHD_ERROR_INVALID_DEVICE;
+
+    if (cmd->stream_mode == STREAM_MODE_STOP_CONTINUOUS)
+    {
+        h->streaming = false;
+        return UHD_ERROR_NONE;
+    }
+
+    const auto now = h->device->getTimeNow();
+    const auto requestedTime = static_cast<double> (cmd->time_spec_full_secs) + cmd->time_spec_frac_secs;
+
+    h->streaming = true;
+    h->streamStartTime = cmd->stream_now ? now : std::max (now, requestedTime);
+    h->startIsLate = !cmd->stream_now && (requestedTime < now);
+    h->numSamplesRequested = (cmd->stream_mode == STREAM_MODE_START_CONTINUOUS) ? -1 : static_cast<long long> (cmd->num_samps);
+    h->nextSampleIdx = 0;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_streamer_recv (uhd_rx_streamer_handle h, void** buffs, size_t numSamplesPerBuff, uhd_rx_metadata_handle* md, double timeout, bool onePacket, size_t* itemsReceived)
+{
+    auto& metadata = **md;
+    metadata = uhd_rx_metadata();
+    *itemsReceived = 0;
+
+    if (h->device == nullptr)
+        return UHD_ERROR_INVALID_DEVICE;
+
+    auto& device = *h->device;
+    auto& config = device.config;
+
+    if (!h->streaming)
+    {
+        device.waitUntil (device.getTimeNow() + timeout, timeout);
+        metadata.errorCode = RX_ERROR_TIMEOUT;
+        return UHD_ERROR_NONE;
+    }
+
+    if (h->startIsLate)
+    {
+        h->startIsLate = false;
+        h->streaming = false;
+        metadata.errorCode = RX_ERROR_LATE;
+        return UHD_ERROR_NONE;
+    }
+
+    const auto callIdx = ++device.numRecvCalls;
+    const auto timeOfNextSample = h->streamStartTime + static_cast<double> (h->nextSampleIdx) / h->sampleRate;
+
+    // samples that were not fetched in time are lost, which is reported once through a separate metadata like UHD does
+    const auto numSamplesBuffered = static_cast<long long> ((device.getTimeNow() - timeOfNextSample) * h->sampleRate);
+    const bool lagsBehind = config.realtime && (numSamplesBuffered > config.rxBufferSamples);
+    const bool injectOverflow = (config.overflowInterval > 0) && ((callIdx % config.overflowInterval) == 0);
+
+    if ((lagsBehind || injectOverflow) && !h->lastRecvWasOverflow)
+    {
+        const auto numSamplesDropped = lagsBehind ? numSamplesBuffered : config.overflowSamples;
+        h->nextSampleIdx += numSamplesDropped;
+        h->toneGenerator.advance (static_cast<size_t> (numSamplesDropped));
+        h->lastRecvWasOverflow = true;
+
+        metadata.errorCode = RX_ERROR_OVERFLOW;
+        metadata.hasTimeSpec = true;
+        metadata.time = timeOfNextSample;
+        return UHD_ERROR_NONE;
+    }
+
+    h->lastRecvWasOverflow = false;
+
+    auto numSamples = onePacket ? std::min (numSamplesPerBuff, h->maxNumSamples) : numSamplesPerBuff;
+    if (h->numSamplesRequested >= 0)
+        numSamples = std::min (numSamples, static_cast<size_t> (std::max (0LL, h->numSamplesRequested - h->nextSampleIdx)));
+
+    const auto timeOfLastSample = timeOfNextSample + static_cast<double> (numSamples) / h->sampleRate;
+
+    if (!device.waitUntil (timeOfLastSample + config.rxLatency, timeout))
+    {
+        metadata.errorCode = RX_ERROR_TIMEOUT;
+        return UHD_ERROR_NONE;
+    }
+
+    h->toneGenerator.generate (buffs, numSamples, 0, h->cpuFormat);
+
+    metadata.hasTimeSpec = true;
+    metadata.time = timeOfNextSample;
+
+    h->nextSampleIdx += static_cast<long long> (numSamples);
+    *itemsReceived = numSamples;
+
+    if ((h->numSamplesRequested >= 0) && (h->nextSampleIdx >= h->numSamplesRequested))
+        h->streaming = false;
+
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_tx_streamer_send (uhd_tx_streamer_handle h, const void**, size_t numSamplesPerBuff, uhd_tx_metadata_handle* md, double timeout, size_t* itemsSent)
+{
+    *itemsSent = 0;
+
+    if (h->device == nullptr)
+        return UHD_ERROR_INVALID_DEVICE;
+
+    auto& device = *h->device;
+    auto& config = device.config;
+    auto& metadata = **md;
+
+    const auto callIdx = ++device.numSendCalls;
+    const auto now = device.getTimeNow();
+
+    if (metadata.startOfBurst || !h->inBurst)
+    {
+        h->inBurst = true;
+
+        if (metadata.hasTimeSpec && (metadata.time < now))
+        {
+            // the device drops a late burst and reports it once
+            h->inBurst = false;
+            h->addAsyncEvent (ASYNC_TIME_ERROR);
+            *itemsSent = numSamplesPerBuff;
+            return UHD_ERROR_NONE;
+        }
+
+        h->nextSampleTime = metadata.hasTimeSpec ? metadata.time : now;
+    }
+    else if (config.realtime && (h->nextSampleTime < now))
+    {
+        // the host didn't deliver the samples in time
+        h->addAsyncEvent (ASYNC_UNDERFLOW);
+        h->nextSampleTime = now;
+    }
+
+    if ((config.underflowInterval > 0) && ((callIdx % config.underflowInterval) == 0))
+        h->addAsyncEvent (ASYNC_UNDERFLOW);
+
+    // the device buffers about one packet ahead, so sending blocks until the samples before have been transmitted
+    const auto packetDuration = static_cast<double> (h->maxNumSamples) / h->sampleRate;
+    if (!device.waitUntil (h->nextSampleTime - packetDuration, timeout))
+        return UHD_ERROR_NONE;
+
+    h->nextSampleTime += static_cast<double> (numSamplesPerBuff) / h->sampleRate;
+    *itemsSent = numSamplesPerBuff;
+
+    if (metadata.endOfBurst)
+    {
+        h->inBurst = false;
+        h->addAsyncEvent (ASYNC_BURST_ACK);
+    }
+
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_tx_streamer_recv_async_msg (uhd_tx_streamer_handle h, uhd_async_metadata_handle* md, double timeout, bool* valid)
+{
+    std::unique_lock<std::mutex> scopedLock (h->asyncLock);
+
+    h->asyncEventAdded.wait_for (scopedLock, std::chrono::duration<double> (timeout), [h]() { return !h->asyncEvents.empty(); });
+
+    *valid = !h->asyncEvents.empty();
+
+    if (*valid)
+    {
+        (*md)->eventCode = h->asyncEvents.front();
+        h->asyncEvents.pop_front();
+    }
+
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_metadata_error_code (uhd_rx_metadata_handle h, int* errorCodeOut)
+{
+    *errorCodeOut = h->errorCode;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_metadata_has_time_spec (uhd_rx_metadata_handle h, bool* hasTimeSpecOut)
+{
+    *hasTimeSpecOut = h->hasTimeSpec;
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_metadata_time_spec (uhd_rx_metadata_handle h, time_t* fullSecsOut, double* fracSecsOut)
+{
+    splitTimeSpec (h->time, *fullSecsOut, *fracSecsOut);
+    return UHD_ERROR_NONE;
+}
+
+MOCK_UHD_EXPORT uhd_error uhd_rx_metadata_out_of_sequence (uhd_rx_metadata_handle h, bool* outOfSequenceOut)
+{
+    *outOfSequenceOut = h->outOfSequence;
+    return UHD_ERROR_NONE;
+}
@@ -0,0 +1,824 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * mcvtool - a command line tool to inspect and process MCV files. All commands stream through the files in blocks,
+ * so the memory footprint does not depend on the file size. Reading, processing and writing run on separate threads
+ * and the processing of each block is spread over all cores.
+ */
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <iostream>
+
+/** The number of rows read from the input per block */
+static const int numRowsPerBlock = 1 << 16;
+
+static const char* usage = R"(usage: mcvtool <command> [options]
+
+Commands:
+  info <file> [--rate <Hz>]
+      Prints the format, size and chunk index of a file.
+
+  convert <in> <out> [output options]
+      Converts a file to another precision, value type or a quantized raw format.
+
+  slice <in> <out> [--from <sample>] [--to <sample>] [--start-time <s>] [--end-time <s>]
+                   [--channels <c0,c1,...>] [output options]
+      Extracts a range of samples and/or a subset of channels. The range end is exclusive. Start and end times refer
+      to the timestamps of the chunk index and need --rate.
+
+  concat <out> <in1> <in2> ... [output options]
+      Appends all input files to a single output file. All inputs need the same number of channels.
+
+  decimate <in> <out> --factor <n> [--taps <n>] [output options]
+      Low-pass filters all channels with a windowed sinc FIR filter and keeps every n-th sample. The output is delayed
+      by half the filter length.
+
+Output options:
+  --precision float|double   Precision of the output, defaults to the precision of the first input
+  --real | --complex         Value type of the output, defaults to the type of the first input. Converting complex
+                             to real values keeps the real part
+  --format mcv|sc16|sc8      sc16 and sc8 write interleaved 16 or 8 bit integers without a header
+  --scale <factor>           Factor applied before quantizing, defaults to the integer range
+  --compress [<rows>]        Writes a compressed MCV file with blocks of the given number of rows
+  --rate <Hz>                Sample rate, used to compute timestamps of partial chunks
+)";
+
+//==============================================================================
+/** A minimal parser for the command line. Options are passed as --name or --name value */
+class Arguments
+{
+public:
+    Arguments (int argc, char* argv[])
+    {
+        for (int i = 1; i < argc; ++i)
+            args.add (juce::CharPointer_UTF8 (argv[i]));
+    }
+
+    juce::String getCommand() const { return args[0]; }
+
+    /** Returns all arguments after the command that are neither options nor option values */
+    juce::StringArray getPositionalArguments() const
+    {
+        juce::StringArray positional;
+
+        for (int i = 1; i < args.size(); ++i)
+        {
+            if (args[i].startsWith ("--"))
+            {
+                if (takesValue (args[i]))
+                    ++i;
+
+                continue;
+            }
+
+            positional.add (args[i]);
+        }
+
+        return positional;
+    }
+
+    bool hasOption (const juce::String& name) const { return args.contains (name); }
+
+    juce::String getValue (const juce::String& name, const juce::String& defaultValue = {}) const
+    {
+        auto idx = args.indexOf (name);
+
+        if ((idx < 0) || (idx + 1 >= args.size()) || args[idx + 1].startsWith ("--"))
+            return defaultValue;
+
+        return args[idx + 1];
+    }
+
+private:
+    juce::StringArray args;
+
+    bool takesValue (const juce::String& option) const
+    {
+        static const juce::StringArray optionsWithValue {"--from", "--to", "--start-time", "--end-time", "--channels",
+                                                         "--precision", "--format", "--scale", "--rate", "--factor",
+                                                         "--taps"};
+
+        if (optionsWithValue.contains (option))
+            return true;
+
+        // The block size after --compress is optional
+        auto idx = args.indexOf (option);
+        return (option == "--compress") && (idx + 1 < args.size()) && args[idx + 1].containsOnly ("0123456789");
+    }
+};
+
+//==============================================================================
+/** Runs jobs on all cores and waits for them to finish */
+class ParallelFor
+{
+public:
+    ParallelFor() : threadPool (juce::SystemStats::getNumCpus()) {}
+
+    int getNumThreads() const { return threadPool.getNumThreads(); }
+
+    void run (int numJobs, const std::function<void (int)>& job)
+    {
+        if (numJobs <= 1)
+        {
+            if (numJobs == 1)
+                job (0);
+
+            return;
+        }
+
+        std::atomic<int> numJobsRemaining (numJobs);
+        juce::WaitableEvent allJobsFinished;
+
+        for (int i = 0; i < numJobs; ++i)
+        {
+            threadPool.addJob ([i, &job, &numJobsRemaining, &allJobsFinished]()
+            {
+                job (i);
+
+                if (--numJobsRemaining == 0)
+                    allJobsFinished.signal();
+            });
+        }
+
+        allJobsFinished.wait();
+    }
+
+private:
+    juce::ThreadPool threadPool;
+};
+
+//==============================================================================
+struct OutputFormat
+{
+    enum Type
+    {
+        mcv,
+        sc16,
+        sc8
+    };
+
+    Type type = mcv;
+    bool isComplex = true;
+    bool doublePrecision = false;
+    int compressionBlockSize = 0;
+    double scale = 0.0;
+};
+
+/** Describes a chunk that starts with the block passed to the output */
+struct ChunkStart
+{
+    bool startsNewChunk = false;
+    double timestamp = 0.0;
+    double centerFrequency = 0.0;
+};
+
+/** The destination of all processed blocks */
+template <typename SampleType>
+class OutputSink
+{
+public:
+    virtual ~OutputSink() {}
+
+    /** Marks the next sample written as the beginning of a new chunk */
+    virtual void startNewChunk (double timestamp, double centerFrequency) = 0;
+
+    virtual juce::Result write (const ntlab::SampleBufferComplex<SampleType>& block) = 0;
+
+    /** Waits until everything has been written to disk */
+    virtual juce::Result finish() = 0;
+};
+
+/** Writes to an MCV file. Samples are handed to the writer thread of the MCVWriter, so disk access runs in parallel */
+template <typename SampleType>
+class MCVSink : public OutputSink<SampleType>
+{
+public:
+    MCVSink (const juce::File& file, int numChannels, const OutputFormat& format, ParallelFor& parallelFor)
+      : writer (numChannels, std::is_same<SampleType, double>::value, format.isComplex, file, 4 * numRowsPerBlock),
+        writeComplexValues (format.isComplex),
+        realBlock (format.isComplex ? 0 : numChannels, numRowsPerBlock),
+        parallel (parallelFor)
+    {
+        writer.setOverflowPolicy (ntlab::MCVWriter::blockUntilDeadline, 60000);
+
+        if (format.compressionBlockSize > 0)
+            writer.enableBlockCompression (format.compressionBlockSize);
+    }
+
+    bool isValid() { return writer.isValid(); }
+
+    void startNewChunk (double timestamp, double centerFrequency) override
+    {
+        writer.startNewChunk (timestamp, centerFrequency);
+    }
+
+    juce::Result write (const ntlab::SampleBufferComplex<SampleType>& block) override
+    {
+        int numSamplesDropped;
+
+        if (writeComplexValues)
+        {
+            numSamplesDropped = writer.appendSampleBuffer (block);
+        }
+        else
+        {
+            const auto numSamples = block.getNumSamples();
+            realBlock.setNumSamples (numSamples);
+
+            parallel.run (block.getNumChannels(), [&] (int c)
+            {
+                auto* source = block.getReadPointer (c);
+                auto* destination = realBlock.getWritePointer (c);
+
+                for (int i = 0; i < numSamples; ++i)
+                    destination[i] = source[i].real();
+            });
+
+            numSamplesDropped = writer.appendSampleBuffer (realBlock);
+        }
+
+        if (numSamplesDropped > 0)
+            return juce::Result::fail ("Writing to disk stalled, " + juce::String (numSamplesDropped) + " samples have been lost");
+
+        return juce::Result::ok();
+    }
+
+    juce::Result finish() override
+    {
+        writer.waitForEmptyFIFO();
+        return juce::Result::ok();
+    }
+
+private:
+    ntlab::MCVWriter writer;
+    const bool writeComplexValues;
+    ntlab::SampleBufferReal<SampleType> realBlock;
+    ParallelFor& parallel;
+};
+
+/** Writes interleaved integers without any header, as used by many SDR tools */
+template <typename SampleType, typename IntType>
+class QuantizedSink : public OutputSink<SampleType>
+{
+public:
+    QuantizedSink (const juce::File& file, int numChannels, const OutputFormat& format, ParallelFor& parallelFor)
+      : stream (file),
+        writeComplexValues (format.isComplex),
+        numValuesPerRow (numChannels * (format.isComplex ? 2 : 1)),
+        scale (format.scale > 0.0 ? format.scale : static_cast<double> (std::numeric_limits<IntType>::max())),
+        interleaved (static_cast<size_t> (numValuesPerRow) * numRowsPerBlock),
+        parallel (parallelFor)
+    {
+        if (stream.openedOk())
+        {
+            stream.setPosition (0);
+            stream.truncate();
+        }
+    }
+
+    bool isValid() { return stream.openedOk(); }
+
+    void startNewChunk (double, double) override {}
+
+    juce::Result write (const ntlab::SampleBufferComplex<SampleType>& block) override
+    {
+        const auto numSamples = block.getNumSamples();
+        const auto numChannels = block.getNumChannels();
+        const auto numJobs = std::min (parallel.getNumThreads(), std::max (1, numSamples / 4096));
+
+        parallel.run (numJobs, [&] (int job)
+        {
+            const auto firstRow = static_cast<int> (static_cast<int64_t> (numSamples) * job / numJobs);
+            const auto endRow   = static_cast<int> (static_cast<int64_t> (numSamples) * (job + 1) / numJobs);
+
+            auto* destination = interleaved.data() + static_cast<size_t> (firstRow) * numValuesPerRow;
+
+            for (int row = firstRow; row < endRow; ++row)
+            {
+                for (int c = 0; c < numChannels; ++c)
+                {
+                    auto value = block.getReadPointer (c)[row];
+
+                    *destination++ = quantize (value.real());
+
+                    if (writeComplexValues)
+                        *destination++ = quantize (value.imag());
+                }
+            }
+        });
+
+        if (!stream.write (interleaved.data(), sizeof (IntType) * static_cast<size_t> (numValuesPerRow * numSamples)))
+            return juce::Result::fail ("Writing to " + stream.getFile().getFullPathName() + " failed");
+
+        return juce::Result::ok();
+    }
+
+    juce::Result finish() override
+    {
+        stream.flush();
+        return stream.getStatus();
+    }
+
+private:
+    juce::FileOutputStream stream;
+    const bool writeComplexValues;
+    const int numValuesPerRow;
+    const double scale;
+    std::vector<IntType> interleaved;
+    ParallelFor& parallel;
+
+    IntType quantize (SampleType value) const
+    {
+        constexpr double minValue = std::numeric_limits<IntType>::min();
+        constexpr double maxValue = std::numeric_limits<IntType>::max();
+
+        return static_cast<IntType> (juce::jlimit (minValue, maxValue, std::round (value * scale)));
+    }
+};
+
+template <typename SampleType>
+std::unique_ptr<OutputSink<SampleType>> createOutputSink (const juce::File& file, int numChannels, const OutputFormat& format, ParallelFor& parallel)
+{
+    if (format.type == OutputFormat::sc16)
+    {
+        auto sink = std::make_unique<QuantizedSink<SampleType, int16_t>> (file, numChannels, format, parallel);
+        return sink->isValid() ? std::move (sink) : nullptr;
+    }
+
+    if (format.type == OutputFormat::sc8)
+    {
+        auto sink = std::make_unique<QuantizedSink<SampleType, int8_t>> (file, numChannels, format, parallel);
+        return sink->isValid() ? std::move (sink) : nullptr;
+    }
+
+    auto sink = std::make_unique<MCVSink<SampleType>> (file, numChannels, format, parallel);
+    return sink->isValid() ? std::move (sink) : nullptr;
+}
+
+//==============================================================================
+/** A windowed sinc low-pass filter followed by a downsampler, each channel is processed on its own core */
+template <typename SampleType>
+class Decimator
+{
+public:
+    Decimator (int numChannels, int decimationFactor, int numFilterTaps)
+      : factor (decimationFactor),
+        numTaps (numFilterTaps),
+        coefficients (static_cast<size_t> (numFilterTaps)),
+        history (static_cast<size_t> (numChannels))
+    {
+        // Blackman windowed sinc with the cutoff at the new Nyquist frequency
+        const double cutoff = 0.5 / factor;
+        const double center = (numTaps - 1) / 2.0;
+        double sum = 0.0;
+
+        for (int i = 0; i < numTaps; ++i)
+        {
+            auto x = i - center;
+            auto sinc = (x == 0.0) ? 2.0 * cutoff : std::sin (2.0 * juce::MathConstants<double>::pi * cutoff * x) / (juce::MathConstants<double>::pi * x);
+            auto window = (numTaps == 1) ? 1.0 : 0.42 - 0.5  * std::cos (2.0 * juce::MathConstants<double>::pi * i / (numTaps - 1))
+                                                      + 0.08 * std::cos (4.0 * juce::MathConstants<double>::pi * i / (numTaps - 1));
+            coefficients[static_cast<size_t> (i)] = static_cast<SampleType> (sinc * window);
+            sum += sinc * window;
+        }
+
+        // Unity gain at DC
+        for (auto& c : coefficients)
+            c = static_cast<SampleType> (c / sum);
+
+        // Each channel keeps the last numTaps - 1 input samples in front of the current block
+        for (auto& h : history)
+            h.resize (static_cast<size_t> (numTaps - 1 + numRowsPerBlock));
+    }
+
+    /** Returns the maximum number of output samples produced from one block */
+    static int getMaxNumOutputSamples (int decimationFactor) { return numRowsPerBlock / decimationFactor + 1; }
+
+    void process (const ntlab::SampleBufferComplex<SampleType>& input, ntlab::SampleBufferComplex<SampleType>& output, ParallelFor& parallel)
+    {
+        const auto numInputSamples = input.getNumSamples();
+        const auto numOutputSamples = (phase < numInputSamples) ? (numInputSamples - phase + factor - 1) / factor : 0;
+
+        parallel.run (input.getNumChannels(), [&] (int c)
+        {
+            auto& samples = history[static_cast<size_t> (c)];
+            std::copy (input.getReadPointer (c), input.getReadPointer (c) + numInputSamples, samples.begin() + (numTaps - 1));
+
+            auto* destination = output.getWritePointer (c);
+
+            for (int n = 0; n < numOutputSamples; ++n)
+            {
+                // The newest sample of the filter window is the input sample phase + n * factor
+                auto* newest = samples.data() + (numTaps - 1) + phase + n * factor;
+                std::complex<SampleType> sum (0);
+
+                for (int k = 0; k < numTaps; ++k)
+                    sum += coefficients[static_cast<size_t> (k)] * newest[-k];
+
+                destination[n] = sum;
+            }
+
+            std::copy (samples.begin() + numInputSamples, samples.begin() + (numInputSamples + numTaps - 1), samples.begin());
+        });
+
+        output.setNumSamples (numOutputSamples);
+        phase += numOutputSamples * factor - numInputSamples;
+    }
+
+private:
+    const int factor;
+    const int numTaps;
+    std::vector<SampleType> coefficients;
+    std::vector<std::vector<std::complex<SampleType>>> history;
+
+    // The index of the next input sample that produces an output sample, relative to the next block
+    int phase = 0;
+};
+
+//==============================================================================
+/** Describes what has to be done with the input files */
+struct Job
+{
+    juce::Array<juce::File> inputFiles;
+
+    /** The readers of the input files, each file is opened once by prepareJob */
+    juce::OwnedArray<ntlab::MCVReader> readers;
+
+    juce::File outputFile;
+    OutputFormat format;
+
+    /** The channels to keep. Empty means all channels */
+    juce::Array<int> channels;
+
+    /** The range of rows to read. Only applies if there is a single input file, -1 means until the end */
+    int64_t firstRow = 0;
+    int64_t endRow = -1;
+
+    int decimationFactor = 1;
+    int numFilterTaps = 0;
+
+    double sampleRate = 0.0;
+};
+
+/**
+ * Reads the rows from firstRow to endRow block by block and passes them to the processing function. Blocks end at
+ * chunk boundaries, so each chunk starts with a new block.
+ */
+template <typename SampleType, typename ProcessingFunction>
+juce::Result readBlocks (ntlab::MCVReader& reader, int64_t firstRow, int64_t endRow, double sampleRate, ProcessingFunction&& process)
+{
+    ntlab::SampleBufferComplex<SampleType> block (static_cast<int> (reader.getNumColsOrChannels()), numRowsPerBlock);
+
+    if (firstRow >= endRow)
+        return juce::Result::ok();
+
+    reader.seekToSample (firstRow);
+    reader.enableReadAhead (4, numRowsPerBlock);
+
+    for (auto row = firstRow; row < endRow;)
+    {
+        auto numRows = std::min<int64_t> (numRowsPerBlock, endRow - row);
+        ChunkStart chunkStart;
+
+        auto chunkIdx = reader.getCurrentChunk();
+        if (chunkIdx >= 0)
+        {
+            auto firstSampleOfChunk = reader.getChunkFirstSample (chunkIdx);
+
+            // A chunk that started before the first row can only be continued if the sample rate is known
+            if (row == firstSampleOfChunk)
+            {
+                chunkStart = {true, reader.getChunkTimestamp (chunkIdx), reader.getChunkCenterFrequency (chunkIdx)};
+            }
+            else if ((row == firstRow) && (sampleRate > 0.0))
+            {
+                auto timestamp = reader.getChunkTimestamp (chunkIdx) + (row - firstSampleOfChunk) / sampleRate;
+                chunkStart = {true, timestamp, reader.getChunkCenterFrequency (chunkIdx)};
+            }
+        }
+
+        if (chunkIdx + 1 < reader.getNumChunks())
+            numRows = std::min (numRows, reader.getChunkFirstSample (chunkIdx + 1) - row);
+
+        block.setNumSamples (static_cast<int> (numRows));
+        reader.fillNextSamplesIntoBuffer (block);
+
+        auto result = process (block, chunkStart);
+        if (result.failed())
+            return result;
+
+        row += numRows;
+    }
+
+    return juce::Result::ok();
+}
+
+template <typename SampleType>
+juce::Result runJob (const Job& job)
+{
+    ParallelFor parallel;
+
+    auto& readers = job.readers;
+    const auto numInputChannels = static_cast<int> (readers[0]->getNumColsOrChannels());
+
+    auto channels = job.channels;
+    if (channels.isEmpty())
+        for (int c = 0; c < numInputChannels; ++c)
+            channels.add (c);
+
+    for (auto c : channels)
+        if (!juce::isPositiveAndBelow (c, numInputChannels))
+            return juce::Result::fail ("Channel " + juce::String (c) + " does not exist");
+
+    auto sink = createOutputSink<SampleType> (job.outputFile, channels.size(), job.format, parallel);
+    if (sink == nullptr)
+        return juce::Result::fail ("Can't write " + job.outputFile.getFullPathName());
+
+    std::unique_ptr<Decimator<SampleType>> decimator;
+    ntlab::SampleBufferComplex<SampleType> decimatedBlock (job.decimationFactor > 1 ? channels.size() : 0, Decimator<SampleType>::getMaxNumOutputSamples (job.decimationFactor));
+
+    if (job.decimationFactor > 1)
+        decimator.reset (new Decimator<SampleType> (channels.size(), job.decimationFactor, job.numFilterTaps));
+
+    std::vector<std::complex<SampleType>*> selectedChannels (static_cast<size_t> (channels.size()));
+
+    for (auto* reader : readers)
+    {
+        auto firstRow = readers.size() == 1 ? job.firstRow : 0;
+        auto endRow   = (readers.size() == 1) && (job.endRow >= 0) ? job.endRow : reader->getNumRowsOrSamples();
+
+        auto result = readBlocks<SampleType> (*reader, firstRow, endRow, job.sampleRate, [&] (ntlab::SampleBufferComplex<SampleType>& block, const ChunkStart& chunkStart)
+        {
+            // Selecting channels just refers to the channels needed, nothing is copied
+            for (int i = 0; i < channels.size(); ++i)
+                selectedChannels[static_cast<size_t> (i)] = block.getWritePointer (channels[i]);
+
+            ntlab::SampleBufferComplex<SampleType> selection (channels.size(), block.getNumSamples(), selectedChannels.data());
+
+            if (chunkStart.startsNewChunk)
+                sink->startNewChunk (chunkStart.timestamp, chunkStart.centerFrequency);
+
+            if (decimator == nullptr)
+                return sink->write (selection);
+
+            decimator->process (selection, decimatedBlock, parallel);
+            return sink->write (decimatedBlock);
+        });
+
+        if (result.failed())
+            return result;
+    }
+
+    return sink->finish();
+}
+
+//==============================================================================
+static juce::File getFile (const juce::String& path)
+{
+    return juce::File::getCurrentWorkingDirectory().getChildFile (path);
+}
+
+/** Reads the output options. The defaults are taken from the first input file */
+static juce::Result parseOutputFormat (const Arguments& args, ntlab::MCVReader& firstInput, OutputFormat& format)
+{
+    format.isComplex = firstInput.isComplex();
+    format.doublePrecision = firstInput.hasDoublePrecision();
+
+    if (args.hasOption ("--real"))
+        format.isComplex = false;
+
+    if (args.hasOption ("--complex"))
+        format.isComplex = true;
+
+    auto precision = args.getValue ("--precision");
+    if (precision.isNotEmpty())
+    {
+        if ((precision != "float") && (precision != "double"))
+            return juce::Result::fail ("Unknown precision " + precision);
+
+        format.doublePrecision = precision == "double";
+    }
+
+    auto type = args.getValue ("--format", "mcv");
+    if (type == "sc16")
+        format.type = OutputFormat::sc16;
+    else if (type == "sc8")
+        format.type = OutputFormat::sc8;
+    else if (type != "mcv")
+        return juce::Result::fail ("Unknown output format " + type);
+
+    format.scale = args.getValue ("--scale", "0").getDoubleValue();
+
+    if (args.hasOption ("--compress"))
+    {
+        auto blockSize = args.getValue ("--compress");
+        format.compressionBlockSize = blockSize.containsOnly ("0123456789") && blockSize.isNotEmpty() ? blockSize.getIntValue() : numRowsPerBlock;
+    }
+
+    return juce::Result::ok();
+}
+
+/** Opens the input files of the job and reads the output options */
+static juce::Result prepareJob (const Arguments& args, Job& job)
+{
+    for (auto& inputFile : job.inputFiles)
+    {
+        auto* reader = job.readers.add (new ntlab::MCVReader (inputFile));
+        if (!reader->isValid())
+            return juce::Result::fail ("Can't read " + inputFile.getFullPathName());
+
+        if (reader->getNumColsOrChannels() != job.readers[0]->getNumColsOrChannels())
+            return juce::Result::fail ("All input files need the same number of channels");
+    }
+
+    return parseOutputFormat (args, *job.readers[0], job.format);
+}
+
+static juce::Result runJob (const Job& job)
+{
+    // Quantized formats don't gain anything from double precision processing
+    if (job.format.doublePrecision && (job.format.type == OutputFormat::mcv))
+        return runJob<double> (job);
+
+    return runJob<float> (job);
+}
+
+static juce::Result info (const Arguments& args)
+{
+    auto positional = args.getPositionalArguments();
+    if (positional.size() != 1)
+        return juce::Result::fail ("info expects exactly one file");
+
+    auto file = getFile (positional[0]);
+    ntlab::MCVReader reader (file);
+    if (!reader.isValid())
+        return juce::Result::fail ("Can't read " + file.getFullPathName());
+
+    auto sampleRate = args.getValue ("--rate", "0").getDoubleValue();
+
+    std::cout << "File:        " << file.getFullPathName() << std::endl;
+    std::cout << "Format:      " << (reader.isComplex() ? "complex " : "real ") << (reader.hasDoublePrecision() ? "double" : "float")
+                                 << (reader.isCompressed() ? ", compressed" : "") << std::endl;
+    std::cout << "Channels:    " << reader.getNumColsOrChannels() << std::endl;
+    std::cout << "Samples:     " << reader.getNumRowsOrSamples() << std::endl;
+    std::cout << "Size:        " << juce::File::descriptionOfSizeInBytes (file.getSize()) << std::endl;
+
+    if (sampleRate > 0.0)
+        std::cout << "Duration:    " << reader.getNumRowsOrSamples() / sampleRate << " s" << std::endl;
+
+    std::cout << "Chunks:      " << reader.getNumChunks() << std::endl;
+
+    for (int i = 0; i < reader.getNumChunks(); ++i)
+    {
+        std::cout << "  sample " << reader.getChunkFirstSample (i)
+                  << ", time " << juce::String (reader.getChunkTimestamp (i), 6)
+                  << " s, center frequency " << reader.getChunkCenterFrequency (i) << " Hz" << std::endl;
+    }
+
+    return juce::Result::ok();
+}
+
+static juce::Result convert (const Arguments& args)
+{
+    auto positional = args.getPositionalArguments();
+    if (positional.size() != 2)
+        return juce::Result::fail ("convert expects an input and an output file");
+
+    Job job;
+    job.inputFiles.add (getFile (positional[0]));
+    job.outputFile = getFile (positional[1]);
+    job.sampleRate = args.getValue ("--rate", "0").getDoubleValue();
+
+    auto result = prepareJob (args, job);
+    return result.failed() ? result : runJob (job);
+}
+
+static juce::Result slice (const Arguments& args)
+{
+    auto positional = args.getPositionalArguments();
+    if (positional.size() != 2)
+        return juce::Result::fail ("slice expects an input and an output file");
+
+    Job job;
+    job.inputFiles.add (getFile (positional[0]));
+    job.outputFile = getFile (positional[1]);
+    job.sampleRate = args.getValue ("--rate", "0").getDoubleValue();
+
+    auto result = prepareJob (args, job);
+    if (result.failed())
+        return result;
+
+    auto& reader = *job.readers[0];
+    job.firstRow = args.getValue ("--from", "0").getLargeIntValue();
+    job.endRow   = args.getValue ("--to", juce::String (reader.getNumRowsOrSamples())).getLargeIntValue();
+
+    // Times are looked up in the chunk index
+    for (auto option : {"--start-time", "--end-time"})
+    {
+        if (!args.hasOption (option))
+            continue;
+
+        if (job.sampleRate <= 0.0)
+            return juce::Result::fail ("Slicing by time needs --rate");
+
+        if (!reader.seekToTime (args.getValue (option).getDoubleValue(), job.sampleRate))
+            return juce::Result::fail (juce::String (option) + " is not covered by the chunk index of the input file");
+
+        (juce::String (option) == "--start-time" ? job.firstRow : job.endRow) = reader.getReadPosition();
+    }
+
+    job.firstRow = juce::jlimit<int64_t> (0, reader.getNumRowsOrSamples(), job.firstRow);
+    job.endRow   = juce::jlimit<int64_t> (job.firstRow, reader.getNumRowsOrSamples(), job.endRow);
+
+    for (auto& channel : juce::StringArray::fromTokens (args.getValue ("--channels"), ",", ""))
+        job.channels.add (channel.trim().getIntValue());
+
+    return runJob (job);
+}
+
+static juce::Result concat (const Arguments& args)
+{
+    auto positional = args.getPositionalArguments();
+    if (positional.size() < 3)
+        return juce::Result::fail ("concat expects an output file and at least two input files");
+
+    Job job;
+    job.outputFile = getFile (positional[0]);
+    job.sampleRate = args.getValue ("--rate", "0").getDoubleValue();
+
+    for (int i = 1; i < positional.size(); ++i)
+        job.inputFiles.add (getFile (positional[i]));
+
+    auto result = prepareJob (args, job);
+    return result.failed() ? result : runJob (job);
+}
+
+static juce::Result decimate (const Arguments& args)
+{
+    auto positional = args.getPositionalArguments();
+    if (positional.size() != 2)
+        return juce::Result::fail ("decimate expects an input and an output file");
+
+    Job job;
+    job.inputFiles.add (getFile (positional[0]));
+    job.outputFile = getFile (positional[1]);
+    job.sampleRate = args.getValue ("--rate", "0").getDoubleValue();
+    job.decimationFactor = args.getValue ("--factor", "0").getIntValue();
+    job.numFilterTaps = args.getValue ("--taps", juce::String (16 * job.decimationFactor + 1)).getIntValue();
+
+    if (job.decimationFactor < 2)
+        return juce::Result::fail ("decimate needs a --factor of at least 2");
+
+    if (job.numFilterTaps < 1)
+        return juce::Result::fail ("The filter needs at least one tap");
+
+    auto result = prepareJob (args, job);
+    return result.failed() ? result : runJob (job);
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    Arguments args (argc, argv);
+    auto command = args.getCommand();
+
+    std::map<juce::String, std::function<juce::Result (const Arguments&)>> commands
+    {
+        {"info",     info},
+        {"convert",  convert},
+        {"slice",    slice},
+        {"concat",   concat},
+        {"decimate", decimate}
+    };
+
+    auto it = commands.find (command);
+    if (it == commands.end())
+    {
+        std::cout << usage;
+        return (command.isEmpty() || command == "--help") ? 0 : 1;
+    }
+
+    auto result = it->second (args);
+    if (result.failed())
+    {
+        std::cerr << "mcvtool: " << result.getErrorMessage() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
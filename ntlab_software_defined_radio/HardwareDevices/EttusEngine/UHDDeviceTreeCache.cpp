@@ -0,0 +1,201 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "UHDDeviceTreeCache.h"
+
+namespace ntlab
+{
+    const juce::Identifier UHDDeviceTreeCache::propertyVersion    ("version");
+    const juce::Identifier UHDDeviceTreeCache::propertyDevices    ("devices");
+    const juce::Identifier UHDDeviceTreeCache::propertyAddress    ("addr");
+    const juce::Identifier UHDDeviceTreeCache::propertyTree       ("tree");
+    const juce::Identifier UHDDeviceTreeCache::propertyType       ("type");
+    const juce::Identifier UHDDeviceTreeCache::propertyProperties ("properties");
+    const juce::Identifier UHDDeviceTreeCache::propertyChildren   ("children");
+
+    UHDDeviceTreeCache::UHDDeviceTreeCache (const juce::File& cacheFile)
+      : cacheFile (cacheFile),
+        devices (new juce::DynamicObject)
+    {
+        if (!cacheFile.existsAsFile())
+            return;
+
+        auto cache = juce::JSON::parse (cacheFile);
+
+        if (static_cast<int> (cache.getProperty (propertyVersion, 0)) != cacheVersion)
+            return;
+
+        if (auto* cachedDevices = cache.getProperty (propertyDevices, juce::var()).getDynamicObject())
+            devices = cachedDevices;
+    }
+
+    juce::ValueTree UHDDeviceTreeCache::getDeviceTree (const juce::String& serial, const juce::String& address) const
+    {
+        const juce::ScopedLock scopedLock (lock);
+
+        auto entry = devices->getProperty (serial);
+
+        // an address change is the cheapest hint that the setup changed, so better probe the device again
+        if (entry.getProperty (propertyAddress, juce::var()).toString() != address)
+            return juce::ValueTree();
+
+        return valueTreeFromJSON (entry.getProperty (propertyTree, juce::var()));
+    }
+
+    void UHDDeviceTreeCache::setDeviceTree (const juce::String& serial, const juce::String& address, const juce::ValueTree& deviceTree)
+    {
+        jassert (serial.isNotEmpty());
+
+        juce::DynamicObject::Ptr entry (new juce::DynamicObject);
+        entry->setProperty (propertyAddress, address);
+        entry->setProperty (propertyTree, valueTreeToJSON (deviceTree));
+
+        const juce::ScopedLock scopedLock (lock);
+        devices->setProperty (serial, entry.get());
+    }
+
+    juce::Result UHDDeviceTreeCache::save() const
+    {
+        juce::DynamicObject::Ptr cache (new juce::DynamicObject);
+        cache->setProperty (propertyVersion, cacheVersion);
+
+        juce::String json;
+        {
+            const juce::ScopedLock scopedLock (lock);
+            cache->setProperty (propertyDevices, devices.get());
+            json = juce::JSON::toString (cache.get());
+        }
+
+        if (!cacheFile.getParentDirectory().createDirectory())
+            return juce::Result::fail ("Can't create the directory for " + cacheFile.getFullPathName());
+
+        // a process killed while writing must not leave a corrupted cache behind
+        juce::TemporaryFile temporaryFile (cacheFile);
+
+        if (!temporaryFile.getFile().replaceWithText (json) || !temporaryFile.overwriteTargetFileWithTemporary())
+            return juce::Result::fail ("Can't write " + cacheFile.getFullPathName());
+
+        return juce::Result::ok();
+    }
+
+    juce::var UHDDeviceTreeCache::valueTreeToJSON (const juce::ValueTree& tree)
+    {
+        juce::DynamicObject::Ptr properties (new juce::DynamicObject);
+
+        for (int i = 0; i < tree.getNumProperties(); ++i)
+        {
+            auto name = tree.getPropertyName (i);
+            auto& value = tree.getProperty (name);
+
+            if (value.isDouble() && !std::isfinite (static_cast<double> (value)))
+                properties->setProperty (name, juce::var());
+            else
+                properties->setProperty (name, value);
+        }
+
+        juce::Array<juce::var> children;
+        for (const auto& child : tree)
+            children.add (valueTreeToJSON (child));
+
+        juce::DynamicObject::Ptr json (new juce::DynamicObject);
+        json->setProperty (propertyType,       tree.getType().toString());
+        json->setProperty (propertyProperties, properties.get());
+        json->setProperty (propertyChildren,   children);
+
+        return json.get();
+    }
+
+    juce::ValueTree UHDDeviceTreeCache::valueTreeFromJSON (const juce::var& json)
+    {
+        auto type = json.getProperty (propertyType, juce::var()).toString();
+        if (type.isEmpty())
+            return juce::ValueTree();
+
+        juce::ValueTree tree (type);
+
+        if (auto* properties = json.getProperty (propertyProperties, juce::var()).getDynamicObject())
+        {
+            for (auto& property : properties->getProperties())
+            {
+                if (property.value.isVoid())
+                    tree.setProperty (property.name, std::numeric_limits<double>::quiet_NaN(), nullptr);
+                else
+                    tree.setProperty (property.name, property.value, nullptr);
+            }
+        }
+
+        if (auto* children = json.getProperty (propertyChildren, juce::var()).getArray())
+        {
+            for (auto& child : *children)
+            {
+                auto childTree = valueTreeFromJSON (child);
+                if (childTree.isValid())
+                    tree.appendChild (childTree, nullptr);
+            }
+        }
+
+        return tree;
+    }
+
+#ifdef NTLAB_SOFTWARE_DEFINED_RADIO_UNIT_TESTS
+
+    class UHDDeviceTreeCacheTest : public juce::UnitTest
+    {
+    public:
+        UHDDeviceTreeCacheTest() : juce::UnitTest ("UHDDeviceTreeCache test") {};
+
+        void runTest() override
+        {
+            auto cacheFile = juce::File::getSpecialLocation (juce::File::SpecialLocationType::tempDirectory).getChildFile ("uhdDeviceTreeCache.json");
+            cacheFile.deleteFile();
+
+            juce::ValueTree range ("Freq_range", {{"min", -50.0}, {"max", 50.0}, {"unit", "MHz"}, {"current_value", std::numeric_limits<double>::quiet_NaN()}});
+            juce::ValueTree device ("USRP2_N-Series_Device_0", {{"serial", "3089166"}, {"hardware", "2577"}, {"ip-addr", "192.168.20.3"}});
+            device.getOrCreateChildWithName ("RX_DSP", nullptr).getOrCreateChildWithName ("_0", nullptr).appendChild (range, nullptr);
+
+            beginTest ("Convert a device tree to JSON and back");
+
+            auto restoredDevice = UHDDeviceTreeCache::valueTreeFromJSON (juce::JSON::parse (juce::JSON::toString (UHDDeviceTreeCache::valueTreeToJSON (device))));
+            auto restoredRange = restoredDevice.getChildWithName ("RX_DSP").getChildWithName ("_0").getChildWithName ("Freq_range");
+
+            expect (restoredDevice.getType() == device.getType());
+            expectEquals (restoredDevice.getProperty ("hardware").toString(), juce::String ("2577"));
+            expectEquals (static_cast<double> (restoredRange.getProperty ("min")), -50.0);
+            expect (std::isnan (static_cast<double> (restoredRange.getProperty ("current_value"))));
+
+            beginTest ("Restore cached devices by serial and address");
+            {
+                UHDDeviceTreeCache cache (cacheFile);
+                expect (!cache.getDeviceTree ("3089166", "192.168.20.3").isValid());
+
+                cache.setDeviceTree ("3089166", "192.168.20.3", device);
+                expect (cache.save().wasOk());
+            }
+
+            UHDDeviceTreeCache loadedCache (cacheFile);
+            expect (loadedCache.getDeviceTree ("3089166", "192.168.20.3").getType() == device.getType());
+            expect (!loadedCache.getDeviceTree ("3089166", "192.168.20.4").isValid());
+            expect (!loadedCache.getDeviceTree ("3089167", "192.168.20.3").isValid());
+
+            cacheFile.deleteFile();
+        }
+    };
+
+    static UHDDeviceTreeCacheTest uhdDeviceTreeCacheTest;
+
+#endif // NTLAB_SOFTWARE_DEFINED_RADIO_UNIT_TESTS
+}
@@ -0,0 +1,81 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <juce_data_structures/juce_data_structures.h>
+
+namespace ntlab
+{
+    /**
+     * A persistent cache for the device subtrees the UHDEngine builds by probing each device. Probing a networked
+     * USRP takes seconds, while the discovery of all devices returns their serials and addresses almost instantly.
+     * The cache stores the subtree of each device keyed by its serial, so that a device found with the same serial at
+     * the same address doesn't need to be probed again. The cache is stored as a JSON file and can safely be accessed
+     * from multiple threads.
+     */
+    class UHDDeviceTreeCache
+    {
+    public:
+        /** Creates a cache and loads all entries found in the cache file, which doesn't need to exist */
+        UHDDeviceTreeCache (const juce::File& cacheFile);
+
+        /** Returns the file the cache is stored in */
+        const juce::File& getCacheFile() const { return cacheFile; }
+
+        /**
+         * Returns a copy of the cached subtree of the device with the serial passed. If the device is not cached or
+         * was cached with a different address, an invalid tree is returned.
+         */
+        juce::ValueTree getDeviceTree (const juce::String& serial, const juce::String& address) const;
+
+        /** Adds or replaces the subtree of a device. Call save to make the change persistent */
+        void setDeviceTree (const juce::String& serial, const juce::String& address, const juce::ValueTree& deviceTree);
+
+        /** Writes all entries to the cache file, replacing the old file only if writing succeeded */
+        juce::Result save() const;
+
+        /**
+         * Converts a ValueTree into a JSON object that holds its type, properties and children. Other than the
+         * ValueTree XML representation, this keeps the types of numeric properties. Non-finite doubles are stored as
+         * null as JSON can't represent them.
+         */
+        static juce::var valueTreeToJSON (const juce::ValueTree& tree);
+
+        /** Restores a ValueTree from its JSON representation, null properties are restored as NaN */
+        static juce::ValueTree valueTreeFromJSON (const juce::var& json);
+
+    private:
+        static const juce::Identifier propertyVersion;
+        static const juce::Identifier propertyDevices;
+        static const juce::Identifier propertyAddress;
+        static const juce::Identifier propertyTree;
+        static const juce::Identifier propertyType;
+        static const juce::Identifier propertyProperties;
+        static const juce::Identifier propertyChildren;
+
+        /** Increase this if the structure of the device tree changes, cache files of other versions are ignored */
+        static const int cacheVersion = 1;
+
+        const juce::File cacheFile;
+
+        juce::CriticalSection lock;
+        juce::DynamicObject::Ptr devices;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UHDDeviceTreeCache)
+    };
+}
@@ -47,7 +47,6 @@ namespace ntlab
 // ugly solution but makes the NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR macro work
 #define errorDescription UHDr::errorDescription
 
-    const juce::String UHDEngine::defaultCpuFormat ("fc32");
     const juce::String UHDEngine::emptyArg;
 #endif
 
@@ -82,6 +81,9 @@ namespace ntlab
     const juce::Identifier UHDEngine::propertyAntennas         ("Antennas");
     const juce::Identifier UHDEngine::propertySyncSetup        ("Synchronization_setup");
     const juce::Identifier UHDEngine::propertySampleRate       ("Sample_rate");
+    const juce::Identifier UHDEngine::propertyCpuFormat        ("CPU_format");
+    const juce::Identifier UHDEngine::propertyOtwFormat        ("OTW_format");
+    const juce::Identifier UHDEngine::propertyQueueDepth       ("Queue_depth");
 
 #if !JUCE_IOS
 
@@ -99,6 +101,8 @@ namespace ntlab
 
     UHDEngine::~UHDEngine ()
     {
+        stopDeviceTreeRefresh();
+
         if (isStreaming ())
             stopStreaming ();
 
@@ -118,7 +122,8 @@ namespace ntlab
       : juce::Thread ("UHD Engine Thread"),
         uhdLogStreambuffer (activeCallback),
         uhdr (uhdLibrary),
-        devicesInActiveUSRPSetup ("Active_Devices")
+        devicesInActiveUSRPSetup ("Active_Devices"),
+        deviceTreeRefreshThread ("UHD Engine Device Tree Refresh Thread", [this]() { refreshDeviceTreeCache(); })
     {
         previousClogStreambuf = std::clog.rdbuf (&uhdLogStreambuffer);
     }
@@ -128,6 +133,9 @@ namespace ntlab
         // rearranging the whole setup while streaming is running seems like a bad idea...
         jassert (!isStreaming());
 
+        // probing devices in the background would disturb the devices opened below
+        stopDeviceTreeRefresh();
+
         // update the device tree if neccesarry
         if (!deviceTree.isValid())
             getDeviceTree();
@@ -243,21 +251,11 @@ namespace ntlab
                 return setRxSubdevSpec;
         }
 
-        UHDr::Error error;
-        UHDr::StreamArgs streamArgs;
-        streamArgs.numChannels = rxChannelMapping->numChannels;
-        streamArgs.channelList = rxChannelMapping->getStreamArgsChannelList();
-        streamArgs.cpuFormat   = const_cast<char*> (defaultCpuFormat.toRawUTF8());
-        streamArgs.otwFormat   = const_cast<char*> (emptyArg.toRawUTF8());
-        streamArgs.args        = const_cast<char*> (emptyArg.toRawUTF8());
-        rxStream.reset (usrp->makeRxStream (streamArgs, error));
-
-        if (error)
-        {
-            rxStream.reset (nullptr);
-            return juce::Result::fail ("Error creating Rx Stream: " + usrp->getLastUSRPError ());
-        }
+        auto creatingRxStream = createRxStream();
+        if (creatingRxStream.failed())
+            return creatingRxStream;
 
+        UHDr::Error error;
         std::vector<juce::StringArray> gainElements;
         for (int c = 0; c < rxChannelMapping->numChannels; ++c)
         {
@@ -291,38 +289,132 @@ namespace ntlab
                 return setTxSubdevSpec;
         }
 
+        auto creatingTxStream = createTxStream();
+        if (creatingTxStream.failed())
+            return creatingTxStream;
+
+        UHDr::Error error;
+        std::vector<juce::StringArray> gainElements;
+        for (int c = 0; c < txChannelMapping->numChannels; ++c)
+        {
+            gainElements.emplace_back (usrp->getValidTxGainElements (c));
+            error = usrp->setTxAntenna (channelSetup[c].antennaPort.toRawUTF8 (), c);
+            if (error)
+            {
+                rxStream.reset (nullptr);
+                return juce::Result::fail ("Error setting Tx Antenna: " + usrp->getLastUSRPError ());
+            }
+        }
+        txChannelMapping->setGainElements (std::move (gainElements));
+
+        txEnabled = true;
+
+        return juce::Result::ok();
+    }
+
+    juce::Result UHDEngine::setStreamFormat (StreamFormat newCpuFormat, StreamFormat newOtwFormat)
+    {
+        // changing the format of the streams while they are in use would pull the rug from under the engine thread
+        jassert (!isStreaming());
+
+        if (newOtwFormat == fc32)
+            return juce::Result::fail ("fc32 can't be used as over-the-wire format");
+
+        if ((newCpuFormat == sc8) && (newOtwFormat != sc8))
+            return juce::Result::fail ("An sc8 cpu format requires an sc8 over-the-wire format");
+
+        cpuFormat = newCpuFormat;
+        otwFormat = newOtwFormat;
+
+        if (rxStream != nullptr)
+        {
+            auto creatingRxStream = createRxStream();
+            if (creatingRxStream.failed())
+                return creatingRxStream;
+        }
+
+        if (txStream != nullptr)
+        {
+            auto creatingTxStream = createTxStream();
+            if (creatingTxStream.failed())
+                return creatingTxStream;
+        }
+
+        return juce::Result::ok();
+    }
+
+    juce::Result UHDEngine::createRxStream()
+    {
+        // the stream has to be destroyed before a new one can be created for the same channels
+        rxStream.reset (nullptr);
+
+        UHDr::Error error;
+        UHDr::StreamArgs streamArgs;
+        streamArgs.numChannels = rxChannelMapping->numChannels;
+        streamArgs.channelList = rxChannelMapping->getStreamArgsChannelList();
+        streamArgs.cpuFormat   = const_cast<char*> (getFormatName (cpuFormat));
+        streamArgs.otwFormat   = const_cast<char*> (getFormatName (otwFormat));
+        streamArgs.args        = const_cast<char*> (emptyArg.toRawUTF8());
+        rxStream.reset (usrp->makeRxStream (streamArgs, error));
+
+        if (error)
+        {
+            rxStream.reset (nullptr);
+            return juce::Result::fail ("Error creating Rx Stream: " + usrp->getLastUSRPError ());
+        }
+
+        return juce::Result::ok();
+    }
+
+    juce::Result UHDEngine::createTxStream()
+    {
+        // the stream has to be destroyed before a new one can be created for the same channels
+        txStream.reset (nullptr);
+
         UHDr::Error error;
         UHDr::StreamArgs streamArgs;
         streamArgs.numChannels = txChannelMapping->numChannels;
         streamArgs.channelList = txChannelMapping->getStreamArgsChannelList();
-        streamArgs.cpuFormat   = const_cast<char*> (defaultCpuFormat.toRawUTF8());
-        streamArgs.otwFormat   = const_cast<char*> (emptyArg.toRawUTF8());
+        streamArgs.cpuFormat   = const_cast<char*> (getFormatName (cpuFormat));
+        streamArgs.otwFormat   = const_cast<char*> (getFormatName (otwFormat));
         streamArgs.args        = const_cast<char*> (emptyArg.toRawUTF8());
 
         txStream.reset (usrp->makeTxStream (streamArgs, error));
 
         if (error)
         {
-            rxStream.reset (nullptr);
+            txStream.reset (nullptr);
             return juce::Result::fail ("Error creating Tx Stream: " + usrp->getLastUSRPError ());
         }
 
-        std::vector<juce::StringArray> gainElements;
-        for (int c = 0; c < txChannelMapping->numChannels; ++c)
+        return juce::Result::ok();
+    }
+
+    const char* UHDEngine::getFormatName (StreamFormat format)
+    {
+        switch (format)
         {
-            gainElements.emplace_back (usrp->getValidTxGainElements (c));
-            error = usrp->setTxAntenna (channelSetup[c].antennaPort.toRawUTF8 (), c);
-            if (error)
+            case fc32: return "fc32";
+            case sc16: return "sc16";
+            case sc8:  return "sc8";
+        }
+
+        jassertfalse;
+        return "";
+    }
+
+    bool UHDEngine::getFormatFromName (const juce::String& name, StreamFormat& format)
+    {
+        for (auto candidate : { fc32, sc16, sc8 })
+        {
+            if (name == getFormatName (candidate))
             {
-                rxStream.reset (nullptr);
-                return juce::Result::fail ("Error setting Tx Antenna: " + usrp->getLastUSRPError ());
+                format = candidate;
+                return true;
             }
         }
-        txChannelMapping->setGainElements (std::move (gainElements));
-
-        txEnabled = true;
 
-        return juce::Result::ok();
+        return false;
     }
 
     bool UHDEngine::setSampleRate (double newSampleRate)
@@ -355,10 +447,20 @@ namespace ntlab
                         return false;
                     }
                 }
-
-                auto setSampleRate = usrp->setRxSampleRate (newSampleRate, c);
-                NTLAB_RETURN_FALSE_AND_PRINT_ERROR_DBG_IF_FAILED (setSampleRate);
             }
+
+            auto setSampleRate = configureMboardsConcurrently (*rxChannelMapping, [this, newSampleRate] (const juce::Array<int>& channels)
+            {
+                for (auto c : channels)
+                {
+                    auto setChannelSampleRate = usrp->setRxSampleRate (newSampleRate, rxChannelMapping->getHardwareChannelForBufferChannel (c));
+                    if (setChannelSampleRate.failed())
+                        return setChannelSampleRate;
+                }
+
+                return juce::Result::ok();
+            });
+            NTLAB_RETURN_FALSE_AND_PRINT_ERROR_DBG_IF_FAILED (setSampleRate);
         }
 
         if (txChannelMapping != nullptr)
@@ -384,10 +486,20 @@ namespace ntlab
                         return false;
                     }
                 }
-
-                auto setSampleRate = usrp->setTxSampleRate (newSampleRate, c);
-                NTLAB_RETURN_FALSE_AND_PRINT_ERROR_DBG_IF_FAILED (setSampleRate);
             }
+
+            auto setSampleRate = configureMboardsConcurrently (*txChannelMapping, [this, newSampleRate] (const juce::Array<int>& channels)
+            {
+                for (auto c : channels)
+                {
+                    auto setChannelSampleRate = usrp->setTxSampleRate (newSampleRate, txChannelMapping->getHardwareChannelForBufferChannel (c));
+                    if (setChannelSampleRate.failed())
+                        return setChannelSampleRate;
+                }
+
+                return juce::Result::ok();
+            });
+            NTLAB_RETURN_FALSE_AND_PRINT_ERROR_DBG_IF_FAILED (setSampleRate);
         }
 
         return true;
@@ -432,18 +544,41 @@ namespace ntlab
 
     juce::ValueTree UHDEngine::getDeviceTree()
     {
+        stopDeviceTreeRefresh();
+
         deviceTree = getUHDTree();
 
+        if (cachedDevicesToRefresh.size() > 0)
+            deviceTreeRefreshThread.startThread (0);
+
         numMboardsInDeviceTree = deviceTree.getNumChildren();
 
         return deviceTree;
     }
 
+    void UHDEngine::setDeviceTreeCacheFile (const juce::File& cacheFile)
+    {
+        stopDeviceTreeRefresh();
+
+        if (cacheFile == juce::File())
+            deviceTreeCache.reset();
+        else
+            deviceTreeCache.reset (new UHDDeviceTreeCache (cacheFile));
+    }
+
+    juce::File UHDEngine::getDefaultDeviceTreeCacheFile()
+    {
+        return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory).getChildFile ("ntlab").getChildFile ("UHDDeviceTreeCache.json");
+    }
+
     juce::ValueTree UHDEngine::getActiveConfig ()
     {
         juce::ValueTree activeSetup (propertyUSRPDeviceConfig);
         activeSetup.setProperty (propertySyncSetup, synchronizationSetup, nullptr);
         activeSetup.setProperty (propertySampleRate, getSampleRate(), nullptr);
+        activeSetup.setProperty (propertyCpuFormat, getFormatName (cpuFormat), nullptr);
+        activeSetup.setProperty (propertyOtwFormat, getFormatName (otwFormat), nullptr);
+        activeSetup.setProperty (propertyQueueDepth, queueDepth, nullptr);
 
         juce::ValueTree mboardsInSetup (propertyMBoards);
         activeSetup.addChild (mboardsInSetup, -1, nullptr);
@@ -501,6 +636,23 @@ namespace ntlab
         if (makingUSRP.failed())
             return makingUSRP;
 
+        // configs stored before the stream format was configurable don't contain it and use the defaults
+        auto newCpuFormat = fc32;
+        auto newOtwFormat = sc16;
+
+        if (configToSet.hasProperty (propertyCpuFormat) && !getFormatFromName (configToSet.getProperty (propertyCpuFormat), newCpuFormat))
+            return juce::Result::fail ("Invalid config, unknown cpu format " + configToSet.getProperty (propertyCpuFormat).toString());
+
+        if (configToSet.hasProperty (propertyOtwFormat) && !getFormatFromName (configToSet.getProperty (propertyOtwFormat), newOtwFormat))
+            return juce::Result::fail ("Invalid config, unknown over-the-wire format " + configToSet.getProperty (propertyOtwFormat).toString());
+
+        auto settingStreamFormat = setStreamFormat (newCpuFormat, newOtwFormat);
+        if (settingStreamFormat.failed())
+            return settingStreamFormat;
+
+        if (configToSet.hasProperty (propertyQueueDepth) && !setQueueDepth (configToSet.getProperty (propertyQueueDepth)))
+            return juce::Result::fail ("Invalid config, can't use a queue depth of " + configToSet.getProperty (propertyQueueDepth).toString());
+
         auto rxSetup = configToSet.getChildWithName ("Rx_Channel_Setup");
         auto txSetup = configToSet.getChildWithName ("Tx_Channel_Setup");
 
@@ -534,6 +686,207 @@ namespace ntlab
         return true;
     }
 
+    bool UHDEngine::setQueueDepth (int numBlocks)
+    {
+        // the queues are set up when streaming starts
+        jassert (!isStreaming());
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (numBlocks < 0);
+
+#ifdef NTLAB_FORCED_BLOCKSIZE
+        // The forced block size setup already decouples the callback through a ThreadedCallback
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (numBlocks > 0);
+#endif
+
+        queueDepth = numBlocks;
+        return true;
+    }
+
+    bool UHDEngine::scheduleTxBurst (const SampleBufferComplex<float>& samples, double startTimeInSeconds)
+    {
+        // You cannot schedule a burst if you haven't set up your tx channels successfully
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (txStream == nullptr);
+
+        // Timed bursts can't be interleaved with the continuous tx burst
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (txEnabled);
+
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (samples.getNumChannels() != txChannelMapping->numChannels);
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (startTimeInSeconds < 0.0);
+
+        std::unique_ptr<ScheduledTxBurst> burst (new ScheduledTxBurst (samples, startTimeInSeconds, cpuFormat));
+
+        {
+            juce::ScopedLock scopedLock (scheduledTxBurstsLock);
+
+            sentTxBursts.clear();
+            scheduledTxBursts.add (burst.release());
+            sentTxBursts.ensureStorageAllocated (scheduledTxBursts.size());
+        }
+
+        txBurstScheduled.signal();
+        return true;
+    }
+
+    UHDEngine::StreamingStats UHDEngine::getStreamingStats() const
+    {
+        StreamingStats stats;
+
+        stats.numRxOverflows        = streamingStatsCounters.numRxOverflows;
+        stats.numRxSequenceErrors   = streamingStatsCounters.numRxSequenceErrors;
+        stats.numRxLateCommands     = streamingStatsCounters.numRxLateCommands;
+        stats.numRxSamplesDropped   = streamingStatsCounters.numRxSamplesDropped;
+        stats.numRxSamplesDiscarded = streamingStatsCounters.numRxSamplesDiscarded;
+        stats.numTxUnderflows       = streamingStatsCounters.numTxUnderflows;
+        stats.numTxSequenceErrors   = streamingStatsCounters.numTxSequenceErrors;
+        stats.numTxLateBursts       = streamingStatsCounters.numTxLateBursts;
+
+        return stats;
+    }
+
+    double UHDEngine::getDeviceTime()
+    {
+        NTLAB_RETURN_MINUS_ONE_IF (usrp == nullptr);
+
+        // all motherboards are synchronized to the time of the first one
+        UHDr::Error error;
+        return usrp->getTimeNow (0, error);
+    }
+
+    bool UHDEngine::setRxCenterFrequencyAt (double newCenterFrequency, double tuneTimeInSeconds, int channel)
+    {
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (usrp == nullptr);
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (rxChannelMapping == nullptr);
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (tuneTimeInSeconds < 0.0);
+
+        // this will be executed on a different thread if called from within the realtime thread
+        auto retune = [this, newCenterFrequency, tuneTimeInSeconds, channel]()
+        {
+            auto success = runTimedCommands (*rxChannelMapping, channel, tuneTimeInSeconds, [&]() { return setRxCenterFrequency (newCenterFrequency, channel); });
+
+            // a failed retune must not mark a boundary. If the tune time passed while the commands were issued, the
+            // next block received starts at the boundary
+            if (success)
+                pendingRxRetuneTime = tuneTimeInSeconds;
+
+            return success ? UHDr::Error::errorNone : UHDr::Error::unknown;
+        };
+
+        return usrp->callLambda (retune) == UHDr::Error::errorNone;
+    }
+
+    bool UHDEngine::setTxCenterFrequencyAt (double newCenterFrequency, double tuneTimeInSeconds, int channel)
+    {
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (usrp == nullptr);
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (txChannelMapping == nullptr);
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (tuneTimeInSeconds < 0.0);
+
+        // this will be executed on a different thread if called from within the realtime thread
+        auto retune = [this, newCenterFrequency, tuneTimeInSeconds, channel]()
+        {
+            auto success = runTimedCommands (*txChannelMapping, channel, tuneTimeInSeconds, [&]() { return setTxCenterFrequency (newCenterFrequency, channel); });
+            return success ? UHDr::Error::errorNone : UHDr::Error::unknown;
+        };
+
+        return usrp->callLambda (retune) == UHDr::Error::errorNone;
+    }
+
+    bool UHDEngine::runTimedCommands (const ChannelMapping& channelMapping, int channel, double timeInSeconds, const std::function<bool()>& commands)
+    {
+        juce::Array<int> mboardsInvolved;
+
+        if (channel == allChannels)
+        {
+            for (int c = 0; c < channelMapping.numChannels; ++c)
+                mboardsInvolved.addIfNotAlreadyThere (channelMapping.getMboardIdxForBufferChannel (c));
+        }
+        else
+        {
+            mboardsInvolved.add (channelMapping.getMboardIdxForBufferChannel (channel));
+        }
+
+        const auto fullSecs = static_cast<time_t> (timeInSeconds);
+        const auto fracSecs = timeInSeconds - static_cast<double> (fullSecs);
+
+        auto success = true;
+
+        for (auto m : mboardsInvolved)
+        {
+            auto settingCommandTime = usrp->setCommandTime (fullSecs, fracSecs, m);
+            if (settingCommandTime.failed())
+            {
+                DBG (lastError = "Error setting command time for mboard " + juce::String (m) + ": " + settingCommandTime.getErrorMessage());
+                success = false;
+                break;
+            }
+        }
+
+        if (success)
+            success = commands();
+
+        // also clear the command time of the motherboards set before a failure
+        for (auto m : mboardsInvolved)
+            usrp->clearCommandTime (m);
+
+        return success;
+    }
+
+    juce::Result UHDEngine::configureMboardsConcurrently (const ChannelMapping& channelMapping, const std::function<juce::Result (const juce::Array<int>&)>& configureMboard)
+    {
+        juce::Array<int> mboards;
+        juce::Array<juce::Array<int>> channelsPerMboard;
+
+        for (int c = 0; c < channelMapping.numChannels; ++c)
+        {
+            const int m = channelMapping.getMboardIdxForBufferChannel (c);
+            const int idx = mboards.indexOf (m);
+
+            if (idx < 0)
+            {
+                mboards.add (m);
+                channelsPerMboard.add (juce::Array<int> (c));
+            }
+            else
+            {
+                channelsPerMboard.getReference (idx).add (c);
+            }
+        }
+
+        if (mboards.size() == 1)
+            return configureMboard (channelsPerMboard.getReference (0));
+
+        // Each setting is a round trip to the device, so waiting for one motherboard after another adds up quickly
+        std::vector<juce::Result> results (static_cast<size_t> (mboards.size()), juce::Result::ok());
+        juce::OwnedArray<StageThread> configurationThreads;
+
+        for (int i = 0; i < mboards.size(); ++i)
+        {
+            auto& result = results[static_cast<size_t> (i)];
+            const auto& channels = channelsPerMboard.getReference (i);
+
+            configurationThreads.add (new StageThread ("UHD Engine Mboard " + juce::String (mboards[i]) + " Configuration Thread", [&result, &channels, &configureMboard]()
+            {
+                result = configureMboard (channels);
+            }));
+
+            configurationThreads.getLast()->startThread();
+        }
+
+        juce::StringArray errors;
+
+        for (int i = 0; i < mboards.size(); ++i)
+        {
+            configurationThreads[i]->waitForThreadToExit (-1);
+
+            auto& result = results[static_cast<size_t> (i)];
+            if (result.failed())
+                errors.add ("Mboard " + juce::String (mboards[i]) + ": " + result.getErrorMessage());
+        }
+
+        if (errors.isEmpty())
+            return juce::Result::ok();
+
+        return juce::Result::fail (errors.joinIntoString ("\n"));
+    }
+
     bool UHDEngine::isReadyToStream ()
     {
         return ((rxStream != nullptr) || (txStream != nullptr));
@@ -968,40 +1321,165 @@ namespace ntlab
         return character;
     }
 
-    UHDEngine::ChannelMapping::ChannelMapping (const juce::Array<ntlab::UHDEngine::ChannelSetup>& channelSetup, UHDEngine& engine, ChannelMapping::Direction direction)
-      : numChannels (channelSetup.size()),
-        channelSetupHardwareOrder (channelSetup),
-        gainElementSubtree (static_cast<size_t> (numChannels)),
-        gainElementsMap    (static_cast<size_t> (numChannels)),
-        uhdEngine (engine)
+    UHDEngine::HostFormatStagingBuffer::HostFormatStagingBuffer (StreamFormat cpuFormat, int numChannels, int numSamples)
+      : cpuFormat (cpuFormat),
+        numChannels (numChannels),
+        sc16Samples (cpuFormat == sc16 ? numChannels : 0, numSamples),
+        sc8Samples  (cpuFormat == sc8  ? numChannels : 0, numSamples)
+    {}
+
+    UHDr::BuffsPtr UHDEngine::HostFormatStagingBuffer::getStreamBuffers (std::complex<float>** floatBuffers)
     {
-        int numChannels = channelSetup.size();
-        size_t hardwareChannel = 0;
-        bufferOrderToHardwareOrder.resize (numChannels);
+        // UHD passes the buffers on as void pointers and interprets them according to the cpu format of the stream
+        switch (cpuFormat)
+        {
+            case sc16: return reinterpret_cast<UHDr::BuffsPtr> (sc16Samples.getArrayOfWritePointers());
+            case sc8:  return reinterpret_cast<UHDr::BuffsPtr> (sc8Samples.getArrayOfWritePointers());
+            default:   return floatBuffers;
+        }
+    }
 
-        juce::Identifier propertyDboard;
-        juce::Identifier propertyFrontend;
-        juce::Identifier propertyCodec;
-        if (direction == rx)
+    void UHDEngine::HostFormatStagingBuffer::convertToFloat (std::complex<float>** floatBuffers, int numSamples)
+    {
+        if (cpuFormat == sc16)
         {
-            propertyDboard   = propertyRxDboard;
-            propertyFrontend = propertyRxFrontend;
-            propertyCodec    = propertyRxCodec;
+            for (int c = 0; c < numChannels; ++c)
+                ComplexVectorOperations::convertToFloat (sc16Samples.getReadPointer (c), floatBuffers[c], numSamples);
         }
-        else
+        else if (cpuFormat == sc8)
         {
-            propertyDboard   = propertyTxDboard;
-            propertyFrontend = propertyTxFrontend;
-            propertyCodec    = propertyTxCodec;
+            for (int c = 0; c < numChannels; ++c)
+                ComplexVectorOperations::convertToFloat (sc8Samples.getReadPointer (c), floatBuffers[c], numSamples);
         }
+    }
 
-        for (int m = 0; m < engine.numMboardsInUSRP; ++m)
+    void UHDEngine::HostFormatStagingBuffer::convertFromFloat (std::complex<float>** floatBuffers, int numSamples)
+    {
+        if (cpuFormat == sc16)
         {
-            juce::String motherboardSubdevSpec;
-
             for (int c = 0; c < numChannels; ++c)
-            {
-                // if this assert is hit one of the mboardIdx values was out of range
+                ComplexVectorOperations::convertFromFloat (floatBuffers[c], sc16Samples.getWritePointer (c), numSamples);
+        }
+        else if (cpuFormat == sc8)
+        {
+            for (int c = 0; c < numChannels; ++c)
+                ComplexVectorOperations::convertFromFloat (floatBuffers[c], sc8Samples.getWritePointer (c), numSamples);
+        }
+    }
+
+    UHDEngine::RxBlockTimestamper::RxBlockTimestamper (double sampleRate, double tickRate, std::atomic<double>& pendingRetuneTime)
+      : sampleRate (sampleRate),
+        pendingRetuneTime (pendingRetuneTime)
+    {
+        timestamp.tickRate = tickRate;
+    }
+
+    const RxBlockTimestamp& UHDEngine::RxBlockTimestamper::update (UHDr::USRP::RxStream& rxStream, int numSamplesReceived)
+    {
+        UHDr::Error error;
+        time_t fullSecs;
+        double fracSecs;
+
+        timestamp.hasTime = rxStream.getLastRxTimeSpec (fullSecs, fracSecs, error);
+        const auto expectedSampleIndex = nextSampleIndex;
+
+        if (timestamp.hasTime)
+        {
+            if (!hasTimeOfFirstSample)
+            {
+                firstSampleFullSecs = fullSecs;
+                firstSampleFracSecs = fracSecs;
+                hasTimeOfFirstSample = true;
+            }
+
+            timestamp.firstSampleSeconds = static_cast<double> (fullSecs) + fracSecs;
+            timestamp.firstSampleTicks = std::llround ((static_cast<double> (fullSecs) + fracSecs) * timestamp.tickRate);
+
+            // Subtracting full and fractional seconds separately keeps the precision for long streaming sessions
+            const auto secondsSinceFirstSample = static_cast<double> (fullSecs - firstSampleFullSecs) + (fracSecs - firstSampleFracSecs);
+            timestamp.firstSampleIndex = std::llround (secondsSinceFirstSample * sampleRate);
+        }
+        else
+        {
+            timestamp.firstSampleIndex = nextSampleIndex;
+        }
+
+        timestamp.retuneSampleOffset = -1;
+        auto retuneTime = pendingRetuneTime.load();
+
+        if (timestamp.hasTime && (retuneTime >= 0.0))
+        {
+            const auto retuneOffset = std::llround ((retuneTime - timestamp.firstSampleSeconds) * sampleRate);
+
+            // if the retune time was already over when the block started, the first sample is the boundary. An
+            // overflow still carries a time but no samples, so the boundary is marked in the next block with samples
+            if ((numSamplesReceived > 0) && (retuneOffset < numSamplesReceived))
+            {
+                timestamp.retuneSampleOffset = static_cast<int> (std::max<long long> (0, retuneOffset));
+                pendingRetuneTime.compare_exchange_strong (retuneTime, -1.0);
+            }
+        }
+
+        numSamplesSkipped = std::max<int64_t> (0, timestamp.firstSampleIndex - expectedSampleIndex);
+        nextSampleIndex = timestamp.firstSampleIndex + numSamplesReceived;
+        return timestamp;
+    }
+
+    void UHDEngine::StreamingStatsCounters::reset()
+    {
+        numRxOverflows        = 0;
+        numRxSequenceErrors   = 0;
+        numRxLateCommands     = 0;
+        numRxSamplesDropped   = 0;
+        numRxSamplesDiscarded = 0;
+        numTxUnderflows       = 0;
+        numTxSequenceErrors   = 0;
+        numTxLateBursts       = 0;
+    }
+
+    UHDEngine::ScheduledTxBurst::ScheduledTxBurst (const SampleBufferComplex<float>& samplesToSend, double startTime, StreamFormat cpuFormat)
+      : samples (samplesToSend.getNumChannels(), samplesToSend.getNumSamples()),
+        stagingBuffer (cpuFormat, samplesToSend.getNumChannels(), samplesToSend.getNumSamples()),
+        startTimeInSeconds (startTime)
+    {
+        samplesToSend.copyTo (samples, samples.getNumSamples(), samples.getNumChannels());
+        stagingBuffer.convertFromFloat (samples.getArrayOfWritePointers(), samples.getNumSamples());
+    }
+
+    UHDEngine::ChannelMapping::ChannelMapping (const juce::Array<ntlab::UHDEngine::ChannelSetup>& channelSetup, UHDEngine& engine, ChannelMapping::Direction direction)
+      : numChannels (channelSetup.size()),
+        channelSetupHardwareOrder (channelSetup),
+        gainElementSubtree (static_cast<size_t> (numChannels)),
+        gainElementsMap    (static_cast<size_t> (numChannels)),
+        uhdEngine (engine)
+    {
+        int numChannels = channelSetup.size();
+        size_t hardwareChannel = 0;
+        bufferOrderToHardwareOrder.resize (numChannels);
+
+        juce::Identifier propertyDboard;
+        juce::Identifier propertyFrontend;
+        juce::Identifier propertyCodec;
+        if (direction == rx)
+        {
+            propertyDboard   = propertyRxDboard;
+            propertyFrontend = propertyRxFrontend;
+            propertyCodec    = propertyRxCodec;
+        }
+        else
+        {
+            propertyDboard   = propertyTxDboard;
+            propertyFrontend = propertyTxFrontend;
+            propertyCodec    = propertyTxCodec;
+        }
+
+        for (int m = 0; m < engine.numMboardsInUSRP; ++m)
+        {
+            juce::String motherboardSubdevSpec;
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                // if this assert is hit one of the mboardIdx values was out of range
                 jassert (juce::isPositiveAndBelow (channelSetup[c].mboardIdx, engine.numMboardsInUSRP));
                 if (channelSetup[c].mboardIdx == m)
                 {
@@ -1350,94 +1828,443 @@ namespace ntlab
             return settingUpChannels;
         }
 
+        struct ChannelSettings
+        {
+            double gains[UHDGainElements::count] = {};
+            double centerFrequency = 0.0;
+            double bandwidth = 0.0;
+            UHDr::TuneResult tuneResult;
+            bool frequencySet = false;
+            bool bandwidthSet = false;
+        };
+
+        const bool isRx = direction == rx;
+
+        // The settings are read and checked up front as the trees must not be accessed from the configuration threads
+        std::vector<ChannelSettings> settings (static_cast<size_t> (numChannelsInt));
+        juce::StringArray errors;
+
         for (int c = 0; c < numChannelsInt; ++c)
         {
             auto channelTree = serializedSetup.getChild (c);
-            const int hardwareChannel = static_cast<int> (channelMapping->bufferOrderToHardwareOrder[c]);
+            auto& channelSettings = settings[static_cast<size_t> (c)];
 
-            const int idxOfAnalogGainElement      = channelMapping->gainElementsMap[c][UHDGainElements::analog];
-            const int idxOfDigitalGainElement     = channelMapping->gainElementsMap[c][UHDGainElements::digital];
-            const int idxOfDigitalFineGainElement = channelMapping->gainElementsMap[c][UHDGainElements::digitalFine];
+            channelSettings.gains[UHDGainElements::analog]      = channelTree.getProperty (propertyAnalogGain);
+            channelSettings.gains[UHDGainElements::digital]     = channelTree.getProperty (propertyDigitalGain);
+            channelSettings.gains[UHDGainElements::digitalFine] = channelTree.getProperty (propertyDigitalGainFine);
+            channelSettings.centerFrequency                     = channelTree.getProperty (propertyCenterFrequency);
+            channelSettings.bandwidth                           = channelTree.getProperty (propertyAnalogBandwitdh);
 
-            UHDr::Error error;
+            auto frequencyInRange = channelMapping->isFrontendPropertyInValidRange (c, propertyFreqRange, channelSettings.centerFrequency, false);
+            if (frequencyInRange.failed())
+                errors.add (frequencyInRange.getErrorMessage());
 
-            if (direction == rx)
+            auto bandwidthInRange = channelMapping->isFrontendPropertyInValidRange (c, propertyBandwidthRange, channelSettings.bandwidth, false);
+            if (bandwidthInRange.failed())
+                errors.add (bandwidthInRange.getErrorMessage());
+        }
+
+        if (errors.isEmpty())
+        {
+            auto& mapping = *channelMapping;
+            auto& usrp = *engine.usrp;
+
+            auto configuring = engine.configureMboardsConcurrently (mapping, [&] (const juce::Array<int>& channels)
             {
-                if (idxOfAnalogGainElement >= 0)
-                {
-                    error = engine.usrp->setRxGain (channelTree.getProperty (propertyAnalogGain), hardwareChannel, channelMapping->gainElements[c][idxOfAnalogGainElement].toRawUTF8());
-                    NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR_AND_INVOKE_ACTIONS_BEFORE (error, channelMapping.reset (nullptr); engine.rxStream.reset (nullptr););
-                }
+                juce::StringArray mboardErrors;
 
-                if (idxOfDigitalGainElement >= 0)
+                for (auto c : channels)
                 {
-                    error = engine.usrp->setRxGain (channelTree.getProperty (propertyDigitalGain), hardwareChannel, channelMapping->gainElements[c][idxOfDigitalGainElement].toRawUTF8());
-                    NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR_AND_INVOKE_ACTIONS_BEFORE (error, channelMapping.reset (nullptr); engine.rxStream.reset (nullptr););
-                }
+                    const int hardwareChannel = static_cast<int> (mapping.bufferOrderToHardwareOrder[c]);
+                    auto& channelSettings = settings[static_cast<size_t> (c)];
 
-                if (idxOfDigitalFineGainElement >= 0)
-                {
-                    error = engine.usrp->setRxGain (channelTree.getProperty (propertyDigitalGainFine), hardwareChannel, channelMapping->gainElements[c][idxOfDigitalFineGainElement].toRawUTF8());
-                    NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR_AND_INVOKE_ACTIONS_BEFORE (error, channelMapping.reset (nullptr); engine.rxStream.reset (nullptr););
+                    for (auto gainElement : { UHDGainElements::analog, UHDGainElements::digital, UHDGainElements::digitalFine })
+                    {
+                        const int idxOfGainElement = mapping.gainElementsMap[c][gainElement];
+                        if (idxOfGainElement < 0)
+                            continue;
+
+                        auto gain = channelSettings.gains[gainElement];
+                        auto* gainElementString = mapping.gainElements[c][idxOfGainElement].toRawUTF8();
+                        auto error = isRx ? usrp.setRxGain (gain, hardwareChannel, gainElementString) : usrp.setTxGain (gain, hardwareChannel, gainElementString);
+                        if (error)
+                            mboardErrors.add ("Error setting gain " + juce::String (gain) + " for channel " + juce::String (c) + ": " + errorDescription (error));
+                    }
+
+                    UHDr::TuneRequest request;
+                    char requestArgs[] = "";
+                    request.targetFreq = channelSettings.centerFrequency;
+                    request.args = requestArgs;
+
+                    auto error = isRx ? usrp.setRxFrequency (request, channelSettings.tuneResult, hardwareChannel) : usrp.setTxFrequency (request, channelSettings.tuneResult, hardwareChannel);
+                    if (error)
+                        mboardErrors.add ("Error setting center frequency " + juce::String (channelSettings.centerFrequency) + " for channel " + juce::String (c) + ": " + errorDescription (error));
+                    else
+                        channelSettings.frequencySet = true;
+
+                    error = isRx ? usrp.setRxBandwidth (channelSettings.bandwidth, hardwareChannel) : usrp.setTxBandwidth (channelSettings.bandwidth, hardwareChannel);
+                    if (error)
+                        mboardErrors.add ("Error setting bandwidth " + juce::String (channelSettings.bandwidth) + " for channel " + juce::String (c) + ": " + errorDescription (error));
+                    else
+                        channelSettings.bandwidthSet = true;
                 }
 
-                auto success = engine.setRxCenterFrequency (channelTree.getProperty (propertyCenterFrequency), c);
-                if (!success)
+                return mboardErrors.isEmpty() ? juce::Result::ok() : juce::Result::fail (mboardErrors.joinIntoString ("\n"));
+            });
+
+            if (configuring.failed())
+                errors.add (configuring.getErrorMessage());
+
+            // Back on the calling thread, the trees are updated and the listeners are notified about what was set
+            for (int c = 0; c < numChannelsInt; ++c)
+            {
+                auto& channelSettings = settings[static_cast<size_t> (c)];
+
+                if (channelSettings.frequencySet)
                 {
-                    channelMapping.reset (nullptr);
-                    engine.rxStream.reset (nullptr);
-                    return juce::Result::fail ("Error setting Rx center frequency of " + channelTree.getProperty (propertyCenterFrequency).toString () + " for channel " + juce::String (c));
+                    mapping.isFrontendPropertyInValidRange (c, propertyFreqRange, channelSettings.centerFrequency);
+
+                    if (isRx)
+                        engine.notifyListenersRxCenterFreqChanged (channelSettings.tuneResult.actualRfFreq, c);
+                    else
+                        engine.notifyListenersTxCenterFreqChanged (channelSettings.tuneResult.actualRfFreq, c);
+
+                    if (!juce::approximatelyEqual (channelSettings.tuneResult.actualRfFreq, channelSettings.tuneResult.targetRfFreq))
+                        juce::Logger::writeToLog (engine.lastError = "Error setting exact center frequency for channel " + juce::String (c) + ". Target Rf frequency: "
+                                                                   + juce::String (channelSettings.tuneResult.targetRfFreq) + "Hz, actual Rf frequency: "
+                                                                   + juce::String (channelSettings.tuneResult.actualRfFreq) + "Hz");
                 }
 
-                success = engine.setRxBandwidth (channelTree.getProperty (propertyAnalogBandwitdh), c);
-                if (!success)
+                if (channelSettings.bandwidthSet)
                 {
-                    channelMapping.reset (nullptr);
-                    engine.rxStream.reset (nullptr);
-                    return juce::Result::fail ("Error setting Rx bandwidth of " + channelTree.getProperty (propertyAnalogBandwitdh).toString () + " for channel " + juce::String (c));
+                    mapping.isFrontendPropertyInValidRange (c, propertyBandwidthRange, channelSettings.bandwidth);
+
+                    if (isRx)
+                        engine.notifyListenersRxBandwidthChanged (channelSettings.bandwidth, c);
+                    else
+                        engine.notifyListenersTxBandwidthChanged (channelSettings.bandwidth, c);
                 }
             }
+        }
+
+        if (!errors.isEmpty())
+        {
+            channelMapping.reset (nullptr);
+
+            if (isRx)
+                engine.rxStream.reset (nullptr);
             else
+                engine.txStream.reset (nullptr);
+
+            return juce::Result::fail ("Error restoring the " + juce::String (isRx ? "Rx" : "Tx") + " channel setup:\n" + errors.joinIntoString ("\n"));
+        }
+
+        return juce::Result::ok ();
+    }
+
+    const char UHDEngine::ChannelMapping::emptyGainElementString[1] = "";
+
+    std::unique_ptr<OptionalCLSampleBufferComplexFloat> UHDEngine::createStreamBuffer (int numChannels, int numSamples, bool isRxBuffer)
+    {
+        if (numChannels == 0)
+            numSamples = 0;
+
+#if NTLAB_USE_CL_SAMPLE_BUFFER_COMPLEX_FOR_SDR_IO_DEVICE_CALLBACK
+        if (numChannels == 0)
+            return std::unique_ptr<OptionalCLSampleBufferComplexFloat> (new CLSampleBufferComplex<float> (0, 0, clQueue, clContext));
+
+        if (isRxBuffer)
+            return std::unique_ptr<OptionalCLSampleBufferComplexFloat> (new CLSampleBufferComplex<float> (numChannels, numSamples, clQueue, clContext, false, CL_MEM_READ_ONLY, CL_MAP_WRITE));
+
+        std::unique_ptr<OptionalCLSampleBufferComplexFloat> txBuffer (new CLSampleBufferComplex<float> (numChannels, numSamples, clQueue, clContext, false, CL_MEM_WRITE_ONLY, CL_MAP_READ));
+        txBuffer->clearBufferRegion();
+        return txBuffer;
+#else
+        juce::ignoreUnused (isRxBuffer);
+        return std::unique_ptr<OptionalCLSampleBufferComplexFloat> (new SampleBufferComplex<float> (numChannels, numSamples));
+#endif
+    }
+
+    juce::Result UHDEngine::streamThroughQueues (HostFormatStagingBuffer& rxStagingBuffer, HostFormatStagingBuffer& txStagingBuffer, RxBlockTimestamper& rxTimestamper, int numRxChannels, int numTxChannels, int blockSize)
+    {
+        if (rxStream == nullptr)
+            numRxChannels = 0;
+        if (txStream == nullptr)
+            numTxChannels = 0;
+
+        SampleBlockQueue<TimestampedRxBlock> rxQueue (queueDepth, [&]()
+        {
+            std::unique_ptr<TimestampedRxBlock> block (new TimestampedRxBlock);
+            block->samples = createStreamBuffer (numRxChannels, blockSize, true);
+            return block;
+        });
+
+        SampleBlockQueue<OptionalCLSampleBufferComplexFloat> txQueue (queueDepth, [&]() { return createStreamBuffer (numTxChannels, blockSize, false); });
+
+        // Received into if the rx queue is full, so that the hardware buffers don't overflow
+        auto discardBuffer = createStreamBuffer (numRxChannels, blockSize, true);
+
+        // Passed to the callback in place of the disabled direction
+        auto emptyRxBuffer = createStreamBuffer (numRxChannels, blockSize, true);
+        auto emptyTxBuffer = createStreamBuffer (numTxChannels, blockSize, false);
+        emptyRxBuffer->setNumSamples (0);
+        emptyTxBuffer->setNumSamples (0);
+        const RxBlockTimestamp noRxTimestamp {};
+
+        StageThread processingThread ("UHD Engine Processing Thread", [&]()
+        {
+            usrp->setRealtimeThreadID (juce::Thread::getCurrentThreadId());
+
+            while (!threadShouldExit())
             {
-                if (idxOfAnalogGainElement >= 0)
+                // if these values change in the callback, still finish this block as it was started
+                const bool rxWasEnabled = rxEnabled;
+                const bool txWasEnabled = txEnabled;
+
+                auto* rxBuffer = emptyRxBuffer.get();
+                auto* txBuffer = emptyTxBuffer.get();
+                auto* rxTimestamp = &noRxTimestamp;
+
+                if (rxWasEnabled)
                 {
-                    error = engine.usrp->setTxGain (channelTree.getProperty (propertyAnalogGain), hardwareChannel, channelMapping->gainElements[c][idxOfAnalogGainElement].toRawUTF8());
-                    NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR_AND_INVOKE_ACTIONS_BEFORE (error, channelMapping.reset (nullptr); engine.txStream.reset (nullptr););
+                    auto* rxBlock = rxQueue.waitForNextBlock (100);
+                    if (rxBlock == nullptr)
+                        continue;
+
+                    rxBuffer = rxBlock->samples.get();
+                    rxTimestamp = &rxBlock->timestamp;
                 }
 
-                if (idxOfDigitalGainElement >= 0)
+                if (txWasEnabled)
                 {
-                    error = engine.usrp->setTxGain (channelTree.getProperty (propertyDigitalGain), hardwareChannel, channelMapping->gainElements[c][idxOfDigitalGainElement].toRawUTF8());
-                    NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR_AND_INVOKE_ACTIONS_BEFORE (error, channelMapping.reset (nullptr); engine.txStream.reset (nullptr););
-                }
+                    // without rx, the speed at which the tx queue is drained paces the processing
+                    txBuffer = txQueue.waitForFreeBlock (100);
+                    if (txBuffer == nullptr)
+                        continue;
 
-                if (idxOfDigitalFineGainElement >= 0)
+                    txBuffer->setNumSamples (rxWasEnabled ? rxBuffer->getNumSamples() : blockSize);
+                }
+                else if (!rxWasEnabled)
                 {
-                    error = engine.usrp->setTxGain (channelTree.getProperty (propertyDigitalGainFine), hardwareChannel, channelMapping->gainElements[c][idxOfDigitalFineGainElement].toRawUTF8());
-                    NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR_AND_INVOKE_ACTIONS_BEFORE (error, channelMapping.reset (nullptr); engine.txStream.reset (nullptr););
+                    juce::Thread::sleep (10);
+                    continue;
                 }
 
-                auto success = engine.setTxCenterFrequency (channelTree.getProperty (propertyCenterFrequency), c);
-                if (!success)
+                activeCallback->processTimestampedRFSampleBlock (*rxBuffer, *txBuffer, *rxTimestamp);
+
+#if NTLAB_USE_CL_SAMPLE_BUFFER_COMPLEX_FOR_SDR_IO_DEVICE_CALLBACK
+                // Always map buffers at the end of the processRFSampleBlock callback!
+                jassert (rxBuffer->isCurrentlyMapped());
+                jassert (txBuffer->isCurrentlyMapped());
+#endif
+
+                if (txWasEnabled)
+                    txQueue.push();
+
+                if (rxWasEnabled)
+                    rxQueue.release();
+            }
+        });
+
+        StageThread sendThread ("UHD Engine Send Thread", [&]()
+        {
+            while (!threadShouldExit())
+            {
+                // scheduled bursts are sent once the continuous burst is disabled and all of its blocks are sent
+                if (!txEnabled && (txQueue.getNumQueuedBlocks() == 0))
                 {
-                    channelMapping.reset (nullptr);
-                    engine.txStream.reset (nullptr);
-                    return juce::Result::fail ("Error setting Tx center frequency of " + channelTree.getProperty (propertyCenterFrequency).toString () + " for channel " + juce::String (c));
+                    sendScheduledTxBursts();
+                    checkTxAsyncEvents();
+                    txBurstScheduled.wait (10);
+                    continue;
                 }
 
-                success = engine.setTxBandwidth (channelTree.getProperty (propertyAnalogBandwitdh), c);
-                if (!success)
+                auto* txBuffer = txQueue.waitForNextBlock (100);
+                if (txBuffer == nullptr)
+                    continue;
+
+                UHDr::Error error;
+                const int numSamplesThisBlock = txBuffer->getNumSamples();
+                auto txSource = txBuffer->getArrayOfWritePointers();
+
+                txStagingBuffer.convertFromFloat (txSource, numSamplesThisBlock);
+                auto numSamplesSent = txStream->send (txStagingBuffer.getStreamBuffers (txSource), numSamplesThisBlock, error, 0.5);
+                txQueue.release();
+
+                if (error)
                 {
-                    channelMapping.reset (nullptr);
-                    engine.txStream.reset (nullptr);
-                    return juce::Result::fail ("Error setting Tx bandwith of " + channelTree.getProperty (propertyAnalogBandwitdh).toString () + " for channel " + juce::String (c));
+                    activeCallback->handleError (GeneralErrorMessageNonOwning ("Error executing UHDr::USRP::TxStream::send: " + UHDr::errorDescription (error) + ". Stopping stream."));
+                    signalThreadShouldExit();
+                    return;
                 }
+
+                if (numSamplesSent != numSamplesThisBlock)
+                    activeCallback->handleError (GeneralErrorMessageNonOwning ("Error sending samples: " + txStream->getLastError()));
+
+                checkTxAsyncEvents();
+            }
+        });
+
+        processingThread.startThread (realtimeAudioPriority);
+        if (txStream != nullptr)
+            sendThread.startThread (realtimeAudioPriority);
+
+        auto result = juce::Result::ok();
+
+        while (!threadShouldExit())
+        {
+            if (!rxEnabled)
+            {
+                wait (10);
+                continue;
+            }
+
+            auto* rxBlock = rxQueue.getFreeBlock();
+            const bool queueIsFull = rxBlock == nullptr;
+            auto* rxBuffer = queueIsFull ? discardBuffer.get() : rxBlock->samples.get();
+
+            UHDr::Error error;
+            auto rxDestination = rxBuffer->getArrayOfWritePointers();
+            auto numSamplesThisBlock = rxStream->receive (rxStagingBuffer.getStreamBuffers (rxDestination), blockSize, error, false, 0.5);
+
+            if (error)
+            {
+                result = juce::Result::fail ("Error executing UHDr::USRP::RxStream::receive: " + UHDr::errorDescription (error));
+                break;
+            }
+
+            // keeps counting the sample index for discarded blocks too
+            auto& rxTimestamp = rxTimestamper.update (*rxStream, numSamplesThisBlock);
+            checkRxMetadata (rxTimestamper);
+
+            if (queueIsFull)
+            {
+                // the processing fell behind by more than the queue depth, these samples never reach the callback
+                streamingStatsCounters.numRxSamplesDiscarded += numSamplesThisBlock;
+                rxSampleDropError.setNumRxSampsDropped (numSamplesThisBlock);
+                rxSampleDropError.setNumTxSampsDropped (0);
+                activeCallback->handleError (rxSampleDropError);
+                continue;
             }
+
+            rxStagingBuffer.convertToFloat (rxDestination, numSamplesThisBlock);
+            rxBuffer->setNumSamples (numSamplesThisBlock);
+            rxBlock->timestamp = rxTimestamp;
+            rxQueue.push();
         }
-        return juce::Result::ok ();
+
+        // both stage threads run until the engine thread should exit. They reference the queues and buffers on this
+        // stack frame, so they must never be killed. All their waits time out, so they notice the exit request soon
+        signalThreadShouldExit();
+        processingThread.stopThread (-1);
+        sendThread.stopThread (-1);
+
+        return result;
     }
 
-    const char UHDEngine::ChannelMapping::emptyGainElementString[1] = "";
+    void UHDEngine::sendScheduledTxBursts()
+    {
+        const juce::ScopedTryLock scopedTryLock (scheduledTxBurstsLock);
+        if (!scopedTryLock.isLocked())
+            return;
+
+        while (!scheduledTxBursts.isEmpty())
+        {
+            auto* burst = scheduledTxBursts.removeAndReturn (0);
+            sentTxBursts.add (burst);
+
+            UHDr::Error error;
+            const auto fullSecs = static_cast<time_t> (burst->startTimeInSeconds);
+            const auto fracSecs = burst->startTimeInSeconds - static_cast<double> (fullSecs);
+            const auto numSamples = burst->samples.getNumSamples();
+
+            // the timeout has to cover the time until the device starts consuming the burst
+            auto numSamplesSent = txStream->sendBurst (burst->stagingBuffer.getStreamBuffers (burst->samples.getArrayOfWritePointers()), numSamples, fullSecs, fracSecs, error, 2.0 + numSamples / getSampleRate());
+
+            if (error)
+                activeCallback->handleError (GeneralErrorMessageNonOwning ("Error executing UHDr::USRP::TxStream::sendBurst: " + UHDr::errorDescription (error)));
+            else if (numSamplesSent != numSamples)
+                activeCallback->handleError (GeneralErrorMessageNonOwning ("Error sending samples of scheduled burst: " + txStream->getLastError()));
+        }
+    }
+
+    void UHDEngine::checkRxMetadata (const RxBlockTimestamper& rxTimestamper)
+    {
+        UHDr::Error error;
+        auto rxMetadataError = rxStream->getLastRxMetadataError (error);
+        if (error)
+            return;
+
+        bool dropOfUnknownLength = false;
+
+        switch (rxMetadataError)
+        {
+            case UHDr::rxCodeOverflow:
+                if (rxStream->wasLastRxOutOfSequence (error))
+                    ++streamingStatsCounters.numRxSequenceErrors;
+                else
+                    ++streamingStatsCounters.numRxOverflows;
+
+                // without timestamps there is no way to measure the gap
+                dropOfUnknownLength = !rxTimestamper.deliversTimes();
+                break;
+
+            case UHDr::rxLateCommand:
+                ++streamingStatsCounters.numRxLateCommands;
+                activeCallback->handleError (GeneralErrorMessageNonOwning ("Rx stream command arrived late at the device"));
+                break;
+
+            default:
+                break;
+        }
+
+        // the gap shows up in the timestamp of the first block received after the overflow
+        const auto numSamplesSkipped = rxTimestamper.getNumSamplesSkipped();
+
+        if ((numSamplesSkipped > 0) || dropOfUnknownLength)
+        {
+            streamingStatsCounters.numRxSamplesDropped += numSamplesSkipped;
+
+            rxSampleDropError.setNumRxSampsDropped (dropOfUnknownLength ? -1 : static_cast<int> (std::min<int64_t> (numSamplesSkipped, std::numeric_limits<int>::max())));
+            rxSampleDropError.setNumTxSampsDropped (0);
+            activeCallback->handleError (rxSampleDropError);
+        }
+    }
+
+    void UHDEngine::checkTxAsyncEvents()
+    {
+        UHDr::Error error;
+        UHDr::AsyncEventCode eventCode;
+
+        while (txStream->receiveAsyncEvent (eventCode, error))
+        {
+            switch (eventCode)
+            {
+                case UHDr::txUnderflow:
+                case UHDr::txUnderflowInPacket:
+                    ++streamingStatsCounters.numTxUnderflows;
+                    break;
+
+                case UHDr::txSequenceError:
+                case UHDr::txSequenceErrorInBurst:
+                    ++streamingStatsCounters.numTxSequenceErrors;
+                    break;
+
+                case UHDr::txTimeError:
+                    ++streamingStatsCounters.numTxLateBursts;
+                    activeCallback->handleError (GeneralErrorMessageNonOwning ("Tx burst arrived late at the device"));
+                    continue;
+
+                default:
+                    continue;
+            }
+
+            // UHD doesn't report for how long the device was missing tx samples
+            txSampleDropError.setNumRxSampsDropped (0);
+            txSampleDropError.setNumTxSampsDropped (-1);
+            activeCallback->handleError (txSampleDropError);
+        }
+    }
 
     void UHDEngine::run()
     {
@@ -1479,31 +2306,20 @@ namespace ntlab
 
         activeCallback->prepareForStreaming (getSampleRate(), numRxChannels, numTxChannels, maxBufferSize);
 
-#if NTLAB_USE_CL_SAMPLE_BUFFER_COMPLEX_FOR_SDR_IO_DEVICE_CALLBACK
+        // the streams never deliver or consume more than one hardware block per call
+        HostFormatStagingBuffer rxStagingBuffer (cpuFormat, rxStream != nullptr ? numRxChannels : 0, maxHardwareBlockSize);
+        HostFormatStagingBuffer txStagingBuffer (cpuFormat, txStream != nullptr ? numTxChannels : 0, maxHardwareBlockSize);
 
-        if (rxStream != nullptr)
-            rxBuffer.reset (new CLSampleBufferComplex<float> (numRxChannels, maxBufferSize, clQueue, clContext, false, CL_MEM_READ_ONLY, CL_MAP_WRITE));
-        else
-            rxBuffer.reset (new CLSampleBufferComplex<float> (0, 0, clQueue, clContext));
+        rxBuffer = createStreamBuffer (rxStream != nullptr ? numRxChannels : 0, maxBufferSize, true);
+        txBuffer = createStreamBuffer (txStream != nullptr ? numTxChannels : 0, maxBufferSize, false);
 
-        if (txStream != nullptr)
-        {
-            txBuffer.reset (new CLSampleBufferComplex<float>(numTxChannels, maxBufferSize, clQueue, clContext, false, CL_MEM_WRITE_ONLY, CL_MAP_READ));
-            txBuffer->clearBufferRegion();
-        }
-        else
-            txBuffer.reset (new CLSampleBufferComplex<float> (0, 0, clQueue, clContext));
-#else
-        if (rxStream != nullptr)
-            rxBuffer.reset (new SampleBufferComplex<float> (numRxChannels, maxBufferSize));
-        else
-            rxBuffer.reset (new SampleBufferComplex<float> (0, 0));
-
-        if (txStream != nullptr)
-            txBuffer.reset (new SampleBufferComplex<float> (numTxChannels, maxBufferSize));
-        else
-            txBuffer.reset (new SampleBufferComplex<float> (0, 0));
-#endif
+        // all motherboards share the same time base, so the clock of the first one determines the tick rate
+        UHDr::Error masterClockRateError;
+        auto masterClockRate = usrp->getMasterClockRate (0, masterClockRateError);
+        RxBlockTimestamper rxTimestamper (getSampleRate(), masterClockRateError ? 0.0 : masterClockRate, pendingRxRetuneTime);
+        streamingStatsCounters.reset();
+        const RxBlockTimestamp noRxTimestamp {};
+        RxBlockTimestamp rxTimestamp;
 
         switch (synchronizationSetup)
         {
@@ -1546,88 +2362,157 @@ namespace ntlab
             }
         }
 
-        while (!threadShouldExit())
+        if (queueDepth > 0)
+        {
+            auto streamingThroughQueues = streamThroughQueues (rxStagingBuffer, txStagingBuffer, rxTimestamper, numRxChannels, numTxChannels, maxHardwareBlockSize);
+            if (streamingThroughQueues.failed())
+            {
+                activeCallback->handleError (GeneralErrorMessageNonOwning (streamingThroughQueues.getErrorMessage() + ". Stopping stream."));
+                activeCallback->streamingHasStopped();
+                return;
+            }
+        }
+        else
         {
-            int numSamplesThisBlock = 0;
+            // A timed burst blocks until the device takes it, which would stall receiving if it was sent from this
+            // thread. While continuous tx is disabled, the bursts and the async tx events are handled on their own thread
+            StageThread burstSendThread ("UHD Engine Burst Send Thread", [this]()
+            {
+                while (!juce::Thread::currentThreadShouldExit())
+                {
+                    if (!txEnabled)
+                    {
+                        sendScheduledTxBursts();
+                        checkTxAsyncEvents();
+                    }
 
-            if (rxEnabled)
+                    txBurstScheduled.wait (10);
+                }
+            });
+
+            if (txStream != nullptr)
+                burstSendThread.startThread();
+
+            while (!threadShouldExit())
             {
-                UHDr::Error error;
+                int numSamplesThisBlock = 0;
+
+                if (rxEnabled)
+                {
+                    UHDr::Error error;
 
 #ifdef NTLAB_FORCED_BLOCKSIZE
-                rxBuffer->fillArrayOfPointersForAppending (rxBufferPtrs.data());
+                    // the block passed to the callback is assembled from multiple receive calls
+                    const bool blockStarts = rxBuffer->getNumSamples() == 0;
+
+                    rxBuffer->fillArrayOfPointersForAppending (rxBufferPtrs.data());
+                    auto rxDestination = rxBufferPtrs.data();
 
-                int numDesiredSamplesThisBlock = std::min (maxHardwareBlockSize, maxBufferSize - rxBuffer->getNumSamples());
+                    int numDesiredSamplesThisBlock = std::min (maxHardwareBlockSize, maxBufferSize - rxBuffer->getNumSamples());
 
-                numSamplesThisBlock = rxStream->receive(rxBufferPtrs.data(), numDesiredSamplesThisBlock, error, false, 0.5);
+                    numSamplesThisBlock = rxStream->receive (rxStagingBuffer.getStreamBuffers (rxDestination), numDesiredSamplesThisBlock, error, false, 0.5);
 #else
-                numSamplesThisBlock = rxStream->receive (rxBuffer->getArrayOfWritePointers(), maxHardwareBlockSize, error, false, 0.5);
+                    auto rxDestination = rxBuffer->getArrayOfWritePointers();
+                    numSamplesThisBlock = rxStream->receive (rxStagingBuffer.getStreamBuffers (rxDestination), maxHardwareBlockSize, error, false, 0.5);
 #endif
-                if (error)
-                {
-                    activeCallback->handleError ( GeneralErrorMessageNonOwning (
-                            "Error executing UHDr::USRP::RxStream::receive: " + UHDr::errorDescription (error) +
-                            ". Stopping stream."));
-                    activeCallback->streamingHasStopped();
-                    return;
-                }
+                    if (error)
+                    {
+                        activeCallback->handleError ( GeneralErrorMessageNonOwning (
+                                "Error executing UHDr::USRP::RxStream::receive: " + UHDr::errorDescription (error) +
+                                ". Stopping stream."));
+                        burstSendThread.stopThread (-1);
+                        activeCallback->streamingHasStopped();
+                        return;
+                    }
+
+                    rxStagingBuffer.convertToFloat (rxDestination, numSamplesThisBlock);
 
 #ifdef NTLAB_FORCED_BLOCKSIZE
-                rxBuffer->incrementNumSamples (numSamplesThisBlock);
-            }
+                    auto& timestampThisReceive = rxTimestamper.update (*rxStream, numSamplesThisBlock);
+                    if (blockStarts)
+                        rxTimestamp = timestampThisReceive;
+
+                    // the offset reported refers to the samples of this receive call, not to the whole block
+                    if (timestampThisReceive.retuneSampleOffset >= 0)
+                        rxTimestamp.retuneSampleOffset = rxBuffer->getNumSamples() + timestampThisReceive.retuneSampleOffset;
+
+                    checkRxMetadata (rxTimestamper);
+
+                    rxBuffer->incrementNumSamples (numSamplesThisBlock);
+                }
 #else
-                rxBuffer->setNumSamples (numSamplesThisBlock);
-                if (txEnabled)
-                    txBuffer->setNumSamples (numSamplesThisBlock);
+                    rxTimestamp = rxTimestamper.update (*rxStream, numSamplesThisBlock);
+                    checkRxMetadata (rxTimestamper);
 
-            }
-            else
-            {
-                rxBuffer->setNumSamples (0);
-                txBuffer->setNumSamples (maxBufferSize);
-            }
+                    rxBuffer->setNumSamples (numSamplesThisBlock);
+                    if (txEnabled)
+                        txBuffer->setNumSamples (numSamplesThisBlock);
+
+                }
+                else
+                {
+                    rxBuffer->setNumSamples (0);
+                    txBuffer->setNumSamples (maxBufferSize);
+                }
 #endif
 
-            // if this value changes in the callback, still process tx data after this callback
-            bool txWasEnabled = txEnabled;
+                // if this value changes in the callback, still process tx data after this callback
+                bool txWasEnabled = txEnabled;
 
-            activeCallback->processRFSampleBlock (*rxBuffer, *txBuffer);
+                activeCallback->processTimestampedRFSampleBlock (*rxBuffer, *txBuffer, rxEnabled ? rxTimestamp : noRxTimestamp);
 
 #if NTLAB_USE_CL_SAMPLE_BUFFER_COMPLEX_FOR_SDR_IO_DEVICE_CALLBACK
-			// Always map buffers at the end of the processRFSampleBlock callback!
-			jassert (rxBuffer->isCurrentlyMapped());
-			jassert (txBuffer->isCurrentlyMapped());
+                // Always map buffers at the end of the processRFSampleBlock callback!
+                jassert (rxBuffer->isCurrentlyMapped());
+                jassert (txBuffer->isCurrentlyMapped());
 #endif
 
-            if (txWasEnabled)
-            {
+                if (txWasEnabled)
+                {
 
-                UHDr::Error error;
+                    UHDr::Error error;
 #ifdef NTLAB_FORCED_BLOCKSIZE
-                if (!rxEnabled)
-                    numSamplesThisBlock = std::min (maxHardwareBlockSize, NTLAB_FORCED_BLOCKSIZE - txBufferStartIdx);
-
-                txBuffer->fillArrayOfPointersForReadingFrom (txBufferPtrs.data(), txBufferStartIdx);
-                auto numSamplesSent = txStream->send (txBufferPtrs.data(), numSamplesThisBlock, error, 0.5);
-                txBufferStartIdx += numSamplesSent;
+                    if (!rxEnabled)
+                        numSamplesThisBlock = std::min (maxHardwareBlockSize, NTLAB_FORCED_BLOCKSIZE - txBufferStartIdx);
 
+                    txBuffer->fillArrayOfPointersForReadingFrom (txBufferPtrs.data(), txBufferStartIdx);
+                    auto txSource = txBufferPtrs.data();
 #else
-                numSamplesThisBlock = txBuffer->getNumSamples();
-                auto numSamplesSent = txStream->send (txBuffer->getArrayOfWritePointers(), numSamplesThisBlock, error, 0.5);
+                    numSamplesThisBlock = txBuffer->getNumSamples();
+                    auto txSource = txBuffer->getArrayOfWritePointers();
+#endif
+                    txStagingBuffer.convertFromFloat (txSource, numSamplesThisBlock);
+                    auto numSamplesSent = txStream->send (txStagingBuffer.getStreamBuffers (txSource), numSamplesThisBlock, error, 0.5);
+#ifdef NTLAB_FORCED_BLOCKSIZE
+                    txBufferStartIdx += numSamplesSent;
 #endif
 
-                if (error)
-                {
-                    activeCallback->handleError (GeneralErrorMessageNonOwning ("Error executing UHDr::USRP::TxStream::send: " + UHDr::errorDescription (error) + ". Stopping stream."));
-                    activeCallback->streamingHasStopped();
-                    return;
-                }
+                    if (error)
+                    {
+                        activeCallback->handleError (GeneralErrorMessageNonOwning ("Error executing UHDr::USRP::TxStream::send: " + UHDr::errorDescription (error) + ". Stopping stream."));
+                        burstSendThread.stopThread (-1);
+                        activeCallback->streamingHasStopped();
+                        return;
+                    }
 
-                if (numSamplesSent != numSamplesThisBlock)
-                {
-                    activeCallback->handleError (GeneralErrorMessageNonOwning ("Error sending samples: " + txStream->getLastError()));
+                    if (numSamplesSent != numSamplesThisBlock)
+                    {
+                        activeCallback->handleError (GeneralErrorMessageNonOwning ("Error sending samples: " + txStream->getLastError()));
+                    }
+
+                    checkTxAsyncEvents();
                 }
             }
+
+            // a burst that is being sent is finished before the stream ends, the thread must not be killed inside UHD
+            burstSendThread.stopThread (-1);
+        }
+
+        {
+            // bursts not sent before streaming stopped are discarded, deallocating them is fine at this point
+            juce::ScopedLock scopedLock (scheduledTxBurstsLock);
+            scheduledTxBursts.clear();
+            sentTxBursts.clear();
         }
 
         if (txStream != nullptr)
@@ -1646,7 +2531,7 @@ namespace ntlab
     juce::ValueTree UHDEngine::getUHDTree()
     {
         // find all devices
-        juce::StringArray allIPAddresses;
+        juce::StringArray allIPAddresses, allSerials;
         auto allDevices = uhdr->findAllDevices ("");
 #if NTLAB_DEBUGPRINT_UHDTREE
         std::cout << "findAllDevices output:\n---------------------------------\n";
@@ -1657,6 +2542,7 @@ namespace ntlab
                 jassertfalse;
 
             allIPAddresses.add (d.getValue ("addr", "0.0.0.0"));
+            allSerials.add (d.getValue ("serial", ""));
 
 #if NTLAB_DEBUGPRINT_UHDTREE
             auto size = d.size();
@@ -1669,211 +2555,302 @@ namespace ntlab
         }
 
         juce::ValueTree tree (propertyUSRPDevice);
+        cachedDevicesToRefresh.clear();
+        bool cacheChanged = false;
 
+        // iterate over all devices
+        for (int i = 0; i < allIPAddresses.size(); ++i)
+        {
+            const auto& address = allIPAddresses[i];
+            const auto& serial  = allSerials[i];
+            const bool cacheable = (deviceTreeCache != nullptr) && serial.isNotEmpty();
+            const int deviceIdx = tree.getNumChildren();
+
+            juce::ValueTree device;
+
+            if (cacheable)
+                device = deviceTreeCache->getDeviceTree (serial, address);
+
+            if (device.isValid())
+            {
+                // the device might have been cached under a different index, so replace the index at the end of its name
+                juce::ValueTree renamedDevice (device.getType().toString().trimCharactersAtEnd ("0123456789") + juce::String (deviceIdx));
+                renamedDevice.copyPropertiesAndChildrenFrom (device, nullptr);
+                device = renamedDevice;
+
+                cachedDevicesToRefresh.set (serial, address);
+            }
+            else
+            {
+                device = probeDevice (address, deviceIdx);
+
+                if (!device.isValid())
+                    continue;
+
+                if (cacheable)
+                {
+                    deviceTreeCache->setDeviceTree (serial, address, device);
+                    cacheChanged = true;
+                }
+            }
+
+            tree.appendChild (device, nullptr);
+        }
+
+        if (cacheChanged)
+        {
+            auto saveResult = deviceTreeCache->save();
+            if (saveResult.failed())
+                DBG ("Error saving the UHD device tree cache: " << saveResult.getErrorMessage());
+        }
+
+#if NTLAB_DEBUGPRINT_UHDTREE
+        std::cout << "Parsed UHD tree:\n\n" << tree.toXmlString() << std::endl;
+#endif
+
+        return tree;
+    }
+
+    juce::ValueTree UHDEngine::probeDevice (const juce::String& address, int deviceIdx)
+    {
         juce::StringArray probeArgs ("uhd_usrp_probe");
+        probeArgs.add ("--args=addr=" + address);
 
-        // iterate over all devices
-        int currentDevice = 0;
-        juce::Array<juce::ValueTree> treeHistory (tree);
+        ntlab::ChildProcess uhdUSRPProbe;
+        if (!uhdUSRPProbe.start (probeArgs))
+            return juce::ValueTree();
 
-        for (auto& a : allIPAddresses)
+        // a probe started from the refresh thread is killed by stopDeviceTreeRefresh. If the refresh was stopped
+        // before the probe was registered here, it has to be killed right away as stopDeviceTreeRefresh missed it
         {
-            // go back to the trees root
-            TreeLevel lastLevel = device;
-            probeArgs.set (1, "--args=addr=" + a);
+            const juce::ScopedLock scopedLock (runningProbeLock);
+            runningProbe = &uhdUSRPProbe;
 
-            ntlab::ChildProcess uhdUSRPProbe;
-            bool success = uhdUSRPProbe.start (probeArgs);
+            if (juce::Thread::currentThreadShouldExit())
+                uhdUSRPProbe.kill();
+        }
 
-            if (!success)
-                continue;
+        auto outputToParse = uhdUSRPProbe.readAllProcessOutput ();
+
+        {
+            const juce::ScopedLock scopedLock (runningProbeLock);
+            runningProbe = nullptr;
+        }
 
-            auto outputToParse = uhdUSRPProbe.readAllProcessOutput ();
+        if (outputToParse.isEmpty () || juce::Thread::currentThreadShouldExit())
+            return juce::ValueTree();
 
-            if (outputToParse.isEmpty ())
-                continue;
+        juce::ValueTree tree (propertyUSRPDevice);
+        juce::Array<juce::ValueTree> treeHistory (tree);
+        TreeLevel lastLevel = device;
 
-            auto linesToParse = juce::StringArray::fromLines (outputToParse);
+        auto linesToParse = juce::StringArray::fromLines (outputToParse);
 
-            int idxOfDeviceEntry = 0;
-            for (auto& l : linesToParse)
-            {
-                if (l.contains ("Device: "))
-                    break;
+        int idxOfDeviceEntry = 0;
+        for (auto& l : linesToParse)
+        {
+            if (l.contains ("Device: "))
+                break;
 
-                idxOfDeviceEntry++;
-            }
-            if (idxOfDeviceEntry < linesToParse.size ())
-            {
-                linesToParse.set (idxOfDeviceEntry, linesToParse[idxOfDeviceEntry] + juce::String (currentDevice));
-                currentDevice++;
-            }
+            idxOfDeviceEntry++;
+        }
+        if (idxOfDeviceEntry < linesToParse.size ())
+            linesToParse.set (idxOfDeviceEntry, linesToParse[idxOfDeviceEntry] + juce::String (deviceIdx));
 
-            for (auto& line : linesToParse)
-            {
-                // remove whitespaces from the start
-                line = line.trimStart();
+        for (auto& line : linesToParse)
+        {
+            // remove whitespaces from the start
+            line = line.trimStart();
 
-                if (line.startsWith ("|") || line.startsWith ("/"))
+            if (line.startsWith ("|") || line.startsWith ("/"))
+            {
+                // count "|" characters to get the depth
+                TreeLevel level = beforeOrAfterTree;
+                const char* endOfLine = line.toRawUTF8() + line.length ();
+                for (char* c = (char*) line.toRawUTF8(); c != endOfLine; ++c)
                 {
-                    // count "|" characters to get the depth
-                    TreeLevel level = beforeOrAfterTree;
-                    const char* endOfLine = line.toRawUTF8() + line.length ();
-                    for (char* c = (char*) line.toRawUTF8(); c != endOfLine; ++c)
+                    if (*c == '|')
                     {
-                        if (*c == '|')
-                        {
-                            level = static_cast<TreeLevel> (level + 1);
-                        }
-                        else if (*c != ' ')
-                        {
-                            break;
-                        }
+                        level = static_cast<TreeLevel> (level + 1);
+                    }
+                    else if (*c != ' ')
+                    {
+                        break;
                     }
+                }
 
-                    // the end of a branch is reached
-                    if (level < lastLevel)
+                // the end of a branch is reached
+                if (level < lastLevel)
+                {
+                    if (!((level == device) && (lastLevel == mboard)))
                     {
-                        if (!((level == device) && (lastLevel == mboard)))
+                        int levelDiff = lastLevel - level;
+                        treeHistory.removeLast (levelDiff);
+                        if (treeHistory.isEmpty())
                         {
-                            int levelDiff = lastLevel - level;
-                            treeHistory.removeLast (levelDiff);
-                            if (treeHistory.isEmpty())
-                            {
-                                lastLevel = device;
-                                treeHistory.add (tree);
-                            }
-
-                            lastLevel = level;
-                            continue;
+                            lastLevel = device;
+                            treeHistory.add (tree);
                         }
+
+                        lastLevel = level;
+                        continue;
                     }
+                }
 
-                    // clear up the line
-                    line = line.trimCharactersAtStart ("| _/");
+                // clear up the line
+                line = line.trimCharactersAtStart ("| _/");
 
-                    // just jump to the next line if it's empty now
-                    if (line.isEmpty ())
-                        continue;
+                // just jump to the next line if it's empty now
+                if (line.isEmpty ())
+                    continue;
 
-                    // create a pair of property and value
-                    auto valuePair = juce::StringArray::fromTokens (line, ":", "");
+                // create a pair of property and value
+                auto valuePair = juce::StringArray::fromTokens (line, ":", "");
 
-                    if (valuePair.size() != 2)
-                    {
-                        // Multiple ":" characters would be an interesting case, please raise an issue on GitHub with
-                        // information regarding the USRP device you use
-                        jassert (valuePair.size() < 2);
+                if (valuePair.size() != 2)
+                {
+                    // Multiple ":" characters would be an interesting case, please raise an issue on GitHub with
+                    // information regarding the USRP device you use
+                    jassert (valuePair.size() < 2);
 
-                        continue;
-                    }
+                    continue;
+                }
 
-                    // Found this case for entry "RFNoC blocks on this device"
-                    if (valuePair[1].isEmpty())
-                        continue;
+                // Found this case for entry "RFNoC blocks on this device"
+                if (valuePair[1].isEmpty())
+                    continue;
+
+                // special case: mac-address has multiple ':' chars leading to unintended string splits
+                if (valuePair[0].equalsIgnoreCase ("mac-addr"))
+                    valuePair.set (1, line.fromFirstOccurrenceOf ("mac-addr: ", false, true));
 
-                    // special case: mac-address has multiple ':' chars leading to unintended string splits
-                    if (valuePair[0].equalsIgnoreCase ("mac-addr"))
-                        valuePair.set (1, line.fromFirstOccurrenceOf ("mac-addr: ", false, true));
+                // remove whitespaces from value
+                valuePair.set (1, valuePair[1].trimStart());
+
+                if (level == device)
+                {
+                    juce::ValueTree deviceTree (valuePair[1].replaceCharacter (' ', '_').removeCharacters ("/"));
 
-                    // remove whitespaces from value
-                    valuePair.set (1, valuePair[1].trimStart());
+                    // sometimes the ip address is not in the parsed output, so better set it here
+                    deviceTree.setProperty (propertyIPAddress, address, nullptr);
 
-                    if (level == device)
+                    treeHistory.getLast().addChild (deviceTree, -1, nullptr);
+                    treeHistory.add (deviceTree);
+                    lastLevel = mboard;
+                    continue;
+                }
+                else
+                {
+                    if (level > lastLevel)
                     {
-                        juce::ValueTree deviceTree (valuePair[1].replaceCharacter (' ', '_').removeCharacters ("/"));
+                        auto newLeaf = treeHistory.getLast().getOrCreateChildWithName (valuePair[0].replaceCharacter (' ', '_'), nullptr);
 
-                        // sometimes the ip address is not in the parsed output, so better set it here
-                        deviceTree.setProperty (propertyIPAddress, a, nullptr);
+                        // check if the second argument starts with a number. Add a _ to create a valid xml version
+                        auto cp = valuePair[1].getCharPointer();
+                        if ((*cp >= '0') && (*cp <= '9'))
+                            valuePair.set (1, '_' + valuePair[1]);
 
-                        treeHistory.getLast().addChild (deviceTree, -1, nullptr);
-                        treeHistory.add (deviceTree);
-                        lastLevel = mboard;
-                        continue;
+                        treeHistory.add (newLeaf.getOrCreateChildWithName (valuePair[1].replaceCharacter (' ', '_'), nullptr));
                     }
                     else
                     {
-                        if (level > lastLevel)
-                        {
-                            auto newLeaf = treeHistory.getLast().getOrCreateChildWithName (valuePair[0].replaceCharacter (' ', '_'), nullptr);
-
-                            // check if the second argument starts with a number. Add a _ to create a valid xml version
-                            auto cp = valuePair[1].getCharPointer();
-                            if ((*cp >= '0') && (*cp <= '9'))
-                                valuePair.set (1, '_' + valuePair[1]);
-
-                            treeHistory.add (newLeaf.getOrCreateChildWithName (valuePair[1].replaceCharacter (' ', '_'), nullptr));
-                        }
-                        else
+                        // check if it's a range.
+                        if (valuePair[1].contains (" to "))
                         {
-                            // check if it's a range.
-                            if (valuePair[1].contains (" to "))
+                            juce::String lowerLimit = valuePair[1].upToFirstOccurrenceOf (" to ", false, false);
+                            juce::String remainigPart = valuePair[1].fromFirstOccurrenceOf (" to ", false, false);
+                            juce::String upperLimit, step;
+                            if (remainigPart.contains (" step "))
                             {
-                                juce::String lowerLimit = valuePair[1].upToFirstOccurrenceOf (" to ", false, false);
-                                juce::String remainigPart = valuePair[1].fromFirstOccurrenceOf (" to ", false, false);
-                                juce::String upperLimit, step;
-                                if (remainigPart.contains (" step "))
-                                {
-                                    upperLimit   = remainigPart.upToFirstOccurrenceOf (" step ", false, false);
-                                    remainigPart = remainigPart.fromFirstOccurrenceOf (" step ", false, false);
-                                    step = remainigPart.upToFirstOccurrenceOf (" ", false, false);
-                                }
-                                else
-                                    upperLimit = remainigPart.upToFirstOccurrenceOf (" ", false, false);
-
-                                const double lowerLimitDouble = lowerLimit.getDoubleValue();
-                                const double upperLimitDouble = upperLimit.getDoubleValue();
-
-                                // the current limit is unknown at this point. Only exception: There is no choice ;)
-                                double currentValue = std::numeric_limits<double>::quiet_NaN();
-                                if (lowerLimit == upperLimit)
-                                    currentValue = upperLimitDouble;
-
-                                juce::String unit = remainigPart.fromFirstOccurrenceOf (" ", false, false);
-                                double stepWidth = 0.0;
-                                if (step.isNotEmpty())
-                                    stepWidth = step.getDoubleValue();
-
-                                double unitScaling = 1.0;
-                                if (unit.startsWithChar ('k'))
-                                    unitScaling = 1e3;
-                                else if (unit.startsWithChar ('M'))
-                                    unitScaling = 1e6;
-                                else if (unit.startsWithChar ('G'))
-                                    unitScaling = 1e9;
-
-                                juce::ValueTree range (valuePair[0].replaceCharacter (' ', '_'), {{propertyMin, lowerLimitDouble},
-                                                                                                  {propertyMax, upperLimitDouble},
-                                                                                                  {propertyStepWidth, stepWidth},
-                                                                                                  {propertyUnit, unit},
-                                                                                                  {propertyUnitScaling, unitScaling},
-                                                                                                  {propertyCurrentValue, currentValue}});
-
-                                treeHistory.getLast().addChild (range, -1, nullptr);
-                            }
-                            else if (valuePair[1].contains (","))
-                            {
-                                juce::ValueTree array (valuePair[0].replaceCharacter (' ', '_'), {{propertyArray, valuePair[1]},
-                                                                                                  {propertyCurrentValue, std::numeric_limits<double>::quiet_NaN()}});
-                                treeHistory.getLast().addChild (array, -1, nullptr);
+                                upperLimit   = remainigPart.upToFirstOccurrenceOf (" step ", false, false);
+                                remainigPart = remainigPart.fromFirstOccurrenceOf (" step ", false, false);
+                                step = remainigPart.upToFirstOccurrenceOf (" ", false, false);
                             }
                             else
-                                treeHistory.getLast().setProperty (valuePair[0].replaceCharacter (' ', '_'), valuePair[1], nullptr);
+                                upperLimit = remainigPart.upToFirstOccurrenceOf (" ", false, false);
+
+                            const double lowerLimitDouble = lowerLimit.getDoubleValue();
+                            const double upperLimitDouble = upperLimit.getDoubleValue();
+
+                            // the current limit is unknown at this point. Only exception: There is no choice ;)
+                            double currentValue = std::numeric_limits<double>::quiet_NaN();
+                            if (lowerLimit == upperLimit)
+                                currentValue = upperLimitDouble;
+
+                            juce::String unit = remainigPart.fromFirstOccurrenceOf (" ", false, false);
+                            double stepWidth = 0.0;
+                            if (step.isNotEmpty())
+                                stepWidth = step.getDoubleValue();
+
+                            double unitScaling = 1.0;
+                            if (unit.startsWithChar ('k'))
+                                unitScaling = 1e3;
+                            else if (unit.startsWithChar ('M'))
+                                unitScaling = 1e6;
+                            else if (unit.startsWithChar ('G'))
+                                unitScaling = 1e9;
+
+                            juce::ValueTree range (valuePair[0].replaceCharacter (' ', '_'), {{propertyMin, lowerLimitDouble},
+                                                                                              {propertyMax, upperLimitDouble},
+                                                                                              {propertyStepWidth, stepWidth},
+                                                                                              {propertyUnit, unit},
+                                                                                              {propertyUnitScaling, unitScaling},
+                                                                                              {propertyCurrentValue, currentValue}});
+
+                            treeHistory.getLast().addChild (range, -1, nullptr);
                         }
-                        lastLevel = level;
+                        else if (valuePair[1].contains (","))
+                        {
+                            juce::ValueTree array (valuePair[0].replaceCharacter (' ', '_'), {{propertyArray, valuePair[1]},
+                                                                                              {propertyCurrentValue, std::numeric_limits<double>::quiet_NaN()}});
+                            treeHistory.getLast().addChild (array, -1, nullptr);
+                        }
+                        else
+                            treeHistory.getLast().setProperty (valuePair[0].replaceCharacter (' ', '_'), valuePair[1], nullptr);
                     }
+                    lastLevel = level;
                 }
             }
+        }
 
-            lastLevel = device;
-            treeHistory.clearQuick();
-            treeHistory.add (tree);
+        auto probedDevice = tree.getChild (0);
+        tree.removeChild (probedDevice, nullptr);
+
+        return probedDevice;
+    }
+
+    void UHDEngine::refreshDeviceTreeCache()
+    {
+        auto serials   = cachedDevicesToRefresh.getAllKeys();
+        auto addresses = cachedDevicesToRefresh.getAllValues();
+        bool cacheChanged = false;
+
+        for (int i = 0; (i < serials.size()) && !deviceTreeRefreshThread.threadShouldExit(); ++i)
+        {
+            auto device = probeDevice (addresses[i], 0);
+
+            if (device.isValid())
+            {
+                deviceTreeCache->setDeviceTree (serials[i], addresses[i], device);
+                cacheChanged = true;
+            }
         }
-#if NTLAB_DEBUGPRINT_UHDTREE
-        std::cout << "Parsed UHD tree:\n\n" << tree.toXmlString() << std::endl;
-#endif
 
-        return tree;
+        if (cacheChanged)
+            deviceTreeCache->save();
+    }
+
+    void UHDEngine::stopDeviceTreeRefresh()
+    {
+        deviceTreeRefreshThread.signalThreadShouldExit();
+
+        {
+            const juce::ScopedLock scopedLock (runningProbeLock);
+            if (runningProbe != nullptr)
+                runningProbe->kill();
+        }
+
+        deviceTreeRefreshThread.stopThread (2000);
     }
 
     juce::IPAddress UHDEngine::getIPAddressForMboard (int mboardIdx)
@@ -1926,5 +2903,239 @@ namespace ntlab
         return new UHDEngine (uhdr);
     }
 
+#if defined (NTLAB_SOFTWARE_DEFINED_RADIO_UNIT_TESTS) && ! JUCE_WINDOWS
+
+    class UHDEngineUnitTest : public juce::UnitTest
+    {
+    public:
+        UHDEngineUnitTest() : juce::UnitTest ("UHDEngine test") {};
+
+        void runTest() override
+        {
+            // These tests need a device, they run against the mock UHD library found in DevelopmentHelpers/MockUHD
+            juce::DynamicLibrary uhdLib;
+            if (!uhdLib.open (UHDr::uhdLibName) || (uhdLib.getFunction ("ntlab_mock_uhd_is_loaded") == nullptr))
+            {
+                logMessage ("Skipping UHDEngine tests, the mock UHD library is not present on this system");
+                return;
+            }
+
+            juce::String loadingError;
+            auto uhdr = UHDr::load (UHDr::uhdLibName, loadingError);
+            expect (uhdr != nullptr, loadingError);
+            if (uhdr == nullptr)
+                return;
+
+            testRxBlockTimestamps (*uhdr);
+            testConcurrentCallsOnOneUSRP (*uhdr);
+        }
+
+    private:
+        /** Sets environment variables for the lifetime of this object, the mock reads them when a USRP is made */
+        struct ScopedEnvironment
+        {
+            ScopedEnvironment (std::initializer_list<std::pair<const char*, const char*>> variablesToSet)
+            {
+                for (auto& variable : variablesToSet)
+                {
+                    auto* previousValue = std::getenv (variable.first);
+                    previousValues.emplace_back (variable.first, previousValue != nullptr ? std::string (previousValue) : std::string(), previousValue != nullptr);
+                    setenv (variable.first, variable.second, 1);
+                }
+            }
+
+            ~ScopedEnvironment()
+            {
+                for (auto& variable : previousValues)
+                {
+                    if (std::get<2> (variable))
+                        setenv (std::get<0> (variable), std::get<1> (variable).c_str(), 1);
+                    else
+                        unsetenv (std::get<0> (variable));
+                }
+            }
+
+            std::vector<std::tuple<const char*, std::string, bool>> previousValues;
+        };
+
+        void testRxBlockTimestamps (UHDr& uhdr)
+        {
+            beginTest ("Rx block timestamps count overflows and mark timed retunes");
+
+            const double sampleRate = 1e6;
+            const int blockSize = 1000;
+            const int overflowInterval = 4;
+            const int numSamplesPerOverflow = 1000;
+            // The samples lost by an overflow are detected with the next block, so the last call must not be an overflow
+            const int numReceiveCalls = 41;
+
+            // Each fourth receive call reports an overflow that drops a fixed number of samples
+            ScopedEnvironment environment ({ { "NTLAB_MOCK_UHD_REALTIME",               "0" },
+                                             { "NTLAB_MOCK_UHD_OVERFLOW_EVERY_N_RECVS", "4" },
+                                             { "NTLAB_MOCK_UHD_OVERFLOW_NUM_SAMPLES",   "1000" } });
+
+            juce::StringPairArray args;
+            args.set ("addr", "192.168.10.2");
+
+            UHDr::Error error;
+            auto usrp = uhdr.makeUSRP (args, error);
+            expect (!error, UHDr::errorDescription (error));
+            if (usrp == nullptr)
+                return;
+
+            expect (usrp->setRxSampleRate (sampleRate, 0).wasOk());
+
+            size_t channelList[] = { 0 };
+            UHDr::StreamArgs streamArgs;
+            streamArgs.numChannels = 1;
+            streamArgs.channelList = channelList;
+            streamArgs.cpuFormat   = const_cast<char*> ("fc32");
+            streamArgs.otwFormat   = const_cast<char*> ("sc16");
+            streamArgs.args        = const_cast<char*> ("");
+
+            std::unique_ptr<UHDr::USRP::RxStream> rxStream (usrp->makeRxStream (streamArgs, error));
+            expect (!error, UHDr::errorDescription (error));
+            if (rxStream == nullptr)
+                return;
+
+            UHDr::StreamCmd streamCmd;
+            streamCmd.streamMode = UHDr::StreamMode::startContinuous;
+            streamCmd.numSamples = 0;
+            streamCmd.streamNow = true;
+            streamCmd.timeSpecFullSecs = 0;
+            streamCmd.timeSpecFracSecs = 0.0;
+            expect (rxStream->issueStreamCmd (streamCmd).wasOk());
+
+            std::atomic<double> pendingRetuneTime {-1.0};
+            UHDEngine::RxBlockTimestamper timestamper (sampleRate, 100e6, pendingRetuneTime);
+            SampleBufferComplex<float> buffer (1, blockSize);
+
+            const int retuneOffset = 250;
+            int64_t numSamplesSkipped = 0;
+            int numOverflows = 0;
+            bool retuneMarked = false;
+            bool retuneAfterOverflowMarked = false;
+
+            for (int i = 1; i <= numReceiveCalls; ++i)
+            {
+                auto numSamplesReceived = rxStream->receive (buffer.getArrayOfWritePointers(), blockSize, error, false, 1.0);
+                expect (!error, UHDr::errorDescription (error));
+
+                auto& timestamp = timestamper.update (*rxStream, numSamplesReceived);
+                expect (timestamp.hasTime);
+
+                if (i % overflowInterval == 0)
+                {
+                    expectEquals (numSamplesReceived, 0);
+                    ++numOverflows;
+                }
+                else
+                {
+                    expectEquals (numSamplesReceived, blockSize);
+                }
+
+                numSamplesSkipped += timestamper.getNumSamplesSkipped();
+
+                // The retune is expected in the next call, which is no overflow
+                if (i == overflowInterval + 1)
+                {
+                    pendingRetuneTime = timestamp.firstSampleSeconds + static_cast<double> (blockSize + retuneOffset) / sampleRate;
+                }
+                else if (i == overflowInterval + 2)
+                {
+                    expectEquals (timestamp.retuneSampleOffset, retuneOffset);
+                    expectEquals (pendingRetuneTime.load(), -1.0);
+                    retuneMarked = true;
+                }
+                // The next retune time lies within the samples of this call, so it is already over when the following
+                // overflow is reported
+                else if (i == 2 * overflowInterval - 1)
+                {
+                    expectEquals (timestamp.retuneSampleOffset, -1);
+                    pendingRetuneTime = timestamp.firstSampleSeconds + static_cast<double> (blockSize - retuneOffset) / sampleRate;
+                }
+                // The overflow has a time but no samples, the boundary has to be marked in the next block
+                else if (i == 2 * overflowInterval)
+                {
+                    expectEquals (timestamp.retuneSampleOffset, -1);
+                    expect (pendingRetuneTime.load() >= 0.0);
+                }
+                else if (i == 2 * overflowInterval + 1)
+                {
+                    expectEquals (timestamp.retuneSampleOffset, 0);
+                    expectEquals (pendingRetuneTime.load(), -1.0);
+                    retuneAfterOverflowMarked = true;
+                }
+                else
+                {
+                    expectEquals (timestamp.retuneSampleOffset, -1);
+                }
+            }
+
+            expect (retuneMarked);
+            expect (retuneAfterOverflowMarked);
+            expectEquals (numSamplesSkipped, static_cast<int64_t> (numOverflows) * numSamplesPerOverflow);
+        }
+
+        void testConcurrentCallsOnOneUSRP (UHDr& uhdr)
+        {
+            beginTest ("Concurrent calls on the motherboards of one USRP report their own errors");
+
+            ScopedEnvironment environment ({ { "NTLAB_MOCK_UHD_CALL_LATENCY_MS", "1" } });
+
+            juce::StringPairArray args;
+            args.set ("addr0", "192.168.10.2");
+            args.set ("addr1", "192.168.10.3");
+
+            UHDr::Error error;
+            auto usrp = uhdr.makeUSRP (args, error);
+            expect (!error, UHDr::errorDescription (error));
+            if (usrp == nullptr)
+                return;
+
+            expectEquals (usrp->getNumInputChannels(), 2);
+
+            // Like with UHD, each call clears the error string of the handle, so the read-out of a failed call must
+            // not interleave with the calls for the other motherboard
+            const double sampleRate = 1e6;
+            const int numCalls = 100;
+            std::atomic<int> numErrorsNotReported {0};
+            std::atomic<int> numUnexpectedFailures {0};
+
+            UHDEngine::StageThread failingThread ("Mboard 0 Test Thread", [&]()
+            {
+                for (int i = 0; i < numCalls; ++i)
+                {
+                    auto result = usrp->setRxSampleRate (-1.0, 0);
+                    if (result.wasOk() || !result.getErrorMessage().contains ("invalid sample rate"))
+                        ++numErrorsNotReported;
+                }
+            });
+
+            UHDEngine::StageThread succeedingThread ("Mboard 1 Test Thread", [&]()
+            {
+                for (int i = 0; i < numCalls; ++i)
+                {
+                    if (usrp->setRxSampleRate (sampleRate, 1).failed())
+                        ++numUnexpectedFailures;
+                }
+            });
+
+            failingThread.startThread();
+            succeedingThread.startThread();
+            failingThread.waitForThreadToExit (-1);
+            succeedingThread.waitForThreadToExit (-1);
+
+            expectEquals (numErrorsNotReported.load(), 0);
+            expectEquals (numUnexpectedFailures.load(), 0);
+            expectEquals (usrp->getRxSampleRate (1, error), sampleRate);
+            expect (!error, UHDr::errorDescription (error));
+        }
+    };
+
+    static UHDEngineUnitTest uhdEngineUnitTest;
+
+#endif // NTLAB_SOFTWARE_DEFINED_RADIO_UNIT_TESTS
+
 #endif //!JUCE_IOS
 }
@@ -19,9 +19,11 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 
 #include "../SDRIOEngine.h"
 #include "UHDReplacement.h"
+#include "UHDDeviceTreeCache.h"
 
 namespace ntlab
 {
+    class ChildProcess;
 
     class UHDEngine
 #if !JUCE_IOS
@@ -30,6 +32,9 @@ namespace ntlab
         friend class UHDEngineManager;
         friend class ChannelMapping;
         friend class UHDEngineConfigurationComponent;
+#ifdef NTLAB_SOFTWARE_DEFINED_RADIO_UNIT_TESTS
+        friend class UHDEngineUnitTest;
+#endif
 #else
     {
 #endif
@@ -84,6 +89,57 @@ namespace ntlab
             twoDevicesMIMOCableMasterSlave = 2
         };
 
+        /**
+         * The sample formats UHD supports for the host memory (cpu format) and the transport between device and
+         * host (over-the-wire format). Using sc16 or sc8 as cpu format halves or quarters the amount of memory that
+         * has to be touched in the streaming thread. The samples are then converted to the float buffers passed to
+         * the callback by the engine, which is faster than the generic conversion UHD does internally.
+         */
+        enum StreamFormat
+        {
+            /** Complex 32 bit float samples, can only be used as cpu format */
+            fc32 = 0,
+
+            /** Complex 16 bit integer samples */
+            sc16 = 1,
+
+            /** Complex 8 bit integer samples */
+            sc8 = 2
+        };
+
+        /**
+         * Counts the problems the device reported while streaming. The counters are reset when streaming starts. The
+         * numbers of dropped rx samples are estimated from the gaps in the rx timestamps, so they are only known if
+         * the device delivers timestamps. UHD doesn't report how long a tx underflow lasted, so only the number of
+         * underflows is counted for tx.
+         */
+        struct StreamingStats
+        {
+            /** The host didn't receive fast enough and the device had to drop samples */
+            int64_t numRxOverflows = 0;
+
+            /** Rx packets got lost between device and host */
+            int64_t numRxSequenceErrors = 0;
+
+            /** A stream command arrived at the device after the time it should have been executed */
+            int64_t numRxLateCommands = 0;
+
+            /** The estimated number of rx samples lost through overflows and sequence errors */
+            int64_t numRxSamplesDropped = 0;
+
+            /** Rx samples received but discarded because the rx queue was full, @see setQueueDepth */
+            int64_t numRxSamplesDiscarded = 0;
+
+            /** The host didn't send fast enough and the device ran out of tx samples */
+            int64_t numTxUnderflows = 0;
+
+            /** Tx packets got lost between host and device */
+            int64_t numTxSequenceErrors = 0;
+
+            /** A timed tx burst arrived at the device after its start time */
+            int64_t numTxLateBursts = 0;
+        };
+
         static const juce::Identifier propertyUSRPDevice;
         static const juce::Identifier propertyUSRPDeviceConfig;
         static const juce::Identifier propertyMBoards;
@@ -115,6 +171,9 @@ namespace ntlab
         static const juce::Identifier propertyAntennas;
         static const juce::Identifier propertySyncSetup;
         static const juce::Identifier propertySampleRate;
+        static const juce::Identifier propertyCpuFormat;
+        static const juce::Identifier propertyOtwFormat;
+        static const juce::Identifier propertyQueueDepth;
 
 #if JUCE_IOS
     };
@@ -154,12 +213,100 @@ namespace ntlab
          */
         juce::Result setupTxChannels (const juce::Array<ChannelSetup>& channelSetup);
 
+        /**
+         * Sets the sample format used in host memory and the one used for the transport from and to the device. The
+         * default is fc32 on the host and sc16 over the wire. Rx and tx streams that have already been set up are
+         * recreated with the new format. An sc8 cpu format requires sc8 over the wire and fc32 can't be used over the
+         * wire. This must not be called while streaming.
+         */
+        juce::Result setStreamFormat (StreamFormat cpuFormat, StreamFormat otwFormat = sc16);
+
+        /** Returns the sample format currently used in host memory */
+        StreamFormat getCpuFormat() const { return cpuFormat; }
+
+        /** Returns the sample format currently used for the transport from and to the device */
+        StreamFormat getOtwFormat() const { return otwFormat; }
+
+        /**
+         * Sets the number of sample blocks that can be queued between the hardware and the callback. With a queue
+         * depth of 0, which is the default, receiving, processing and sending happen one after another on a single
+         * thread, so any processing jitter directly leads to rx overflows. With a queue depth greater than 0,
+         * receiving, processing and sending run on three separate threads connected by queues of that many
+         * preallocated blocks. The processing may then lag behind the hardware by up to numBlocks blocks before rx
+         * samples are dropped, which adds up to that many blocks of latency. Not available if NTLAB_FORCED_BLOCKSIZE
+         * is defined. This must not be called while streaming.
+         */
+        bool setQueueDepth (int numBlocks);
+
+        /** Returns the number of sample blocks that can be queued between the hardware and the callback */
+        int getQueueDepth() const { return queueDepth; }
+
+        /**
+         * Schedules a burst of tx samples that starts exactly at the device time passed in seconds, e.g. a time derived
+         * from the RxBlockTimestamp passed to processTimestampedRFSampleBlock. The samples are copied and converted
+         * to the cpu format, so this is not realtime safe and should not be called from the processing callback. The
+         * burst is handed to the device by the streaming threads as soon as possible, so the start time should be
+         * far enough in the future. As UHD can't interleave a timed burst with a running burst, bursts can only be
+         * scheduled while tx channels are set up but continuous tx is disabled. In both streaming modes, the bursts
+         * are sent from a thread of their own, so a long burst never delays receiving. Bursts that have not been
+         * sent when streaming stops are discarded. Returns false if the burst can't be scheduled.
+         */
+        bool scheduleTxBurst (const SampleBufferComplex<float>& samples, double startTimeInSeconds);
+
+        /**
+         * Returns the overflows, underflows and other streaming problems counted since streaming was started. This
+         * can be polled from any thread while streaming. Each problem is also reported to the callback through
+         * handleError, sample drops as SampleDropError.
+         */
+        StreamingStats getStreamingStats() const;
+
+        /**
+         * Returns the current time of the devices in seconds, which is the time base for timed tx bursts and timed
+         * retuning. This needs a round trip to the device, so while streaming better derive the time from the
+         * RxBlockTimestamp passed to processTimestampedRFSampleBlock. Returns -1 in case of an error.
+         */
+        double getDeviceTime();
+
+        /**
+         * Retunes one or all rx channels at the device time passed instead of as soon as possible. The tune commands
+         * are timed on all motherboards involved, so in a multi USRP setup all channels retune at the same sample and
+         * keep their phase relationship. The time should be far enough in the future for the commands to reach the
+         * devices, a few ten milliseconds are usually enough for networked devices. The first rx sample received
+         * after the retune is marked through RxBlockTimestamp::retuneSampleOffset. If this is called from the
+         * callback, the commands are issued from a separate thread, so this is not realtime safe.
+         */
+        bool setRxCenterFrequencyAt (double newCenterFrequency, double tuneTimeInSeconds, int channel = allChannels);
+
+        /**
+         * Retunes one or all tx channels at the device time passed instead of as soon as possible. Pass the same time
+         * as for setRxCenterFrequencyAt to retune rx and tx at once. @see setRxCenterFrequencyAt
+         */
+        bool setTxCenterFrequencyAt (double newCenterFrequency, double tuneTimeInSeconds, int channel = allChannels);
+
         bool setSampleRate (double newSampleRate) override;
 
         double getSampleRate() override;
 
+        /**
+         * Builds the tree of all devices found. Probing a device takes seconds for networked devices, so if a cache
+         * file has been set, the subtrees of all devices probed are stored in a cache keyed by the device serials. A device that is found with the
+         * same serial at the same address again is taken from the cache and probed in the background afterwards to
+         * keep the cache up to date for the next call. As probing a device that is in use would disturb it, the
+         * background refresh is stopped as soon as makeUSRP is called.
+         */
         juce::ValueTree getDeviceTree() override;
 
+        /**
+         * Sets the file the device tree cache is stored in. No cache is used by default, so that the engine doesn't
+         * write any files the application didn't ask for and getDeviceTree probes all devices each time it is called.
+         * Pass getDefaultDeviceTreeCacheFile to use a location shared by all applications or juce::File() to disable
+         * the cache again.
+         */
+        void setDeviceTreeCacheFile (const juce::File& cacheFile);
+
+        /** Returns a suggested location for the device tree cache file, which is shared by all applications */
+        static juce::File getDefaultDeviceTreeCacheFile();
+
         juce::ValueTree getActiveConfig() override;
 
         juce::Result setConfig (juce::ValueTree& configToSet) override;
@@ -304,6 +451,101 @@ namespace ntlab
             static const char emptyGainElementString[1];
         };
 
+        // Holds the samples in the cpu format of the streams and converts them from and to the float buffers passed to
+        // the callback. If the cpu format is fc32, the streams work on the float buffers directly.
+        class HostFormatStagingBuffer
+        {
+        public:
+            HostFormatStagingBuffer (StreamFormat cpuFormat, int numChannels, int numSamples);
+
+            // Returns the buffer pointers to pass to the stream, which are the float buffers passed if no conversion is needed
+            UHDr::BuffsPtr getStreamBuffers (std::complex<float>** floatBuffers);
+
+            void convertToFloat (std::complex<float>** floatBuffers, int numSamples);
+
+            void convertFromFloat (std::complex<float>** floatBuffers, int numSamples);
+
+        private:
+            const StreamFormat cpuFormat;
+            const int numChannels;
+            SampleBufferComplex<int16_t> sc16Samples;
+            SampleBufferComplex<int8_t>  sc8Samples;
+        };
+
+        // Derives the timestamps of the received blocks from the rx metadata
+        class RxBlockTimestamper
+        {
+        public:
+            RxBlockTimestamper (double sampleRate, double tickRate, std::atomic<double>& pendingRetuneTime);
+
+            // Must be called after each receive call, also if the samples received are discarded
+            const RxBlockTimestamp& update (UHDr::USRP::RxStream& rxStream, int numSamplesReceived);
+
+            // Returns the number of samples the device skipped between the last two receive calls
+            int64_t getNumSamplesSkipped() const { return numSamplesSkipped; }
+
+            // Returns true if the device delivered a timestamp at least once
+            bool deliversTimes() const { return hasTimeOfFirstSample; }
+
+        private:
+            const double sampleRate;
+            RxBlockTimestamp timestamp;
+            int64_t numSamplesSkipped = 0;
+
+            // The time of a timed rx retune that didn't take effect yet or -1
+            std::atomic<double>& pendingRetuneTime;
+
+            bool hasTimeOfFirstSample = false;
+            time_t firstSampleFullSecs = 0;
+            double firstSampleFracSecs = 0.0;
+            int64_t nextSampleIndex = 0;
+        };
+
+        // A block passed through the rx queue, the timestamp belongs to the samples of the block
+        struct TimestampedRxBlock
+        {
+            std::unique_ptr<OptionalCLSampleBufferComplexFloat> samples;
+            RxBlockTimestamp timestamp;
+        };
+
+        // A tx burst scheduled through scheduleTxBurst, already converted to the cpu format
+        struct ScheduledTxBurst
+        {
+            ScheduledTxBurst (const SampleBufferComplex<float>& samplesToSend, double startTime, StreamFormat cpuFormat);
+
+            SampleBufferComplex<float> samples;
+            HostFormatStagingBuffer stagingBuffer;
+            const double startTimeInSeconds;
+        };
+
+        // Written by the streaming threads and read by getStreamingStats from any other thread
+        struct StreamingStatsCounters
+        {
+            std::atomic<int64_t> numRxOverflows        {0};
+            std::atomic<int64_t> numRxSequenceErrors   {0};
+            std::atomic<int64_t> numRxLateCommands     {0};
+            std::atomic<int64_t> numRxSamplesDropped   {0};
+            std::atomic<int64_t> numRxSamplesDiscarded {0};
+            std::atomic<int64_t> numTxUnderflows       {0};
+            std::atomic<int64_t> numTxSequenceErrors   {0};
+            std::atomic<int64_t> numTxLateBursts       {0};
+
+            void reset();
+        };
+
+        // Runs one of the stages of the queued streaming or another task on its own thread
+        class StageThread : public juce::Thread
+        {
+        public:
+            StageThread (const juce::String& threadName, std::function<void()> stageToRun)
+              : juce::Thread (threadName), stage (std::move (stageToRun)) {}
+
+            void run() override { stage(); }
+
+        private:
+            std::function<void()> stage;
+        };
+
         SDRIODeviceCallback* activeCallback = nullptr;
 
         std::streambuf* previousClogStreambuf;
@@ -321,6 +563,13 @@ namespace ntlab
         juce::StringArray deviceTypesInDeviceTree;
         juce::Array<std::reference_wrapper<juce::var>> mboardsInDeviceTree;
 
+        // Devices taken from the cache are probed again in the background, keys are serials and values addresses
+        std::unique_ptr<UHDDeviceTreeCache> deviceTreeCache;
+        juce::StringPairArray cachedDevicesToRefresh;
+        StageThread deviceTreeRefreshThread;
+        juce::CriticalSection runningProbeLock;
+        ChildProcess* runningProbe = nullptr;
+
         UHDr::USRP::Ptr usrp;
         int numMboardsInUSRP = 0;
         juce::Array<int> devicesInUSRP; // indexes referring to the device tree arrays above
@@ -336,18 +585,70 @@ namespace ntlab
         bool txEnabled = false;
 
         int desiredBlockSize = 1024;
+        int queueDepth = 0;
+
+        StreamFormat cpuFormat = fc32;
+        StreamFormat otwFormat = sc16;
+
+        // Sent bursts are only deleted when the next burst is scheduled to keep deallocations off the streaming threads
+        juce::CriticalSection scheduledTxBurstsLock;
+        juce::OwnedArray<ScheduledTxBurst> scheduledTxBursts;
+        juce::OwnedArray<ScheduledTxBurst> sentTxBursts;
+        juce::WaitableEvent txBurstScheduled;
+
+        // Rx and tx problems are detected on different threads in the queued mode, so each direction has its own error
+        StreamingStatsCounters streamingStatsCounters;
+        SampleDropError rxSampleDropError;
+        SampleDropError txSampleDropError;
+
+        std::atomic<double> pendingRxRetuneTime {-1.0};
 
-        // default streaming args
-        static const juce::String defaultCpuFormat;
-        //static const juce::String defaultOtwFormat;
         static const juce::String emptyArg;
 
         juce::String lastError;
 
+        juce::Result createRxStream();
+        juce::Result createTxStream();
+
+        static const char* getFormatName (StreamFormat format);
+        static bool getFormatFromName (const juce::String& name, StreamFormat& format);
+
+        std::unique_ptr<OptionalCLSampleBufferComplexFloat> createStreamBuffer (int numChannels, int numSamples, bool isRxBuffer);
+
+        // Receives on the engine thread while the callback and tx are served by stage threads until the engine thread should exit
+        juce::Result streamThroughQueues (HostFormatStagingBuffer& rxStagingBuffer, HostFormatStagingBuffer& txStagingBuffer, RxBlockTimestamper& rxTimestamper, int numRxChannels, int numTxChannels, int blockSize);
+
+        // Calls configureMboard with the buffer channels of each motherboard used by the channel mapping. With more than
+        // one motherboard, the calls run concurrently on one thread per motherboard. The errors of all motherboards are
+        // combined into the result returned. All threads share the one USRP handle, see UHDr::USRP::getLastUSRPError
+        // for which calls are safe to issue from configureMboard.
+        juce::Result configureMboardsConcurrently (const ChannelMapping& channelMapping, const std::function<juce::Result (const juce::Array<int>& bufferChannels)>& configureMboard);
+
+        // Runs the commands with the command time of all motherboards used by the channel passed set to the time passed
+        bool runTimedCommands (const ChannelMapping& channelMapping, int channel, double timeInSeconds, const std::function<bool()>& commands);
+
+        // Sends all scheduled tx bursts, returns immediately if scheduleTxBurst is currently adding a burst
+        void sendScheduledTxBursts();
+
+        // Evaluates the rx metadata of the last receive call, updates the stats and reports sample drops to the callback
+        void checkRxMetadata (const RxBlockTimestamper& rxTimestamper);
+
+        // Polls the async events of the tx stream, updates the stats and reports them to the callback
+        void checkTxAsyncEvents();
+
         void run() override;
 
         juce::ValueTree getUHDTree();
 
+        // Returns the subtree of the device at the address passed, named with the device index passed
+        juce::ValueTree probeDevice (const juce::String& address, int deviceIdx);
+
+        // Probes all cached devices listed in cachedDevicesToRefresh and saves the updated cache
+        void refreshDeviceTreeCache();
+
+        // Stops the background refresh and kills a probe that might be running
+        void stopDeviceTreeRefresh();
+
         juce::IPAddress getIPAddressForMboard (int mboardIdx);
     };
 
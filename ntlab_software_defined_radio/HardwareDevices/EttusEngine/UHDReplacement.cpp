@@ -255,6 +255,9 @@ namespace ntlab
             NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, setTimeSource,            "uhd_usrp_set_time_source")
             NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, setTimeUnknownPPS,        "uhd_usrp_set_time_unknown_pps")
             NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, setTimeNow,               "uhd_usrp_set_time_now")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, getTimeNow,               "uhd_usrp_get_time_now")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, setCommandTime,           "uhd_usrp_set_command_time")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, clearCommandTime,         "uhd_usrp_clear_command_time")
             NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, getRxStream,              "uhd_usrp_get_rx_stream")
             NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, getTxStream,              "uhd_usrp_get_tx_stream")
             NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, getRxStreamMaxNumSamples, "uhd_rx_streamer_max_num_samps")
@@ -263,6 +266,14 @@ namespace ntlab
             NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, rxStreamerReceive,        "uhd_rx_streamer_recv")
             NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, txStreamerSend,           "uhd_tx_streamer_send")
             NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, getRxMetadataErrorCode,   "uhd_rx_metadata_error_code")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, getRxMetadataHasTimeSpec, "uhd_rx_metadata_has_time_spec")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, getRxMetadataTimeSpec,    "uhd_rx_metadata_time_spec")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, getRxMetadataOutOfSequence, "uhd_rx_metadata_out_of_sequence")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, asyncMetadataMake,        "uhd_async_metadata_make")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, asyncMetadataFree,        "uhd_async_metadata_free")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, asyncMetadataEventCode,   "uhd_async_metadata_event_code")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, txStreamerRecvAsyncMsg,   "uhd_tx_streamer_recv_async_msg")
+            NTLAB_LOAD_FUNCTION_AND_CHECK_FOR_SUCCESS (u, getMasterClockRate,       "uhd_usrp_get_master_clock_rate")
 
             // if the code reached this point, all functions were successully loaded. The object may now be used safely
             result = "Successfully loaded library " + library;
@@ -336,6 +347,9 @@ namespace ntlab
     {
         jassert (juce::isPositiveAndNotGreaterThan (channelIdx, numInputChannels));
 
+        // The error description reads the lastError string, which the next call on this handle would overwrite
+        const juce::ScopedLock scopedLock (lastErrorLock);
+
         Error error = uhd->setRxSampleRate (usrpHandle, newSampleRate, static_cast<size_t >(channelIdx));
         NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR (error);
 
@@ -346,6 +360,9 @@ namespace ntlab
     {
         jassert (juce::isPositiveAndNotGreaterThan (channelIdx, numOutputChannels));
 
+        // The error description reads the lastError string, which the next call on this handle would overwrite
+        const juce::ScopedLock scopedLock (lastErrorLock);
+
         Error error = uhd->setTxSampleRate (usrpHandle, newSampleRate, static_cast<size_t >(channelIdx));
         NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR (error);
 
@@ -361,6 +378,15 @@ namespace ntlab
         NTLAB_RETURN_MINUS_ONE_AND_PRINT_ERROR_DBG_IF_FAILED_RETURN_VALUE_OTHERWISE (error, sampleRate);
     }
 
+    double UHDr::USRP::getMasterClockRate (int mboardIdx, ntlab::UHDr::Error& error)
+    {
+        jassert (juce::isPositiveAndNotGreaterThan (mboardIdx, numMboards));
+
+        double clockRate;
+        error = uhd->getMasterClockRate (usrpHandle, static_cast<size_t> (mboardIdx), &clockRate);
+        NTLAB_RETURN_MINUS_ONE_AND_PRINT_ERROR_DBG_IF_FAILED_RETURN_VALUE_OTHERWISE (error, clockRate);
+    }
+
     juce::Array<double> UHDr::USRP::getRxSampleRates (ntlab::UHDr::Error& error)
     {
         juce::Array<double> sampleRates;
@@ -771,6 +797,38 @@ namespace ntlab
         return juce::Result::ok();
     }
 
+    double UHDr::USRP::getTimeNow (int mboardIdx, ntlab::UHDr::Error& error)
+    {
+        jassert (juce::isPositiveAndNotGreaterThan (mboardIdx, numMboards));
+
+        time_t fullSecs = 0;
+        double fracSecs = 0.0;
+        error = uhd->getTimeNow (usrpHandle, static_cast<size_t> (mboardIdx), &fullSecs, &fracSecs);
+
+        double timeNow = static_cast<double> (fullSecs) + fracSecs;
+        NTLAB_RETURN_MINUS_ONE_AND_PRINT_ERROR_DBG_IF_FAILED_RETURN_VALUE_OTHERWISE (error, timeNow);
+    }
+
+    juce::Result UHDr::USRP::setCommandTime (time_t fullSecs, double fracSecs, int mboardIdx)
+    {
+        jassert (juce::isPositiveAndNotGreaterThan (mboardIdx, numMboards));
+
+        Error error = uhd->setCommandTime (usrpHandle, fullSecs, fracSecs, static_cast<size_t> (mboardIdx));
+        NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR (error);
+
+        return juce::Result::ok();
+    }
+
+    juce::Result UHDr::USRP::clearCommandTime (int mboardIdx)
+    {
+        jassert (juce::isPositiveAndNotGreaterThan (mboardIdx, numMboards));
+
+        Error error = uhd->clearCommandTime (usrpHandle, static_cast<size_t> (mboardIdx));
+        NTLAB_RETURN_FAIL_WITH_ERROR_CODE_DESCRIPTION_IN_CASE_OF_ERROR (error);
+
+        return juce::Result::ok();
+    }
+
     const int UHDr::USRP::getNumInputChannels ()
     {
         return numInputChannels;
@@ -786,13 +844,15 @@ namespace ntlab
         return numMboards;
     }
 
-    const std::string& UHDr::USRP::getLastUSRPError ()
+    std::string UHDr::USRP::getLastUSRPError ()
     {
 	    if (usrpHandle != nullptr)
+        {
+            const juce::ScopedLock scopedLock (lastErrorLock);
             return usrpHandle->lastError;
+        }
 
-	    static const std::string noUSRP ("Can't display last USRP error - no USRP was created");
-        return noUSRP;
+	    return "Can't display last USRP error - no USRP was created";
     }
     UHDr::USRP::RxStream::~RxStream ()
     {
@@ -834,6 +894,24 @@ namespace ntlab
         return lastRxMetadataError;
     }
 
+    bool UHDr::USRP::RxStream::getLastRxTimeSpec (time_t& fullSecs, double& fracSecs, ntlab::UHDr::Error& error)
+    {
+        bool hasTimeSpec = false;
+        error = uhd->getRxMetadataHasTimeSpec (rxMetadataHandle, &hasTimeSpec);
+        if (error || !hasTimeSpec)
+            return false;
+
+        error = uhd->getRxMetadataTimeSpec (rxMetadataHandle, &fullSecs, &fracSecs);
+        return error == Error::errorNone;
+    }
+
+    bool UHDr::USRP::RxStream::wasLastRxOutOfSequence (ntlab::UHDr::Error& error)
+    {
+        bool outOfSequence = false;
+        error = uhd->getRxMetadataOutOfSequence (rxMetadataHandle, &outOfSequence);
+        return outOfSequence;
+    }
+
     UHDr::USRP::RxStream::RxStream (ntlab::UHDr::Ptr uhdr, ntlab::UHDr::USRPHandle& usrpHandle, ntlab::UHDr::StreamArgs& streamArgs, ntlab::UHDr::Error& error) : uhd (uhdr)
     {
         errorDescription = [usrpHandle](Error error) {return UHDr::errorDescription (error) + " (" + usrpHandle->lastError + ")"; };
@@ -883,6 +961,9 @@ namespace ntlab
         if (txMetadataEndOfBurst != nullptr)
             uhd->txMetadataFree (&txMetadataEndOfBurst);
 
+        if (asyncMetadataHandle != nullptr)
+            uhd->asyncMetadataFree (&asyncMetadataHandle);
+
         if (txStreamerHandle != nullptr)
             uhd->txStreamerFree (&txStreamerHandle);
     }
@@ -909,6 +990,64 @@ namespace ntlab
         return static_cast<int> (numSamplesSent);
     }
 
+    int UHDr::USRP::TxStream::sendBurst (UHDr::BuffsPtr buffsPtr, int numSamples, time_t fullSecs, double fracSecs, UHDr::Error& error, double timeoutInSeconds)
+    {
+        // a continuous burst started by send has to be ended before the timed burst can start
+        if (txMetadataHandle == txMetadataContinous)
+        {
+            error = sendEndOfBurst();
+            NTLAB_PRINT_ERROR_TO_DBG_AND_INVOKE_ACTIONS (error, return 0;)
+        }
+
+        const bool hasTimeSpec = true;
+        const bool startOfBurst = true;
+        const bool endOfBurst = false;
+
+        TxMetadataHandle txMetadataTimedStartOfBurst = nullptr;
+        error = uhd->txMetadataMake (&txMetadataTimedStartOfBurst, hasTimeSpec, fullSecs, fracSecs, startOfBurst, endOfBurst);
+        NTLAB_PRINT_ERROR_TO_DBG_AND_INVOKE_ACTIONS (error, return 0;)
+
+        auto samplePtrs = reinterpret_cast<char**> (buffsPtr);
+        size_t numSamplesSent = 0;
+        txMetadataHandle = txMetadataTimedStartOfBurst;
+
+        while (numSamplesSent < static_cast<size_t> (numSamples))
+        {
+            for (int c = 0; c < numActiveChannels; ++c)
+                burstBuffsPtrs[static_cast<size_t> (c)] = samplePtrs[c] + numSamplesSent * bytesPerSample;
+
+            size_t numSamplesSentThisPacket;
+            const auto numSamplesThisPacket = std::min (maxNumSamples, static_cast<size_t> (numSamples) - numSamplesSent);
+            error = uhd->txStreamerSend (txStreamerHandle, reinterpret_cast<BuffsPtr> (burstBuffsPtrs.data()), numSamplesThisPacket, &txMetadataHandle, timeoutInSeconds, &numSamplesSentThisPacket);
+
+            // only the first packet carries the start of burst flag and the time
+            txMetadataHandle = txMetadataContinous;
+
+            if (error || (numSamplesSentThisPacket == 0))
+                break;
+
+            numSamplesSent += numSamplesSentThisPacket;
+        }
+
+        uhd->txMetadataFree (&txMetadataTimedStartOfBurst);
+        NTLAB_PRINT_ERROR_TO_DBG_AND_INVOKE_ACTIONS (error, txMetadataHandle = txMetadataStartOfBurst; return static_cast<int> (numSamplesSent);)
+
+        error = sendEndOfBurst();
+
+        return static_cast<int> (numSamplesSent);
+    }
+
+    bool UHDr::USRP::TxStream::receiveAsyncEvent (UHDr::AsyncEventCode& eventCode, UHDr::Error& error, double timeoutInSeconds)
+    {
+        bool valid = false;
+        error = uhd->txStreamerRecvAsyncMsg (txStreamerHandle, &asyncMetadataHandle, timeoutInSeconds, &valid);
+        if (error || !valid)
+            return false;
+
+        error = uhd->asyncMetadataEventCode (asyncMetadataHandle, &eventCode);
+        return error == Error::errorNone;
+    }
+
     UHDr::Error UHDr::USRP::TxStream::sendEndOfBurst ()
     {
         txMetadataHandle = txMetadataEndOfBurst;
@@ -946,7 +1085,16 @@ namespace ntlab
 
         txMetadataHandle = txMetadataStartOfBurst;
 
+        // created once, so that polling for async events doesn't allocate
+        error = uhd->asyncMetadataMake (&asyncMetadataHandle);
+        NTLAB_PRINT_ERROR_TO_DBG_AND_INVOKE_ACTIONS (error, asyncMetadataHandle = nullptr; return;)
+
         numActiveChannels = streamArgs.numChannels;
+        burstBuffsPtrs.resize (static_cast<size_t> (numActiveChannels));
+
+        // the cpu format names are fc32, sc16 and sc8, so the last digits are the number of bits per real value
+        bytesPerSample = 2 * static_cast<size_t> (juce::String (streamArgs.cpuFormat).getTrailingIntValue()) / 8;
+
         error = uhd->getTxStreamMaxNumSamples (txStreamerHandle, &maxNumSamples);
         NTLAB_PRINT_ERROR_TO_DBG_AND_INVOKE_ACTIONS (error, uhd->txStreamerFree (&txStreamerHandle); return;)
     }
@@ -974,7 +1122,7 @@ namespace ntlab
         error = uhd->usrpMake (&usrpHandle, args);
         NTLAB_PRINT_ERROR_TO_DBG_AND_INVOKE_ACTIONS (error, usrpHandle = nullptr; return;)
 
-        errorDescription = [this](Error error) {return UHDr::errorDescription (error) + " (" + usrpHandle->lastError + ")"; };
+        errorDescription = [this](Error error) {return UHDr::errorDescription (error) + " (" + getLastUSRPError() + ")"; };
 
         size_t n;
         error = uhd->getNumRxChannels (usrpHandle, &n);
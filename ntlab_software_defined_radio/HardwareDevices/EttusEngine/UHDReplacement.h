@@ -110,6 +110,24 @@ namespace ntlab
                     rxBadPacket           = 0xF
         };
 
+        enum AsyncEventCode
+        {
+            //! A burst was successfully transmitted
+                    txBurstAck             = 0x1,
+            //! An internal send buffer has emptied
+                    txUnderflow            = 0x2,
+            //! Packet loss between host and device
+                    txSequenceError        = 0x4,
+            //! Packet had time that was late
+                    txTimeError            = 0x8,
+            //! Underflow occurred inside a packet
+                    txUnderflowInPacket    = 0x10,
+            //! Packet loss within a burst
+                    txSequenceErrorInBurst = 0x20,
+            //! Some kind of custom user payload
+                    txUserPayload          = 0x40
+        };
+
         enum StreamMode
         {
             //! Stream samples indefinitely
@@ -220,6 +238,11 @@ namespace ntlab
         typedef Error (*TxMetadataFree)     (TxMetadataHandle*);
         typedef Error (*TxMetadataLastError)(TxMetadataHandle, char*, size_t);
 
+        typedef void* AsyncMetadataHandle;
+        typedef Error (*AsyncMetadataMake)     (AsyncMetadataHandle*);
+        typedef Error (*AsyncMetadataFree)     (AsyncMetadataHandle*);
+        typedef Error (*AsyncMetadataEventCode)(AsyncMetadataHandle, AsyncEventCode*);
+
         typedef void* SubdevSpecHandle;
         typedef Error (*SubdevSpecMake)(SubdevSpecHandle*, const char*);
         typedef Error (*SubdevSpecFree)(SubdevSpecHandle*);
@@ -258,6 +281,9 @@ namespace ntlab
 
         typedef Error (*SetTimeUnknownPPS)(USRPHandle, time_t, double);
         typedef Error (*SetTimeNow)       (USRPHandle, time_t, double, size_t);
+        typedef Error (*GetTimeNow)       (USRPHandle, size_t, time_t*, double*);
+        typedef Error (*SetCommandTime)   (USRPHandle, time_t, double, size_t);
+        typedef Error (*ClearCommandTime) (USRPHandle, size_t);
 
         typedef Error (*GetRxStream)(USRPHandle, StreamArgs*, RxStreamerHandle);
         typedef Error (*GetTxStream)(USRPHandle, StreamArgs*, TxStreamerHandle);
@@ -271,6 +297,13 @@ namespace ntlab
         typedef Error (*TxStreamerSend)   (TxStreamerHandle, BuffsPtr, size_t, TxMetadataHandle*, double, size_t*);
 
         typedef Error (*GetRxMetadataErrorCode)(RxMetadataHandle, RxMetadataError*);
+        typedef Error (*GetRxMetadataHasTimeSpec)(RxMetadataHandle, bool*);
+        typedef Error (*GetRxMetadataTimeSpec)   (RxMetadataHandle, time_t*, double*);
+        typedef Error (*GetRxMetadataOutOfSequence)(RxMetadataHandle, bool*);
+
+        typedef Error (*TxStreamerRecvAsyncMsg)(TxStreamerHandle, AsyncMetadataHandle*, double, bool*);
+
+        typedef Error (*GetMasterClockRate)(USRPHandle, size_t, double*);
 
 		static const juce::String uhdLibName;
 
@@ -547,6 +580,27 @@ namespace ntlab
              */
             juce::Result setTimeNow (time_t fullSecs, double fracSecs, int mboardIdx);
 
+            /**
+             * Returns the current device time of a particular motherboard in seconds. This needs a round trip to the
+             * device. In case of any error -1 will be returned. Check the error code passed for further details.
+             */
+            double getTimeNow (int mboardIdx, Error &error);
+
+            /**
+             * Sets the time at which all following commands to a particular motherboard, e.g. tune requests, will be
+             * executed by the device. Call clearCommandTime afterwards to return to executing commands immediately.
+             */
+            juce::Result setCommandTime (time_t fullSecs, double fracSecs, int mboardIdx);
+
+            /** Lets a particular motherboard execute all following commands immediately again */
+            juce::Result clearCommandTime (int mboardIdx);
+
+            /**
+             * Returns the rate of the master clock of a particular motherboard, which is the rate device time ticks
+             * are counted at. In case of any error -1 will be returned. Check the error code passed for further details.
+             */
+            double getMasterClockRate (int mboardIdx, Error &error);
+
             /** Returns the number of input channels currently available for this USRP */
             const int getNumInputChannels();
 
@@ -556,8 +610,14 @@ namespace ntlab
             /** Returns the number of physical motherboards managed by this USRP instance */
             const int getNumMboards();
 
-            /** Returns the content of the lastError string of the underlying USRP handle, if it exists */
-            const std::string& getLastUSRPError();
+            /**
+             * Returns a copy of the lastError string of the underlying USRP handle, if it exists. The UHD C API keeps
+             * one such string per handle and each call on the handle overwrites it. Calls that read it back as part of
+             * their error description hold the same lock for the call and the read-out, so they can be issued from
+             * several threads. The setters that only return an error code don't lock, for them we rely on UHD being
+             * thread safe for calls that address different motherboards.
+             */
+            std::string getLastUSRPError();
 
             /**
              * This class wraps the rxStreamer and will be used for actual Rx work. It can only be created through
@@ -602,6 +662,19 @@ namespace ntlab
                  */
                 RxMetadataError getLastRxMetadataError (Error &error);
 
+                /**
+                 * Returns true and fills in the device time of the first sample received by the last receive call, if
+                 * the hardware delivered a time with these samples. The Error handle passed as reference will help
+                 * spotting any error that might occur when calling this function.
+                 */
+                bool getLastRxTimeSpec (time_t& fullSecs, double& fracSecs, Error &error);
+
+                /**
+                 * Returns true if the rxCodeOverflow returned by getLastRxMetadataError was caused by a sequence error,
+                 * e.g. a packet lost on the network, rather than by the host not receiving fast enough.
+                 */
+                bool wasLastRxOutOfSequence (Error &error);
+
             private:
                 RxStream (UHDr::Ptr uhdr, USRPHandle &usrpHandle, StreamArgs &streamArgs, Error &error);
 
@@ -651,6 +724,22 @@ namespace ntlab
 
                 Error sendEndOfBurst();
 
+                /**
+                 * Sends a complete burst of samples that starts at the device time passed. The samples are split into
+                 * as many packets as needed and the burst is terminated with an end of burst flag. The buffers must
+                 * hold samples in the cpu format the stream was created with. A continuous burst started by send is
+                 * ended before. This creates a metadata handle for the start of the burst, so it is not realtime safe.
+                 * @return                  The number of samples per channel that were sent
+                 */
+                int sendBurst (BuffsPtr buffsPtr, int numSamples, time_t fullSecs, double fracSecs, Error &error, double timeoutInSeconds = 1.0);
+
+                /**
+                 * Returns true and fills in the event code if the device reported an asynchronous event like an
+                 * underflow within the timeout passed. With the default timeout of zero this just polls for pending
+                 * events, so it can be called on the realtime thread after each send call.
+                 */
+                bool receiveAsyncEvent (AsyncEventCode& eventCode, Error &error, double timeoutInSeconds = 0.0);
+
                 juce::String getLastError();
 
             private:
@@ -663,10 +752,15 @@ namespace ntlab
                 TxMetadataHandle txMetadataContinous    = nullptr;
                 TxMetadataHandle txMetadataEndOfBurst   = nullptr;
                 TxMetadataHandle txMetadataHandle       = nullptr;
+                AsyncMetadataHandle asyncMetadataHandle = nullptr;
 
                 int numActiveChannels;
                 size_t maxNumSamples;
 
+                // The size of one sample in the cpu format and the pointers to the remaining samples of a burst
+                size_t bytesPerSample;
+                std::vector<void*> burstBuffsPtrs;
+
                 // Masking the UHDr::errorDescription to be able to add the usrpHandle's lastError string to the error description
                 std::function<juce::String(Error)> errorDescription;
 
@@ -687,6 +781,8 @@ namespace ntlab
             int numOutputChannels;
             int numMboards;
 
+            juce::CriticalSection lastErrorLock;
+
             // Masking the UHDr::errorDescription to be able to add the usrpHandle's lastError string to the error description
             std::function<juce::String(Error)> errorDescription;
 
@@ -756,6 +852,9 @@ namespace ntlab
         SetSource                setTimeSource;
         SetTimeUnknownPPS        setTimeUnknownPPS;
         SetTimeNow               setTimeNow;
+        GetTimeNow               getTimeNow;
+        SetCommandTime           setCommandTime;
+        ClearCommandTime         clearCommandTime;
         GetRxStream              getRxStream;
         GetTxStream              getTxStream;
         GetRxStreamMaxNumSamples getRxStreamMaxNumSamples;
@@ -764,6 +863,14 @@ namespace ntlab
         RxStreamerReceive        rxStreamerReceive;
         TxStreamerSend           txStreamerSend;
         GetRxMetadataErrorCode   getRxMetadataErrorCode;
+        GetRxMetadataHasTimeSpec getRxMetadataHasTimeSpec;
+        GetRxMetadataTimeSpec    getRxMetadataTimeSpec;
+        GetRxMetadataOutOfSequence getRxMetadataOutOfSequence;
+        AsyncMetadataMake        asyncMetadataMake;
+        AsyncMetadataFree        asyncMetadataFree;
+        AsyncMetadataEventCode   asyncMetadataEventCode;
+        TxStreamerRecvAsyncMsg   txStreamerRecvAsyncMsg;
+        GetMasterClockRate       getMasterClockRate;
 
         juce::DynamicLibrary uhdLib;
 
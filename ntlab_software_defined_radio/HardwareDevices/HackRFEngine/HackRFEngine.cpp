@@ -1,5 +1,6 @@
 
 #include "HackRfEngine.h"
+#include "../../ErrorHandling/ErrorHandlingMacros.h"
 
 namespace ntlab
 {
@@ -16,6 +17,7 @@ namespace ntlab
     const juce::Identifier HackRFEngine::propertyTxDigitalScaling ("Tx_digital_scaling");
     const juce::Identifier HackRFEngine::propertyRxTxState        ("RxTx_state");
     const juce::Identifier HackRFEngine::propertyMaxBlockSize     ("Max_block_size");
+    const juce::Identifier HackRFEngine::propertyQueueDepth       ("Queue_depth");
 
     const uint32_t HackRFEngine::rxLNAGainMax = 40;
     const uint32_t HackRFEngine::rxLNAGainStep = 8;
@@ -105,8 +107,9 @@ namespace ntlab
         activeConfig.setProperty (propertyRxDigitalScaling, currentRxDigitalScaling,                                    nullptr);
         activeConfig.setProperty (propertyTxAnalogGain,     static_cast<int64_t> (currentTxVGAGain),                    nullptr);
         activeConfig.setProperty (propertyTxDigitalScaling, currentTxDigitalScaling,                                    nullptr);
-        activeConfig.setProperty (propertyRxTxState,        static_cast<int> (rxTxState),                               nullptr);
-        activeConfig.setProperty (propertyMaxBlockSize,     maxBufferSize,                                              nullptr);
+        activeConfig.setProperty (propertyRxTxState,        static_cast<int> (rxTxState.load()),                        nullptr);
+        activeConfig.setProperty (propertyMaxBlockSize,     blockSize,                                                  nullptr);
+        activeConfig.setProperty (propertyQueueDepth,       queueDepth,                                                 nullptr);
 
         return activeConfig;
     }
@@ -151,15 +154,41 @@ namespace ntlab
         if (!setDesiredBlockSize (configToSet.getProperty (propertyMaxBlockSize)))
             return juce::Result::fail ("Error setting max block size of " + configToSet.getProperty (propertyMaxBlockSize).toString());
 
+        if (configToSet.hasProperty (propertyQueueDepth) && !setQueueDepth (configToSet.getProperty (propertyQueueDepth)))
+            return juce::Result::fail ("Error setting queue depth of " + configToSet.getProperty (propertyQueueDepth).toString());
+
         return juce::Result::ok();
     }
 
     bool HackRFEngine::setDesiredBlockSize (int desiredBlockSize)
     {
-        if (desiredBlockSize == maxBufferSize)
+        // re-applying the active config while streaming is fine
+        if (desiredBlockSize == blockSize)
             return true;
 
-        return false;
+        // the queues are set up when streaming starts
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (isStreaming());
+
+        // all blocks of the queues are allocated up front, tiny blocks would need thousands of them
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (desiredBlockSize < minBlockSize);
+
+        blockSize = desiredBlockSize;
+        return true;
+    }
+
+    bool HackRFEngine::setQueueDepth (int numTransfers)
+    {
+        if (numTransfers == queueDepth)
+            return true;
+
+        // the queues are set up when streaming starts
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (isStreaming());
+
+        // at least one transfer is needed to decouple the transfer thread from the processing
+        NTLAB_RETURN_FALSE_AND_ASSERT_IF (numTransfers < 1);
+
+        queueDepth = numTransfers;
+        return true;
     }
 
     bool HackRFEngine::isReadyToStream ()
@@ -189,15 +218,27 @@ namespace ntlab
 
         startStopThread.addJob ([this] ()
         {
-#if NTLAB_USE_CL_SAMPLE_BUFFER_COMPLEX_FOR_SDR_IO_DEVICE_CALLBACK
-            rxBuffer.reset (new CLSampleBufferComplex<float> (1, maxBufferSize, clQueue, clContext, false, CL_MEM_READ_ONLY, CL_MAP_WRITE));
-            txBuffer.reset (new CLSampleBufferComplex<float> (1, maxBufferSize, clQueue, clContext, false, CL_MEM_WRITE_ONLY, CL_MAP_READ));
-#else
-            rxBuffer.reset (new SampleBufferComplex<float> (1, maxBufferSize));
-            txBuffer.reset (new SampleBufferComplex<float> (1, maxBufferSize));
-#endif
+            // all blocks are allocated up front, so that the transfer callbacks never allocate. A single transfer
+            // has to fit into the queue even if it is split into many small blocks
+            const int blocksPerTransfer = (maxBufferSize + blockSize - 1) / blockSize;
+            const int numBlocks = queueDepth * blocksPerTransfer;
+
+            rxQueue.reset (new SampleBlockQueue<OptionalCLSampleBufferComplexFloat> (numBlocks, [this]() { return createStreamBuffer (blockSize, true); }));
+            txQueue.reset (new SampleBlockQueue<OptionalCLSampleBufferComplexFloat> (numBlocks, [this]() { return createStreamBuffer (blockSize, false); }));
+            currentRxBlock = nullptr;
+            currentTxBlock = nullptr;
 
-            currentCallback->prepareForStreaming (currentSampleRate, 1, 1, maxBufferSize);
+            emptyRxBuffer = createStreamBuffer (1, true);
+            emptyTxBuffer = createStreamBuffer (1, false);
+            emptyRxBuffer->setNumSamples (0);
+            emptyTxBuffer->setNumSamples (0);
+
+            numRxSamplesDiscarded = 0;
+            numTxSamplesMissed = 0;
+            txQueueNeedsDraining = false;
+
+            currentCallback->prepareForStreaming (currentSampleRate, 1, 1, blockSize);
+            processingThread.startThread (juce::Thread::realtimeAudioPriority);
 
             if (rxTxState == rxEnabled)
                 hackRF->startRx (rxCallback, this);
@@ -239,6 +280,9 @@ namespace ntlab
                     juce::Thread::sleep (50);
                 }
 
+                // the processing thread exits after the block it is working on, so never kill it in the middle of a callback
+                processingThread.stopThread (-1);
+
                 currentCallback->streamingHasStopped();
                 currentCallback = nullptr;
             });
@@ -467,22 +511,59 @@ namespace ntlab
         jassert (transfer->validLength <= (2 * engine->maxBufferSize));
 
         const float scaleFactor = engine->currentRxDigitalScaling * (1.0f / std::numeric_limits<int8_t>::max());
+        const int numSamplesInTransfer = transfer->validLength / 2;
 
-        float*        rxBuffer       = reinterpret_cast<float*> (engine->rxBuffer->getWritePointer (0));
-        const int8_t* transferBuffer = transfer->buffer;
+        // this runs on the libusb transfer thread, so only convert the samples straight into the queued blocks and
+        // leave the processing to the processing thread. The transfer is split across as many blocks as needed, a
+        // block that isn't full yet is continued with the next transfer.
+        for (int transferPosition = 0; transferPosition < numSamplesInTransfer;)
+        {
+            auto*& rxBlock = engine->currentRxBlock;
 
-        // convert to float
-        for (int sample = 0; sample < transfer->validLength; ++sample)
-            rxBuffer[sample] = transferBuffer[sample] * scaleFactor - 1.0f;
+            if (rxBlock == nullptr)
+            {
+                rxBlock = engine->rxQueue->getFreeBlock();
 
-        engine->rxBuffer->setNumSamples (transfer->validLength / 2);
-        engine->txBuffer->setNumSamples (0);
+                // the processing lags behind too far, discard the samples rather than stalling the transfers
+                if (rxBlock == nullptr)
+                {
+                    engine->numRxSamplesDiscarded += numSamplesInTransfer - transferPosition;
+                    break;
+                }
+
+                rxBlock->setNumSamples (0);
+            }
+
+            const int blockPosition = rxBlock->getNumSamples();
+            const int numSamples = std::min (numSamplesInTransfer - transferPosition, engine->blockSize - blockPosition);
+
+            float*        rxBuffer       = reinterpret_cast<float*> (rxBlock->getWritePointer (0) + blockPosition);
+            const int8_t* transferBuffer = transfer->buffer + 2 * transferPosition;
 
-        engine->currentCallback->processRFSampleBlock (*engine->rxBuffer, *engine->txBuffer);
+            // convert to float
+            for (int sample = 0; sample < 2 * numSamples; ++sample)
+                rxBuffer[sample] = transferBuffer[sample] * scaleFactor - 1.0f;
+
+            rxBlock->setNumSamples (blockPosition + numSamples);
+            transferPosition += numSamples;
+
+            if (rxBlock->getNumSamples() == engine->blockSize)
+            {
+                engine->rxQueue->push();
+                rxBlock = nullptr;
+            }
+        }
 
-        if (engine->rxTxState == txEnabled)
+        // the next tx burst may only start once the blocks left over from the last one have been drained
+        if ((engine->rxTxState == txEnabled) && !engine->txQueueNeedsDraining)
         {
             engine->hackRF->stopRx();
+
+            // hand over the samples of a block that won't be completed anymore
+            if ((engine->currentRxBlock != nullptr) && (engine->currentRxBlock->getNumSamples() > 0))
+                engine->rxQueue->push();
+
+            engine->currentRxBlock = nullptr;
             engine->hackRF->startTx (txCallback, engine);
         }
 
@@ -497,34 +578,152 @@ namespace ntlab
         jassert (transfer->validLength <= (2 * engine->maxBufferSize));
 
         const float scaleFactor = engine->currentTxDigitalScaling * std::numeric_limits<int8_t>::max();
+        const int numSamplesInTransfer = transfer->validLength / 2;
 
-        engine->rxBuffer->setNumSamples (0);
-        engine->txBuffer->setNumSamples (transfer->validLength / 2);
+        // this runs on the libusb transfer thread, so only convert the samples processed in advance by the processing
+        // thread straight from the queued blocks. The transfer is filled from as many blocks as needed, a block that
+        // isn't fully read yet is continued with the next transfer.
+        for (int transferPosition = 0; transferPosition < numSamplesInTransfer;)
+        {
+            auto*& txBlock = engine->currentTxBlock;
+
+            if (txBlock == nullptr)
+            {
+                txBlock = engine->txQueue->getNextBlock();
+                engine->currentTxBlockReadPosition = 0;
 
-        engine->currentCallback->processRFSampleBlock (*engine->rxBuffer, *engine->txBuffer);
+                // the processing lags behind, fill the transfer with silence rather than stalling the transfers
+                if (txBlock == nullptr)
+                {
+                    std::fill (transfer->buffer + 2 * transferPosition, transfer->buffer + transfer->validLength, int8_t (0));
+                    engine->numTxSamplesMissed += numSamplesInTransfer - transferPosition;
+                    break;
+                }
+            }
 
-        auto* transferBuffer = transfer->buffer;
-        auto* txBuffer       = reinterpret_cast<const float*> (engine->txBuffer->getReadPointer (0));
+            const int blockPosition = engine->currentTxBlockReadPosition;
+            const int numSamples = std::min (numSamplesInTransfer - transferPosition, txBlock->getNumSamples() - blockPosition);
 
-        for (int sample = 0; sample < transfer->validLength; ++sample)
-        {
-            float scaledSample = scaleFactor * txBuffer[sample];
+            auto* txBuffer       = reinterpret_cast<const float*> (txBlock->getReadPointer (0) + blockPosition);
+            auto* transferBuffer = transfer->buffer + 2 * transferPosition;
 
-            // overflow!! lower the digital gain
-            jassert ((scaledSample <= std::numeric_limits<int8_t>::max()) && (scaledSample >= std::numeric_limits<int8_t>::min()));
+            for (int sample = 0; sample < 2 * numSamples; ++sample)
+            {
+                float scaledSample = scaleFactor * txBuffer[sample];
 
-            transferBuffer[sample] = static_cast<int8_t> (scaledSample);
+                // overflow!! lower the digital gain
+                jassert ((scaledSample <= std::numeric_limits<int8_t>::max()) && (scaledSample >= std::numeric_limits<int8_t>::min()));
+
+                transferBuffer[sample] = static_cast<int8_t> (scaledSample);
+            }
+
+            engine->currentTxBlockReadPosition += numSamples;
+            transferPosition += numSamples;
+
+            if (engine->currentTxBlockReadPosition == txBlock->getNumSamples())
+            {
+                engine->txQueue->release();
+                txBlock = nullptr;
+            }
         }
 
         if (engine->rxTxState == rxEnabled)
         {
             engine->hackRF->stopTx();
+
+            if (engine->currentTxBlock != nullptr)
+                engine->txQueue->release();
+
+            engine->currentTxBlock = nullptr;
+
+            // blocks processed for this burst must not end up at the start of the next one. The processing thread
+            // might still push a block it is working on, so it drains the queue itself, see processQueuedBlocks
+            engine->txQueueNeedsDraining = true;
             engine->hackRF->startRx (rxCallback, engine);
         }
 
         return HackRFr::Error::success;
     }
 
+    std::unique_ptr<OptionalCLSampleBufferComplexFloat> HackRFEngine::createStreamBuffer (int numSamples, bool isRxBuffer)
+    {
+#if NTLAB_USE_CL_SAMPLE_BUFFER_COMPLEX_FOR_SDR_IO_DEVICE_CALLBACK
+        if (isRxBuffer)
+            return std::unique_ptr<OptionalCLSampleBufferComplexFloat> (new CLSampleBufferComplex<float> (1, numSamples, clQueue, clContext, false, CL_MEM_READ_ONLY, CL_MAP_WRITE));
+
+        return std::unique_ptr<OptionalCLSampleBufferComplexFloat> (new CLSampleBufferComplex<float> (1, numSamples, clQueue, clContext, false, CL_MEM_WRITE_ONLY, CL_MAP_READ));
+#else
+        juce::ignoreUnused (isRxBuffer);
+        return std::unique_ptr<OptionalCLSampleBufferComplexFloat> (new SampleBufferComplex<float> (1, numSamples));
+#endif
+    }
+
+    void HackRFEngine::processQueuedBlocks()
+    {
+        int64_t numRxSamplesDiscardedReported = 0;
+        int64_t numTxSamplesMissedReported    = 0;
+
+        while (!processingThread.threadShouldExit())
+        {
+            reportSampleDrops (numRxSamplesDiscardedReported, numTxSamplesMissedReported);
+
+            // no tx transfers read from the queue until this is cleared, so this thread may act as the consumer here
+            if (txQueueNeedsDraining)
+            {
+                while (txQueue->getNextBlock() != nullptr)
+                    txQueue->release();
+
+                txQueueNeedsDraining = false;
+            }
+
+            // rx blocks still queued after switching to tx are processed first
+            if ((rxTxState == rxEnabled) || (rxQueue->getNumQueuedBlocks() > 0))
+            {
+                auto* rxBlock = rxQueue->waitForNextBlock (100);
+                if (rxBlock == nullptr)
+                    continue;
+
+                currentCallback->processRFSampleBlock (*rxBlock, *emptyTxBuffer);
+                rxQueue->release();
+            }
+            else
+            {
+                // the speed at which the tx transfers drain the queue paces the processing
+                auto* txBlock = txQueue->waitForFreeBlock (100);
+                if (txBlock == nullptr)
+                    continue;
+
+                txBlock->setNumSamples (blockSize);
+                currentCallback->processRFSampleBlock (*emptyRxBuffer, *txBlock);
+                txQueue->push();
+            }
+        }
+
+        // samples dropped while stopping are reported before the callback learns that streaming has stopped
+        reportSampleDrops (numRxSamplesDiscardedReported, numTxSamplesMissedReported);
+    }
+
+    void HackRFEngine::reportSampleDrops (int64_t& numRxSamplesDiscardedReported, int64_t& numTxSamplesMissedReported)
+    {
+        const int64_t numRxSamplesDiscardedNow = numRxSamplesDiscarded;
+        if (numRxSamplesDiscardedNow > numRxSamplesDiscardedReported)
+        {
+            rxSampleDropError.setNumRxSampsDropped (static_cast<int> (std::min<int64_t> (numRxSamplesDiscardedNow - numRxSamplesDiscardedReported, std::numeric_limits<int>::max())));
+            rxSampleDropError.setNumTxSampsDropped (0);
+            currentCallback->handleError (rxSampleDropError);
+            numRxSamplesDiscardedReported = numRxSamplesDiscardedNow;
+        }
+
+        const int64_t numTxSamplesMissedNow = numTxSamplesMissed;
+        if (numTxSamplesMissedNow > numTxSamplesMissedReported)
+        {
+            txSampleDropError.setNumRxSampsDropped (0);
+            txSampleDropError.setNumTxSampsDropped (static_cast<int> (std::min<int64_t> (numTxSamplesMissedNow - numTxSamplesMissedReported, std::numeric_limits<int>::max())));
+            currentCallback->handleError (txSampleDropError);
+            numTxSamplesMissedReported = numTxSamplesMissedNow;
+        }
+    }
+
     bool HackRFEngine::setCenterFrequency (double newCenterFrequency)
     {
         // make sure you have successfully selected a device
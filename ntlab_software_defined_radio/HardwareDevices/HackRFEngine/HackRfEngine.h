@@ -4,6 +4,7 @@
 
 #include "../SDRIOEngine.h"
 #include "HackRFReplacement.h"
+#include "../../Threading/SampleBlockQueue.h"
 
 namespace ntlab
 {
@@ -33,6 +34,7 @@ namespace ntlab
         static const juce::Identifier propertyTxDigitalScaling;
         static const juce::Identifier propertyRxTxState;
         static const juce::Identifier propertyMaxBlockSize;
+        static const juce::Identifier propertyQueueDepth;
 
         /**
          * Must be called before any settings are applied to select a device to operate with.
@@ -81,8 +83,34 @@ namespace ntlab
 
         juce::Result setConfig (juce::ValueTree& configToSet) override;
 
+        /**
+         * Sets the size of the blocks passed to the callback. libhackrf always transfers blocks of 131072 samples,
+         * the transfer callbacks split or merge them into blocks of the desired size while converting the samples
+         * from and to the queued blocks, so re-blocking doesn't add any copies. With a block size smaller than a
+         * transfer, the blocks still arrive in bursts of one transfer. The block size must be at least 1024
+         * samples. It can't be changed while streaming, passing the current block size is always fine.
+         */
         bool setDesiredBlockSize (int desiredBlockSize) override;
 
+        /**
+         * Sets how many transfers worth of sample blocks can be queued between the libhackrf transfer thread and the
+         * thread running the callback. The transfer callbacks only convert the samples from and to the queued blocks,
+         * so the processing may lag behind the hardware by up to numTransfers transfers before rx samples are
+         * discarded or tx transfers are filled with silence, which adds up to that many transfers of latency. Both
+         * are reported to the callback as SampleDropError. The default is 4 transfers. The depth can't be changed
+         * while streaming, passing the current depth is always fine.
+         */
+        bool setQueueDepth (int numTransfers);
+
+        /** Returns how many transfers worth of sample blocks can be queued between the hardware and the callback */
+        int getQueueDepth() const { return queueDepth; }
+
+        /** Returns the number of rx samples discarded since streaming started because the rx queue was full */
+        int64_t getNumRxSamplesDiscarded() const { return numRxSamplesDiscarded; }
+
+        /** Returns the number of tx samples replaced by silence since streaming started because the tx queue was empty */
+        int64_t getNumTxSamplesMissed() const { return numTxSamplesMissed; }
+
         bool isReadyToStream() override;
 
         bool startStreaming (SDRIODeviceCallback* callback) override;
@@ -131,7 +159,9 @@ namespace ntlab
         float currentRxDigitalScaling   = 1.0f;
         uint32_t currentTxVGAGain       = 0;
         float currentTxDigitalScaling   = 1.0f;
-        RxTxState rxTxState = rxEnabled;
+
+        // Read by the transfer callbacks and the processing thread to find out in which direction to stream
+        std::atomic<RxTxState> rxTxState {rxEnabled};
 
         static const uint32_t rxLNAGainMax;
         static const uint32_t rxLNAGainStep;
@@ -144,8 +174,46 @@ namespace ntlab
         SDRIODeviceCallback* currentCallback = nullptr;
 
         static const int maxBufferSize = 131072; // this seems to be a constant value the api uses
-        std::unique_ptr<OptionalCLSampleBufferComplexFloat> rxBuffer, txBuffer;
 
+        // Limits the queues to at most 128 blocks per transfer
+        static const int minBlockSize = 1024;
+
+        // Runs the callback for the blocks queued by the transfer callbacks
+        class ProcessingThread : public juce::Thread
+        {
+        public:
+            ProcessingThread (HackRFEngine& engine) : juce::Thread ("HackRF Engine Processing Thread"), engine (engine) {}
+
+            void run() override { engine.processQueuedBlocks(); }
+
+        private:
+            HackRFEngine& engine;
+        };
+
+        int blockSize  = maxBufferSize;
+        int queueDepth = 4;
+        std::unique_ptr<SampleBlockQueue<OptionalCLSampleBufferComplexFloat>> rxQueue, txQueue;
+
+        // The blocks currently filled or read by the transfer callbacks, which can span multiple transfers
+        OptionalCLSampleBufferComplexFloat* currentRxBlock = nullptr;
+        OptionalCLSampleBufferComplexFloat* currentTxBlock = nullptr;
+        int currentTxBlockReadPosition = 0;
+
+        // Set by the tx transfer callback when a burst ends, cleared by the processing thread once it has drained the
+        // blocks left over from that burst. No new tx burst is started meanwhile
+        std::atomic<bool> txQueueNeedsDraining {false};
+
+        // Passed to the callback in place of the disabled direction
+        std::unique_ptr<OptionalCLSampleBufferComplexFloat> emptyRxBuffer, emptyTxBuffer;
+
+        std::atomic<int64_t> numRxSamplesDiscarded {0};
+        std::atomic<int64_t> numTxSamplesMissed    {0};
+
+        // The transfer callbacks only count the samples dropped, the processing thread reports them to the callback
+        SampleDropError rxSampleDropError;
+        SampleDropError txSampleDropError;
+
+        ProcessingThread processingThread {*this};
         juce::ThreadPool startStopThread {1};
 
         HackRFEngine (HackRFr::Ptr hackRfLibrary);
@@ -154,6 +222,13 @@ namespace ntlab
 
         static int txCallback (HackRFr::Transfer* transfer);
 
+        std::unique_ptr<OptionalCLSampleBufferComplexFloat> createStreamBuffer (int numSamples, bool isRxBuffer);
+
+        void processQueuedBlocks();
+
+        // Reports the samples dropped since the counts passed to the callback and updates the counts
+        void reportSampleDrops (int64_t& numRxSamplesDiscardedReported, int64_t& numTxSamplesMissedReported);
+
         bool setCenterFrequency (double newCenterFrequency);
 
         bool setBandwidth (double newBandwidth);
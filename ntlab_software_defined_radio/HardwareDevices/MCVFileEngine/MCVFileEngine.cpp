@@ -17,6 +17,7 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 
 #include "MCVFileEngine.h"
 #include "../../UnitTestHelpers/UnitTestHelpers.h"
+#include <thread>
 
 namespace ntlab
 {
@@ -27,8 +28,11 @@ namespace ntlab
     const juce::Identifier MCVFileEngine::propertyRxEnabled               ("RX_Enabled");
     const juce::Identifier MCVFileEngine::propertyInputEndOfFileBehaviour ("Input_End_Of_File_Behaviour");
     const juce::Identifier MCVFileEngine::propertyNumOutChannels          ("Num_Output_Channels");
+    const juce::Identifier MCVFileEngine::propertyNumReadAheadBlocks      ("Num_Read_Ahead_Blocks");
+    const juce::Identifier MCVFileEngine::propertyInputMappingWindowSize  ("Input_Mapping_Window_Size");
+    const juce::Identifier MCVFileEngine::propertyReplayMode              ("Replay_Mode");
 
-    MCVFileEngine::MCVFileEngine () : streamingControlThread (1)
+    MCVFileEngine::MCVFileEngine () : juce::Thread ("MCVFileEngine"), streamingControlThread (1)
     {
         engineConfig = juce::ValueTree (propertyMCVFileEngine);
 
@@ -38,9 +42,17 @@ namespace ntlab
         engineConfig.setProperty (propertyTxEnabled, false, nullptr);
         engineConfig.setProperty (propertyInputEndOfFileBehaviour, static_cast<int> (MCVReader::EndOfFileBehaviour::stopAndResize), nullptr);
         engineConfig.setProperty (propertyNumOutChannels, 0, nullptr);
+        engineConfig.setProperty (propertyNumReadAheadBlocks, numReadAheadBlocks, nullptr);
+        engineConfig.setProperty (propertyInputMappingWindowSize, 0, nullptr);
+        engineConfig.setProperty (propertyReplayMode, static_cast<int> (replayMode), nullptr);
     }
 
-    bool MCVFileEngine::setInFile (juce::File& newInFile, ntlab::MCVReader::EndOfFileBehaviour endOfFileBehaviour, bool enableRx)
+    MCVFileEngine::~MCVFileEngine()
+    {
+        stopThread (-1);
+    }
+
+    bool MCVFileEngine::setInFile (juce::File& newInFile, ntlab::MCVReader::EndOfFileBehaviour endOfFileBehaviour, bool enableRx, int64_t mappingWindowSizeInBytes)
     {
         if (streamingIsRunning)
             return false;
@@ -48,7 +60,7 @@ namespace ntlab
         if (! (newInFile.existsAsFile() && newInFile.hasFileExtension ("mcv")))
             return false;
 
-        mcvReader.reset (new MCVReader (newInFile, endOfFileBehaviour));
+        mcvReader.reset (new MCVReader (newInFile, endOfFileBehaviour, mappingWindowSizeInBytes));
 
         if (!mcvReader->isValid())
         {
@@ -66,6 +78,7 @@ namespace ntlab
         engineConfig.setProperty (propertyInFile, newInFile.getFullPathName(), nullptr);
         engineConfig.setProperty (propertyRxEnabled, rxEnabled, nullptr);
         engineConfig.setProperty (propertyInputEndOfFileBehaviour, static_cast<int> (endOfFileBehaviour), nullptr);
+        engineConfig.setProperty (propertyInputMappingWindowSize, mappingWindowSizeInBytes, nullptr);
 
         return true;
     }
@@ -99,6 +112,32 @@ namespace ntlab
         return true;
     }
 
+    bool MCVFileEngine::setNumReadAheadBlocks (int newNumReadAheadBlocks)
+    {
+        if (streamingIsRunning || (newNumReadAheadBlocks < 0))
+            return false;
+
+        numReadAheadBlocks = newNumReadAheadBlocks;
+        engineConfig.setProperty (propertyNumReadAheadBlocks, numReadAheadBlocks, nullptr);
+
+        return true;
+    }
+
+    bool MCVFileEngine::setReplayMode (ReplayMode newReplayMode)
+    {
+        if (streamingIsRunning)
+            return false;
+
+        replayMode = newReplayMode;
+        engineConfig.setProperty (propertyReplayMode, static_cast<int> (replayMode), nullptr);
+
+        return true;
+    }
+
+    MCVFileEngine::ReplayMode MCVFileEngine::getReplayMode() {return replayMode; }
+
+    MCVFileEngine::ReplayStatistics MCVFileEngine::getReplayStatistics() {return replayStatistics; }
+
     const int MCVFileEngine::getNumRxChannels ()
     {
         if (mcvReader == nullptr)
@@ -167,9 +206,10 @@ namespace ntlab
             {
                 bool rxEnabled         = configToSet.getProperty (propertyRxEnabled);
                 int endOfFileBehaviour = configToSet.getProperty (propertyInputEndOfFileBehaviour);
+                juce::int64 windowSize = configToSet.getProperty (propertyInputMappingWindowSize, 0);
                 juce::File inFile (inFileName);
 
-                setInFile (inFile, static_cast<MCVReader::EndOfFileBehaviour> (endOfFileBehaviour), rxEnabled);
+                setInFile (inFile, static_cast<MCVReader::EndOfFileBehaviour> (endOfFileBehaviour), rxEnabled, windowSize);
             }
 
             if (outFileName.isNotEmpty())
@@ -181,6 +221,13 @@ namespace ntlab
                 setOutFile (outFile, numOutChannels, txEnabled);
             }
 
+            // Optional, as configs stored by older versions don't contain it
+            if (configToSet.hasProperty (propertyNumReadAheadBlocks))
+                setNumReadAheadBlocks (configToSet.getProperty (propertyNumReadAheadBlocks));
+
+            if (configToSet.hasProperty (propertyReplayMode))
+                setReplayMode (static_cast<ReplayMode> (static_cast<int> (configToSet.getProperty (propertyReplayMode))));
+
             return juce::Result::ok();
         }
 
@@ -211,13 +258,22 @@ namespace ntlab
         {
             int numInChannels = 0;
             if (mcvReader != nullptr)
+            {
                 numInChannels = static_cast<int> (mcvReader->getNumColsOrChannels());
+                mcvReader->enableReadAhead (numReadAheadBlocks, blockSize);
+            }
 
             activeCallback->prepareForStreaming (sampleRate, numInChannels, numOutChannels, blockSize);
 
-            double timerIntervalInSeconds = blockSize / sampleRate;
+            numSamplesProcessed = 0;
+            replayStatistics = ReplayStatistics();
+            totalLatenessInSeconds = 0.0;
 
-            startTimer (juce::roundToInt (timerIntervalInSeconds / 1000.0));
+            // The thread might still be returning from the end of the previous stream
+            waitForThreadToExit (-1);
+
+            streamingStartTicks = juce::Time::getHighResolutionTicks();
+            startThread (replayMode == realtime ? 9 : 5);
         };
 
         streamingControlThread.addJob (setUpStreaming);
@@ -231,8 +287,8 @@ namespace ntlab
         if (!streamingIsRunning)
             return;
 
-        if (timerThreadID == juce::Thread::getCurrentThreadId())
-            timerShouldStopAfterThisCallback = true;
+        if (getThreadId() == juce::Thread::getCurrentThreadId())
+            streamShouldStopAfterThisBlock = true;
         else
             streamingControlThread.addJob ([this]() {endStreaming(); });
     }
@@ -250,12 +306,51 @@ namespace ntlab
         return true;
     }
 
-    void MCVFileEngine::hiResTimerCallback ()
+    void MCVFileEngine::run()
+    {
+        while (!threadShouldExit())
+        {
+            if (replayMode == realtime)
+                waitForNextBlockDeadline();
+
+            if (processNextBlock())
+            {
+                endStreaming();
+                return;
+            }
+        }
+    }
+
+    void MCVFileEngine::waitForNextBlockDeadline()
     {
-        if (!timerThreadIDisValid)
-            timerThreadID = juce::Thread::getCurrentThreadId();
+        // Computed from the block count rather than accumulated, so rounding errors don't add up over long replays
+        const auto ticksPerSecond = static_cast<double> (juce::Time::getHighResolutionTicksPerSecond());
+        const auto deadline = streamingStartTicks + static_cast<juce::int64> ((replayStatistics.numBlocksProcessed + 1) * blockSize * ticksPerSecond / sampleRate);
+        const auto spinTicks = static_cast<juce::int64> (spinTimeInSeconds * ticksPerSecond);
+
+        auto remainingTicks = deadline - juce::Time::getHighResolutionTicks();
+
+        if (remainingTicks < 0)
+        {
+            auto lateness = -remainingTicks / ticksPerSecond;
+
+            ++replayStatistics.numLateBlocks;
+            replayStatistics.maxLatenessInSeconds = std::max (replayStatistics.maxLatenessInSeconds, lateness);
+            totalLatenessInSeconds += lateness;
+            return;
+        }
 
-        timerShouldStopAfterThisCallback = false;
+        // Sleep until shortly before the deadline and spin for the rest, as the sleep duration is only a lower bound
+        if (remainingTicks > spinTicks)
+            std::this_thread::sleep_for (std::chrono::microseconds (static_cast<int64_t> ((remainingTicks - spinTicks) * 1e6 / ticksPerSecond)));
+
+        while ((juce::Time::getHighResolutionTicks() < deadline) && !threadShouldExit())
+            ;
+    }
+
+    bool MCVFileEngine::processNextBlock()
+    {
+        streamShouldStopAfterThisBlock = false;
 
         outSampleBuffer->setNumSamples (0);
         inSampleBuffer->setNumSamples  (0);
@@ -263,7 +358,7 @@ namespace ntlab
         if ((mcvReader != nullptr) && rxEnabled)
         {
             inSampleBuffer->setNumSamples (blockSize);
-            timerShouldStopAfterThisCallback = (!mcvReader->fillNextSamplesIntoBuffer (*inSampleBuffer)) && shouldStopAtEndOfFile;
+            streamShouldStopAfterThisBlock = (!mcvReader->fillNextSamplesIntoBuffer (*inSampleBuffer)) && shouldStopAtEndOfFile;
 
             if ((mcvWriter != nullptr) && txEnabled)
                 outSampleBuffer->setNumSamples (inSampleBuffer->getNumSamples());
@@ -274,20 +369,27 @@ namespace ntlab
         }
 
         activeCallback->processRFSampleBlock (*inSampleBuffer, *outSampleBuffer);
+        numSamplesProcessed += std::max (inSampleBuffer->getNumSamples(), outSampleBuffer->getNumSamples());
+        ++replayStatistics.numBlocksProcessed;
 
         if (mcvWriter != nullptr)
         {
 #if NTLAB_USE_CL_SAMPLE_BUFFER_COMPLEX_FOR_SDR_IO_DEVICE_CALLBACK
             // todo: This is a quick workaround, need to extend the MCVWriter interface
             SampleBufferComplex tmp (numOutChannels, outSampleBuffer->getNumSamples(), outSampleBuffer->getArrayOfWritePointers());
-            mcvWriter->appendSampleBuffer (tmp);
+            auto numTxSampsDropped = mcvWriter->appendSampleBuffer (tmp);
 #else
-            mcvWriter->appendSampleBuffer (*outSampleBuffer);
+            auto numTxSampsDropped = mcvWriter->appendSampleBuffer (*outSampleBuffer);
 #endif
+            if (numTxSampsDropped > 0)
+            {
+                sampleDropError.setNumRxSampsDropped (0);
+                sampleDropError.setNumTxSampsDropped (numTxSampsDropped);
+                activeCallback->handleError (sampleDropError);
+            }
         }
 
-        if (timerShouldStopAfterThisCallback)
-            endStreaming ();
+        return streamShouldStopAfterThisBlock;
     }
 
     void MCVFileEngine::reallocateBuffers (bool reallocateInBuffer, bool reallocateOutBuffer)
@@ -334,8 +436,31 @@ namespace ntlab
 
     void MCVFileEngine::endStreaming ()
     {
-        stopTimer ();
-        timerThreadIDisValid = false;
+        // The streaming thread ends itself after returning from here
+        if (juce::Thread::getCurrentThreadId() == getThreadId())
+            signalThreadShouldExit();
+        else
+            stopThread (-1);
+
+        // The stream might have ended on the streaming thread while this was waiting for it
+        if (!streamingIsRunning)
+            return;
+
+        replayStatistics.numSamplesProcessed = numSamplesProcessed;
+        replayStatistics.elapsedTimeInSeconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - streamingStartTicks);
+
+        if (replayStatistics.numLateBlocks > 0)
+            replayStatistics.meanLatenessInSeconds = totalLatenessInSeconds / replayStatistics.numLateBlocks;
+
+        if (replayMode == asFastAsPossible)
+            juce::Logger::writeToLog ("MCVFileEngine: Processed " + juce::String (static_cast<juce::int64> (numSamplesProcessed)) + " samples in "
+                                      + juce::String (replayStatistics.elapsedTimeInSeconds, 3) + " s, "
+                                      + juce::String (replayStatistics.getSamplesPerSecond() / 1e6, 2) + " MS/s");
+        else if (replayStatistics.numLateBlocks > 0)
+            juce::Logger::writeToLog ("MCVFileEngine: " + juce::String (static_cast<juce::int64> (replayStatistics.numLateBlocks)) + " of "
+                                      + juce::String (static_cast<juce::int64> (replayStatistics.numBlocksProcessed)) + " blocks were late, max. "
+                                      + juce::String (replayStatistics.maxLatenessInSeconds * 1e3, 3) + " ms, mean "
+                                      + juce::String (replayStatistics.meanLatenessInSeconds * 1e3, 3) + " ms");
 
         if (mcvWriter != nullptr)
         {
@@ -378,6 +503,7 @@ namespace ntlab
             auto tempFolder = juce::File::getSpecialLocation (juce::File::SpecialLocationType::tempDirectory);
             auto inFile  = tempFolder.getChildFile ("inFile.mcv");
             auto outFile = tempFolder.getChildFile ("outFile.mcv");
+            auto fastReplayOutFile = tempFolder.getChildFile ("fastReplayOutFile.mcv");
 
             auto random = getRandom();
 
@@ -403,6 +529,11 @@ namespace ntlab
 
             waitForEngineToFinish.wait (-1);
 
+            // The last block can't be delivered before all of its samples would have been received
+            auto realtimeStatistics = mcvFileEngine->getReplayStatistics();
+            expect (realtimeStatistics.numSamplesProcessed == numSamples);
+            expect (realtimeStatistics.elapsedTimeInSeconds >= static_cast<double> (numSamples) / sampleRate);
+
             beginTest ("Comparing in and out file");
 
             MCVReader mcvReader (outFile, MCVReader::EndOfFileBehaviour::stopAndResize);
@@ -410,8 +541,27 @@ namespace ntlab
             auto sinkBuffer = mcvReader.createSampleBufferComplexFloat();
             expect (UnitTestHelpers::areEqualSampleBuffers (srcBuffer, sinkBuffer));
 
+            beginTest ("Replay as fast as possible");
+
+            expect (mcvFileEngine->setReplayMode (MCVFileEngine::asFastAsPossible));
+            expect (mcvFileEngine->setInFile (inFile));
+            expect (mcvFileEngine->setOutFile (fastReplayOutFile, numChannels));
+
+            deviceManager.startStreaming();
+
+            waitForEngineToFinish.wait (-1);
+
+            // The last block is shorter as the file length is no multiple of the block size
+            expect (mcvFileEngine->getReplayStatistics().numSamplesProcessed == numSamples);
+
+            MCVReader fastReplayReader (fastReplayOutFile, MCVReader::EndOfFileBehaviour::stopAndResize);
+            expect (fastReplayReader.isValid ());
+            auto fastReplaySinkBuffer = fastReplayReader.createSampleBufferComplexFloat();
+            expect (UnitTestHelpers::areEqualSampleBuffers (srcBuffer, fastReplaySinkBuffer));
+
             inFile.deleteFile();
             outFile.deleteFile();
+            fastReplayOutFile.deleteFile();
         }
 
     private:
@@ -444,12 +594,12 @@ namespace ntlab
             waitForEngineToFinish.signal();
         }
 
-        void handleError (const juce::String& errorMessage) override
+        void handleError (const StreamingError& error) override
         {
             beginTest ("handleError callback");
 
             // this callback should not be called
-            expect (false, errorMessage);
+            expect (false, error.getErrorDescription());
         }
 
     };
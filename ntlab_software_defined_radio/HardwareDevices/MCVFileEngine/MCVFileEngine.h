@@ -24,11 +24,54 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 namespace ntlab
 {
 
-    class MCVFileEngine : public SDRIOEngine, private juce::HighResolutionTimer
+    class MCVFileEngine : public SDRIOEngine, private juce::Thread
     {
         friend class MCVFileEngineManager;
     public:
 
+        /** Determines how fast the input file is replayed */
+        enum ReplayMode
+        {
+            /**
+             * Blocks are passed to the callback at the rate they would arrive from a device at the sample rate set.
+             * Block n is delivered at n * blockSize / sampleRate after the start of the stream, measured against an
+             * absolute clock so that the replay rate is exact and doesn't drift, regardless of the block duration.
+             * If the callback overruns, the following blocks are delivered back to back until the stream has caught
+             * up with the clock again, just like a device would deliver its buffered samples.
+             */
+            realtime,
+
+            /**
+             * Blocks are passed to the callback from a dedicated thread as fast as the callback processes them. The
+             * throughput achieved is logged when streaming stops, which makes the engine a benchmark for any
+             * SDRIODeviceCallback.
+             */
+            asFastAsPossible
+        };
+
+        /** Describes the last replay, see getReplayStatistics */
+        struct ReplayStatistics
+        {
+            /** The number of samples per channel passed to the callback */
+            int64_t numSamplesProcessed = 0;
+
+            /** The wall clock time between starting and stopping the stream */
+            double elapsedTimeInSeconds = 0.0;
+
+            double getSamplesPerSecond() const { return elapsedTimeInSeconds > 0.0 ? numSamplesProcessed / elapsedTimeInSeconds : 0.0; }
+
+            /** The number of blocks passed to the callback */
+            int64_t numBlocksProcessed = 0;
+
+            /**
+             * Only used in realtime mode. The number of blocks that could not be delivered in time because the
+             * deadline had already passed when the engine was ready for them, and the worst and mean delay of those.
+             */
+            int64_t numLateBlocks = 0;
+            double maxLatenessInSeconds = 0.0;
+            double meanLatenessInSeconds = 0.0;
+        };
+
         static const juce::Identifier propertyMCVFileEngine;
         static const juce::Identifier propertyInFile;
         static const juce::Identifier propertyOutFile;
@@ -36,15 +79,21 @@ namespace ntlab
         static const juce::Identifier propertyTxEnabled;
         static const juce::Identifier propertyInputEndOfFileBehaviour;
         static const juce::Identifier propertyNumOutChannels;
+        static const juce::Identifier propertyNumReadAheadBlocks;
+        static const juce::Identifier propertyInputMappingWindowSize;
+        static const juce::Identifier propertyReplayMode;
+
+        ~MCVFileEngine();
 
         /**
          * Sets the file to read from. Note that the file will be closed when streaming has stopped, so if you want to
          * start streaming again you need to reopen it. Depending on the endOfFileBehaviour chosen, stopStreaming will
          * be called automatically when the input file has reached its end. If enbableRx is set to true reading from
          * this file will start as soon as the streaming has been started, otherwise you need to enable it via
-         * enableRxTx manually.
+         * enableRxTx manually. Pass a mapping window size to only map a region of the file around the read position,
+         * which keeps the memory footprint constant when replaying very large files. @see MCVReader::MCVReader
          */
-        bool setInFile (juce::File& newInFile, MCVReader::EndOfFileBehaviour endOfFileBehaviour = MCVReader::EndOfFileBehaviour::stopAndResize, bool enableRx = true);
+        bool setInFile (juce::File& newInFile, MCVReader::EndOfFileBehaviour endOfFileBehaviour = MCVReader::EndOfFileBehaviour::stopAndResize, bool enableRx = true, int64_t mappingWindowSizeInBytes = 0);
 
         /**
          * Sets the file to write to. Note that if the file already exists, it will be overwritten. If enbableTx is set
@@ -53,6 +102,25 @@ namespace ntlab
          */
         bool setOutFile (juce::File& newOutFile, int newNumOutChannels, bool enableTx = true);
 
+        /**
+         * Sets the number of blocks the input file is read ahead of the streaming callback on a background thread.
+         * This keeps page faults away from the streaming thread when replaying files that are not in the page cache yet.
+         * Consumed pages of the input file are released, so long replays won't grow the memory footprint. Pass 0
+         * to disable read-ahead.
+         */
+        bool setNumReadAheadBlocks (int newNumReadAheadBlocks);
+
+        /** Sets the replay mode used for the next stream. This can't be changed while streaming */
+        bool setReplayMode (ReplayMode newReplayMode);
+
+        ReplayMode getReplayMode();
+
+        /**
+         * Returns the number of samples processed and the time it took for the last stream. The statistics are
+         * updated right before SDRIODeviceCallback::streamingHasStopped is called.
+         */
+        ReplayStatistics getReplayStatistics();
+
         const int getNumRxChannels() override;
 
         const int getNumTxChannels() override;
@@ -91,7 +159,9 @@ namespace ntlab
         int blockSize = 512;
 #endif
         int numOutChannels = 0;
+        int numReadAheadBlocks = 32;
         double sampleRate = 1e6;
+        ReplayMode replayMode = realtime;
 
         std::unique_ptr<MCVReader> mcvReader;
         std::unique_ptr<MCVWriter> mcvWriter;
@@ -104,14 +174,27 @@ namespace ntlab
 
         juce::ThreadPool streamingControlThread;
         SDRIODeviceCallback* activeCallback = nullptr;
+        SampleDropError sampleDropError;
         bool streamingIsRunning = false;
         bool shouldStopAtEndOfFile = true;
 
-        bool timerThreadIDisValid = false;
-        juce::Thread::ThreadID timerThreadID = nullptr;
+        juce::int64 streamingStartTicks = 0;
+        int64_t numSamplesProcessed = 0;
+        ReplayStatistics replayStatistics;
+        double totalLatenessInSeconds = 0.0;
+
+        /** The remaining time to a deadline that is busy waited instead of sleeping, as sleeping is not precise enough */
+        static constexpr double spinTimeInSeconds = 200e-6;
+
+        bool streamShouldStopAfterThisBlock = true;
+
+        void run() override;
+
+        /** Waits for the deadline of the next block in realtime mode and updates the late block statistics */
+        void waitForNextBlockDeadline();
 
-        bool timerShouldStopAfterThisCallback = true;
-        void hiResTimerCallback() override;
+        /** Reads, processes and writes one block. Returns true if streaming should stop after this block */
+        bool processNextBlock();
 
         void reallocateBuffers (bool reallocateInBuffer = true, bool reallocateOutBuffer = true);
 
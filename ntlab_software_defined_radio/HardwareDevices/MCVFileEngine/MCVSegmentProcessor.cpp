@@ -0,0 +1,327 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MCVSegmentProcessor.h"
+#include "../../UnitTestHelpers/UnitTestHelpers.h"
+
+#if ! NTLAB_USE_CL_SAMPLE_BUFFER_COMPLEX_FOR_SDR_IO_DEVICE_CALLBACK
+
+namespace ntlab
+{
+    MCVSegmentProcessor::MCVSegmentProcessor (const juce::File& inputFile, double sampleRate, int numThreads)
+      : inputFile (inputFile),
+        sampleRate (sampleRate),
+        threadPool (std::max (1, numThreads))
+    {
+        MCVReader reader (inputFile);
+
+        if (reader.isValid() && reader.isComplex())
+        {
+            numInChannels = static_cast<int> (reader.getNumColsOrChannels());
+            numSamplesInFile = reader.getNumRowsOrSamples();
+        }
+    }
+
+    void MCVSegmentProcessor::setSegmentation (int64_t newNumSamplesPerSegment, int64_t newNumOverlapSamples, OverlapHandling newOverlapHandling)
+    {
+        jassert (newNumSamplesPerSegment > 0);
+        jassert (newNumOverlapSamples >= 0);
+
+        // The output of a segment, including its overlap, is held in a single SampleBufferComplex
+        const int64_t maxNumSamplesPerSegmentWithOverlap = std::numeric_limits<int>::max();
+        jassert (newNumSamplesPerSegment + newNumOverlapSamples <= maxNumSamplesPerSegmentWithOverlap);
+
+        numSamplesPerSegment = juce::jlimit<int64_t> (1, maxNumSamplesPerSegmentWithOverlap, newNumSamplesPerSegment);
+        numOverlapSamples = juce::jlimit<int64_t> (0, maxNumSamplesPerSegmentWithOverlap - numSamplesPerSegment, newNumOverlapSamples);
+        overlapHandling = newOverlapHandling;
+    }
+
+    void MCVSegmentProcessor::setBlockSize (int newBlockSize)
+    {
+        jassert (newBlockSize > 0);
+        blockSize = newBlockSize;
+    }
+
+    int MCVSegmentProcessor::getNumSegments()
+    {
+        return static_cast<int> ((numSamplesInFile + numSamplesPerSegment - 1) / numSamplesPerSegment);
+    }
+
+    juce::Result MCVSegmentProcessor::process (const CallbackFactory& createCallback, int numOutChannels, const juce::File& outputFile)
+    {
+        if (numInChannels == 0)
+            return juce::Result::fail ("Can't read complex samples from " + inputFile.getFullPathName());
+
+        std::unique_ptr<MCVWriter> writer;
+
+        if (numOutChannels > 0)
+        {
+            writer.reset (new MCVWriter (numOutChannels, false, true, outputFile, 16 * blockSize));
+            if (!writer->isValid())
+                return juce::Result::fail ("Can't write to " + outputFile.getFullPathName());
+
+            writer->setOverflowPolicy (MCVWriter::blockUntilDeadline, 60000);
+        }
+
+        const auto numSegments = getNumSegments();
+        std::vector<std::unique_ptr<Segment>> segments (static_cast<size_t> (numSegments));
+        int numSegmentsStarted = 0;
+
+        std::vector<std::complex<float>*> outputPointers (static_cast<size_t> (numOutChannels));
+
+        for (int segmentIdx = 0; segmentIdx < numSegments; ++segmentIdx)
+        {
+            // Keep the thread pool busy while this thread waits for the next segment in order
+            while ((numSegmentsStarted < numSegments) && (numSegmentsStarted < segmentIdx + getMaxNumSegmentsInFlight()))
+            {
+                auto& segment = segments[static_cast<size_t> (numSegmentsStarted)];
+                segment.reset (new Segment);
+
+                segment->firstSample = numSegmentsStarted * numSamplesPerSegment;
+                segment->endSample = std::min (numSamplesInFile, segment->firstSample + numSamplesPerSegment);
+                segment->firstSampleToRead = std::max<int64_t> (0, segment->firstSample - numOverlapSamples);
+                segment->callback = createCallback (numSegmentsStarted);
+
+                threadPool.addJob ([this, s = segment.get(), numOutChannels]() { processSegment (*s, numOutChannels); });
+
+                ++numSegmentsStarted;
+            }
+
+            auto& segment = *segments[static_cast<size_t> (segmentIdx)];
+            segment.finished.wait();
+
+            if (onSegmentProcessed)
+                onSegmentProcessed (segmentIdx, *segment.callback);
+
+            if (writer != nullptr)
+            {
+                // The writer FIFO is smaller than a segment, so the output is appended block by block
+                auto& output = *segment.output;
+
+                for (int i = 0; i < output.getNumSamples(); i += blockSize)
+                {
+                    output.fillArrayOfPointersForReadingFrom (outputPointers.data(), i);
+                    SampleBufferComplex<float> block (numOutChannels, std::min (blockSize, output.getNumSamples() - i), outputPointers.data());
+
+                    if (writer->appendSampleBuffer (block) > 0)
+                    {
+                        threadPool.removeAllJobs (true, -1);
+                        return juce::Result::fail ("Writing to " + outputFile.getFullPathName() + " stalled");
+                    }
+                }
+            }
+
+            segments[static_cast<size_t> (segmentIdx)].reset();
+        }
+
+        if (writer != nullptr)
+            writer->waitForEmptyFIFO();
+
+        return juce::Result::ok();
+    }
+
+    void MCVSegmentProcessor::processSegment (Segment& segment, int numOutChannels)
+    {
+        MCVReader reader (inputFile, MCVReader::stopAndResize);
+        reader.seekToSample (segment.firstSampleToRead);
+
+        const auto firstSampleToKeep = overlapHandling == discardOverlapOutput ? segment.firstSample : segment.firstSampleToRead;
+        const auto numOutputSamples = static_cast<int> (segment.endSample - firstSampleToKeep);
+
+        SampleBufferComplex<float> inBlock  (numInChannels,  blockSize);
+        SampleBufferComplex<float> outBlock (numOutChannels, blockSize);
+        segment.output.reset (new SampleBufferComplex<float> (numOutChannels, numOutputSamples));
+
+        segment.callback->prepareForStreaming (sampleRate, numInChannels, numOutChannels, blockSize);
+
+        for (auto s = segment.firstSampleToRead; s < segment.endSample;)
+        {
+            auto numSamples = static_cast<int> (std::min<int64_t> (blockSize, segment.endSample - s));
+
+            inBlock.setNumSamples (numSamples);
+            reader.fillNextSamplesIntoBuffer (inBlock);
+            outBlock.setNumSamples (numOutChannels > 0 ? numSamples : 0);
+
+            segment.callback->processRFSampleBlock (inBlock, outBlock);
+
+            // Only keep the output of the samples past the overlap if it should be discarded
+            auto numSamplesToSkip = static_cast<int> (juce::jlimit<int64_t> (0, numSamples, firstSampleToKeep - s));
+            if ((numOutChannels > 0) && (numSamplesToSkip < numSamples))
+                outBlock.copyTo (*segment.output, numSamples - numSamplesToSkip, numOutChannels, numSamplesToSkip, static_cast<int> (s + numSamplesToSkip - firstSampleToKeep));
+
+            s += numSamples;
+        }
+
+        segment.callback->streamingHasStopped();
+        segment.finished.signal();
+    }
+
+#ifdef NTLAB_SOFTWARE_DEFINED_RADIO_UNIT_TESTS
+
+    class MCVSegmentProcessorTest : public juce::UnitTest
+    {
+    public:
+        MCVSegmentProcessorTest() : juce::UnitTest ("MCVSegmentProcessor test") {};
+
+        void runTest() override
+        {
+            auto tempFolder = juce::File::getSpecialLocation (juce::File::SpecialLocationType::tempDirectory);
+            auto inFile             = tempFolder.getChildFile ("segmentProcessorIn.mcv");
+            auto sequentialOutFile  = tempFolder.getChildFile ("segmentProcessorSequential.mcv");
+            auto parallelOutFile    = tempFolder.getChildFile ("segmentProcessorParallel.mcv");
+            auto keepOverlapOutFile = tempFolder.getChildFile ("segmentProcessorKeepOverlap.mcv");
+
+            auto random = getRandom();
+
+            SampleBufferComplex<float> srcBuffer (numChannels, numSamples);
+            UnitTestHelpers::fillSampleBuffer (srcBuffer, random);
+            MCVWriter::writeSampleBuffer (srcBuffer, inFile);
+
+            auto createMovingAverage = [] (int) { return std::unique_ptr<SDRIODeviceCallback> (new MovingAverage); };
+
+            beginTest ("Process as a single segment");
+
+            MCVSegmentProcessor sequentialProcessor (inFile, 1e6, 1);
+            sequentialProcessor.setSegmentation (numSamples);
+            expectEquals (sequentialProcessor.getNumSegments(), 1);
+            expect (sequentialProcessor.process (createMovingAverage, numChannels, sequentialOutFile).wasOk());
+
+            beginTest ("Process overlapping segments in parallel");
+
+            MCVSegmentProcessor parallelProcessor (inFile, 1e6, 4);
+            parallelProcessor.setSegmentation (1000, MovingAverage::length - 1);
+            expectEquals (parallelProcessor.getNumSegments(), (numSamples + 999) / 1000);
+
+            int nextSegmentExpected = 0;
+            parallelProcessor.onSegmentProcessed = [&] (int segmentIdx, SDRIODeviceCallback&) { expectEquals (segmentIdx, nextSegmentExpected++); };
+
+            expect (parallelProcessor.process (createMovingAverage, numChannels, parallelOutFile).wasOk());
+            expectEquals (nextSegmentExpected, parallelProcessor.getNumSegments());
+
+            // With an overlap covering the filter length, the segment boundaries are invisible in the output
+            MCVReader sequentialReader (sequentialOutFile);
+            MCVReader parallelReader (parallelOutFile);
+            expect (sequentialReader.getNumRowsOrSamples() == numSamples);
+            auto sequentialOutput = sequentialReader.createSampleBufferComplexFloat();
+            auto parallelOutput = parallelReader.createSampleBufferComplexFloat();
+            expect (UnitTestHelpers::areEqualSampleBuffers (sequentialOutput, parallelOutput));
+
+            beginTest ("Keep the output of the overlap samples");
+
+            const int numSamplesPerSegment = 1000;
+            const int numOverlapSamples = MovingAverage::length - 1;
+
+            MCVSegmentProcessor keepOverlapProcessor (inFile, 1e6, 4);
+            keepOverlapProcessor.setSegmentation (numSamplesPerSegment, numOverlapSamples, MCVSegmentProcessor::keepOverlapOutput);
+            expect (keepOverlapProcessor.process (createMovingAverage, numChannels, keepOverlapOutFile).wasOk());
+
+            // Each segment after the first one is longer by its overlap samples
+            const int numSegments = keepOverlapProcessor.getNumSegments();
+            MCVReader keepOverlapReader (keepOverlapOutFile);
+            expect (keepOverlapReader.getNumRowsOrSamples() == numSamples + (numSegments - 1) * numOverlapSamples);
+            auto keepOverlapOutput = keepOverlapReader.createSampleBufferComplexFloat();
+
+            for (int segmentIdx = 1; segmentIdx < numSegments; ++segmentIdx)
+            {
+                const int firstSample = segmentIdx * numSamplesPerSegment;
+                const int endSample = std::min (numSamples, firstSample + numSamplesPerSegment);
+                const int segmentStartInOutput = firstSample + (segmentIdx - 1) * numOverlapSamples;
+
+                // The prefix is the output of a filter that starts from scratch at the first overlap sample
+                SampleBufferComplex<float> overlapIn  (numChannels, numOverlapSamples);
+                SampleBufferComplex<float> overlapOut (numChannels, numOverlapSamples);
+                srcBuffer.copyTo (overlapIn, numOverlapSamples, numChannels, firstSample - numOverlapSamples);
+
+                MovingAverage freshFilter;
+                freshFilter.prepareForStreaming (1e6, numChannels, numChannels, numOverlapSamples);
+                freshFilter.processRFSampleBlock (overlapIn, overlapOut);
+
+                bool prefixMatches = true;
+                bool remainderMatches = true;
+
+                for (int c = 0; c < numChannels; ++c)
+                {
+                    auto* segmentOutput = keepOverlapOutput.getReadPointer (c) + segmentStartInOutput;
+
+                    for (int i = 0; i < numOverlapSamples; ++i)
+                        prefixMatches &= segmentOutput[i] == overlapOut.getReadPointer (c)[i];
+
+                    // Past the overlap, the filter has settled and the output matches the one of a single segment
+                    for (int i = firstSample; i < endSample; ++i)
+                        remainderMatches &= segmentOutput[numOverlapSamples + i - firstSample] == sequentialOutput.getReadPointer (c)[i];
+                }
+
+                expect (prefixMatches, "Unexpected overlap output at the start of segment " + juce::String (segmentIdx));
+                expect (remainderMatches, "Unexpected output after the overlap of segment " + juce::String (segmentIdx));
+            }
+
+            inFile.deleteFile();
+            sequentialOutFile.deleteFile();
+            parallelOutFile.deleteFile();
+            keepOverlapOutFile.deleteFile();
+        }
+
+    private:
+        static const int numChannels = 2;
+        static const int numSamples = 10500;
+
+        /** A stateful filter, its output depends on the last samples of the previous block */
+        class MovingAverage : public SDRIODeviceCallback
+        {
+        public:
+            static const int length = 16;
+
+            void prepareForStreaming (double, int numActiveChannelsIn, int, int) override
+            {
+                history.assign (static_cast<size_t> (numActiveChannelsIn * length), std::complex<float> (0.0f));
+            }
+
+            void processRFSampleBlock (OptionalCLSampleBufferComplexFloat& rxSamples, OptionalCLSampleBufferComplexFloat& txSamples) override
+            {
+                for (int c = 0; c < rxSamples.getNumChannels(); ++c)
+                {
+                    auto* channelHistory = history.data() + c * length;
+
+                    for (int i = 0; i < rxSamples.getNumSamples(); ++i)
+                    {
+                        std::memmove (channelHistory, channelHistory + 1, (length - 1) * sizeof (std::complex<float>));
+                        channelHistory[length - 1] = rxSamples.getReadPointer (c)[i];
+
+                        std::complex<float> sum (0.0f);
+                        for (int k = 0; k < length; ++k)
+                            sum += channelHistory[k];
+
+                        txSamples.getWritePointer (c)[i] = sum / static_cast<float> (length);
+                    }
+                }
+            }
+
+            void streamingHasStopped() override {}
+
+            void handleError (const StreamingError&) override {}
+
+        private:
+            std::vector<std::complex<float>> history;
+        };
+    };
+
+    static MCVSegmentProcessorTest mcvSegmentProcessorTest;
+
+#endif // NTLAB_SOFTWARE_DEFINED_RADIO_UNIT_TESTS
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../SDRIODeviceCallback.h"
+#include "../../MCVFileFormat/MCVReader.h"
+#include "../../MCVFileFormat/MCVWriter.h"
+
+#if ! NTLAB_USE_CL_SAMPLE_BUFFER_COMPLEX_FOR_SDR_IO_DEVICE_CALLBACK
+
+namespace ntlab
+{
+    /**
+     * Processes an MCV file offline on all cores. The file is split into segments, each segment is streamed through
+     * its own instance of an SDRIODeviceCallback created by a factory function and the segments are processed in
+     * parallel on a thread pool. The callbacks see the usual sequence of prepareForStreaming, processRFSampleBlock
+     * and streamingHasStopped calls, just like they would when the segment was replayed by the MCVFileEngine.
+     *
+     * As the callbacks are independent, stateful processing like filters would start from scratch at each segment
+     * boundary. To avoid this, each segment can start a number of overlap samples before its actual beginning so that
+     * the callback state has settled when the segment begins. The overlap handling determines what happens with the
+     * output the callback produced for these samples.
+     *
+     * The output of all segments is written to an MCV file in segment order, no matter in which order the segments
+     * finished. Results the callbacks collect themselves can be merged through onSegmentProcessed, which is also called
+     * in segment order. Only the segments currently processed and the ones waiting to be merged are held in memory.
+     * This is not available if NTLAB_USE_CL_SAMPLE_BUFFER_COMPLEX_FOR_SDR_IO_DEVICE_CALLBACK is enabled.
+     */
+    class MCVSegmentProcessor
+    {
+    public:
+        /** Determines what happens with the output of the samples that overlap with the previous segment */
+        enum OverlapHandling
+        {
+            /**
+             * The overlap samples are only used to settle the callback state, their output is discarded. The output
+             * file contains exactly one output sample per input sample.
+             */
+            discardOverlapOutput,
+
+            /**
+             * The output of the overlap samples is kept, so each segment after the first one starts with the output
+             * of its overlap samples. The output file is longer than the input file in this case.
+             */
+            keepOverlapOutput
+        };
+
+        /** Creates a new callback instance for the segment passed */
+        using CallbackFactory = std::function<std::unique_ptr<SDRIODeviceCallback> (int segmentIdx)>;
+
+        /**
+         * Creates a processor for the input file passed. The sample rate is passed to the callbacks and the number of
+         * threads determines how many segments are processed in parallel.
+         */
+        MCVSegmentProcessor (const juce::File& inputFile, double sampleRate, int numThreads = juce::SystemStats::getNumCpus());
+
+        /**
+         * Sets the length of the segments and the number of samples each segment starts before its beginning. The
+         * first segment has no overlap. As the output of a segment is held in a single buffer, the segment length plus
+         * the overlap must not exceed the maximum int value, larger values are clamped.
+         */
+        void setSegmentation (int64_t numSamplesPerSegment, int64_t numOverlapSamples = 0, OverlapHandling overlapHandling = discardOverlapOutput);
+
+        /** Sets the number of samples passed to each processRFSampleBlock call */
+        void setBlockSize (int newBlockSize);
+
+        /** Returns the number of segments the input file will be split into */
+        int getNumSegments();
+
+        /**
+         * Processes the whole input file and returns when all segments have been processed. If the number of output
+         * channels is greater than zero, the output of the callbacks is written to the output file.
+         */
+        juce::Result process (const CallbackFactory& createCallback, int numOutChannels = 0, const juce::File& outputFile = juce::File());
+
+        /**
+         * Called on the thread that invoked process after a segment has been processed and before its callback is
+         * destroyed. This is called in ascending segment order, so it can be used to merge the results of the
+         * callbacks in order.
+         */
+        std::function<void (int segmentIdx, SDRIODeviceCallback& callback)> onSegmentProcessed;
+
+    private:
+        struct Segment
+        {
+            int64_t firstSampleToRead;
+            int64_t firstSample;
+            int64_t endSample;
+
+            std::unique_ptr<SDRIODeviceCallback> callback;
+            std::unique_ptr<SampleBufferComplex<float>> output;
+            juce::WaitableEvent finished;
+        };
+
+        const juce::File inputFile;
+        const double sampleRate;
+
+        // Read from the file header on construction, numInChannels is 0 if the file is not valid
+        int numInChannels = 0;
+        int64_t numSamplesInFile = 0;
+
+        int64_t numSamplesPerSegment = 1 << 20;
+        int64_t numOverlapSamples = 0;
+        OverlapHandling overlapHandling = discardOverlapOutput;
+        int blockSize = 512;
+
+        juce::ThreadPool threadPool;
+
+        /** Limits the number of segments held in memory at the same time */
+        int getMaxNumSegmentsInFlight() { return 2 * threadPool.getNumThreads(); }
+
+        void processSegment (Segment& segment, int numOutChannels);
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MCVSegmentProcessor)
+    };
+}
+
+#endif
@@ -69,7 +69,7 @@ namespace ntlab
 
         juce::StringRef getErrorDescription() const override
         {
-            static juce::String errorDescription = "Dropped " +
+            errorDescription = "Dropped " +
                     ((numRxSampsDropped < 0) ? "an unknown amount of" : juce::String (numRxSampsDropped)) +
                     " rx samples and " +
                     ((numTxSampsDropped < 0) ? "an unknown amount of" : juce::String (numTxSampsDropped)) +
@@ -80,6 +80,8 @@ namespace ntlab
     private:
         int numRxSampsDropped = -1;
         int numTxSampsDropped = -1;
+
+        mutable juce::String errorDescription;
     };
 
     // A lightweight object that just holds a StringRef to pass an external string to the error. Should be created
@@ -128,6 +130,37 @@ namespace ntlab
     using OptionalCLSampleBufferComplexFloat = SampleBufferComplex<float>;
 #endif
 
+    /**
+     * Describes when the first sample of a block of rx samples was received. Engines that can't provide a hardware
+     * time leave hasTime false but still count the sample index up continuously.
+     */
+    struct RxBlockTimestamp
+    {
+        /** True if the hardware delivered a time for this block */
+        bool hasTime = false;
+
+        /** The device time of the first sample in device clock ticks, only valid if hasTime is true */
+        int64_t firstSampleTicks = 0;
+
+        /** The device time of the first sample in seconds, only valid if hasTime is true */
+        double firstSampleSeconds = 0.0;
+
+        /** The rate at which the device clock ticks, 0 if unknown */
+        double tickRate = 0.0;
+
+        /**
+         * The index of the first sample in this block, counted from the first sample received after streaming was
+         * started. If the hardware delivers times, samples lost through an overflow are taken into account.
+         */
+        int64_t firstSampleIndex = 0;
+
+        /**
+         * If a timed retune took effect during this block, this is the index of the first sample in the block that was
+         * received with the new center frequency. It is -1 if no timed retune took effect during this block.
+         */
+        int retuneSampleOffset = -1;
+    };
+
     /**
      * A pure virtual interface class describing the interface any class needs to implement that should continously
      * process samples from an SDR IO device. processRFSampleBlock will be called repeatedly on a high-priority thread.
@@ -157,6 +190,16 @@ namespace ntlab
          */
         virtual void processRFSampleBlock (OptionalCLSampleBufferComplexFloat& rxSamples, OptionalCLSampleBufferComplexFloat& txSamples) = 0;
 
+        /**
+         * Engines that know when the rx samples were received call this instead of processRFSampleBlock. Override it
+         * if your processing needs the timestamp of the block. The default implementation just forwards the call to
+         * processRFSampleBlock, so callbacks not interested in timestamps don't need to care about it.
+         */
+        virtual void processTimestampedRFSampleBlock (OptionalCLSampleBufferComplexFloat& rxSamples, OptionalCLSampleBufferComplexFloat& txSamples, const RxBlockTimestamp& /* rxTimestamp */)
+        {
+            processRFSampleBlock (rxSamples, txSamples);
+        }
+
         /**
          * This callback will be called after the last call to processRFSampleBlock. It is the place to do all your
          * cleanup work.
@@ -56,6 +56,12 @@ namespace ntlab
          * Otherwise it swaps buffers and passes them to the second processing thread
          */
         void processRFSampleBlock (OptionalCLSampleBufferComplexFloat& rxSamples, OptionalCLSampleBufferComplexFloat& txSamples) override
+        {
+            processTimestampedRFSampleBlock (rxSamples, txSamples, RxBlockTimestamp());
+        }
+
+        /** Like processRFSampleBlock, the timestamp passed has to be the one of the first sample in the rx buffer */
+        void processTimestampedRFSampleBlock (OptionalCLSampleBufferComplexFloat& rxSamples, OptionalCLSampleBufferComplexFloat& txSamples, const RxBlockTimestamp& rxTimestamp) override
         {
             if (rxEnabled)
             {
@@ -71,6 +77,7 @@ namespace ntlab
 
 
             processingSyncPoint.wait();
+            swapTimestamp = rxTimestamp;
             rxSamples.swapWith (rxSwapBuffer);
             txSamples.swapWith (txSwapBuffer);
             notify();
@@ -103,7 +110,7 @@ namespace ntlab
                 if (threadShouldExit())
                     return;
 
-                originalCallback.processRFSampleBlock (rxSwapBuffer, txSwapBuffer);
+                originalCallback.processTimestampedRFSampleBlock (rxSwapBuffer, txSwapBuffer, swapTimestamp);
                 processingSyncPoint.signal();
             }
         }
@@ -119,6 +126,7 @@ namespace ntlab
 #else
         SampleBufferComplex<float> rxSwapBuffer, txSwapBuffer;
 #endif
+        RxBlockTimestamp swapTimestamp;
         juce::WaitableEvent processingSyncPoint;
         int threadTimeout = 0;
     };
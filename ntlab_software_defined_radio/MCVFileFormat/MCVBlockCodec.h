@@ -0,0 +1,92 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace ntlab
+{
+    /**
+     * The lossless codec used for the blocks of a compressed MCV file. Each block is encoded independently, so that
+     * blocks can be decoded in any order and in parallel. The block content is byte-shuffled first, which means that
+     * all first bytes of each scalar value are grouped together, followed by all second bytes and so on. For sample
+     * data close to the noise floor the exponent and high mantissa bytes are highly redundant, so grouping them
+     * leads to long runs that the following zlib stage compresses well. The fastest zlib compression level is used
+     * to keep up with the data rates of streaming applications.
+     */
+    struct MCVBlockCodec
+    {
+        /**
+         * Encodes numBytes of raw block data and appends the encoded block to the destination stream. The size of a
+         * scalar value is 4 for float and 8 for double data. The shuffleBuffer will be resized if needed, pass in the
+         * same instance for successive calls to avoid repeated allocations. Returns the number of bytes written.
+         */
+        static int64_t encodeBlock (const void* rawData, size_t numBytes, size_t sizeOfScalar, juce::OutputStream& destination, juce::MemoryBlock& shuffleBuffer)
+        {
+            shuffleBuffer.ensureSize (numBytes);
+            shuffle (static_cast<const uint8_t*> (rawData), static_cast<uint8_t*> (shuffleBuffer.getData()), numBytes, sizeOfScalar);
+
+            auto startPosition = destination.getPosition();
+            {
+                juce::GZIPCompressorOutputStream compressor (destination, 1);
+                if (!compressor.write (shuffleBuffer.getData(), numBytes))
+                    return -1;
+            }
+
+            return destination.getPosition() - startPosition;
+        }
+
+        /**
+         * Decodes an encoded block into the destination memory which has to be able to hold numDecodedBytes. The
+         * shuffleBuffer will be resized if needed, pass in the same instance for successive calls to avoid repeated
+         * allocations. Returns false if the encoded data is corrupted.
+         */
+        static bool decodeBlock (const void* encodedData, size_t numEncodedBytes, void* destination, size_t numDecodedBytes, size_t sizeOfScalar, juce::MemoryBlock& shuffleBuffer)
+        {
+            shuffleBuffer.ensureSize (numDecodedBytes);
+
+            juce::MemoryInputStream encodedStream (encodedData, numEncodedBytes, false);
+            juce::GZIPDecompressorInputStream decompressor (encodedStream);
+
+            if (decompressor.read (shuffleBuffer.getData(), static_cast<int> (numDecodedBytes)) != static_cast<int> (numDecodedBytes))
+                return false;
+
+            unshuffle (static_cast<const uint8_t*> (shuffleBuffer.getData()), static_cast<uint8_t*> (destination), numDecodedBytes, sizeOfScalar);
+            return true;
+        }
+
+    private:
+        static void shuffle (const uint8_t* in, uint8_t* out, size_t numBytes, size_t sizeOfScalar)
+        {
+            const auto numScalars = numBytes / sizeOfScalar;
+
+            for (size_t b = 0; b < sizeOfScalar; ++b)
+                for (size_t i = 0; i < numScalars; ++i)
+                    out[b * numScalars + i] = in[i * sizeOfScalar + b];
+        }
+
+        static void unshuffle (const uint8_t* in, uint8_t* out, size_t numBytes, size_t sizeOfScalar)
+        {
+            const auto numScalars = numBytes / sizeOfScalar;
+
+            for (size_t b = 0; b < sizeOfScalar; ++b)
+                for (size_t i = 0; i < numScalars; ++i)
+                    out[i * sizeOfScalar + b] = in[b * numScalars + i];
+        }
+    };
+}
@@ -0,0 +1,225 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <vector>
+
+namespace ntlab
+{
+    /**
+     * The trailing chunk index of a chunked MCV file. A chunked MCV file stores its payload exactly like a plain MCV
+     * file but has an additional index appended after the payload. Each entry of the index marks the beginning of a
+     * chunk and stores the byte offset of its first sample in the file, the index of that sample, a timestamp and the
+     * center frequency the samples in this chunk were recorded at. The index is followed by the number of entries
+     * as signed 64 bit integer, so a reader can locate it by reading the last 8 bytes of the file.
+     *
+     * A compressed MCV file uses a second index of the same format to locate its independently encoded blocks. In
+     * this block index, the timestamp and center frequency of each entry are unused. The chunk index of a compressed
+     * file is appended after the block index.
+     */
+    class MCVChunkIndex
+    {
+    public:
+        struct Entry
+        {
+            /** The offset of the first byte of this chunk, counted from the beginning of the file */
+            int64_t byteOffset;
+
+            /** The row or sample index of the first sample of this chunk */
+            int64_t firstSample;
+
+            /** The timestamp of the first sample of this chunk in seconds */
+            double timestamp;
+
+            /** The center frequency this chunk was recorded at in Hz. Set to 0 if not applicable */
+            double centerFrequency;
+        };
+
+        /** The size of one serialised index entry */
+        static const int sizeOfEntryInBytes = 32;
+
+        /** The size of the trailing entry count written after the last entry */
+        static const int sizeOfTrailerInBytes = 8;
+
+        MCVChunkIndex() {}
+
+        /** Returns the number of chunks held by the index */
+        int getNumChunks() const { return static_cast<int> (entries.size()); }
+
+        bool isEmpty() const { return entries.empty(); }
+
+        /** Returns an entry. The index passed must be valid */
+        const Entry& getEntry (int chunkIdx) const
+        {
+            jassert (juce::isPositiveAndBelow (chunkIdx, getNumChunks()));
+            return entries[static_cast<size_t> (chunkIdx)];
+        }
+
+        /**
+         * Appends a new entry. Entries must be added in ascending sample order, entries starting at the same sample
+         * as the last one will replace that one.
+         */
+        void addEntry (const Entry& newEntry)
+        {
+            if (!entries.empty())
+            {
+                // Chunks must be appended in ascending sample order
+                jassert (newEntry.firstSample >= entries.back().firstSample);
+
+                if (newEntry.firstSample == entries.back().firstSample)
+                {
+                    entries.back() = newEntry;
+                    return;
+                }
+            }
+
+            entries.push_back (newEntry);
+        }
+
+        /**
+         * Adjusts the index after numSamplesRemoved samples starting at firstSampleRemoved have been taken out of the
+         * stream before being written. Chunks that started in the removed region start at the first sample after it,
+         * all later chunks move towards the beginning. This doesn't allocate.
+         */
+        void removeSamples (int64_t firstSampleRemoved, int64_t numSamplesRemoved, int64_t numBytesPerSample)
+        {
+            size_t numEntriesKept = 0;
+
+            for (auto& e : entries)
+            {
+                if (e.firstSample > firstSampleRemoved)
+                {
+                    auto shift = std::min (numSamplesRemoved, e.firstSample - firstSampleRemoved);
+                    e.firstSample -= shift;
+                    e.byteOffset  -= shift * numBytesPerSample;
+                }
+
+                // Chunks that collapsed onto the same sample are replaced by the latest one
+                if ((numEntriesKept > 0) && (entries[numEntriesKept - 1].firstSample == e.firstSample))
+                    entries[numEntriesKept - 1] = e;
+                else
+                    entries[numEntriesKept++] = e;
+            }
+
+            entries.resize (numEntriesKept);
+        }
+
+        /** Pre-allocates memory for the expected number of chunks */
+        void reserve (int numChunks) { entries.reserve (static_cast<size_t> (numChunks)); }
+
+        void clear() { entries.clear(); }
+
+        /**
+         * Returns the index of the chunk containing the sample passed or -1 if the sample lies before the first
+         * chunk. This is a binary search over the index.
+         */
+        int findChunkContainingSample (int64_t sampleIdx) const
+        {
+            auto it = std::upper_bound (entries.begin(), entries.end(), sampleIdx, [] (int64_t s, const Entry& e) { return s < e.firstSample; });
+            return static_cast<int> (std::distance (entries.begin(), it)) - 1;
+        }
+
+        /**
+         * Returns the index of the last chunk that started at or before the point in time passed or -1 if the time
+         * lies before the first chunk. This is a binary search over the index, it expects ascending timestamps.
+         */
+        int findChunkContainingTime (double timeInSeconds) const
+        {
+            auto it = std::upper_bound (entries.begin(), entries.end(), timeInSeconds, [] (double t, const Entry& e) { return t < e.timestamp; });
+            return static_cast<int> (std::distance (entries.begin(), it)) - 1;
+        }
+
+        /** Returns the first sample after the chunk passed. For the last chunk, the total number of samples passed is returned */
+        int64_t getEndOfChunk (int chunkIdx, int64_t totalNumSamples) const
+        {
+            return chunkIdx + 1 < getNumChunks() ? getEntry (chunkIdx + 1).firstSample : totalNumSamples;
+        }
+
+        /** Returns the number of bytes needed to store the index including the trailing entry count */
+        int64_t getSerialisedSizeInBytes (int numEntries = -1) const
+        {
+            if (numEntries < 0)
+                numEntries = getNumChunks();
+
+            return static_cast<int64_t> (numEntries) * sizeOfEntryInBytes + sizeOfTrailerInBytes;
+        }
+
+        /**
+         * Writes the first numEntries entries followed by the entry count to the current position of the stream.
+         * Pass -1 to write all entries.
+         */
+        bool writeToStream (juce::OutputStream& outputStream, int numEntries = -1) const
+        {
+            if (numEntries < 0)
+                numEntries = getNumChunks();
+
+            for (int i = 0; i < numEntries; ++i)
+            {
+                auto& e = entries[static_cast<size_t> (i)];
+
+                if (!outputStream.write (&e.byteOffset,      8)) return false;
+                if (!outputStream.write (&e.firstSample,     8)) return false;
+                if (!outputStream.write (&e.timestamp,       8)) return false;
+                if (!outputStream.write (&e.centerFrequency, 8)) return false;
+            }
+
+            int64_t numEntriesToWrite = numEntries;
+            return outputStream.write (&numEntriesToWrite, 8);
+        }
+
+        /**
+         * Reads the index from the end of a memory block holding the whole file. Returns false if the block does not
+         * end with a valid index. In this case the index will be empty.
+         */
+        bool readFromEndOfBlock (const void* data, int64_t sizeOfBlock)
+        {
+            entries.clear();
+
+            if (sizeOfBlock < sizeOfTrailerInBytes)
+                return false;
+
+            auto bytes = static_cast<const char*> (data);
+
+            int64_t numEntries;
+            std::memcpy (&numEntries, bytes + sizeOfBlock - sizeOfTrailerInBytes, 8);
+
+            // check the count read from the file in 64 bit before narrowing it, a corrupt count must not wrap around
+            const int64_t maxNumEntries = (sizeOfBlock - sizeOfTrailerInBytes) / sizeOfEntryInBytes;
+            if ((numEntries < 0) || (numEntries > maxNumEntries) || (numEntries > std::numeric_limits<int>::max()))
+                return false;
+
+            auto entryPtr = bytes + sizeOfBlock - getSerialisedSizeInBytes (static_cast<int> (numEntries));
+            entries.resize (static_cast<size_t> (numEntries));
+
+            for (auto& e : entries)
+            {
+                std::memcpy (&e.byteOffset,      entryPtr,      8);
+                std::memcpy (&e.firstSample,     entryPtr + 8,  8);
+                std::memcpy (&e.timestamp,       entryPtr + 16, 8);
+                std::memcpy (&e.centerFrequency, entryPtr + 24, 8);
+                entryPtr += sizeOfEntryInBytes;
+            }
+
+            return true;
+        }
+
+    private:
+        std::vector<Entry> entries;
+    };
+}
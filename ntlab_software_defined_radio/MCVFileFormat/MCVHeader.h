@@ -116,6 +116,23 @@ namespace ntlab
         /** Returns true if the MCV file contains double precision values */
         bool hasDoublePrecision() {return flags[1]; }
 
+        /** Returns true if the payload of the MCV file is followed by a chunk index. @see MCVChunkIndex */
+        bool hasChunkIndex() {return flags[2]; }
+
+        void setHasChunkIndex (bool shouldHaveChunkIndex) { flags.set (2, shouldHaveChunkIndex); }
+
+        /**
+         * Returns true if the payload is stored as independently compressed blocks. In this case, the file always
+         * has a block index that stores the location of each block, followed by the chunk index if there is one.
+         * @see MCVBlockCodec
+         */
+        bool isCompressed() {return flags[3]; }
+
+        void setCompressed (bool shouldBeCompressed) { flags.set (3, shouldBeCompressed); }
+
+        /** Returns the size of a single float or double value, regardless if the values are complex or not */
+        size_t sizeOfOneScalar() { return hasDoublePrecision() ? 8 : 4; }
+
         size_t sizeOfOneValue()
         {
             size_t size = 4;
@@ -128,6 +145,10 @@ namespace ntlab
             return size;
         }
 
+        /**
+         * Returns the size of the header and the payload. A chunk index might follow after this. For compressed files
+         * this is the size the file would have if it was not compressed.
+         */
         size_t expectedSizeOfFile()
         {
             size_t size = sizeOfHeaderInBytes;
@@ -158,7 +179,7 @@ namespace ntlab
 
     private:
         char identifier[7];
-        // bit 0: complex, bit 1: double, other bits: unused
+        // bit 0: complex, bit 1: double, bit 2: chunk index appended, bit 3: compressed, other bits: unused
         std::bitset<8> flags;
         int64_t numColsOrChannels;
         int64_t numRowsOrSamples;
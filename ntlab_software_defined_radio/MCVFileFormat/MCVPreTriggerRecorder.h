@@ -0,0 +1,252 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "MCVWriter.h"
+#include "../SampleBuffers/SampleBuffers.h"
+
+namespace ntlab
+{
+    /**
+     * An always-on recorder that keeps the most recent complex samples of all channels in a preallocated ring buffer
+     * and writes a window around a trigger event to an MCV file. Push every block received to it from your
+     * processRFSampleBlock callback and call trigger from the same thread when something interesting happens. Both
+     * calls never allocate or block. As soon as the post-trigger samples have been pushed, a background thread writes
+     * the window to a new file in the output directory.
+     *
+     * The ring holds twice the window length, so the window is safe from being overwritten for the duration of one
+     * window after it has been completed. If writing the file takes longer, writing stops as soon as the ring has
+     * caught up with it and the window is reported as incomplete. The resulting file contains two chunks, the first
+     * one starting at the beginning of the window and the second one starting at the trigger sample, so that
+     * MCVReader::getChunkFirstSample (1) returns the trigger position within the file.
+     */
+    template <typename SampleType>
+    class MCVPreTriggerRecorder : private juce::Thread
+    {
+    public:
+        /**
+         * Creates the recorder and allocates its ring buffer. Files are named after the file name prefix and the time
+         * the trigger fired and are placed in the output directory, which has to exist.
+         */
+        MCVPreTriggerRecorder (int numChannels,
+                               double sampleRate,
+                               double preTriggerTimeInSeconds,
+                               double postTriggerTimeInSeconds,
+                               const juce::File& outputDirectory,
+                               const juce::String& fileNamePrefix = "trigger")
+          : juce::Thread ("MCVPreTriggerRecorder"),
+            numPreTriggerSamples  (juce::roundToInt (preTriggerTimeInSeconds  * sampleRate)),
+            numPostTriggerSamples (juce::roundToInt (postTriggerTimeInSeconds * sampleRate)),
+            ringSize (2 * (numPreTriggerSamples + numPostTriggerSamples)),
+            ring (numChannels, ringSize, true),
+            windowPointers (static_cast<size_t> (numChannels)),
+            sampleRate (sampleRate),
+            directory (outputDirectory),
+            prefix (fileNamePrefix)
+        {
+            jassert (numChannels > 0);
+            jassert (ringSize > 0);
+            jassert (outputDirectory.isDirectory());
+
+            startThread();
+        }
+
+        ~MCVPreTriggerRecorder()
+        {
+            stopThread (-1);
+        }
+
+        /**
+         * Appends a block of samples to the ring. Call this for every block received on the realtime thread, this
+         * never allocates or blocks.
+         */
+        template <typename BufferType>
+        void pushSamples (const BufferType& samples)
+        {
+            static_assert (IsSampleBuffer<BufferType, SampleType>::complex(), "The recorder only accepts complex buffers with matching precision");
+            jassert (samples.getNumChannels() == ring.getNumChannels());
+
+            const auto numSamples = samples.getNumSamples();
+            jassert (numSamples <= ringSize);
+
+            const auto firstSample = numSamplesPushed.load (std::memory_order_relaxed);
+
+            // Announce the region that is about to be overwritten before touching it, so the writer thread can tell
+            // if the samples it has just read are still valid
+            numSamplesClaimed.store (firstSample + numSamples, std::memory_order_release);
+
+            auto ringIdx = static_cast<int> (firstSample % ringSize);
+            auto numSamplesToEnd = std::min (numSamples, ringSize - ringIdx);
+
+            samples.copyTo (ring, numSamplesToEnd, ring.getNumChannels(), 0, ringIdx);
+
+            if (numSamplesToEnd < numSamples)
+                samples.copyTo (ring, numSamples - numSamplesToEnd, ring.getNumChannels(), numSamplesToEnd, 0);
+
+            numSamplesPushed.store (firstSample + numSamples, std::memory_order_release);
+
+            auto triggerPosition = triggerSample.load (std::memory_order_acquire);
+            if ((triggerPosition >= 0) && (firstSample + numSamples >= triggerPosition + numPostTriggerSamples) && !windowCompleted.exchange (true))
+                notify();
+        }
+
+        /**
+         * Marks the end of the samples pushed so far as the trigger position. Returns false if the window of a
+         * previous trigger has not been written yet, in this case the trigger is ignored. This never allocates or
+         * blocks, so it can be called from the realtime thread.
+         */
+        bool trigger (double centerFrequency = 0.0)
+        {
+            int64_t noTrigger = -1;
+            auto triggerPosition = numSamplesPushed.load (std::memory_order_relaxed);
+
+            if (!triggerSample.compare_exchange_strong (noTrigger, triggerPosition, std::memory_order_acq_rel))
+                return false;
+
+            // The writer thread only reads these after the window has been completed on this thread
+            triggerTimeInMilliseconds = juce::Time::currentTimeMillis();
+            triggerCenterFrequency    = centerFrequency;
+
+            if ((numPostTriggerSamples == 0) && !windowCompleted.exchange (true))
+                notify();
+
+            return true;
+        }
+
+        /** Returns true while a trigger has fired and its window has not been written completely */
+        bool isTriggered() const { return triggerSample.load() >= 0; }
+
+        /** Returns the number of samples written before and after each trigger */
+        int getNumPreTriggerSamples()  const { return numPreTriggerSamples; }
+        int getNumPostTriggerSamples() const { return numPostTriggerSamples; }
+
+        /**
+         * Called on the writer thread after a window has been written. The flag is false if the ring was overwritten
+         * before the whole window was written or the file could not be opened.
+         */
+        std::function<void (const juce::File& file, bool windowComplete)> onWindowWritten = [] (const juce::File&, bool) {};
+
+    private:
+        static constexpr int maxNumSamplesPerAppend = 16384;
+
+        const int numPreTriggerSamples;
+        const int numPostTriggerSamples;
+        const int ringSize;
+
+        SampleBufferComplex<SampleType> ring;
+        std::vector<std::complex<SampleType>*> windowPointers;
+
+        std::atomic<int64_t> numSamplesPushed  {0};
+        std::atomic<int64_t> numSamplesClaimed {0};
+        std::atomic<int64_t> triggerSample     {-1};
+        std::atomic<bool>    windowCompleted   {false};
+
+        std::atomic<juce::int64> triggerTimeInMilliseconds {0};
+        std::atomic<double>      triggerCenterFrequency    {0.0};
+
+        const double sampleRate;
+        const juce::File directory;
+        const juce::String prefix;
+
+        int64_t getFirstValidSample() const
+        {
+            return std::max<int64_t> (0, numSamplesClaimed.load (std::memory_order_acquire) - ringSize);
+        }
+
+        void run() override
+        {
+            while (!threadShouldExit())
+            {
+                wait (-1);
+
+                if (windowCompleted.load())
+                {
+                    writeWindow();
+
+                    // Re-arm the trigger before clearing the flag so that a block pushed in between can't complete
+                    // the window of the trigger that has just been written again
+                    triggerSample = -1;
+                    windowCompleted = false;
+                }
+            }
+        }
+
+        void writeWindow()
+        {
+            const auto triggerPosition = triggerSample.load();
+            const auto triggerTime = triggerTimeInMilliseconds.load() / 1000.0;
+            const auto centerFrequency = triggerCenterFrequency.load();
+
+            auto windowStart = std::max (triggerPosition - numPreTriggerSamples, getFirstValidSample());
+            auto windowEnd   = triggerPosition + numPostTriggerSamples;
+
+            auto fileName = prefix + juce::Time (triggerTimeInMilliseconds.load()).formatted ("_%Y-%m-%d_%H-%M-%S");
+            auto file = directory.getNonexistentChildFile (fileName, ".mcv", false);
+
+            bool windowComplete = true;
+
+            {
+                MCVWriter writer (ring.getNumChannels(), std::is_same<SampleType, double>::value, true, file, 2 * maxNumSamplesPerAppend);
+
+                if (!writer.isValid())
+                {
+                    onWindowWritten (file, false);
+                    return;
+                }
+
+                writer.setOverflowPolicy (MCVWriter::blockUntilDeadline, 1000);
+                writer.reserveChunkIndex (2);
+                writer.startNewChunk (triggerTime - (triggerPosition - windowStart) / sampleRate, centerFrequency);
+
+                for (auto s = windowStart; s < windowEnd;)
+                {
+                    if ((s == triggerPosition) && (s > windowStart))
+                        writer.startNewChunk (triggerTime, centerFrequency);
+
+                    auto ringIdx = static_cast<int> (s % ringSize);
+                    auto numSamples = static_cast<int> (std::min<int64_t> ({windowEnd - s, ringSize - ringIdx, maxNumSamplesPerAppend}));
+
+                    // Don't let a segment cross the trigger so that the second chunk starts exactly there
+                    if ((s < triggerPosition) && (s + numSamples > triggerPosition))
+                        numSamples = static_cast<int> (triggerPosition - s);
+
+                    ring.fillArrayOfPointersForReadingFrom (windowPointers.data(), ringIdx);
+                    SampleBufferComplex<SampleType> segment (ring.getNumChannels(), numSamples, windowPointers.data());
+
+                    auto numSamplesDropped = writer.appendSampleBuffer (segment);
+
+                    // The realtime thread might have overwritten the segment while it was copied
+                    if ((numSamplesDropped > 0) || (s < getFirstValidSample()))
+                    {
+                        windowComplete = false;
+                        break;
+                    }
+
+                    s += numSamples;
+                }
+
+                writer.waitForEmptyFIFO();
+            }
+
+            onWindowWritten (file, windowComplete);
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MCVPreTriggerRecorder)
+    };
+}
@@ -17,10 +17,20 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 
 #include "MCVReader.h"
 
+#if ! JUCE_WINDOWS
+#include <sys/mman.h>
+#endif
+
 namespace ntlab
 {
-    MCVReader::MCVReader (const juce::File& mcvFile, EndOfFileBehaviour endOfFileBehaviour)
-      : file (mcvFile, juce::MemoryMappedFile::readOnly, true),
+    MCVReader::MCVReader (const juce::File& mcvFile, EndOfFileBehaviour endOfFileBehaviour, int64_t mappingWindowSizeInBytes)
+      : sourceFile (mcvFile),
+        fileSize (mcvFile.getSize()),
+        mappingWindowSize (std::max<int64_t> (0, mappingWindowSizeInBytes)),
+        file (mcvFile,
+              juce::Range<juce::int64> (0, mappingWindowSize > 0 ? std::min<juce::int64> (fileSize, MCVHeader::sizeOfHeaderInBytes) : fileSize),
+              juce::MemoryMappedFile::readOnly,
+              mappingWindowSize == 0),
         behaviour (endOfFileBehaviour)
     {
         jassert (mcvFile.hasFileExtension ("mcv"));
@@ -33,13 +43,197 @@ namespace ntlab
         if (!metadata->isValid())
             return;
 
-        if (file.getSize() != metadata->expectedSizeOfFile())
+        numBytesPerRow = metadata->sizeOfOneValue() * static_cast<size_t> (metadata->getNumColsOrChannels());
+
+        if (metadata->isCompressed())
+        {
+            if (!openCompressedFile())
+                return;
+        }
+        else if (metadata->hasChunkIndex())
+        {
+            if (!readIndex (chunkIndex, fileSize))
+                return;
+
+            if (fileSize != metadata->expectedSizeOfFile() + chunkIndex.getSerialisedSizeInBytes())
+                return;
+        }
+        else if (fileSize != metadata->expectedSizeOfFile())
+        {
             return;
+        }
 
         valid = true;
-        beginOfSamples = juce::addBytesToPointer (file.getData(), MCVHeader::sizeOfHeaderInBytes);
-        readPtr = beginOfSamples;
-        numRowsOrSamplesRemaining = metadata->getNumRowsOrSamples();
+
+        if (!isWindowed())
+            beginOfSamples = juce::addBytesToPointer (file.getData(), MCVHeader::sizeOfHeaderInBytes);
+    }
+
+    MCVReader::~MCVReader()
+    {
+        readAheadThread.reset();
+
+        // The thread pool is shared with other readers, so blocks still decoded for this reader have to be awaited
+        for (auto& block : decodedBlocks)
+            if (block->decodingInProgress)
+                block->decodingFinished.wait();
+    }
+
+    bool MCVReader::openCompressedFile()
+    {
+        // The chunk index, if any, is appended after the block index
+        auto endOfBlockIndex = fileSize;
+
+        if (metadata->hasChunkIndex())
+        {
+            if (!readIndex (chunkIndex, fileSize))
+                return false;
+
+            endOfBlockIndex -= chunkIndex.getSerialisedSizeInBytes();
+
+            for (int i = 0; i < chunkIndex.getNumChunks(); ++i)
+                if (!juce::isPositiveAndBelow (chunkIndex.getEntry (i).firstSample, getNumRowsOrSamples()))
+                    return false;
+        }
+
+        if (!readIndex (blockIndex, endOfBlockIndex))
+            return false;
+
+        endOfEncodedBlocks = endOfBlockIndex - blockIndex.getSerialisedSizeInBytes();
+
+        if (blockIndex.isEmpty())
+            return metadata->getNumRowsOrSamples() == 0;
+
+        // Check that the blocks are consecutive and don't exceed the payload region
+        int64_t previousOffset = MCVHeader::sizeOfHeaderInBytes;
+        int64_t previousFirstSample = -1;
+
+        if (blockIndex.getEntry (0).firstSample != 0)
+            return false;
+
+        for (int i = 0; i < blockIndex.getNumChunks(); ++i)
+        {
+            auto& block = blockIndex.getEntry (i);
+
+            if ((block.byteOffset < previousOffset) || (block.byteOffset > endOfEncodedBlocks))
+                return false;
+
+            if ((block.firstSample <= previousFirstSample) || (block.firstSample >= getNumRowsOrSamples()))
+                return false;
+
+            previousOffset = block.byteOffset;
+            previousFirstSample = block.firstSample;
+        }
+
+        for (int i = 0; i < blockIndex.getNumChunks(); ++i)
+            maxNumRowsPerBlock = std::max (maxNumRowsPerBlock, getNumRowsInBlock (i));
+
+        // One cached block is read while the others are decoded ahead by the thread pool
+        auto numCachedBlocks = std::min (getThreadPool().getNumThreads(), 8) + 1;
+
+        for (int i = 0; i < numCachedBlocks; ++i)
+            decodedBlocks.emplace_back (new DecodedBlock);
+
+        return true;
+    }
+
+    bool MCVReader::readIndex (MCVChunkIndex& index, int64_t endOfIndex)
+    {
+        if (!isWindowed())
+            return index.readFromEndOfBlock (file.getData(), endOfIndex);
+
+        // Map the trailing entry count first to find out how much of the file end has to be mapped for the index
+        const auto trailerStart = endOfIndex - MCVChunkIndex::sizeOfTrailerInBytes;
+        if (trailerStart < MCVHeader::sizeOfHeaderInBytes)
+            return false;
+
+        int64_t numEntries;
+        {
+            juce::MemoryMappedFile trailer (sourceFile, juce::Range<juce::int64> (trailerStart, endOfIndex), juce::MemoryMappedFile::readOnly, false);
+            if (trailer.getData() == nullptr)
+                return false;
+
+            std::memcpy (&numEntries, getPointerToByte (trailer, trailerStart), 8);
+        }
+
+        if ((numEntries < 0) || (numEntries > (endOfIndex - MCVHeader::sizeOfHeaderInBytes) / MCVChunkIndex::sizeOfEntryInBytes))
+            return false;
+
+        const auto indexStart = endOfIndex - index.getSerialisedSizeInBytes (static_cast<int> (numEntries));
+
+        juce::MemoryMappedFile indexMapping (sourceFile, juce::Range<juce::int64> (indexStart, endOfIndex), juce::MemoryMappedFile::readOnly, false);
+        if (indexMapping.getData() == nullptr)
+            return false;
+
+        return index.readFromEndOfBlock (getPointerToByte (indexMapping, indexStart), endOfIndex - indexStart);
+    }
+
+    const char* MCVReader::getPointerToByte (const juce::MemoryMappedFile& mapping, int64_t byteOffset)
+    {
+        // The mapping doesn't contain the byte requested
+        jassert (mapping.getRange().contains (byteOffset));
+
+        return static_cast<const char*> (mapping.getData()) + (byteOffset - mapping.getRange().getStart());
+    }
+
+    void MCVReader::moveWindowToRow (int64_t row)
+    {
+        const auto rowStart = MCVHeader::sizeOfHeaderInBytes + row * static_cast<int64_t> (numBytesPerRow);
+
+        if ((window != nullptr) && (window->getRange().getStart() <= rowStart) && (window->getRange().getEnd() >= rowStart + static_cast<int64_t> (numBytesPerRow)))
+            return;
+
+        // Unmap the old window first, so that both are never mapped at the same time. The window always holds at
+        // least one row.
+        window.reset();
+
+        auto windowEnd = std::min (fileSize, rowStart + std::max (mappingWindowSize, static_cast<int64_t> (numBytesPerRow)));
+        window.reset (new juce::MemoryMappedFile (sourceFile, juce::Range<juce::int64> (rowStart, windowEnd), juce::MemoryMappedFile::readOnly, false));
+
+        // If this fails, the file could not be mapped, e.g. because it has been deleted
+        jassert (window->getData() != nullptr);
+
+#if ! JUCE_WINDOWS
+        if (adviseSequentialAccess && (window->getData() != nullptr))
+            madvise (window->getData(), window->getSize(), MADV_SEQUENTIAL);
+#endif
+    }
+
+    juce::ThreadPool& MCVReader::getThreadPool()
+    {
+        return sharedThreadPool->getThreadPool();
+    }
+
+    juce::ThreadPool& MCVReader::SharedThreadPool::getThreadPool()
+    {
+        const juce::ScopedLock scopedLock (lock);
+
+        if (threadPool == nullptr)
+            threadPool.reset (new juce::ThreadPool (juce::jmax (1, juce::SystemStats::getNumCpus())));
+
+        return *threadPool;
+    }
+
+    void MCVReader::runInParallel (int numJobs, std::function<void (int)> job)
+    {
+        if (numJobs == 0)
+            return;
+
+        std::atomic<int> numJobsRemaining (numJobs);
+        juce::WaitableEvent allJobsFinished;
+
+        for (int i = 0; i < numJobs; ++i)
+        {
+            getThreadPool().addJob ([i, &job, &numJobsRemaining, &allJobsFinished]()
+            {
+                job (i);
+
+                if (--numJobsRemaining == 0)
+                    allJobsFinished.signal();
+            });
+        }
+
+        allJobsFinished.wait();
     }
 
     bool MCVReader::isValid () {return valid; }
@@ -48,6 +242,8 @@ namespace ntlab
 
     bool MCVReader::hasDoublePrecision () {return metadata->hasDoublePrecision(); }
 
+    bool MCVReader::isCompressed () {return metadata->isCompressed(); }
+
     int64_t MCVReader::getNumColsOrChannels () {return metadata->getNumColsOrChannels(); }
 
     int64_t MCVReader::getNumRowsOrSamples () {return metadata->getNumRowsOrSamples(); }
@@ -58,7 +254,7 @@ namespace ntlab
             return SampleBufferReal<float> (0, 0);
 
         SampleBufferReal<float> buf (static_cast<int> (getNumColsOrChannels()), static_cast<int> (getNumRowsOrSamples()));
-        fillBuffer (buf.getArrayOfWritePointers(), beginOfSamples, getNumRowsOrSamples ());
+        readRows (buf.getArrayOfWritePointers(), 0, getNumRowsOrSamples());
         return buf;
     }
 
@@ -68,7 +264,7 @@ namespace ntlab
             return SampleBufferReal<double> (0, 0);
 
         SampleBufferReal<double> buf (static_cast<int> (getNumColsOrChannels()), static_cast<int> (getNumRowsOrSamples()));
-        fillBuffer (buf.getArrayOfWritePointers(), beginOfSamples, getNumRowsOrSamples());
+        readRows (buf.getArrayOfWritePointers(), 0, getNumRowsOrSamples());
         return buf;
     }
 
@@ -78,7 +274,7 @@ namespace ntlab
             return SampleBufferComplex<float> (0, 0);
 
         SampleBufferComplex<float> buf (static_cast<int> (getNumColsOrChannels()), static_cast<int> (getNumRowsOrSamples()));
-        fillBuffer (buf.getArrayOfWritePointers(), beginOfSamples, getNumRowsOrSamples());
+        readRows (buf.getArrayOfWritePointers(), 0, getNumRowsOrSamples());
         return buf;
     }
 
@@ -88,7 +284,7 @@ namespace ntlab
             return SampleBufferComplex<double> (0, 0);
 
         SampleBufferComplex<double> buf (static_cast<int> (getNumColsOrChannels()), static_cast<int> (getNumRowsOrSamples()));
-        fillBuffer (buf.getArrayOfWritePointers(), beginOfSamples, getNumRowsOrSamples());
+        readRows (buf.getArrayOfWritePointers(), 0, getNumRowsOrSamples());
         return buf;
     }
 
@@ -99,9 +295,9 @@ namespace ntlab
             return Eigen::MatrixXf();
 
         if (hasDoublePrecision())
-            return createMatrixRealDouble().cast<float>();
+            return createMatrixFromPayload<Eigen::MatrixXf, double>();
 
-        return Eigen::Map<Eigen::MatrixXf> (static_cast<float*> (beginOfSamples), getNumRowsOrSamples(), getNumColsOrChannels());
+        return createMatrixFromPayload<Eigen::MatrixXf, float>();
     }
 
     Eigen::MatrixXd MCVReader::createMatrixRealDouble()
@@ -109,10 +305,10 @@ namespace ntlab
         if (isComplex() || (!valid))
             return Eigen::MatrixXd();
 
-        if (!hasDoublePrecision())
-            return createMatrixRealFloat().cast<double>();
+        if (hasDoublePrecision())
+            return createMatrixFromPayload<Eigen::MatrixXd, double>();
 
-        return Eigen::Map<Eigen::MatrixXd> (static_cast<double*> (beginOfSamples), getNumRowsOrSamples(), getNumColsOrChannels());
+        return createMatrixFromPayload<Eigen::MatrixXd, float>();
     }
 
     Eigen::MatrixXcf MCVReader::createMatrixComplexFloat()
@@ -123,18 +319,18 @@ namespace ntlab
         if (isComplex())
         {
             if (hasDoublePrecision())
-                return createMatrixComplexDouble().cast<std::complex<float>>();
+                return createMatrixFromPayload<Eigen::MatrixXcf, std::complex<double>>();
 
-            return Eigen::Map<Eigen::MatrixXcf> (static_cast<std::complex<float>*> (beginOfSamples), getNumRowsOrSamples(), getNumColsOrChannels());
+            return createMatrixFromPayload<Eigen::MatrixXcf, std::complex<float>>();
         }
 
         if (hasDoublePrecision())
-            return createMatrixRealDouble().cast<std::complex<float>>();
+            return createMatrixFromPayload<Eigen::MatrixXcf, double>();
 
-        return createMatrixRealDouble().cast<std::complex<float>>();
+        return createMatrixFromPayload<Eigen::MatrixXcf, float>();
     }
 
-    Eigen::MatrixXcd MCVReader::createMatrixComplexDouble ()
+    Eigen::MatrixXcd MCVReader::createMatrixComplexDouble()
     {
         if (!valid)
             return Eigen::MatrixXcd();
@@ -142,111 +338,752 @@ namespace ntlab
         if (isComplex())
         {
             if (hasDoublePrecision())
-                return Eigen::Map<Eigen::MatrixXcd> (static_cast<std::complex<double>*> (beginOfSamples), getNumRowsOrSamples(), getNumColsOrChannels());
+                return createMatrixFromPayload<Eigen::MatrixXcd, std::complex<double>>();
 
-            return createMatrixComplexFloat().cast<std::complex<double>>();
+            return createMatrixFromPayload<Eigen::MatrixXcd, std::complex<float>>();
         }
 
         if (hasDoublePrecision())
-            return createMatrixRealDouble().cast<std::complex<double>>();
+            return createMatrixFromPayload<Eigen::MatrixXcd, double>();
+
+        return createMatrixFromPayload<Eigen::MatrixXcd, float>();
+    }
+
+    Eigen::Map<const Eigen::MatrixXf>  MCVReader::getMatrixViewRealFloat()     { return getMatrixView<float>(); }
+    Eigen::Map<const Eigen::MatrixXd>  MCVReader::getMatrixViewRealDouble()    { return getMatrixView<double>(); }
+    Eigen::Map<const Eigen::MatrixXcf> MCVReader::getMatrixViewComplexFloat()  { return getMatrixView<std::complex<float>>(); }
+    Eigen::Map<const Eigen::MatrixXcd> MCVReader::getMatrixViewComplexDouble() { return getMatrixView<std::complex<double>>(); }
+
+    template <typename ValueType>
+    Eigen::Map<const Eigen::Matrix<ValueType, Eigen::Dynamic, Eigen::Dynamic>> MCVReader::getMatrixView()
+    {
+        using View = Eigen::Map<const Eigen::Matrix<ValueType, Eigen::Dynamic, Eigen::Dynamic>>;
+
+        const bool valueTypeMatches = isComplex() ? (hasDoublePrecision() ? std::is_same<ValueType, std::complex<double>>::value : std::is_same<ValueType, std::complex<float>>::value)
+                                                  : (hasDoublePrecision() ? std::is_same<ValueType, double>::value               : std::is_same<ValueType, float>::value);
 
-        return createMatrixRealFloat().cast<std::complex<double>>();
+        // Only a completely mapped plain payload can be viewed without copying
+        if (!valid || !valueTypeMatches || isCompressed() || isWindowed())
+            return View (nullptr, 0, 0);
+
+        return View (static_cast<const ValueType*> (beginOfSamples), getNumRowsOrSamples(), getNumColsOrChannels());
+    }
+
+    template <typename MatrixType, typename FileValueType>
+    MatrixType MCVReader::createMatrixFromPayload()
+    {
+        // Decoding or copying only happens for compressed or windowed files, plain files are converted straight from the mapping
+        juce::MemoryBlock payloadStorage;
+        Eigen::Map<const Eigen::Matrix<FileValueType, Eigen::Dynamic, Eigen::Dynamic>> payload (static_cast<const FileValueType*> (getWholePayload (payloadStorage)), getNumRowsOrSamples(), getNumColsOrChannels());
+
+        return payload.template cast<typename MatrixType::Scalar>();
     }
 #endif
 
-    int64_t MCVReader::getReadPosition() {return metadata->getNumRowsOrSamples() - numRowsOrSamplesRemaining; }
+    int64_t MCVReader::getReadPosition() {return readPosition; }
+
+    bool MCVReader::seekToSample (int64_t sampleIdx)
+    {
+        if (!valid)
+            return false;
+
+        if (!juce::isPositiveAndNotGreaterThan (sampleIdx, getNumRowsOrSamples()))
+            return false;
+
+        readPosition = sampleIdx;
+        readPositionChanged();
+        return true;
+    }
+
+    bool MCVReader::seekToTime (double timeInSeconds, double sampleRate)
+    {
+        if ((!valid) || chunkIndex.isEmpty())
+            return false;
+
+        auto chunkIdx = chunkIndex.findChunkContainingTime (timeInSeconds);
+        if (chunkIdx < 0)
+            return false;
+
+        auto& chunk = chunkIndex.getEntry (chunkIdx);
+        auto endOfChunk = chunkIndex.getEndOfChunk (chunkIdx, getNumRowsOrSamples());
+
+        auto sampleIdx = chunk.firstSample;
+        if (sampleRate > 0.0)
+            sampleIdx = std::min (endOfChunk, sampleIdx + static_cast<int64_t> ((timeInSeconds - chunk.timestamp) * sampleRate + 0.5));
+
+        if (sampleIdx >= getNumRowsOrSamples())
+            return false;
+
+        return seekToSample (sampleIdx);
+    }
+
+    void MCVReader::enableReadAhead (int numBlocksAhead, int numRowsPerBlock, bool releaseConsumedPages)
+    {
+        readAheadThread.reset();
+
+        if ((!valid) || (numBlocksAhead <= 0) || (numRowsPerBlock <= 0))
+            return;
+
+#if ! JUCE_WINDOWS
+        if (isWindowed())
+            adviseSequentialAccess = true;
+        else
+            madvise (file.getData(), file.getSize(), MADV_SEQUENTIAL);
+#endif
+
+        readAheadThread.reset (new ReadAheadThread (*this, static_cast<int64_t> (numBlocksAhead) * numRowsPerBlock, numRowsPerBlock, releaseConsumedPages));
+        readPositionChanged();
+    }
+
+    bool MCVReader::hasChunkIndex() {return !chunkIndex.isEmpty(); }
+
+    int MCVReader::getNumChunks() {return chunkIndex.getNumChunks(); }
+
+    int64_t MCVReader::getChunkFirstSample (int chunkIdx) {return chunkIndex.getEntry (chunkIdx).firstSample; }
+
+    double MCVReader::getChunkTimestamp (int chunkIdx) {return chunkIndex.getEntry (chunkIdx).timestamp; }
+
+    double MCVReader::getChunkCenterFrequency (int chunkIdx) {return chunkIndex.getEntry (chunkIdx).centerFrequency; }
+
+    int MCVReader::getCurrentChunk()
+    {
+        if (chunkIndex.isEmpty())
+            return -1;
+
+        return chunkIndex.findChunkContainingSample (getReadPosition());
+    }
+
+    const void* MCVReader::getRowsPointer (int64_t firstRow, int64_t& numRowsAvailable)
+    {
+        if (!isCompressed())
+        {
+            numRowsAvailable = getNumRowsOrSamples() - firstRow;
+
+            if (!isWindowed())
+                return readPositionPtrForSample (firstRow);
+
+            moveWindowToRow (firstRow);
+
+            const auto rowStart = MCVHeader::sizeOfHeaderInBytes + firstRow * static_cast<int64_t> (numBytesPerRow);
+            numRowsAvailable = std::min (numRowsAvailable, (window->getRange().getEnd() - rowStart) / static_cast<int64_t> (numBytesPerRow));
+            return getPointerToByte (*window, rowStart);
+        }
+
+        auto blockIdx = blockIndex.findChunkContainingSample (firstRow);
+        auto& block = getDecodedBlock (blockIdx);
+        auto rowInBlock = firstRow - blockIndex.getEntry (blockIdx).firstSample;
+
+        numRowsAvailable = getNumRowsInBlock (blockIdx) - rowInBlock;
+        return juce::addBytesToPointer (block.data.getData(), static_cast<size_t> (rowInBlock) * numBytesPerRow);
+    }
+
+    const void* MCVReader::getWholePayload (juce::MemoryBlock& storage)
+    {
+        if (!isCompressed())
+        {
+            if (!isWindowed())
+                return beginOfSamples;
+
+            storage.setSize (static_cast<size_t> (getNumRowsOrSamples()) * numBytesPerRow);
+
+            for (int64_t row = 0; row < getNumRowsOrSamples();)
+            {
+                int64_t numRowsAvailable;
+                auto source = getRowsPointer (row, numRowsAvailable);
+                std::memcpy (juce::addBytesToPointer (storage.getData(), static_cast<size_t> (row) * numBytesPerRow), source, static_cast<size_t> (numRowsAvailable) * numBytesPerRow);
+                row += numRowsAvailable;
+            }
+
+            return storage.getData();
+        }
+
+        storage.setSize (static_cast<size_t> (getNumRowsOrSamples()) * numBytesPerRow);
+
+        runInParallel (blockIndex.getNumChunks(), [this, &storage] (int blockIdx)
+        {
+            juce::MemoryBlock shuffleBuffer;
+            auto destination = juce::addBytesToPointer (storage.getData(), static_cast<size_t> (blockIndex.getEntry (blockIdx).firstSample) * numBytesPerRow);
+            decodeBlock (blockIdx, destination, shuffleBuffer);
+        });
+
+        return storage.getData();
+    }
+
+    int64_t MCVReader::getNumRowsInBlock (int blockIdx)
+    {
+        auto endOfBlock = (blockIdx + 1 < blockIndex.getNumChunks()) ? blockIndex.getEntry (blockIdx + 1).firstSample : getNumRowsOrSamples();
+        return endOfBlock - blockIndex.getEntry (blockIdx).firstSample;
+    }
+
+    bool MCVReader::decodeBlock (int blockIdx, void* destination, juce::MemoryBlock& shuffleBuffer)
+    {
+        auto& block = blockIndex.getEntry (blockIdx);
+        auto endOfBlock = (blockIdx + 1 < blockIndex.getNumChunks()) ? blockIndex.getEntry (blockIdx + 1).byteOffset : endOfEncodedBlocks;
+        auto numDecodedBytes = static_cast<size_t> (getNumRowsInBlock (blockIdx)) * numBytesPerRow;
+
+        // With a mapping window, each block is mapped on its own, so that blocks can be decoded on multiple threads
+        std::unique_ptr<juce::MemoryMappedFile> blockMapping;
+        const void* encodedBlock;
+
+        if (isWindowed())
+        {
+            blockMapping.reset (new juce::MemoryMappedFile (sourceFile, juce::Range<juce::int64> (block.byteOffset, endOfBlock), juce::MemoryMappedFile::readOnly, false));
+            encodedBlock = blockMapping->getData() != nullptr ? getPointerToByte (*blockMapping, block.byteOffset) : nullptr;
+        }
+        else
+        {
+            encodedBlock = juce::addBytesToPointer (file.getData(), block.byteOffset);
+        }
+
+        if ((encodedBlock != nullptr) &&
+            MCVBlockCodec::decodeBlock (encodedBlock,
+                                        static_cast<size_t> (endOfBlock - block.byteOffset),
+                                        destination,
+                                        numDecodedBytes,
+                                        metadata->sizeOfOneScalar(),
+                                        shuffleBuffer))
+            return true;
+
+        // If you hit this, the compressed file is corrupted. The block will be filled with zeros
+        jassertfalse;
+        std::memset (destination, 0, numDecodedBytes);
+        return false;
+    }
+
+    MCVReader::DecodedBlock& MCVReader::getDecodedBlock (int blockIdx)
+    {
+        const int numCachedBlocks = static_cast<int> (decodedBlocks.size());
+        auto& block = *decodedBlocks[static_cast<size_t> (blockIdx % numCachedBlocks)];
+
+        if (block.blockIdx != blockIdx)
+            startDecodingBlock (block, blockIdx);
+
+        // Decode the following blocks in the background, so that they are ready when the reading thread needs them
+        for (int i = 1; i < numCachedBlocks; ++i)
+        {
+            auto nextBlockIdx = blockIdx + i;
+            if (nextBlockIdx >= blockIndex.getNumChunks())
+                break;
+
+            auto& nextBlock = *decodedBlocks[static_cast<size_t> (nextBlockIdx % numCachedBlocks)];
+            if (nextBlock.blockIdx != nextBlockIdx)
+                startDecodingBlock (nextBlock, nextBlockIdx);
+        }
+
+        if (block.decodingInProgress)
+        {
+            block.decodingFinished.wait();
+            block.decodingInProgress = false;
+        }
+
+        return block;
+    }
+
+    void MCVReader::startDecodingBlock (DecodedBlock& block, int blockIdx)
+    {
+        // Don't touch a block that is still decoded by the thread pool
+        if (block.decodingInProgress)
+            block.decodingFinished.wait();
+
+        block.decodingFinished.reset();
+        block.decodingInProgress = true;
+        block.blockIdx = blockIdx;
+        block.data.ensureSize (static_cast<size_t> (maxNumRowsPerBlock) * numBytesPerRow);
+
+        getThreadPool().addJob ([this, &block, blockIdx]()
+        {
+            decodeBlock (blockIdx, block.data.getData(), block.shuffleBuffer);
+            block.decodingFinished.signal();
+        });
+    }
+
+    template <typename DestinationType>
+    void MCVReader::readRowsFromAllSources (DestinationType** destinationBuffer, int64_t firstRow, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+    {
+        // Large reads from completely mapped plain files and whole compressed files are converted in parallel.
+        // Partial reads from compressed files go through the block cache and plain files with a mapping window go
+        // through the window, both are only accessed by the reading thread.
+        const bool canReadInParallel = isCompressed() ? (numRowsOrSamples == getNumRowsOrSamples()) : (!isWindowed());
+
+        if ((numRowsOrSamples >= minNumRowsForParallelReading) && canReadInParallel)
+        {
+            juce::MemoryBlock payloadStorage;
+            auto sourceStart = static_cast<const char*> (getWholePayload (payloadStorage)) + static_cast<size_t> (firstRow) * numBytesPerRow;
+
+            fillBufferInParallel (destinationBuffer, sourceStart, numRowsOrSamples, destinationStartRowOrSample);
+            return;
+        }
+
+        while (numRowsOrSamples > 0)
+        {
+            int64_t numRowsAvailable;
+            auto sourceStart = getRowsPointer (firstRow, numRowsAvailable);
+            auto numRowsToRead = std::min (numRowsOrSamples, numRowsAvailable);
+
+            fillBuffer (destinationBuffer, sourceStart, numRowsToRead, destinationStartRowOrSample);
+
+            firstRow                    += numRowsToRead;
+            destinationStartRowOrSample += numRowsToRead;
+            numRowsOrSamples            -= numRowsToRead;
+        }
+    }
+
+    template <typename DestinationType>
+    void MCVReader::fillBufferInParallel (DestinationType** destinationBuffer, const void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+    {
+        // Partitions start at multiples of 1024 rows, so the destination vectors of two partitions don't share cache
+        // lines and the SIMD conversion of each partition starts aligned if the destination buffer is aligned
+        const int64_t partitionGranularity = 1024;
+        auto numPartitions = std::max<int64_t> (getThreadPool().getNumThreads(), (numRowsOrSamples + maxNumRowsPerPartition - 1) / maxNumRowsPerPartition);
+        auto numRowsPerPartition = (numRowsOrSamples + numPartitions - 1) / numPartitions;
+        numRowsPerPartition = ((numRowsPerPartition + partitionGranularity - 1) / partitionGranularity) * partitionGranularity;
+        numPartitions = (numRowsOrSamples + numRowsPerPartition - 1) / numRowsPerPartition;
+
+        runInParallel (static_cast<int> (numPartitions), [&] (int partition)
+        {
+            auto firstRow = partition * numRowsPerPartition;
+            auto numRowsInPartition = std::min (numRowsPerPartition, numRowsOrSamples - firstRow);
+
+            fillBuffer (destinationBuffer,
+                        static_cast<const char*> (sourceStart) + static_cast<size_t> (firstRow) * numBytesPerRow,
+                        numRowsInPartition,
+                        destinationStartRowOrSample + firstRow);
+        });
+    }
+
+    template <typename SourceType, typename DestinationType>
+    void MCVReader::deinterleaveRows (const SourceType* source, DestinationType** destinationBuffer, int64_t numCols, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+    {
+        if (numCols == 1)
+        {
+            auto* destination = destinationBuffer[0] + destinationStartRowOrSample;
+
+            if constexpr (std::is_same<SourceType, DestinationType>::value)
+            {
+                std::memcpy (destination, source, static_cast<size_t> (numRowsOrSamples) * sizeof (SourceType));
+            }
+            else
+            {
+                for (int64_t row = 0; row < numRowsOrSamples; ++row)
+                    destination[row] = DestinationType (source[row]);
+            }
+
+            return;
+        }
+
+        if constexpr (std::is_same<SourceType, float>::value && std::is_same<DestinationType, float>::value)
+        {
+            // Two interleaved real columns have the memory layout of a complex vector, so we can use the SIMD
+            // accelerated complex split
+            if (numCols == 2)
+            {
+                ComplexVectorOperations::extractRealAndImagPart (reinterpret_cast<const std::complex<float>*> (source),
+                                                                 destinationBuffer[0] + destinationStartRowOrSample,
+                                                                 destinationBuffer[1] + destinationStartRowOrSample,
+                                                                 static_cast<int> (numRowsOrSamples));
+                return;
+            }
+        }
+
+        const int64_t numRowsPerBlock = 64;
+
+        for (int64_t blockStart = 0; blockStart < numRowsOrSamples; blockStart += numRowsPerBlock)
+        {
+            auto blockEnd = std::min (numRowsOrSamples, blockStart + numRowsPerBlock);
+
+            for (int64_t col = 0; col < numCols; ++col)
+            {
+                auto* destination = destinationBuffer[col] + destinationStartRowOrSample;
+                auto* sourceColumn = source + col;
+
+                for (int64_t row = blockStart; row < blockEnd; ++row)
+                    destination[row] = DestinationType (sourceColumn[row * numCols]);
+            }
+        }
+    }
+
+    void MCVReader::readRows (float** destinationBuffer, int64_t firstRow, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+    {
+        readRowsFromAllSources (destinationBuffer, firstRow, numRowsOrSamples, destinationStartRowOrSample);
+    }
+
+    void MCVReader::readRows (double** destinationBuffer, int64_t firstRow, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+    {
+        readRowsFromAllSources (destinationBuffer, firstRow, numRowsOrSamples, destinationStartRowOrSample);
+    }
+
+    void MCVReader::readRows (std::complex<float>** destinationBuffer, int64_t firstRow, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+    {
+        readRowsFromAllSources (destinationBuffer, firstRow, numRowsOrSamples, destinationStartRowOrSample);
+    }
+
+    void MCVReader::readRows (std::complex<double>** destinationBuffer, int64_t firstRow, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+    {
+        readRowsFromAllSources (destinationBuffer, firstRow, numRowsOrSamples, destinationStartRowOrSample);
+    }
+
+    void MCVReader::readSelectedRows (float** destinationBuffer, const juce::BigInteger& channelMask, int64_t firstRow, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample)
+    {
+        readSelectedRowsFromAllSources (destinationBuffer, channelMask, firstRow, numRowsOrSamples, rowStride, destinationStartRowOrSample);
+    }
+
+    void MCVReader::readSelectedRows (double** destinationBuffer, const juce::BigInteger& channelMask, int64_t firstRow, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample)
+    {
+        readSelectedRowsFromAllSources (destinationBuffer, channelMask, firstRow, numRowsOrSamples, rowStride, destinationStartRowOrSample);
+    }
+
+    void MCVReader::readSelectedRows (std::complex<float>** destinationBuffer, const juce::BigInteger& channelMask, int64_t firstRow, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample)
+    {
+        readSelectedRowsFromAllSources (destinationBuffer, channelMask, firstRow, numRowsOrSamples, rowStride, destinationStartRowOrSample);
+    }
+
+    void MCVReader::readSelectedRows (std::complex<double>** destinationBuffer, const juce::BigInteger& channelMask, int64_t firstRow, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample)
+    {
+        readSelectedRowsFromAllSources (destinationBuffer, channelMask, firstRow, numRowsOrSamples, rowStride, destinationStartRowOrSample);
+    }
+
+    template <typename DestinationType>
+    void MCVReader::readSelectedRowsFromAllSources (DestinationType** destinationBuffer, const juce::BigInteger& channelMask, int64_t firstRow, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample)
+    {
+        if (numRowsOrSamples <= 0)
+            return;
+
+        juce::Array<int> columns;
+        for (auto col = channelMask.findNextSetBit (0); col >= 0; col = channelMask.findNextSetBit (col + 1))
+            columns.add (col);
+
+        if (columns.isEmpty())
+            return;
+
+        // Large reads from completely mapped plain files are split up across the thread pool. Everything else goes
+        // through the window or the block cache, which are only accessed by the reading thread.
+        if ((numRowsOrSamples >= minNumRowsForParallelReading) && !isCompressed() && !isWindowed())
+        {
+            const int64_t partitionGranularity = 1024;
+            auto numPartitions = std::max<int64_t> (getThreadPool().getNumThreads(), (numRowsOrSamples + maxNumRowsPerPartition - 1) / maxNumRowsPerPartition);
+            auto numRowsPerPartition = (numRowsOrSamples + numPartitions - 1) / numPartitions;
+            numRowsPerPartition = ((numRowsPerPartition + partitionGranularity - 1) / partitionGranularity) * partitionGranularity;
+            numPartitions = (numRowsOrSamples + numRowsPerPartition - 1) / numRowsPerPartition;
+
+            runInParallel (static_cast<int> (numPartitions), [&] (int partition)
+            {
+                auto firstRowInPartition = partition * numRowsPerPartition;
+                auto numRowsInPartition = std::min (numRowsPerPartition, numRowsOrSamples - firstRowInPartition);
+
+                gatherRows (destinationBuffer,
+                            readPositionPtrForSample (firstRow + firstRowInPartition * rowStride),
+                            columns.getRawDataPointer(),
+                            columns.size(),
+                            numRowsInPartition,
+                            rowStride,
+                            destinationStartRowOrSample + firstRowInPartition);
+            });
+
+            return;
+        }
+
+        while (numRowsOrSamples > 0)
+        {
+            int64_t numRowsAvailable;
+            auto sourceStart = getRowsPointer (firstRow, numRowsAvailable);
+            auto numRowsToRead = std::min (numRowsOrSamples, (numRowsAvailable + rowStride - 1) / rowStride);
+
+            gatherRows (destinationBuffer, sourceStart, columns.getRawDataPointer(), columns.size(), numRowsToRead, rowStride, destinationStartRowOrSample);
+
+            firstRow                    += numRowsToRead * rowStride;
+            destinationStartRowOrSample += numRowsToRead;
+            numRowsOrSamples            -= numRowsToRead;
+        }
+    }
+
+    template <typename DestinationType>
+    void MCVReader::gatherRows (DestinationType** destinationBuffer, const void* sourceStart, const int* columns, int numColumns, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample)
+    {
+        const auto numCols = getNumColsOrChannels();
+        constexpr bool destinationIsComplex = std::is_same<DestinationType, std::complex<float>>::value || std::is_same<DestinationType, std::complex<double>>::value;
+
+        if constexpr (destinationIsComplex)
+        {
+            if (isComplex())
+            {
+                if (hasDoublePrecision())
+                    gatherColumns (static_cast<const std::complex<double>*> (sourceStart), destinationBuffer, columns, numColumns, numCols, numRowsOrSamples, rowStride, destinationStartRowOrSample);
+                else
+                    gatherColumns (static_cast<const std::complex<float>*> (sourceStart), destinationBuffer, columns, numColumns, numCols, numRowsOrSamples, rowStride, destinationStartRowOrSample);
+
+                return;
+            }
+        }
+
+        // Reading complex values into a real buffer is not supported
+        jassert (!isComplex());
+
+        if (hasDoublePrecision())
+            gatherColumns (static_cast<const double*> (sourceStart), destinationBuffer, columns, numColumns, numCols, numRowsOrSamples, rowStride, destinationStartRowOrSample);
+        else
+            gatherColumns (static_cast<const float*> (sourceStart), destinationBuffer, columns, numColumns, numCols, numRowsOrSamples, rowStride, destinationStartRowOrSample);
+    }
+
+    template <typename SourceType, typename DestinationType>
+    void MCVReader::gatherColumns (const SourceType* source, DestinationType** destinationBuffer, const int* columns, int numColumns, int64_t numCols, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample)
+    {
+        // Same blocking as in deinterleaveRows, the source rows of a block stay in the cache while the selected
+        // columns are written one after another
+        const int64_t numRowsPerBlock = 64;
+        const auto sourceStride = rowStride * numCols;
+
+        for (int64_t blockStart = 0; blockStart < numRowsOrSamples; blockStart += numRowsPerBlock)
+        {
+            auto blockEnd = std::min (numRowsOrSamples, blockStart + numRowsPerBlock);
+
+            for (int i = 0; i < numColumns; ++i)
+            {
+                auto* destination = destinationBuffer[i] + destinationStartRowOrSample;
+                auto* sourceColumn = source + columns[i];
+
+                for (int64_t row = blockStart; row < blockEnd; ++row)
+                    destination[row] = DestinationType (sourceColumn[row * sourceStride]);
+            }
+        }
+    }
 
     // Helper macro to fill a buffer with source data that handles all casting if necessary
-#define NTLAB_FILL_DESTINATION_BUFFER(sourceDataType, destinationDataType) sourceDataType* sourceBuffer = static_cast<sourceDataType*> (sourceStart);     \
-                                                                           for (int64_t row = destinationStartRowOrSample; row < numRowsOrSamples; ++row) \
-                                                                           {                                                                              \
-                                                                               for (int64_t col = 0; col < getNumColsOrChannels(); ++col)                 \
-                                                                               {                                                                          \
-                                                                                   destinationBuffer[col][row] = destinationDataType (*sourceBuffer);     \
-                                                                                   ++sourceBuffer;                                                        \
-                                                                               }                                                                          \
-                                                                           }                                                                              \
-
-    void MCVReader::fillBuffer (float** destinationBuffer, void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+#define NTLAB_FILL_DESTINATION_BUFFER(sourceDataType) deinterleaveRows (static_cast<const sourceDataType*> (sourceStart), destinationBuffer, getNumColsOrChannels(), numRowsOrSamples, destinationStartRowOrSample);
+
+    void MCVReader::fillBuffer (float** destinationBuffer, const void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
     {
         if (hasDoublePrecision())
         {
-            NTLAB_FILL_DESTINATION_BUFFER (double, float)
+            NTLAB_FILL_DESTINATION_BUFFER (double)
         }
         else
         {
-            NTLAB_FILL_DESTINATION_BUFFER (float, float)
+            NTLAB_FILL_DESTINATION_BUFFER (float)
         }
     }
 
-    void MCVReader::fillBuffer (double** destinationBuffer, void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+    void MCVReader::fillBuffer (double** destinationBuffer, const void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
     {
         if (hasDoublePrecision())
         {
-            NTLAB_FILL_DESTINATION_BUFFER (double , double)
+            NTLAB_FILL_DESTINATION_BUFFER (double)
         }
         else
         {
-            NTLAB_FILL_DESTINATION_BUFFER (float, double)
+            NTLAB_FILL_DESTINATION_BUFFER (float)
         }
     }
 
-    void MCVReader::fillBuffer (std::complex<float>** destinationBuffer, void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+    void MCVReader::fillBuffer (std::complex<float>** destinationBuffer, const void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
     {
         if (isComplex())
         {
             if (hasDoublePrecision())
             {
-                NTLAB_FILL_DESTINATION_BUFFER (std::complex<double>, std::complex<float>)
+                NTLAB_FILL_DESTINATION_BUFFER (std::complex<double>)
             }
             else
             {
-                NTLAB_FILL_DESTINATION_BUFFER (std::complex<float>, std::complex<float>)
+                NTLAB_FILL_DESTINATION_BUFFER (std::complex<float>)
             }
         }
         else
         {
             if (hasDoublePrecision())
             {
-                NTLAB_FILL_DESTINATION_BUFFER (double, std::complex<float>)
+                NTLAB_FILL_DESTINATION_BUFFER (double)
             }
             else
             {
-                NTLAB_FILL_DESTINATION_BUFFER (float, std::complex<float>)
+                NTLAB_FILL_DESTINATION_BUFFER (float)
             }
 
         }
     }
 
-    void MCVReader::fillBuffer (std::complex<double>** destinationBuffer, void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
+    void MCVReader::fillBuffer (std::complex<double>** destinationBuffer, const void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample)
     {
         if (isComplex())
         {
             if (hasDoublePrecision())
             {
-                NTLAB_FILL_DESTINATION_BUFFER (std::complex<double>, std::complex<double>)
+                NTLAB_FILL_DESTINATION_BUFFER (std::complex<double>)
             }
             else
             {
-                NTLAB_FILL_DESTINATION_BUFFER (std::complex<float>, std::complex<double>)
+                NTLAB_FILL_DESTINATION_BUFFER (std::complex<float>)
             }
         }
         else
         {
             if (hasDoublePrecision())
             {
-                NTLAB_FILL_DESTINATION_BUFFER (double, std::complex<double>)
+                NTLAB_FILL_DESTINATION_BUFFER (double)
             }
             else
             {
-                NTLAB_FILL_DESTINATION_BUFFER (float, std::complex<double>)
+                NTLAB_FILL_DESTINATION_BUFFER (float)
+            }
+
+        }
+    }
+
+    void MCVReader::readPositionChanged()
+    {
+        if (readAheadThread != nullptr)
+            readAheadThread->setReadPosition (readPosition);
+    }
+
+    juce::Range<int64_t> MCVReader::getByteRangeOfRows (int64_t firstRow, int64_t numRowsOrSamples)
+    {
+        if (!isCompressed())
+        {
+            auto start = MCVHeader::sizeOfHeaderInBytes + firstRow * static_cast<int64_t> (numBytesPerRow);
+            return juce::Range<int64_t> (start, start + numRowsOrSamples * static_cast<int64_t> (numBytesPerRow));
+        }
+
+        if (blockIndex.isEmpty())
+            return {};
+
+        auto firstBlock = blockIndex.findChunkContainingSample (firstRow);
+        auto start = blockIndex.getEntry (firstBlock).byteOffset;
+
+        if (numRowsOrSamples <= 0)
+            return juce::Range<int64_t> (start, start);
+
+        auto lastBlock = blockIndex.findChunkContainingSample (firstRow + numRowsOrSamples - 1);
+        auto end = (lastBlock + 1 < blockIndex.getNumChunks()) ? blockIndex.getEntry (lastBlock + 1).byteOffset : endOfEncodedBlocks;
+
+        return juce::Range<int64_t> (start, end);
+    }
+
+    MCVReader::ReadAheadThread::ReadAheadThread (MCVReader& readerToPrefetch, int64_t rowsAhead, int64_t rowsPerBlock, bool releasePages)
+      : juce::Thread ("MCVReader Read-Ahead Thread"),
+        reader (readerToPrefetch),
+        numRowsAhead (rowsAhead),
+        numRowsPerBlock (rowsPerBlock),
+        releaseConsumedPages (releasePages)
+    {
+        startThread();
+    }
+
+    MCVReader::ReadAheadThread::~ReadAheadThread()
+    {
+        stopThread (1000);
+    }
+
+    void MCVReader::ReadAheadThread::setReadPosition (int64_t newReadPosition)
+    {
+        readPosition = newReadPosition;
+        notify();
+    }
+
+    void MCVReader::ReadAheadThread::run()
+    {
+        while (!threadShouldExit())
+        {
+            const auto position = readPosition.load();
+            const auto numRows = reader.getNumRowsOrSamples();
+            const auto numRowsAheadUntilEnd = std::min (numRowsAhead, numRows - position);
+
+            auto bytesAhead = reader.getByteRangeOfRows (position, numRowsAheadUntilEnd);
+
+            // The read position moved backwards, e.g. due to a seek or looping
+            if (bytesAhead.getStart() < releasedUpTo)
+                releasedUpTo = prefetchedUpTo = bytesAhead.getStart();
+
+            if (bytesAhead.getEnd() > prefetchedUpTo)
+            {
+                prefetch (bytesAhead.withStart (std::max (prefetchedUpTo, bytesAhead.getStart())));
+                prefetchedUpTo = bytesAhead.getEnd();
+            }
+
+            // When looping, the beginning of the file is needed next
+            if ((reader.behaviour == loop) && (numRowsAheadUntilEnd < numRowsAhead))
+                prefetch (reader.getByteRangeOfRows (0, std::min (numRows, numRowsAhead - numRowsAheadUntilEnd)));
+
+            // Keep the last block read, as it might still be accessed
+            if (releaseConsumedPages)
+            {
+                auto releaseEnd = reader.getByteRangeOfRows (std::max<int64_t> (0, position - numRowsPerBlock), 0).getStart();
+
+                if (releaseEnd > releasedUpTo)
+                {
+                    release ({ releasedUpTo, releaseEnd });
+                    releasedUpTo = releaseEnd;
+                }
             }
 
+            wait (-1);
         }
     }
 
-    void* MCVReader::readPositionPtrForSample (int64_t sampleIdx)
+    void MCVReader::ReadAheadThread::prefetch (juce::Range<int64_t> byteRange)
+    {
+        if (byteRange.isEmpty())
+            return;
+
+        const auto pageSize = static_cast<int64_t> (juce::SystemStats::getPageSize());
+
+        // With a mapping window, the range is mapped temporarily. The pages stay in the page cache after unmapping,
+        // so mapping them into the window later on won't have to wait for the disk
+        std::unique_ptr<juce::MemoryMappedFile> prefetchMapping;
+        const juce::MemoryMappedFile* mapping = &reader.file;
+
+        if (reader.isWindowed())
+        {
+            prefetchMapping.reset (new juce::MemoryMappedFile (reader.sourceFile, byteRange, juce::MemoryMappedFile::readOnly, false));
+            if (prefetchMapping->getData() == nullptr)
+                return;
+
+            mapping = prefetchMapping.get();
+        }
+
+        auto alignedStart = std::max<int64_t> (mapping->getRange().getStart(), (byteRange.getStart() / pageSize) * pageSize);
+        auto numBytes = byteRange.getEnd() - alignedStart;
+        auto* firstPage = getPointerToByte (*mapping, alignedStart);
+
+#if ! JUCE_WINDOWS
+        madvise (const_cast<char*> (firstPage), static_cast<size_t> (numBytes), MADV_WILLNEED);
+#endif
+
+        // Touching one byte per page makes sure the pages are resident when the reading thread gets there, as the
+        // advice above is only a hint to the operating system
+        volatile char touchedByte = 0;
+
+        for (int64_t offset = 0; offset < numBytes; offset += pageSize)
+        {
+            if (threadShouldExit())
+                return;
+
+            touchedByte = firstPage[offset];
+        }
+
+        juce::ignoreUnused (touchedByte);
+    }
+
+    void MCVReader::ReadAheadThread::release (juce::Range<int64_t> byteRange)
+    {
+        // Windows that have been passed are unmapped anyway
+        if (reader.isWindowed())
+            return;
+
+#if ! JUCE_WINDOWS
+        const auto pageSize = static_cast<int64_t> (juce::SystemStats::getPageSize());
+
+        // Only release whole pages that have been consumed completely
+        auto alignedStart = (byteRange.getStart() / pageSize) * pageSize;
+        auto alignedEnd   = (byteRange.getEnd()   / pageSize) * pageSize;
+
+        if (alignedEnd > alignedStart)
+            madvise (static_cast<char*> (reader.file.getData()) + alignedStart, static_cast<size_t> (alignedEnd - alignedStart), MADV_DONTNEED);
+#else
+        juce::ignoreUnused (byteRange);
+#endif
+    }
+
+    const void* MCVReader::readPositionPtrForSample (int64_t sampleIdx)
     {
-        return juce::addBytesToPointer (beginOfSamples, metadata->sizeOfOneValue() * sampleIdx * getNumColsOrChannels());
+        return static_cast<const char*> (beginOfSamples) + numBytesPerRow * static_cast<size_t> (sampleIdx);
     }
 }
\ No newline at end of file
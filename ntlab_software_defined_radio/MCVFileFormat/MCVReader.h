@@ -23,6 +23,8 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 
 #include "../SampleBuffers/SampleBuffers.h"
 #include "MCVHeader.h"
+#include "MCVChunkIndex.h"
+#include "MCVBlockCodec.h"
 
 
 namespace ntlab
@@ -70,8 +72,16 @@ namespace ntlab
         /**
          * Creates an MCVReader object from an mcv file. Always call isValid after creation to check if opening the
          * file was successful.
+         *
+         * By default, the whole file is memory mapped. If you pass a mapping window size, only a region of this size
+         * starting at the current read position is mapped and the region is moved along as reading advances. This
+         * keeps the memory footprint of long replays constant, independent of the file size. Whole-file reads of
+         * uncompressed files are done on a single thread in this mode, so it's mainly useful for streaming
+         * applications.
          */
-        MCVReader (const juce::File& mcvFile, EndOfFileBehaviour endOfFileBehaviour = stopAndFillWithZeros);
+        MCVReader (const juce::File& mcvFile, EndOfFileBehaviour endOfFileBehaviour = stopAndFillWithZeros, int64_t mappingWindowSizeInBytes = 0);
+
+        ~MCVReader();
 
         /** Returns true if opening the file was successful */
         bool isValid();
@@ -82,6 +92,12 @@ namespace ntlab
         /** Returns true if the values in the file are doubles, false if floats */
         bool hasDoublePrecision();
 
+        /**
+         * Returns true if the payload is stored as compressed blocks. All read functions work with compressed files,
+         * blocks are decoded on demand and in parallel to the reading thread.
+         */
+        bool isCompressed();
+
         /** Returns the number of columns / channels held by this file */
         int64_t getNumColsOrChannels();
 
@@ -146,8 +162,8 @@ namespace ntlab
                 return false;
             }
 
-            fillBuffer (sampleBufferToFill.getArrayOfWritePointers(), beginOfSamples, getNumRowsOrSamples());
-            sampleBufferToFill.setNumSamples (metadata->getNumRowsOrSamples());
+            readRows (sampleBufferToFill.getArrayOfWritePointers(), 0, getNumRowsOrSamples());
+            sampleBufferToFill.setNumSamples (static_cast<int> (metadata->getNumRowsOrSamples()));
 
             return true;
         }
@@ -180,6 +196,24 @@ namespace ntlab
          * it will return an empty matrix. Only available if NTLAB_INCLUDE_EIGEN is enabled.
          */
         Eigen::MatrixXcd createMatrixComplexDouble();
+
+        /**
+         * Returns a read-only view on the file content without copying anything. This will only succeed if the file
+         * contains real single precision values, is not compressed and has been mapped completely, that is no mapping
+         * window was passed to the constructor. Otherwise an empty view is returned. The view points directly into the
+         * memory mapped file, so it must not be used after the reader has been destroyed. Only available if
+         * NTLAB_INCLUDE_EIGEN is enabled.
+         */
+        Eigen::Map<const Eigen::MatrixXf> getMatrixViewRealFloat();
+
+        /** Returns a read-only view on a file containing real double precision values, see getMatrixViewRealFloat */
+        Eigen::Map<const Eigen::MatrixXd> getMatrixViewRealDouble();
+
+        /** Returns a read-only view on a file containing complex single precision values, see getMatrixViewRealFloat */
+        Eigen::Map<const Eigen::MatrixXcf> getMatrixViewComplexFloat();
+
+        /** Returns a read-only view on a file containing complex double precision values, see getMatrixViewRealFloat */
+        Eigen::Map<const Eigen::MatrixXcd> getMatrixViewComplexDouble();
 #endif
 
         /**
@@ -197,12 +231,61 @@ namespace ntlab
             jassert (bufferToFill.getNumChannels() == metadata->getNumColsOrChannels());
 
             int64_t bufferSampleCapacity = bufferToFill.getNumSamples() - startSampleInBuffer;
-            int64_t numSamplesToCopy = std::min (bufferSampleCapacity, numRowsOrSamplesRemaining);
+            int64_t numSamplesToCopy = std::min (bufferSampleCapacity, getNumRowsOrSamples() - readPosition);
+
+            bufferToFill.setNumSamples (static_cast<int> (startSampleInBuffer + numSamplesToCopy));
+            readRows (bufferToFill.getArrayOfWritePointers(), readPosition, numSamplesToCopy, startSampleInBuffer);
+            readPosition += numSamplesToCopy;
+            readPositionChanged();
+
+            if (numSamplesToCopy < bufferSampleCapacity)
+            {
+                switch (behaviour)
+                {
+                    case stopAndResize:
+                        break;
+                    case stopAndFillWithZeros:
+                        bufferToFill.setNumSamples (static_cast<int> (startSampleInBuffer + bufferSampleCapacity));
+                        bufferToFill.clearBufferRegion (static_cast<int> (startSampleInBuffer + numSamplesToCopy));
+                        break;
+                    case loop:
+                        readPosition = 0;
+                        readPositionChanged();
+                        bufferToFill.setNumSamples (static_cast<int> (startSampleInBuffer + bufferSampleCapacity));
+                        if (getNumRowsOrSamples() > 0)
+                            fillNextSamplesIntoBuffer (bufferToFill, startSampleInBuffer + numSamplesToCopy);
+                        break;
+                }
+                return false;
+            }
+
+            return true;
+        }
+
+        /**
+         * Fills a buffer with a subset of the channels and every sampleStride-th sample, starting at the read position.
+         * Only the channels whose bit is set in the channel mask are read, the buffer needs one channel per bit set
+         * and they are filled in ascending channel order. Only the bytes of the selected values are accessed, so
+         * reading two out of sixteen channels or decimating by a large stride touches a fraction of the memory a full
+         * read would need. Compressed files are an exception, as the blocks touched have to be decoded completely.
+         * After having filled the buffer, the read position will be advanced by the number of samples filled times
+         * the stride. The end of file handling and the type restrictions are the same as for the version above.
+         */
+        template <typename BufferType>
+        bool fillNextSamplesIntoBuffer (BufferType& bufferToFill, const juce::BigInteger& channelMask, int sampleStride = 1, int64_t startSampleInBuffer = 0)
+        {
+            // The buffer needs one channel per channel selected and the mask must not select channels that don't exist
+            jassert (bufferToFill.getNumChannels() == channelMask.countNumberOfSetBits());
+            jassert (channelMask.getHighestBit() < metadata->getNumColsOrChannels());
+            jassert (sampleStride > 0);
+
+            int64_t bufferSampleCapacity = bufferToFill.getNumSamples() - startSampleInBuffer;
+            int64_t numSamplesToCopy = std::min (bufferSampleCapacity, (getNumRowsOrSamples() - readPosition + sampleStride - 1) / sampleStride);
 
-            bufferToFill.setNumSamples (static_cast<int> (numSamplesToCopy));
-            fillBuffer (bufferToFill.getArrayOfWritePointers(), readPtr, numSamplesToCopy, startSampleInBuffer);
-            numRowsOrSamplesRemaining -= numSamplesToCopy;
-            readPtr = readPositionPtrForSample (getReadPosition());
+            bufferToFill.setNumSamples (static_cast<int> (startSampleInBuffer + numSamplesToCopy));
+            readSelectedRows (bufferToFill.getArrayOfWritePointers(), channelMask, readPosition, numSamplesToCopy, sampleStride, startSampleInBuffer);
+            readPosition = std::min (getNumRowsOrSamples(), readPosition + numSamplesToCopy * sampleStride);
+            readPositionChanged();
 
             if (numSamplesToCopy < bufferSampleCapacity)
             {
@@ -211,13 +294,15 @@ namespace ntlab
                     case stopAndResize:
                         break;
                     case stopAndFillWithZeros:
-                        bufferToFill.setNumSamples (static_cast<int> (bufferSampleCapacity));
-                        bufferToFill.clearBufferRegion (static_cast<int> (numSamplesToCopy));
+                        bufferToFill.setNumSamples (static_cast<int> (startSampleInBuffer + bufferSampleCapacity));
+                        bufferToFill.clearBufferRegion (static_cast<int> (startSampleInBuffer + numSamplesToCopy));
                         break;
                     case loop:
-                        readPtr = beginOfSamples;
-                        numRowsOrSamplesRemaining = metadata->getNumRowsOrSamples();
-                        fillNextSamplesIntoBuffer (bufferToFill, numSamplesToCopy);
+                        readPosition = 0;
+                        readPositionChanged();
+                        bufferToFill.setNumSamples (static_cast<int> (startSampleInBuffer + bufferSampleCapacity));
+                        if (getNumRowsOrSamples() > 0)
+                            fillNextSamplesIntoBuffer (bufferToFill, channelMask, sampleStride, startSampleInBuffer + numSamplesToCopy);
                         break;
                 }
                 return false;
@@ -226,28 +311,260 @@ namespace ntlab
             return true;
         }
 
+        /**
+         * Starts a background thread that keeps numBlocksAhead blocks of numRowsPerBlock rows ahead of the read
+         * position in memory, so that fillNextSamplesIntoBuffer doesn't stall on page faults when reading from a cold
+         * file. On POSIX systems, the mapping is also advised for sequential access and if releaseConsumedPages is
+         * true, pages that have been read are handed back to the operating system. This keeps the resident memory
+         * flat during long replays. Pass 0 blocks to stop the read-ahead thread.
+         */
+        void enableReadAhead (int numBlocksAhead, int numRowsPerBlock, bool releaseConsumedPages = true);
+
         /** Returns the row or sample that gets read with the next call of fillNextSamplesIntoBuffer */
         int64_t getReadPosition();
 
+        /**
+         * Sets the row or sample that gets read with the next call of fillNextSamplesIntoBuffer. This works for all
+         * files in constant time. Returns false if the sample index is out of range.
+         */
+        bool seekToSample (int64_t sampleIdx);
+
+        /**
+         * Sets the read position to the point in time passed. This needs a file with a chunk index. Without a sample
+         * rate the read position will be set to the beginning of the chunk that started at or before the time passed,
+         * with a sample rate the offset into this chunk will be computed. The chunk lookup is a binary search over the
+         * index, so this works on multi-hour captures without touching the payload. If the time lies in a gap between
+         * two chunks the read position is set to the beginning of the next chunk. Returns false if there is no chunk
+         * index or the time is out of range.
+         */
+        bool seekToTime (double timeInSeconds, double sampleRate = 0.0);
+
+        /** Returns true if the file contains a chunk index with timestamps and center frequencies */
+        bool hasChunkIndex();
+
+        /** Returns the number of chunks in the chunk index or 0 if the file has no chunk index */
+        int getNumChunks();
+
+        /** Returns the first row or sample of a chunk. The chunk index passed must be valid */
+        int64_t getChunkFirstSample (int chunkIdx);
+
+        /** Returns the timestamp of the first sample of a chunk in seconds. The chunk index passed must be valid */
+        double getChunkTimestamp (int chunkIdx);
+
+        /** Returns the center frequency of a chunk in Hz. The chunk index passed must be valid */
+        double getChunkCenterFrequency (int chunkIdx);
+
+        /**
+         * Returns the index of the chunk containing the current read position or -1 if the file has no chunk index
+         * or the read position lies before the first chunk
+         */
+        int getCurrentChunk();
+
     private:
+        /** Holds a decoded block of a compressed file */
+        struct DecodedBlock
+        {
+            int blockIdx = -1;
+            bool decodingInProgress = false;
+            juce::MemoryBlock data;
+            juce::MemoryBlock shuffleBuffer;
+            juce::WaitableEvent decodingFinished {true};
+        };
+
+        /**
+         * Touches the pages ahead of the read position on a background thread and releases the pages that have been
+         * consumed. The thread only works after it has been notified about a new read position.
+         */
+        class ReadAheadThread : public juce::Thread
+        {
+        public:
+            ReadAheadThread (MCVReader& readerToPrefetch, int64_t numRowsAhead, int64_t numRowsPerBlock, bool releaseConsumedPages);
+
+            ~ReadAheadThread();
+
+            void setReadPosition (int64_t newReadPosition);
+
+            void run() override;
+
+        private:
+            MCVReader& reader;
+            const int64_t numRowsAhead;
+            const int64_t numRowsPerBlock;
+            const bool releaseConsumedPages;
+
+            std::atomic<int64_t> readPosition {0};
+
+            // Byte offsets into the file
+            int64_t prefetchedUpTo = 0;
+            int64_t releasedUpTo = 0;
+
+            void prefetch (juce::Range<int64_t> byteRange);
+
+            void release (juce::Range<int64_t> byteRange);
+        };
+
+        const juce::File sourceFile;
+        const int64_t fileSize;
+        const int64_t mappingWindowSize;
+
+        // Maps the whole file or only the header if a mapping window is used
         juce::MemoryMappedFile file;
+
+        // Only used if a mapping window is used. Only accessed by the reading thread
+        std::unique_ptr<juce::MemoryMappedFile> window;
+        bool adviseSequentialAccess = false;
         std::unique_ptr<MCVHeader> metadata;
 
-        void* beginOfSamples;
-        void* readPtr;
-        int64_t numRowsOrSamplesRemaining;
+        // Holds the chunks started by the writer. Compressed files index their blocks separately
+        MCVChunkIndex chunkIndex;
+
+        const void* beginOfSamples = nullptr;
+        int64_t readPosition = 0;
+        size_t numBytesPerRow = 0;
         EndOfFileBehaviour behaviour;
 
         bool valid = false;
 
-        void fillBuffer (float** destinationBuffer, void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+        // Only used for compressed files. Blocks are cached direct-mapped, each block requested triggers the
+        // decoding of the following blocks on the thread pool.
+        MCVChunkIndex blockIndex;
+        int64_t endOfEncodedBlocks = 0;
+        int64_t maxNumRowsPerBlock = 0;
+        std::vector<std::unique_ptr<DecodedBlock>> decodedBlocks;
+
+        /**
+         * Holds the thread pool shared by all readers, used for block decoding and to load large row ranges in
+         * parallel. The pool is created on first use, so readers that never read in parallel don't start any threads.
+         */
+        class SharedThreadPool
+        {
+        public:
+            SharedThreadPool() {}
+
+            juce::ThreadPool& getThreadPool();
+
+        private:
+            juce::CriticalSection lock;
+            std::unique_ptr<juce::ThreadPool> threadPool;
+        };
+
+        juce::SharedResourcePointer<SharedThreadPool> sharedThreadPool;
+
+        std::unique_ptr<ReadAheadThread> readAheadThread;
+
+        /** Reads below this number of rows are not worth being split up across multiple threads */
+        static const int64_t minNumRowsForParallelReading = 65536;
+
+        /** The upper limit for the rows converted by one thread pool job */
+        static const int64_t maxNumRowsPerPartition = 1 << 24;
+
+        bool openCompressedFile();
+
+        /** Reads an index that ends at the byte offset passed */
+        bool readIndex (MCVChunkIndex& index, int64_t endOfIndex);
+
+        bool isWindowed() const { return mappingWindowSize > 0; }
+
+        /** Returns a pointer to a byte in the file, which has to be in the range mapped */
+        static const char* getPointerToByte (const juce::MemoryMappedFile& mapping, int64_t byteOffset);
+
+        /** Moves the window so that it starts at the row passed if that row is not completely inside the window */
+        void moveWindowToRow (int64_t row);
+
+        juce::ThreadPool& getThreadPool();
+
+        /** Runs the job for all indices from 0 to numJobs - 1 on the thread pool and returns when all have finished */
+        void runInParallel (int numJobs, std::function<void (int)> job);
+
+        /**
+         * Returns a pointer to the interleaved source data for the row passed and the number of rows that can be read
+         * contiguously from this pointer
+         */
+        const void* getRowsPointer (int64_t firstRow, int64_t& numRowsAvailable);
+
+        /** Returns a pointer to the whole payload. For compressed files, it will be decoded into the storage passed */
+        const void* getWholePayload (juce::MemoryBlock& storage);
 
-        void fillBuffer (double** destinationBuffer, void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+        int64_t getNumRowsInBlock (int blockIdx);
 
-        void fillBuffer (std::complex<float>** destinationBuffer, void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+        bool decodeBlock (int blockIdx, void* destination, juce::MemoryBlock& shuffleBuffer);
 
-        void fillBuffer (std::complex<double>** destinationBuffer, void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+        DecodedBlock& getDecodedBlock (int blockIdx);
 
-        void* readPositionPtrForSample (int64_t sampleIdx);
+        void startDecodingBlock (DecodedBlock& block, int blockIdx);
+
+        void readRows (float** destinationBuffer, int64_t firstRow, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+
+        void readRows (double** destinationBuffer, int64_t firstRow, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+
+        void readRows (std::complex<float>** destinationBuffer, int64_t firstRow, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+
+        void readRows (std::complex<double>** destinationBuffer, int64_t firstRow, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+
+        template <typename DestinationType>
+        void readRowsFromAllSources (DestinationType** destinationBuffer, int64_t firstRow, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample);
+
+        void readSelectedRows (float** destinationBuffer, const juce::BigInteger& channelMask, int64_t firstRow, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample);
+
+        void readSelectedRows (double** destinationBuffer, const juce::BigInteger& channelMask, int64_t firstRow, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample);
+
+        void readSelectedRows (std::complex<float>** destinationBuffer, const juce::BigInteger& channelMask, int64_t firstRow, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample);
+
+        void readSelectedRows (std::complex<double>** destinationBuffer, const juce::BigInteger& channelMask, int64_t firstRow, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample);
+
+        /**
+         * Reads the selected columns of every rowStride-th row. The number of rows passed is the number of rows
+         * written to the destination buffer.
+         */
+        template <typename DestinationType>
+        void readSelectedRowsFromAllSources (DestinationType** destinationBuffer, const juce::BigInteger& channelMask, int64_t firstRow, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample);
+
+        /** Converts the source values of the selected columns, dispatching on the value type stored in the file */
+        template <typename DestinationType>
+        void gatherRows (DestinationType** destinationBuffer, const void* sourceStart, const int* columns, int numColumns, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample);
+
+        /** Copies the selected columns of every rowStride-th row into one destination vector per selected column */
+        template <typename SourceType, typename DestinationType>
+        static void gatherColumns (const SourceType* source, DestinationType** destinationBuffer, const int* columns, int numColumns, int64_t numCols, int64_t numRowsOrSamples, int64_t rowStride, int64_t destinationStartRowOrSample);
+
+#if NTLAB_INCLUDE_EIGEN
+        /** Returns a view on the mapped payload if the file stores values of the type passed, an empty view otherwise */
+        template <typename ValueType>
+        Eigen::Map<const Eigen::Matrix<ValueType, Eigen::Dynamic, Eigen::Dynamic>> getMatrixView();
+
+        /** Converts the payload stored as FileValueType to a new matrix in a single pass */
+        template <typename MatrixType, typename FileValueType>
+        MatrixType createMatrixFromPayload();
+#endif
+
+        /** Splits the rows up into partitions that are converted in parallel */
+        template <typename DestinationType>
+        void fillBufferInParallel (DestinationType** destinationBuffer, const void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample);
+
+        /**
+         * Converts interleaved rows into one destination vector per column. Works on small blocks of rows that fit
+         * into the L1 cache so that each column can be written sequentially.
+         */
+        template <typename SourceType, typename DestinationType>
+        static void deinterleaveRows (const SourceType* source, DestinationType** destinationBuffer, int64_t numCols, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample);
+
+        void fillBuffer (float** destinationBuffer, const void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+
+        void fillBuffer (double** destinationBuffer, const void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+
+        void fillBuffer (std::complex<float>** destinationBuffer, const void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+
+        void fillBuffer (std::complex<double>** destinationBuffer, const void* sourceStart, int64_t numRowsOrSamples, int64_t destinationStartRowOrSample = 0);
+
+        const void* readPositionPtrForSample (int64_t sampleIdx);
+
+        /** Notifies the read-ahead thread if enabled */
+        void readPositionChanged();
+
+        /**
+         * Returns the range of bytes in the file that holds the rows passed. For compressed files, this covers all
+         * blocks that contain the rows.
+         */
+        juce::Range<int64_t> getByteRangeOfRows (int64_t firstRow, int64_t numRowsOrSamples);
     };
 }
\ No newline at end of file
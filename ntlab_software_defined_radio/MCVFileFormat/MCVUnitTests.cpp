@@ -134,8 +134,517 @@ public:
 
         auto cplxDoubleMatrixRead = cplxDoubleMatrixReader.createMatrixComplexDouble();
         expect (cplxDoubleMatrixRead.isApprox (cplxDoubleMatSrc));
+
+        beginTest ("Zero-copy Eigen views");
+
+        auto realFloatMatrixView = realFloatMatrixReader.getMatrixViewRealFloat();
+        expect (realFloatMatrixView.isApprox (realFloatMatSrc));
+
+        auto cplxDoubleMatrixView = cplxDoubleMatrixReader.getMatrixViewComplexDouble();
+        expect (cplxDoubleMatrixView.isApprox (cplxDoubleMatSrc));
+
+        // Two views on the same reader share the mapping
+        expect (cplxDoubleMatrixView.data() == cplxDoubleMatrixReader.getMatrixViewComplexDouble().data());
+
+        // Views on a file with a different value type are empty, converting creates a matrix with the new precision
+        expect (cplxDoubleMatrixReader.getMatrixViewComplexFloat().size() == 0);
+        expect (cplxDoubleMatrixReader.createMatrixComplexFloat().isApprox (cplxDoubleMatSrc.cast<std::complex<float>>()));
+        expect (realFloatMatrixReader.createMatrixComplexDouble().isApprox (realFloatMatSrc.cast<std::complex<double>>()));
 #endif
 
+        beginTest ("Read large MCV files in parallel");
+
+        auto largeRealFile = tempFolder.getChildFile ("largeReal.mcv");
+        auto largeCplxFile = tempFolder.getChildFile ("largeCplx.mcv");
+        const int numSamplesLarge = 300000;
+
+        ntlab::SampleBufferReal<float>    largeRealSrcBuffer (2, numSamplesLarge);
+        ntlab::SampleBufferComplex<float> largeCplxSrcBuffer (numChannels, numSamplesLarge);
+        ntlab::UnitTestHelpers::fillSampleBuffer (largeRealSrcBuffer, random);
+        ntlab::UnitTestHelpers::fillSampleBuffer (largeCplxSrcBuffer, random);
+
+        ntlab::MCVWriter::writeSampleBuffer (largeRealSrcBuffer, largeRealFile);
+        ntlab::MCVWriter::writeSampleBuffer (largeCplxSrcBuffer, largeCplxFile);
+
+        ntlab::MCVReader largeRealReader (largeRealFile);
+        auto largeRealBufferRead = largeRealReader.createSampleBufferRealFloat();
+        expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (largeRealSrcBuffer, largeRealBufferRead));
+
+        ntlab::MCVReader largeCplxReader (largeCplxFile);
+        auto largeCplxBufferRead = largeCplxReader.createSampleBufferComplexFloat();
+        expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (largeCplxSrcBuffer, largeCplxBufferRead));
+
+        beginTest ("Read MCV file through a mapping window");
+
+        ntlab::MCVReader windowedReader (largeCplxFile, ntlab::MCVReader::stopAndFillWithZeros, 100000);
+        expect (windowedReader.isValid());
+
+        auto windowedBufferRead = windowedReader.createSampleBufferComplexFloat();
+        expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (largeCplxSrcBuffer, windowedBufferRead));
+
+        expect (windowedReader.seekToSample (numSamplesLarge - 1000));
+        ntlab::SampleBufferComplex<float> windowedBlockRead (numChannels, 1000);
+        expect (windowedReader.fillNextSamplesIntoBuffer (windowedBlockRead));
+
+        std::vector<std::complex<float>*> windowedExpectedPtrs (numChannels);
+        largeCplxSrcBuffer.fillArrayOfPointersForReadingFrom (windowedExpectedPtrs.data(), numSamplesLarge - 1000);
+        ntlab::SampleBufferComplex<float> windowedExpectedBlock (numChannels, 1000, windowedExpectedPtrs.data());
+        expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (windowedExpectedBlock, windowedBlockRead));
+
+        beginTest ("Read channel subsets with a sample stride");
+
+        {
+            const int stride = 3;
+            const int numStridedSamples = numSamplesLarge / stride;
+
+            juce::BigInteger channelMask;
+            channelMask.setBit (0);
+            channelMask.setBit (2);
+
+            // The fully mapped reader converts in parallel, the windowed reader walks through the window
+            for (auto* reader : { &largeCplxReader, &windowedReader })
+            {
+                expect (reader->seekToSample (0));
+
+                ntlab::SampleBufferComplex<double> stridedRead (2, numStridedSamples);
+                expect (reader->fillNextSamplesIntoBuffer (stridedRead, channelMask, stride));
+                expect (reader->getReadPosition() == static_cast<int64_t> (numStridedSamples) * stride);
+
+                bool allEqual = true;
+                for (int i = 0; i < numStridedSamples; ++i)
+                {
+                    allEqual &= stridedRead.getReadPointer (0)[i] == std::complex<double> (largeCplxSrcBuffer.getReadPointer (0)[i * stride]);
+                    allEqual &= stridedRead.getReadPointer (1)[i] == std::complex<double> (largeCplxSrcBuffer.getReadPointer (2)[i * stride]);
+                }
+
+                expect (allEqual);
+            }
+        }
+
+        largeRealFile.deleteFile();
+        largeCplxFile.deleteFile();
+
+        beginTest ("Write chunked MCV file and seek");
+
+        auto chunkedFile = tempFolder.getChildFile ("chunked.mcv");
+        const int numChunks = 4;
+        const int numSamplesPerChunk = 1000;
+        const double sampleRate = 1e6;
+
+        ntlab::SampleBufferComplex<float> chunkedSrcBuffer (numChannels, numChunks * numSamplesPerChunk);
+        ntlab::UnitTestHelpers::fillSampleBuffer (chunkedSrcBuffer, random);
+
+        {
+            ntlab::MCVWriter chunkedWriter (numChannels, false, true, chunkedFile);
+            expect (chunkedWriter.isValid());
+
+            std::vector<std::complex<float>*> chunkPtrs (numChannels);
+            for (int i = 0; i < numChunks; ++i)
+            {
+                chunkedSrcBuffer.fillArrayOfPointersForReadingFrom (chunkPtrs.data(), i * numSamplesPerChunk);
+                ntlab::SampleBufferComplex<float> chunk (numChannels, numSamplesPerChunk, chunkPtrs.data());
+
+                chunkedWriter.startNewChunk (100.0 + i * numSamplesPerChunk / sampleRate, 1e9 + i * 1e6);
+                chunkedWriter.appendSampleBuffer (chunk);
+            }
+
+            chunkedWriter.waitForEmptyFIFO();
+        }
+
+        ntlab::MCVReader chunkedReader (chunkedFile);
+        expect (chunkedReader.isValid());
+        expect (chunkedReader.hasChunkIndex());
+        expectEquals (chunkedReader.getNumChunks(), numChunks);
+        expectEquals (chunkedReader.getNumRowsOrSamples(), static_cast<int64_t> (numChunks * numSamplesPerChunk));
+        expectEquals (chunkedReader.getChunkCenterFrequency (2), 1e9 + 2e6);
+
+        expect (!chunkedReader.seekToTime (99.0));
+        expect (chunkedReader.seekToTime (100.0 + 2.5 * numSamplesPerChunk / sampleRate));
+        expectEquals (chunkedReader.getReadPosition(), static_cast<int64_t> (2 * numSamplesPerChunk));
+        expectEquals (chunkedReader.getCurrentChunk(), 2);
+
+        expect (chunkedReader.seekToTime (100.0 + 2.5 * numSamplesPerChunk / sampleRate, sampleRate));
+        expectEquals (chunkedReader.getReadPosition(), static_cast<int64_t> (2.5 * numSamplesPerChunk));
+
+        ntlab::SampleBufferComplex<float> chunkReadBuffer (numChannels, numSamplesPerChunk / 2);
+        chunkedReader.fillNextSamplesIntoBuffer (chunkReadBuffer);
+
+        std::vector<std::complex<float>*> expectedPtrs (numChannels);
+        chunkedSrcBuffer.fillArrayOfPointersForReadingFrom (expectedPtrs.data(), static_cast<int> (2.5 * numSamplesPerChunk));
+        ntlab::SampleBufferComplex<float> expectedChunkContent (numChannels, numSamplesPerChunk / 2, expectedPtrs.data());
+        expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (expectedChunkContent, chunkReadBuffer));
+
+        beginTest ("Reject a corrupt chunk index");
+        {
+            ntlab::MCVChunkIndex validIndex;
+            validIndex.addEntry ({ 24, 0, 100.0, 1e9 });
+            validIndex.addEntry ({ 1024, 1000, 101.0, 1e9 });
+
+            juce::MemoryOutputStream indexStream;
+            indexStream.writeRepeatedByte (0, 24);
+            expect (validIndex.writeToStream (indexStream));
+
+            juce::MemoryBlock indexBlock (indexStream.getData(), indexStream.getDataSize());
+            auto trailerOffset = indexBlock.getSize() - ntlab::MCVChunkIndex::sizeOfTrailerInBytes;
+
+            ntlab::MCVChunkIndex readIndex;
+            expect (readIndex.readFromEndOfBlock (indexBlock.getData(), static_cast<int64_t> (indexBlock.getSize())));
+            expectEquals (readIndex.getNumChunks(), 2);
+
+            // a count that would wrap around to 0 when narrowed to an int
+            int64_t corruptNumEntries = int64_t (1) << 32;
+            indexBlock.copyFrom (&corruptNumEntries, static_cast<int> (trailerOffset), 8);
+            expect (!readIndex.readFromEndOfBlock (indexBlock.getData(), static_cast<int64_t> (indexBlock.getSize())));
+            expect (readIndex.isEmpty());
+
+            // one entry more than the block can hold
+            corruptNumEntries = 3;
+            indexBlock.copyFrom (&corruptNumEntries, static_cast<int> (trailerOffset), 8);
+            expect (!readIndex.readFromEndOfBlock (indexBlock.getData(), static_cast<int64_t> (indexBlock.getSize())));
+
+            corruptNumEntries = -1;
+            indexBlock.copyFrom (&corruptNumEntries, static_cast<int> (trailerOffset), 8);
+            expect (!readIndex.readFromEndOfBlock (indexBlock.getData(), static_cast<int64_t> (indexBlock.getSize())));
+        }
+
+        beginTest ("Write compressed MCV file and seek");
+
+        auto compressedFile = tempFolder.getChildFile ("compressed.mcv");
+
+        {
+            ntlab::MCVWriter compressedWriter (numChannels, false, true, compressedFile);
+            expect (compressedWriter.enableBlockCompression (300));
+
+            std::vector<std::complex<float>*> chunkPtrs (numChannels);
+            for (int i = 0; i < numChunks; ++i)
+            {
+                chunkedSrcBuffer.fillArrayOfPointersForReadingFrom (chunkPtrs.data(), i * numSamplesPerChunk);
+                ntlab::SampleBufferComplex<float> chunk (numChannels, numSamplesPerChunk, chunkPtrs.data());
+
+                compressedWriter.startNewChunk (100.0 + i * numSamplesPerChunk / sampleRate, 1e9 + i * 1e6);
+                compressedWriter.appendSampleBuffer (chunk);
+            }
+
+            compressedWriter.waitForEmptyFIFO();
+        }
+
+        ntlab::MCVReader compressedReader (compressedFile);
+        expect (compressedReader.isValid());
+        expect (compressedReader.isCompressed());
+        expectEquals (compressedReader.getNumRowsOrSamples(), static_cast<int64_t> (numChunks * numSamplesPerChunk));
+
+        auto compressedBufferRead = compressedReader.createSampleBufferComplexFloat();
+        expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (chunkedSrcBuffer, compressedBufferRead));
+
+        expect (compressedReader.seekToTime (100.0 + 2.5 * numSamplesPerChunk / sampleRate, sampleRate));
+        expectEquals (compressedReader.getReadPosition(), static_cast<int64_t> (2.5 * numSamplesPerChunk));
+
+        compressedReader.fillNextSamplesIntoBuffer (chunkReadBuffer);
+        expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (expectedChunkContent, chunkReadBuffer));
+
+        // The blocks of a chunk must not show up as chunks of their own
+        expect (compressedReader.hasChunkIndex());
+        expectEquals (compressedReader.getNumChunks(), numChunks);
+        for (int i = 0; i < numChunks; ++i)
+        {
+            expectEquals (compressedReader.getChunkFirstSample (i), static_cast<int64_t> (i * numSamplesPerChunk));
+            expectEquals (compressedReader.getChunkTimestamp (i), 100.0 + i * numSamplesPerChunk / sampleRate);
+            expectEquals (compressedReader.getChunkCenterFrequency (i), 1e9 + i * 1e6);
+        }
+
+        expect (compressedReader.seekToSample (numSamplesPerChunk - 1));
+        expectEquals (compressedReader.getCurrentChunk(), 0);
+
+        auto compressedUnchunkedFile = tempFolder.getChildFile ("compressedUnchunked.mcv");
+
+        {
+            ntlab::MCVWriter compressedWriter (numChannels, false, true, compressedUnchunkedFile);
+            expect (compressedWriter.enableBlockCompression (300));
+            compressedWriter.appendSampleBuffer (chunkedSrcBuffer);
+            compressedWriter.waitForEmptyFIFO();
+        }
+
+        ntlab::MCVReader compressedUnchunkedReader (compressedUnchunkedFile);
+        expect (compressedUnchunkedReader.isValid());
+        expect (!compressedUnchunkedReader.hasChunkIndex());
+        expectEquals (compressedUnchunkedReader.getNumChunks(), 0);
+        expect (!compressedUnchunkedReader.seekToTime (100.0));
+
+        auto compressedUnchunkedBufferRead = compressedUnchunkedReader.createSampleBufferComplexFloat();
+        expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (chunkedSrcBuffer, compressedUnchunkedBufferRead));
+
+        compressedUnchunkedFile.deleteFile();
+
+        beginTest ("Rotate files");
+
+        auto rotatedFile = tempFolder.getChildFile ("rotated.mcv");
+        auto manifestFile = tempFolder.getChildFile ("rotated_manifest.json");
+        const int numSamplesPerFile = 1500;
+
+        {
+            ntlab::MCVWriter rotatingWriter (numChannels, false, true, rotatedFile);
+            expect (rotatingWriter.enableFileRotationByDuration (numSamplesPerFile / sampleRate, sampleRate));
+
+            rotatingWriter.startNewChunk (100.0);
+            rotatingWriter.appendSampleBuffer (chunkedSrcBuffer);
+            rotatingWriter.waitForEmptyFIFO();
+        }
+
+        auto manifest = juce::JSON::parse (manifestFile);
+        auto* rotatedFiles = manifest["files"].getArray();
+        expect (rotatedFiles != nullptr);
+        expectEquals (rotatedFiles->size(), 3);
+        expectEquals (static_cast<int> (manifest["numSamples"]), chunkedSrcBuffer.getNumSamples());
+
+        std::vector<std::complex<float>*> rotatedPtrs (numChannels);
+        for (int i = 0; i < rotatedFiles->size(); ++i)
+        {
+            auto& description = rotatedFiles->getReference (i);
+            const int firstSample = description["firstSample"];
+            const int numSamplesInFile = description["numSamples"];
+
+            expectEquals (firstSample, i * numSamplesPerFile);
+            expectEquals (numSamplesInFile, std::min (numSamplesPerFile, chunkedSrcBuffer.getNumSamples() - firstSample));
+            expectWithinAbsoluteError (static_cast<double> (description["startTime"]), 100.0 + firstSample / sampleRate, 1e-9);
+
+            ntlab::MCVReader rotatedReader (tempFolder.getChildFile (description["file"].toString()));
+            expect (rotatedReader.isValid());
+            expectEquals (rotatedReader.getNumRowsOrSamples(), static_cast<int64_t> (numSamplesInFile));
+            expectEquals (rotatedReader.getChunkFirstSample (0), static_cast<int64_t> (0));
+
+            chunkedSrcBuffer.fillArrayOfPointersForReadingFrom (rotatedPtrs.data(), firstSample);
+            ntlab::SampleBufferComplex<float> expectedContent (numChannels, numSamplesInFile, rotatedPtrs.data());
+
+            auto rotatedBufferRead = rotatedReader.createSampleBufferComplexFloat();
+            expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (expectedContent, rotatedBufferRead));
+        }
+
+        for (int i = 0; i < rotatedFiles->size(); ++i)
+            tempFolder.getChildFile (rotatedFiles->getReference (i)["file"].toString()).deleteFile();
+
+        manifestFile.deleteFile();
+
+        beginTest ("Write pre-trigger window");
+
+        juce::File triggerFile;
+        bool triggerWindowComplete = false;
+        juce::WaitableEvent triggerWindowWritten;
+
+        {
+            ntlab::MCVPreTriggerRecorder<float> recorder (numChannels, 1000.0, 0.5, 0.25, tempFolder, "preTrigger");
+            recorder.onWindowWritten = [&] (const juce::File& file, bool windowComplete)
+            {
+                triggerFile = file;
+                triggerWindowComplete = windowComplete;
+                triggerWindowWritten.signal();
+            };
+
+            std::vector<std::complex<float>*> blockPtrs (numChannels);
+            for (int i = 0; i < chunkedSrcBuffer.getNumSamples(); i += 100)
+            {
+                if (i == 2000)
+                    expect (recorder.trigger());
+
+                chunkedSrcBuffer.fillArrayOfPointersForReadingFrom (blockPtrs.data(), i);
+                ntlab::SampleBufferComplex<float> block (numChannels, 100, blockPtrs.data());
+                recorder.pushSamples (block);
+            }
+
+            expect (triggerWindowWritten.wait (5000));
+        }
+
+        expect (triggerWindowComplete);
+
+        ntlab::MCVReader triggerReader (triggerFile);
+        expect (triggerReader.isValid());
+        expectEquals (triggerReader.getNumRowsOrSamples(), static_cast<int64_t> (750));
+        expectEquals (triggerReader.getChunkFirstSample (1), static_cast<int64_t> (500));
+
+        std::vector<std::complex<float>*> windowPtrs (numChannels);
+        chunkedSrcBuffer.fillArrayOfPointersForReadingFrom (windowPtrs.data(), 1500);
+        ntlab::SampleBufferComplex<float> expectedWindow (numChannels, 750, windowPtrs.data());
+
+        auto triggerBufferRead = triggerReader.createSampleBufferComplexFloat();
+        expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (expectedWindow, triggerBufferRead));
+
+        beginTest ("Drop samples that don't fit into the writer FIFO");
+
+        auto overflowFile = tempFolder.getChildFile ("overflow.mcv");
+        const int fifoSize = 64;
+
+        {
+            // An AbstractFifo can hold one sample less than its size
+            ntlab::MCVWriter overflowWriter (numChannels, false, true, overflowFile, fifoSize);
+            overflowWriter.setOverflowPolicy (ntlab::MCVWriter::dropNewest);
+
+            expectEquals (overflowWriter.appendSampleBuffer (chunkedSrcBuffer), chunkedSrcBuffer.getNumSamples() - (fifoSize - 1));
+            expectEquals (overflowWriter.getNumSamplesDropped(), static_cast<int64_t> (chunkedSrcBuffer.getNumSamples() - (fifoSize - 1)));
+
+            overflowWriter.waitForEmptyFIFO();
+        }
+
+        ntlab::MCVReader overflowReader (overflowFile);
+        expect (overflowReader.isValid());
+        expectEquals (overflowReader.getNumRowsOrSamples(), static_cast<int64_t> (fifoSize - 1));
+
+        beginTest ("Drop the oldest samples and move the chunks started in them");
+
+        auto dropOldestFile = tempFolder.getChildFile ("dropOldest.mcv");
+        const int numDropOldestAppends = 2000;
+        const int numSamplesPerAppend = 50;
+
+        // Each appended block is filled with its index and starts a chunk with that index as timestamp, so the file
+        // shows which parts of which blocks survived, no matter how fast the writer thread keeps up
+        ntlab::SampleBufferReal<float> indexBlock (1, numSamplesPerAppend);
+
+        {
+            ntlab::MCVWriter dropOldestWriter (1, false, false, dropOldestFile, fifoSize);
+            dropOldestWriter.setOverflowPolicy (ntlab::MCVWriter::dropOldest);
+
+            for (int i = 0; i < numDropOldestAppends; ++i)
+            {
+                juce::FloatVectorOperations::fill (indexBlock.getWritePointer (0), static_cast<float> (i), numSamplesPerAppend);
+                dropOldestWriter.startNewChunk (i);
+                dropOldestWriter.appendSampleBuffer (indexBlock);
+            }
+
+            dropOldestWriter.waitForEmptyFIFO();
+            expect (dropOldestWriter.getNumSamplesDropped() > 0);
+            expectEquals (dropOldestWriter.getNumSamplesWritten() + dropOldestWriter.getNumSamplesDropped(), static_cast<int64_t> (numDropOldestAppends * numSamplesPerAppend));
+        }
+
+        ntlab::MCVReader dropOldestReader (dropOldestFile);
+        expect (dropOldestReader.isValid());
+
+        auto dropOldestBufferRead = dropOldestReader.createSampleBufferRealFloat();
+        auto* dropOldestSamples = dropOldestBufferRead.getReadPointer (0);
+        const auto numDropOldestSamples = dropOldestBufferRead.getNumSamples();
+
+        // The newest block always fits into the FIFO, so it is never dropped
+        expect (numDropOldestSamples >= numSamplesPerAppend);
+        expectEquals (dropOldestSamples[numDropOldestSamples - 1], static_cast<float> (numDropOldestAppends - 1));
+        expectEquals (dropOldestSamples[numDropOldestSamples - numSamplesPerAppend], static_cast<float> (numDropOldestAppends - 1));
+
+        // Only the oldest samples of a block can be dropped and each block that survived in parts starts a chunk
+        int dropOldestChunkIdx = 0;
+        for (int i = 0; i < numDropOldestSamples; ++i)
+        {
+            if ((i > 0) && (dropOldestSamples[i] == dropOldestSamples[i - 1]))
+                continue;
+
+            expect ((i == 0) || (dropOldestSamples[i] > dropOldestSamples[i - 1]));
+            expect (dropOldestChunkIdx < dropOldestReader.getNumChunks());
+
+            if (dropOldestChunkIdx < dropOldestReader.getNumChunks())
+            {
+                expectEquals (dropOldestReader.getChunkFirstSample (dropOldestChunkIdx), static_cast<int64_t> (i));
+                expectEquals (dropOldestReader.getChunkTimestamp (dropOldestChunkIdx), static_cast<double> (dropOldestSamples[i]));
+            }
+
+            ++dropOldestChunkIdx;
+        }
+
+        expectEquals (dropOldestReader.getNumChunks(), dropOldestChunkIdx);
+
+        beginTest ("Block until the deadline if the FIFO is full");
+
+        auto blockingFile = tempFolder.getChildFile ("blocking.mcv");
+        const int blockingDeadline = 20;
+
+        {
+            ntlab::MCVWriter blockingWriter (1, false, false, blockingFile, fifoSize);
+
+            // The writer thread makes space in time, so nothing is lost
+            blockingWriter.setOverflowPolicy (ntlab::MCVWriter::blockUntilDeadline, 10000);
+
+            for (int i = 0; i < numDropOldestAppends; ++i)
+            {
+                juce::FloatVectorOperations::fill (indexBlock.getWritePointer (0), static_cast<float> (i), numSamplesPerAppend);
+                expectEquals (blockingWriter.appendSampleBuffer (indexBlock), 0);
+            }
+
+            blockingWriter.waitForEmptyFIFO();
+
+            // A block that is larger than the FIFO can never fit, so the newest samples are dropped after the deadline
+            blockingWriter.setOverflowPolicy (ntlab::MCVWriter::blockUntilDeadline, blockingDeadline);
+
+            ntlab::SampleBufferReal<float> oversizedBlock (1, 2 * fifoSize);
+            juce::FloatVectorOperations::fill (oversizedBlock.getWritePointer (0), static_cast<float> (numDropOldestAppends), oversizedBlock.getNumSamples());
+
+            const auto blockingStart = juce::Time::getMillisecondCounter();
+            expectEquals (blockingWriter.appendSampleBuffer (oversizedBlock), oversizedBlock.getNumSamples() - (fifoSize - 1));
+            expect (juce::Time::getMillisecondCounter() - blockingStart >= static_cast<juce::uint32> (blockingDeadline));
+
+            blockingWriter.waitForEmptyFIFO();
+            expectEquals (blockingWriter.getNumSamplesDropped(), static_cast<int64_t> (oversizedBlock.getNumSamples() - (fifoSize - 1)));
+        }
+
+        ntlab::MCVReader blockingReader (blockingFile);
+        expect (blockingReader.isValid());
+        expectEquals (blockingReader.getNumRowsOrSamples(), static_cast<int64_t> (numDropOldestAppends * numSamplesPerAppend + fifoSize - 1));
+
+        auto blockingBufferRead = blockingReader.createSampleBufferRealFloat();
+        bool allBlocksComplete = true;
+        for (int i = 0; i < numDropOldestAppends * numSamplesPerAppend; ++i)
+            allBlocksComplete &= (blockingBufferRead.getReadPointer (0)[i] == static_cast<float> (i / numSamplesPerAppend));
+
+        expect (allBlocksComplete);
+
+        beginTest ("Create and delete writers while their thread writes another writer");
+
+        auto busyFile = tempFolder.getChildFile ("busy.mcv");
+        auto shortLivedFile = tempFolder.getChildFile ("shortLived.mcv");
+        const int numBusyAppends = 50;
+
+        // All writers share one thread, so the short lived writers are created and deleted while that thread is
+        // busy with the backlog of the first writer
+        ntlab::MCVWriter::setNumWriterThreads (1);
+
+        {
+            ntlab::MCVWriter busyWriter (numChannels, false, true, busyFile, 1 << 16);
+            busyWriter.setOverflowPolicy (ntlab::MCVWriter::blockUntilDeadline, 10000);
+
+            for (int i = 0; i < numBusyAppends; ++i)
+            {
+                expectEquals (busyWriter.appendSampleBuffer (chunkedSrcBuffer), 0);
+
+                {
+                    ntlab::MCVWriter shortLivedWriter (numChannels, false, true, shortLivedFile);
+                    expectEquals (shortLivedWriter.appendSampleBuffer (cplxFloatSrcBuffer), 0);
+                    shortLivedWriter.waitForEmptyFIFO();
+                }
+
+                ntlab::MCVReader shortLivedReader (shortLivedFile);
+                expect (shortLivedReader.isValid());
+
+                auto shortLivedBufferRead = shortLivedReader.createSampleBufferComplexFloat();
+                expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (cplxFloatSrcBuffer, shortLivedBufferRead));
+            }
+
+            busyWriter.waitForEmptyFIFO();
+            expectEquals (busyWriter.getNumSamplesDropped(), static_cast<int64_t> (0));
+        }
+
+        ntlab::MCVWriter::setNumWriterThreads (0);
+
+        ntlab::MCVReader busyReader (busyFile);
+        expect (busyReader.isValid());
+        expectEquals (busyReader.getNumRowsOrSamples(), static_cast<int64_t> (numBusyAppends * chunkedSrcBuffer.getNumSamples()));
+
+        expect (busyReader.seekToSample (static_cast<int64_t> (numBusyAppends - 1) * chunkedSrcBuffer.getNumSamples()));
+        ntlab::SampleBufferComplex<float> busyBufferRead (numChannels, chunkedSrcBuffer.getNumSamples());
+        busyReader.fillNextSamplesIntoBuffer (busyBufferRead);
+        expect (ntlab::UnitTestHelpers::areEqualSampleBuffers (chunkedSrcBuffer, busyBufferRead));
+
+        chunkedFile.deleteFile();
+        compressedFile.deleteFile();
+        overflowFile.deleteFile();
+        triggerFile.deleteFile();
+        busyFile.deleteFile();
+        dropOldestFile.deleteFile();
+        blockingFile.deleteFile();
+        shortLivedFile.deleteFile();
+
         realFloatFile .deleteFile();
         realDoubleFile.deleteFile();
         cplxFloatFile .deleteFile();
@@ -19,15 +19,16 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 
 namespace ntlab
 {
+    std::atomic<int> MCVWriter::numWriterThreads (0);
+
     MCVWriter::MCVWriter (int numChannels, bool useDoublePrecision, bool isComplex, const juce::File& outputFile, int fifoSize)
       : juce::AbstractFifo (fifoSize),
-        outputStream (outputFile)
+        outputFileBase (outputFile),
+        outputStream (createOutputStream (outputFile))
     {
         jassert (outputFile.hasFileExtension ("mcv"));
         jassert (numChannels > 0);
 
-        mcvWriterThread->newWriterCreated (this);
-
         metadata.reset (new MCVHeader (isComplex, useDoublePrecision, numChannels));
 
         auto numBytesPerFIFOChannel = metadata->sizeOfOneValue() * fifoSize;
@@ -37,33 +38,139 @@ namespace ntlab
         for (int i = 0; i < numChannels; ++i)
             fifoBuffers.emplace_back (juce::MemoryBlock (numBytesPerFIFOChannel));
 
-        outputStream.setPosition (MCVHeader::sizeOfHeaderInBytes);
+        interleavedSamples.setSize (numBytesPerFIFOChannel * static_cast<size_t> (numChannels));
+
+        // Register as last step, as the writer thread might access this writer from now on
+        mcvWriterThread = mcvWriterThreadPool->newWriterCreated (this);
     }
 
     MCVWriter::~MCVWriter()
     {
         updateMetadataHeader();
-        mcvWriterThread->writerDeleted (this);
+        mcvWriterThreadPool->writerDeleted (this, mcvWriterThread);
+    }
+
+    int MCVWriter::getBacklog() {return getNumReady(); }
+
+    int MCVWriter::getPeakBacklog() {return peakBacklog; }
+
+    void MCVWriter::resetPeakBacklog() {peakBacklog = 0; }
+
+    int MCVWriter::getFIFOSize() {return getTotalSize(); }
+
+    void MCVWriter::setOverflowPolicy (OverflowPolicy newOverflowPolicy, int blockingDeadlineInMilliseconds)
+    {
+        jassert (blockingDeadlineInMilliseconds >= 0);
+
+        overflowPolicy = newOverflowPolicy;
+        blockingDeadline = blockingDeadlineInMilliseconds;
+    }
+
+    int64_t MCVWriter::getNumSamplesDropped() {return numSamplesDropped; }
+
+    void MCVWriter::resetNumSamplesDropped() {numSamplesDropped = 0; }
+
+    void MCVWriter::setNumWriterThreads (int numThreads)
+    {
+        jassert (numThreads >= 0);
+        numWriterThreads = std::max (0, numThreads);
     }
 
-    bool MCVWriter::isValid () {return outputStream.openedOk(); }
+    bool MCVWriter::isValid () {return (outputStream != nullptr) && outputStream->openedOk(); }
+
+    int64_t MCVWriter::getNumSamplesWritten() {return numSamples; }
 
     void MCVWriter::waitForEmptyFIFO (int timeout)
     {
         waitForEmptyFIFOEvent.wait (timeout);
     }
 
+    void MCVWriter::startNewChunk (double timestampInSeconds, double centerFrequency)
+    {
+        auto numBytesPerRow = static_cast<int64_t> (metadata->sizeOfOneValue()) * metadata->getNumColsOrChannels();
+
+        MCVChunkIndex::Entry newEntry;
+        newEntry.byteOffset      = MCVHeader::sizeOfHeaderInBytes + numSamplesAppended * numBytesPerRow;
+        newEntry.firstSample     = numSamplesAppended;
+        newEntry.timestamp       = timestampInSeconds;
+        newEntry.centerFrequency = centerFrequency;
+
+        juce::SpinLock::ScopedLockType scopedChunkIndexLock (chunkIndexLock);
+        chunkIndex.addEntry (newEntry);
+    }
+
+    void MCVWriter::reserveChunkIndex (int numChunksExpected)
+    {
+        juce::SpinLock::ScopedLockType scopedChunkIndexLock (chunkIndexLock);
+        chunkIndex.reserve (numChunksExpected);
+    }
+
+    bool MCVWriter::enableBlockCompression (int newNumSamplesPerBlock)
+    {
+        jassert (newNumSamplesPerBlock > 0);
+
+        // Compression can't be enabled after samples have been appended
+        if (numSamplesAppended > 0)
+            return false;
+
+        std::lock_guard<std::mutex> scopedOutFileLock (outputFileLock);
+
+        auto numBytesPerBlock = metadata->sizeOfOneValue() * static_cast<size_t> (metadata->getNumColsOrChannels() * newNumSamplesPerBlock);
+
+        compressed = true;
+        numSamplesPerBlock = newNumSamplesPerBlock;
+        pendingBlock.setSize (numBytesPerBlock);
+        shuffleBuffer.setSize (numBytesPerBlock);
+
+        return true;
+    }
+
     void MCVWriter::updateMetadataHeader ()
     {
         std::lock_guard<std::mutex> scopedOutFileLock (outputFileLock);
 
-        auto outputStreamPosition = outputStream.getPosition();
+        // All samples need to be part of a block for the file to be valid. The next samples written will simply start
+        // a new block
+        if (numSamplesInPendingBlock > 0)
+            flushPendingBlock();
+
+        writeHeaderAndIndex();
+
+        if (numSamplesPerFile > 0)
+            writeManifest();
+    }
+
+    bool MCVWriter::enableFileRotationBySize (int64_t maxNumBytesPerFile, double newSampleRate)
+    {
+        auto numBytesPerRow = static_cast<int64_t> (metadata->sizeOfOneValue()) * metadata->getNumColsOrChannels();
+        return enableFileRotation (maxNumBytesPerFile / numBytesPerRow, newSampleRate);
+    }
+
+    bool MCVWriter::enableFileRotationByDuration (double maxDurationPerFileInSeconds, double newSampleRate)
+    {
+        return enableFileRotation (static_cast<int64_t> (maxDurationPerFileInSeconds * newSampleRate), newSampleRate);
+    }
+
+    bool MCVWriter::enableFileRotation (int64_t maxNumSamplesPerFile, double newSampleRate)
+    {
+        jassert (maxNumSamplesPerFile > 0);
+        jassert (newSampleRate > 0.0);
+
+        // Rotation can't be enabled after samples have been appended
+        if ((numSamplesAppended > 0) || (maxNumSamplesPerFile <= 0))
+            return false;
+
+        std::lock_guard<std::mutex> scopedOutFileLock (outputFileLock);
+
+        // The file opened by the constructor is replaced by the first file of the sequence
+        outputStream.reset();
+        outputFileBase.deleteFile();
 
-        metadata->setNumRowsOrSamples (numSamples);
-        metadata->writeToFile (outputStream);
+        numSamplesPerFile = maxNumSamplesPerFile;
+        sampleRate = newSampleRate;
+        outputStream = createOutputStream (getSequenceFile (0));
 
-        outputStream.setPosition (outputStreamPosition);
-        outputStream.flush();
+        return outputStream->openedOk();
     }
 
     bool MCVWriter::writeRawArray (const float** rawArray, int64_t numColsOrChannels, int64_t numRowsOrSamples, const juce::File& outputFile)
@@ -86,7 +193,7 @@ namespace ntlab
         return writeRaw (reinterpret_cast<const void**> (rawArray), numColsOrChannels, numRowsOrSamples, true, true, outputFile);
     }
 
-    MCVWriter::MCVWriterThread::MCVWriterThread () : juce::Thread ("MCVWriter Thread")
+    MCVWriter::MCVWriterThread::MCVWriterThread (int threadIndex) : juce::Thread ("MCVWriter Thread " + juce::String (threadIndex))
     {
         // give it a slightly higher priority than the default one
         startThread (6);
@@ -104,68 +211,496 @@ namespace ntlab
 
     void MCVWriter::MCVWriterThread::writerDeleted (ntlab::MCVWriter* writerThatHasBeenDeleted)
     {
-        auto idx = writers.indexOf (writerThatHasBeenDeleted);
-        writers.remove (idx);
+        writers.removeFirstMatchingValue (writerThatHasBeenDeleted);
     }
 
+    void MCVWriter::MCVWriterThread::waitForWriteInProgress()
+    {
+        const juce::ScopedLock scopedWriteLock (writeLock);
+    }
+
+    int MCVWriter::MCVWriterThread::getNumWriters() {return writers.size(); }
+
     void MCVWriter::MCVWriterThread::run ()
     {
         while (!threadShouldExit())
         {
-            for (auto writer : writers)
+            // Only copy the writers under the lock, so that creating or deleting a writer doesn't have to wait until
+            // all writers of this thread have been written to disk
             {
-                const int numSamplesToWrite = writer->getNumReady();
+                const juce::ScopedLock scopedWritersLock (writers.getLock());
+                writersToWrite.clearQuick();
+                writersToWrite.addArray (writers);
+            }
 
-                if (numSamplesToWrite == 0)
-                {
-                    writer->waitForEmptyFIFOEvent.signal();
-                    continue;
-                }
+            for (auto writer : writersToWrite)
+            {
+                const juce::ScopedLock scopedWriteLock (writeLock);
 
+                // The writer might have been deleted in the meantime
+                if (writers.contains (writer))
+                    writer->writeFIFOContentToFile();
+            }
 
-                int fifoStartIdx1, fifoBlockSize1, fifoStartIdx2, fifoBlockSize2;
-                writer->prepareToRead (numSamplesToWrite, fifoStartIdx1, fifoBlockSize1, fifoStartIdx2, fifoBlockSize2);
+            wait (-1);
+        }
+    }
+
+    MCVWriter::MCVWriterThread* MCVWriter::MCVWriterThreadPool::newWriterCreated (ntlab::MCVWriter* newWriter)
+    {
+        const juce::ScopedLock scopedLock (lock);
+
+        auto numThreadsDesired = numWriterThreads.load();
+        if (numThreadsDesired == 0)
+            numThreadsDesired = juce::jlimit (1, 4, juce::SystemStats::getNumCpus() / 2);
 
-                const auto numChannelsToWrite = writer->metadata->getNumColsOrChannels();
-                const auto numBytesPerValue = writer->metadata->sizeOfOneValue();
-                auto& outputStream = writer->outputStream;
+        MCVWriterThread* leastBusyThread = nullptr;
 
-                std::lock_guard<std::mutex> scopedOutFileLock (writer->outputFileLock);
+        for (auto thread : threads)
+            if ((leastBusyThread == nullptr) || (thread->getNumWriters() < leastBusyThread->getNumWriters()))
+                leastBusyThread = thread;
+
+        // Only start another thread if all existing ones are busy
+        if ((threads.size() < numThreadsDesired) && ((leastBusyThread == nullptr) || (leastBusyThread->getNumWriters() > 0)))
+            leastBusyThread = threads.add (new MCVWriterThread (threads.size()));
+
+        leastBusyThread->newWriterCreated (newWriter);
+        return leastBusyThread;
+    }
+
+    void MCVWriter::MCVWriterThreadPool::writerDeleted (ntlab::MCVWriter* writerThatHasBeenDeleted, MCVWriterThread* assignedThread)
+    {
+        {
+            const juce::ScopedLock scopedLock (lock);
+            assignedThread->writerDeleted (writerThatHasBeenDeleted);
+        }
+
+        // As the writer has been removed, no further write will be started for it. Waiting for a write that might
+        // still be in progress outside the pool lock only stalls the writers that share the assigned thread
+        assignedThread->waitForWriteInProgress();
+    }
+
+    void MCVWriter::writeFIFOContentToFile()
+    {
+        // Samples appended while this runs are left for the next call, the interleaved buffer can't hold more
+        const auto numSamplesReady = getNumReady();
+        int numSamplesToWrite = 0;
+
+        while (numSamplesToWrite < numSamplesReady)
+        {
+            {
+                juce::SpinLock::ScopedLockType scopedFIFOReadLock (fifoReadLock);
+
+                // The dropOldest policy might have discarded samples in the meantime
+                auto numSamplesInSlice = std::min ({ numSamplesReady - numSamplesToWrite, maxNumSamplesPerFIFOSlice, getNumReady() });
+
+                if (numSamplesInSlice == 0)
+                    break;
+
+                int fifoStartIdx1, fifoBlockSize1, fifoStartIdx2, fifoBlockSize2;
+                prepareToRead (numSamplesInSlice, fifoStartIdx1, fifoBlockSize1, fifoStartIdx2, fifoBlockSize2);
 
                 if (fifoBlockSize1 > 0)
+                    interleaveFIFOSamples (fifoStartIdx1, fifoBlockSize1, numSamplesToWrite);
+
+                if (fifoBlockSize2 > 0)
+                    interleaveFIFOSamples (fifoStartIdx2, fifoBlockSize2, numSamplesToWrite + fifoBlockSize1);
+
+                finishedRead (fifoBlockSize1 + fifoBlockSize2);
+                numSamplesTakenFromFIFO += numSamplesInSlice;
+                numSamplesToWrite       += numSamplesInSlice;
+            }
+
+            fifoSpaceAvailableEvent.signal();
+        }
+
+        if (numSamplesToWrite == 0)
+        {
+            waitForEmptyFIFOEvent.signal();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> scopedOutFileLock (outputFileLock);
+            writeInterleavedSamplesToFile (numSamplesToWrite);
+        }
+
+        if (getNumReady() == 0)
+            waitForEmptyFIFOEvent.signal();
+    }
+
+    void MCVWriter::interleaveFIFOSamples (int fifoStartIdx, int numSamplesToCopy, int destinationRow)
+    {
+        const auto numChannelsToWrite = metadata->getNumColsOrChannels();
+        const auto numBytesPerValue = metadata->sizeOfOneValue();
+
+        auto* interleavedDestination = static_cast<char*> (interleavedSamples.getData()) + destinationRow * numChannelsToWrite * numBytesPerValue;
+
+        for (int s = 0; s < numSamplesToCopy; ++ s)
+        {
+            for (int c = 0; c < numChannelsToWrite; ++ c)
+            {
+                std::memcpy (interleavedDestination, juce::addBytesToPointer (fifoBuffers[c].getData(), numBytesPerValue * (fifoStartIdx + s)), numBytesPerValue);
+                interleavedDestination += numBytesPerValue;
+            }
+        }
+    }
+
+    void MCVWriter::writeInterleavedSamplesToFile (int numSamplesToWrite)
+    {
+        const auto numBytesPerRow = metadata->sizeOfOneValue() * static_cast<size_t> (metadata->getNumColsOrChannels());
+
+        auto* source = static_cast<const char*> (interleavedSamples.getData());
+
+        if (!compressed)
+        {
+            while (numSamplesToWrite > 0)
+            {
+                if (limitToCurrentFile (numSamplesToWrite) == 0)
+                    startNextFile();
+
+                auto numSamplesInSegment = limitToCurrentFile (numSamplesToWrite);
+                auto numBytesInSegment = numBytesPerRow * static_cast<size_t> (numSamplesInSegment);
+
+                outputStream->write (source, numBytesInSegment);
+
+                source            += numBytesInSegment;
+                numSamplesToWrite -= numSamplesInSegment;
+                numSamples        += numSamplesInSegment;
+            }
+
+            return;
+        }
+
+        while (numSamplesToWrite > 0)
+        {
+            if (limitToCurrentFile (numSamplesToWrite) == 0)
+                startNextFile();
+
+            // A new chunk always starts a new block
+            if ((numSamplesInPendingBlock > 0) && chunkStartsAt (numSamples))
+                flushPendingBlock();
+
+            auto numSamplesInSegment = limitToCurrentFile (std::min (numSamplesToWrite, numSamplesPerBlock - numSamplesInPendingBlock));
+
+            auto nextChunkStart = getFirstChunkStartAfter (numSamples);
+            if (nextChunkStart > 0)
+                numSamplesInSegment = static_cast<int> (std::min<int64_t> (numSamplesInSegment, nextChunkStart - numSamples));
+
+            auto numBytesInSegment = numBytesPerRow * static_cast<size_t> (numSamplesInSegment);
+            std::memcpy (static_cast<char*> (pendingBlock.getData()) + numBytesPerRow * static_cast<size_t> (numSamplesInPendingBlock), source, numBytesInSegment);
+
+            source                   += numBytesInSegment;
+            numSamplesToWrite        -= numSamplesInSegment;
+            numSamplesInPendingBlock += numSamplesInSegment;
+            numSamples               += numSamplesInSegment;
+
+            if (numSamplesInPendingBlock == numSamplesPerBlock)
+                flushPendingBlock();
+        }
+    }
+
+    int MCVWriter::handleOverflow (int numSamplesToWrite)
+    {
+        int numSamplesDroppedNow = 0;
+
+        switch (overflowPolicy)
+        {
+            case blockUntilDeadline:
+            {
+                const auto deadline = juce::Time::getMillisecondCounter() + static_cast<juce::uint32> (blockingDeadline);
+
+                while (getFreeSpace() < numSamplesToWrite)
                 {
-                    for (int s = 0; s < fifoBlockSize1; ++ s)
-                    {
-                        for (int c = 0; c < numChannelsToWrite; ++ c)
-                        {
-                            void* valueToWrite = juce::addBytesToPointer (writer->fifoBuffers[c].getData(), numBytesPerValue * (fifoStartIdx1 +s));
-                            outputStream.write (valueToWrite, numBytesPerValue);
-                        }
-                    }
-                    writer->numSamples += fifoBlockSize1;
+                    const auto now = juce::Time::getMillisecondCounter();
+                    if (now >= deadline)
+                        break;
+
+                    mcvWriterThread->notify();
+                    fifoSpaceAvailableEvent.wait (static_cast<int> (deadline - now));
                 }
+                break;
+            }
 
-                if (fifoBlockSize2 > 0)
+            case dropOldest:
+            {
+                juce::SpinLock::ScopedLockType scopedFIFOReadLock (fifoReadLock);
+
+                auto numSamplesToDiscard = std::min (numSamplesToWrite - getFreeSpace(), getNumReady());
+
+                if (numSamplesToDiscard > 0)
                 {
-                    for (int s = 0; s < fifoBlockSize2; ++ s)
+                    int fifoStartIdx1, fifoBlockSize1, fifoStartIdx2, fifoBlockSize2;
+                    prepareToRead (numSamplesToDiscard, fifoStartIdx1, fifoBlockSize1, fifoStartIdx2, fifoBlockSize2);
+                    finishedRead (fifoBlockSize1 + fifoBlockSize2);
+
+                    // The discarded samples never make it to the file, so all chunks behind them move forward
+                    const auto numBytesPerRow = static_cast<int64_t> (metadata->sizeOfOneValue()) * metadata->getNumColsOrChannels();
                     {
-                        for (int c = 0; c < numChannelsToWrite; ++ c)
-                        {
-                            void* valueToWrite = juce::addBytesToPointer (writer->fifoBuffers[c].getData(), numBytesPerValue * (fifoStartIdx2 +s));
-                            outputStream.write (valueToWrite, numBytesPerValue);
-                        }
+                        juce::SpinLock::ScopedLockType scopedChunkIndexLock (chunkIndexLock);
+                        chunkIndex.removeSamples (numSamplesTakenFromFIFO, numSamplesToDiscard, numBytesPerRow);
                     }
-                    writer->numSamples += fifoBlockSize2;
+
+                    numSamplesAppended   -= numSamplesToDiscard;
+                    numSamplesDroppedNow += numSamplesToDiscard;
                 }
+                break;
+            }
 
-                writer->finishedRead (fifoBlockSize1 + fifoBlockSize2);
+            case dropNewest:
+                break;
+        }
+
+        // Whatever still doesn't fit is dropped from the end of the new samples
+        numSamplesDroppedNow += std::max (0, numSamplesToWrite - getFreeSpace());
+        numSamplesDropped += numSamplesDroppedNow;
+
+        return numSamplesDroppedNow;
+    }
 
-                if (writer->getNumReady() == 0)
-                    writer->waitForEmptyFIFOEvent.signal();
+    void MCVWriter::flushPendingBlock()
+    {
+        MCVChunkIndex::Entry newBlock;
+        newBlock.byteOffset      = outputStream->getPosition();
+        newBlock.firstSample     = numSamples - numSamplesInPendingBlock;
+        newBlock.firstSample    -= firstSampleOfCurrentFile;
+        newBlock.timestamp       = 0.0;
+        newBlock.centerFrequency = 0.0;
+
+        auto numBytesInBlock = metadata->sizeOfOneValue() * static_cast<size_t> (metadata->getNumColsOrChannels() * numSamplesInPendingBlock);
+
+        // If this fails, the disk is probably full
+        auto numBytesWritten = MCVBlockCodec::encodeBlock (pendingBlock.getData(), numBytesInBlock, metadata->sizeOfOneScalar(), *outputStream, shuffleBuffer);
+        jassert (numBytesWritten > 0);
+        juce::ignoreUnused (numBytesWritten);
+
+        blockIndex.addEntry (newBlock);
+        numSamplesInPendingBlock = 0;
+    }
+
+    void MCVWriter::writeHeaderAndIndex()
+    {
+        auto outputStreamPosition = outputStream->getPosition();
+
+        metadata->setNumRowsOrSamples (numSamples - firstSampleOfCurrentFile);
+
+        if (compressed)
+        {
+            // Every chunk starts a new block, chunks that start in the pending block are indexed once it is flushed
+            auto chunkIndexOfCurrentFile = getChunkIndexOfCurrentFile();
+            MCVChunkIndex chunkIndexToWrite;
+
+            for (int i = 0; i < chunkIndexOfCurrentFile.getNumChunks(); ++i)
+            {
+                auto& chunk = chunkIndexOfCurrentFile.getEntry (i);
+                auto blockIdx = blockIndex.findChunkContainingSample (chunk.firstSample);
+                if ((blockIdx < 0) || (blockIndex.getEntry (blockIdx).firstSample != chunk.firstSample))
+                    continue;
+
+                auto entry = chunk;
+                entry.byteOffset = blockIndex.getEntry (blockIdx).byteOffset;
+                chunkIndexToWrite.addEntry (entry);
             }
 
-            wait (-1);
+            metadata->setCompressed (true);
+            metadata->setHasChunkIndex (!chunkIndexToWrite.isEmpty());
+            metadata->writeToFile (*outputStream);
+
+            // The block index is followed by the chunk index, so that the reader can locate both from the end of the file
+            outputStream->setPosition (outputStreamPosition);
+            blockIndex.writeToStream (*outputStream);
+            if (!chunkIndexToWrite.isEmpty())
+                chunkIndexToWrite.writeToStream (*outputStream);
+        }
+        else
+        {
+            auto chunkIndexToWrite = getChunkIndexOfCurrentFile();
+
+            metadata->setHasChunkIndex (!chunkIndexToWrite.isEmpty());
+            metadata->writeToFile (*outputStream);
+
+            // The index is appended directly after the payload. Samples written afterwards will overwrite it until it
+            // is written again on the next update
+            outputStream->setPosition (outputStreamPosition);
+            if (!chunkIndexToWrite.isEmpty())
+                chunkIndexToWrite.writeToStream (*outputStream);
         }
+
+        // An index written by a previous update might have been longer
+        outputStream->truncate();
+
+        outputStream->setPosition (outputStreamPosition);
+        outputStream->flush();
+    }
+
+    int MCVWriter::limitToCurrentFile (int numSamplesToWrite)
+    {
+        if (numSamplesPerFile == 0)
+            return numSamplesToWrite;
+
+        return static_cast<int> (std::min<int64_t> (numSamplesToWrite, firstSampleOfCurrentFile + numSamplesPerFile - numSamples));
+    }
+
+    void MCVWriter::startNextFile()
+    {
+        if (numSamplesInPendingBlock > 0)
+            flushPendingBlock();
+
+        writeHeaderAndIndex();
+        completedFiles.add (describeCurrentFile());
+
+        outputStream = createOutputStream (getSequenceFile (++currentFileIdx));
+
+        // If this fails, the disk is probably full
+        jassert (outputStream->openedOk());
+
+        firstSampleOfCurrentFile = numSamples;
+        blockIndex.clear();
+
+        writeManifest();
+    }
+
+    juce::File MCVWriter::getSequenceFile (int fileIdx)
+    {
+        return outputFileBase.getSiblingFile (outputFileBase.getFileNameWithoutExtension() + "_" + juce::String (fileIdx).paddedLeft ('0', 4) + ".mcv");
+    }
+
+    MCVChunkIndex::Entry MCVWriter::getEntryForCurrentFile (const MCVChunkIndex::Entry& chunk)
+    {
+        auto numBytesPerRow = static_cast<int64_t> (metadata->sizeOfOneValue()) * metadata->getNumColsOrChannels();
+        auto entry = chunk;
+
+        // A chunk that started in a previous file is continued at the beginning of this one
+        if (entry.firstSample < firstSampleOfCurrentFile)
+        {
+            entry.timestamp  += (firstSampleOfCurrentFile - entry.firstSample) / sampleRate;
+            entry.firstSample = firstSampleOfCurrentFile;
+        }
+
+        entry.firstSample -= firstSampleOfCurrentFile;
+        entry.byteOffset   = MCVHeader::sizeOfHeaderInBytes + entry.firstSample * numBytesPerRow;
+
+        return entry;
+    }
+
+    MCVChunkIndex MCVWriter::getChunkIndexOfCurrentFile()
+    {
+        MCVChunkIndex currentFileIndex;
+
+        if (numSamples == firstSampleOfCurrentFile)
+            return currentFileIndex;
+
+        // The appending thread might spin on the lock, so the entries are only copied into a buffer that has been
+        // grown before taking the lock. The index is built after releasing it
+        for (bool copied = false; !copied;)
+        {
+            size_t numChunks;
+            {
+                juce::SpinLock::ScopedLockType scopedChunkIndexLock (chunkIndexLock);
+                numChunks = static_cast<size_t> (chunkIndex.getNumChunks());
+            }
+
+            chunksOfCurrentFile.clear();
+            chunksOfCurrentFile.reserve (numChunks);
+
+            juce::SpinLock::ScopedLockType scopedChunkIndexLock (chunkIndexLock);
+
+            // Chunks might have been started in the meantime
+            if (static_cast<size_t> (chunkIndex.getNumChunks()) > chunksOfCurrentFile.capacity())
+                continue;
+
+            // Only chunks that start at a sample that has already been written to disk are part of the index
+            auto firstChunkIdx = std::max (0, chunkIndex.findChunkContainingSample (firstSampleOfCurrentFile));
+            auto lastChunkIdx  = chunkIndex.findChunkContainingSample (numSamples - 1);
+
+            for (auto i = firstChunkIdx; i <= lastChunkIdx; ++i)
+                chunksOfCurrentFile.push_back (chunkIndex.getEntry (i));
+
+            copied = true;
+        }
+
+        currentFileIndex.reserve (static_cast<int> (chunksOfCurrentFile.size()));
+
+        for (auto& chunk : chunksOfCurrentFile)
+            currentFileIndex.addEntry (getEntryForCurrentFile (chunk));
+
+        return currentFileIndex;
+    }
+
+    juce::var MCVWriter::describeCurrentFile()
+    {
+        auto* description = new juce::DynamicObject();
+        description->setProperty ("file",        getSequenceFile (currentFileIdx).getFileName());
+        description->setProperty ("firstSample", static_cast<juce::int64> (firstSampleOfCurrentFile));
+        description->setProperty ("numSamples",  static_cast<juce::int64> (numSamples - firstSampleOfCurrentFile));
+
+        MCVChunkIndex::Entry firstChunk {};
+        bool hasFirstChunk = false;
+
+        {
+            // setProperty allocates, which must not happen while the appending thread might spin on this lock
+            juce::SpinLock::ScopedLockType scopedChunkIndexLock (chunkIndexLock);
+
+            auto chunkIdx = chunkIndex.findChunkContainingSample (firstSampleOfCurrentFile);
+            if (chunkIdx >= 0)
+            {
+                firstChunk = chunkIndex.getEntry (chunkIdx);
+                hasFirstChunk = true;
+            }
+        }
+
+        if (hasFirstChunk)
+            description->setProperty ("startTime", getEntryForCurrentFile (firstChunk).timestamp);
+
+        return juce::var (description);
+    }
+
+    void MCVWriter::writeManifest()
+    {
+        auto files = completedFiles;
+        files.add (describeCurrentFile());
+
+        auto* manifest = new juce::DynamicObject();
+        manifest->setProperty ("numChannels",       static_cast<juce::int64> (metadata->getNumColsOrChannels()));
+        manifest->setProperty ("isComplex",         metadata->isComplex());
+        manifest->setProperty ("doublePrecision",   metadata->hasDoublePrecision());
+        manifest->setProperty ("compressed",        compressed);
+        manifest->setProperty ("sampleRate",        sampleRate);
+        manifest->setProperty ("numSamplesPerFile", static_cast<juce::int64> (numSamplesPerFile));
+        manifest->setProperty ("numSamples",        static_cast<juce::int64> (numSamples.load()));
+        manifest->setProperty ("files",             files);
+
+        auto manifestFile = outputFileBase.getSiblingFile (outputFileBase.getFileNameWithoutExtension() + "_manifest.json");
+        manifestFile.replaceWithText (juce::JSON::toString (juce::var (manifest)));
+    }
+
+    std::unique_ptr<juce::FileOutputStream> MCVWriter::createOutputStream (const juce::File& file)
+    {
+        std::unique_ptr<juce::FileOutputStream> stream (new juce::FileOutputStream (file));
+
+        if (stream->openedOk())
+        {
+            stream->setPosition (MCVHeader::sizeOfHeaderInBytes);
+            stream->truncate();
+        }
+
+        return stream;
+    }
+
+    bool MCVWriter::chunkStartsAt (int64_t sampleIdx)
+    {
+        juce::SpinLock::ScopedLockType scopedChunkIndexLock (chunkIndexLock);
+
+        auto chunkIdx = chunkIndex.findChunkContainingSample (sampleIdx);
+        return (chunkIdx >= 0) && (chunkIndex.getEntry (chunkIdx).firstSample == sampleIdx);
+    }
+
+    int64_t MCVWriter::getFirstChunkStartAfter (int64_t sampleIdx)
+    {
+        juce::SpinLock::ScopedLockType scopedChunkIndexLock (chunkIndexLock);
+
+        auto nextChunkIdx = chunkIndex.findChunkContainingSample (sampleIdx) + 1;
+        return nextChunkIdx < chunkIndex.getNumChunks() ? chunkIndex.getEntry (nextChunkIdx).firstSample : -1;
     }
 
     void MCVWriter::setTmpChannelPointersToIndex (int index)
@@ -193,9 +728,9 @@ namespace ntlab
         if (!header.writeToFile (outputStream))
             return false;
 
-        for (int row = 0; row < numRowsOrSamples; ++row)
+        for (int64_t row = 0; row < numRowsOrSamples; ++row)
         {
-            for (int col = 0; col < numColsOrChannels; ++col)
+            for (int64_t col = 0; col < numColsOrChannels; ++col)
             {
                 if (!outputStream.write (static_cast<const char*>(rawArray[col]) + row * numBytesPerValue, numBytesPerValue))
                     return false;
@@ -23,6 +23,8 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 
 #include <juce_core/juce_core.h>
 #include "MCVHeader.h"
+#include "MCVChunkIndex.h"
+#include "MCVBlockCodec.h"
 #include "../SampleBuffers/SampleBuffers.h"
 #include <mutex>
 
@@ -38,6 +40,25 @@ namespace ntlab
         friend class MCVWriterThread;
     public:
 
+        /** Describes what appendSampleBuffer does if the FIFO can't take all samples passed */
+        enum OverflowPolicy
+        {
+            /**
+             * Waits for the writer thread to make space in the FIFO, but not longer than the blocking deadline. If
+             * there is still not enough space after the deadline, the newest samples are dropped.
+             */
+            blockUntilDeadline,
+
+            /**
+             * Discards the oldest samples in the FIFO that have not been written yet to make space for the new
+             * samples. Chunks that started in the discarded region start at the next sample written.
+             */
+            dropOldest,
+
+            /** Drops the samples that don't fit into the FIFO. This never blocks and is the default policy */
+            dropNewest
+        };
+
         /**
          * Create an MCVWriter instance if you want to continously write and append samples to a MCV File. In case you
          * want to write a matrix or a sample buffer at once, use on of the static member functions
@@ -63,9 +84,95 @@ namespace ntlab
          */
         void waitForEmptyFIFO (int timeout = -1);
 
-        /** Appends the content of this sample buffer to the file */
+        /**
+         * Marks the next sample appended as the beginning of a new chunk. As soon as at least one chunk has been
+         * started, the file will be written as a chunked MCV file with a trailing chunk index that stores the
+         * timestamp and center frequency passed for each chunk. This allows readers to seek to a point in time via
+         * MCVReader::seekToTime. Timestamps must be ascending. Call this from the same thread that calls
+         * appendSampleBuffer. As it might allocate memory to grow the index, call reserveChunkIndex before streaming
+         * if you want to call it from a realtime thread.
+         */
+        void startNewChunk (double timestampInSeconds, double centerFrequency = 0.0);
+
+        /** Pre-allocates space for the expected number of chunks. @see startNewChunk */
+        void reserveChunkIndex (int numChunksExpected);
+
+        /**
+         * Switches the writer to the compressed MCV format. The samples are collected in blocks of numSamplesPerBlock
+         * rows which are encoded independently by the writer thread, so that a reader can still seek to any block
+         * and decode multiple blocks in parallel. A block ends early if a new chunk is started, so each block belongs
+         * to exactly one chunk. This has to be called before the first sample is appended, returns false otherwise.
+         */
+        bool enableBlockCompression (int numSamplesPerBlock = 65536);
+
+        /**
+         * Splits the recording into a sequence of files that hold at most maxNumBytesPerFile bytes of payload each.
+         * The file passed to the constructor is only used as base name, the files are named like the base file
+         * followed by a running four digit index, e.g. capture_0000.mcv, capture_0001.mcv and so on. The files are
+         * written back to back, so concatenating their payloads gives the exact stream of samples appended. A chunk
+         * that spans multiple files is continued at the beginning of each file with a timestamp that is advanced by
+         * the number of samples in the previous files, which is why the sample rate is needed. For compressed files
+         * the size refers to the uncompressed payload, so the actual files will be smaller.
+         *
+         * Next to the files, a JSON manifest named like the base file with a _manifest.json suffix lists all files
+         * of the sequence with their first sample, number of samples and start time. It is rewritten each time a
+         * file is completed and each time the metadata header is updated, so files that are listed before the
+         * current one can be moved away while the recording continues.
+         *
+         * This has to be called before the first sample is appended, returns false otherwise or if the first file
+         * could not be opened.
+         */
+        bool enableFileRotationBySize (int64_t maxNumBytesPerFile, double sampleRate);
+
+        /**
+         * Splits the recording into a sequence of files that hold at most maxDurationPerFileInSeconds seconds of
+         * samples each. @see enableFileRotationBySize
+         */
+        bool enableFileRotationByDuration (double maxDurationPerFileInSeconds, double sampleRate);
+
+        /** Returns the total number of samples written to disk so far */
+        int64_t getNumSamplesWritten();
+
+        /**
+         * Returns the number of samples that are currently waiting in the FIFO to be written to disk. If this gets
+         * close to the FIFO size, the disk can't keep up.
+         */
+        int getBacklog();
+
+        /** Returns the highest backlog seen since the writer was created or since the last call to resetPeakBacklog */
+        int getPeakBacklog();
+
+        void resetPeakBacklog();
+
+        /** Returns the number of samples the FIFO can hold */
+        int getFIFOSize();
+
+        /**
+         * Sets the number of threads that write the samples of all MCVWriter instances to disk. Each writer is
+         * assigned to the thread that serves the fewest writers when it is created, so a writer whose disk can't
+         * keep up only stalls the writers that share its thread. Changes only affect writers created afterwards,
+         * threads that have been started already keep running. By default, half the number of CPU cores is used,
+         * limited to the range of 1 to 4. Pass 0 to return to the default.
+         */
+        static void setNumWriterThreads (int numThreads);
+
+        /**
+         * Sets the behaviour of appendSampleBuffer in case the FIFO is full. The deadline is only used by the
+         * blockUntilDeadline policy. @see OverflowPolicy
+         */
+        void setOverflowPolicy (OverflowPolicy newOverflowPolicy, int blockingDeadlineInMilliseconds = 10);
+
+        /** Returns the total number of samples that were dropped due to FIFO overflows */
+        int64_t getNumSamplesDropped();
+
+        void resetNumSamplesDropped();
+
+        /**
+         * Appends the content of this sample buffer to the file. Returns the number of samples that had to be dropped
+         * because the FIFO was full. What is dropped depends on the overflow policy, @see setOverflowPolicy.
+         */
         template <typename BufferType>
-        void appendSampleBuffer (const BufferType& bufferToAppend)
+        int appendSampleBuffer (const BufferType& bufferToAppend)
         {
             jassert (bufferToAppend.getNumChannels() == metadata->getNumColsOrChannels());
 
@@ -83,10 +190,17 @@ namespace ntlab
                 jassert (!metadata->isComplex()); // you are passing a real buffer to a complex writer
 
             int numSamplesToWrite = bufferToAppend.getNumSamples();
+            int numSamplesDroppedNow = 0;
 
             if (numSamplesToWrite)
                 waitForEmptyFIFOEvent.reset();
 
+            if (numSamplesToWrite > getFreeSpace())
+            {
+                numSamplesDroppedNow = handleOverflow (numSamplesToWrite);
+                numSamplesToWrite = std::min (numSamplesToWrite, getFreeSpace());
+            }
+
             int fifoStartIdx1, fifoBlockSize1, fifoStartIdx2, fifoBlockSize2;
             prepareToWrite (numSamplesToWrite, fifoStartIdx1, fifoBlockSize1, fifoStartIdx2, fifoBlockSize2);
 
@@ -104,13 +218,16 @@ namespace ntlab
                 bufferToAppend.copyTo (fifoBlock2, fifoBlockSize2, static_cast<int> (metadata->getNumColsOrChannels()), fifoBlockSize1);
             }
 
-            // If this assert fires, the fifo size is too small
-            jassert (fifoBlockSize1 + fifoBlockSize2 < numSamplesToWrite);
-
-
             finishedWrite (fifoBlockSize1 + fifoBlockSize2);
+            numSamplesAppended += fifoBlockSize1 + fifoBlockSize2;
+
+            auto backlog = getNumReady();
+            if (backlog > peakBacklog)
+                peakBacklog = backlog;
 
             mcvWriterThread->notify();
+
+            return numSamplesDroppedNow;
         }
 
         /** Writes a SampleBuffer to the desired output file. Allowed types are all ntlab SampleBuffer classes and juce
@@ -191,30 +308,144 @@ namespace ntlab
         class MCVWriterThread : public juce::Thread
         {
         public:
-            MCVWriterThread();
+            MCVWriterThread (int threadIndex);
             ~MCVWriterThread();
 
             void newWriterCreated (MCVWriter* newWriter);
             void writerDeleted (MCVWriter* writerThatHasBeenDeleted);
 
+            // Returns once the write this thread might currently be doing has finished
+            void waitForWriteInProgress();
+
+            int getNumWriters();
+
             void run() override;
         private:
-            juce::Array<MCVWriter*, juce::SpinLock> writers;
+            juce::Array<MCVWriter*, juce::CriticalSection> writers;
+
+            // A copy of the writers that is written to disk outside the writers lock. Only accessed by this thread
+            juce::Array<MCVWriter*> writersToWrite;
+
+            // Locked while the samples of one writer are written, so a writer can't be deleted during that time
+            juce::CriticalSection writeLock;
+        };
+
+        /** Holds all writer threads and assigns new writers to them */
+        class MCVWriterThreadPool
+        {
+        public:
+            MCVWriterThreadPool() {}
+
+            /** Returns the thread the writer has been assigned to */
+            MCVWriterThread* newWriterCreated (MCVWriter* newWriter);
+            void writerDeleted (MCVWriter* writerThatHasBeenDeleted, MCVWriterThread* assignedThread);
+
+        private:
+            juce::CriticalSection lock;
+            juce::OwnedArray<MCVWriterThread> threads;
         };
 
-        juce::SharedResourcePointer<MCVWriterThread> mcvWriterThread;
+        static std::atomic<int> numWriterThreads;
+
+        juce::SharedResourcePointer<MCVWriterThreadPool> mcvWriterThreadPool;
+        MCVWriterThread* mcvWriterThread = nullptr;
         juce::WaitableEvent waitForEmptyFIFOEvent;
 
         std::vector<juce::MemoryBlock> fifoBuffers;
         std::vector<void*> tmpChannelPointers;
 
-        juce::FileOutputStream outputStream;
+        const juce::File outputFileBase;
+        std::unique_ptr<juce::FileOutputStream> outputStream;
         std::mutex outputFileLock;
         std::unique_ptr<MCVHeader> metadata;
-        int numSamples = 0;
+        std::atomic<int64_t> numSamples {0};
+        int64_t numSamplesAppended = 0;
+
+        MCVChunkIndex chunkIndex;
+        juce::SpinLock chunkIndexLock;
+
+        // The entries of chunkIndex that belong to the current file, only accessed with the output file locked
+        std::vector<MCVChunkIndex::Entry> chunksOfCurrentFile;
+
+        // Only used for compressed files, these are accessed by the writer thread with the output file locked
+        bool compressed = false;
+        int numSamplesPerBlock = 0;
+        int numSamplesInPendingBlock = 0;
+        juce::MemoryBlock pendingBlock;
+        juce::MemoryBlock shuffleBuffer;
+        MCVChunkIndex blockIndex;
+
+        // Only used if file rotation is enabled, these are accessed by the writer thread with the output file locked
+        int64_t numSamplesPerFile = 0;
+        double sampleRate = 0.0;
+        int currentFileIdx = 0;
+        int64_t firstSampleOfCurrentFile = 0;
+        juce::Array<juce::var> completedFiles;
+
+        std::atomic<int> peakBacklog {0};
+
+        OverflowPolicy overflowPolicy = dropNewest;
+        int blockingDeadline = 10;
+        std::atomic<int64_t> numSamplesDropped {0};
+        juce::WaitableEvent fifoSpaceAvailableEvent;
+
+        // The read side of the FIFO is locked, as the dropOldest policy might discard samples from the appending
+        // thread. The writer thread only holds the lock while copying one slice of samples out of the FIFO, so that
+        // the appending thread never spins for longer than copying a slice takes.
+        juce::SpinLock fifoReadLock;
+        int64_t numSamplesTakenFromFIFO = 0;
+        static constexpr int maxNumSamplesPerFIFOSlice = 1024;
+
+        // The writer thread interleaves the samples taken from the FIFO into this buffer
+        juce::MemoryBlock interleavedSamples;
+
+        /** Drops samples according to the overflow policy. Returns the number of samples dropped */
+        int handleOverflow (int numSamplesToWrite);
 
         void setTmpChannelPointersToIndex (int index);
 
+        /** Writes all samples in the FIFO to the file. Called by the writer thread */
+        void writeFIFOContentToFile();
+
+        /** Copies samples from the FIFO into the interleaved samples buffer */
+        void interleaveFIFOSamples (int fifoStartIdx, int numSamplesToCopy, int destinationRow);
+
+        /** Writes the interleaved samples to the file. Called by the writer thread with the output file locked */
+        void writeInterleavedSamplesToFile (int numSamplesToWrite);
+
+        /** Encodes the pending block, appends it to the file and adds it to the block index */
+        void flushPendingBlock();
+
+        /** Writes the header and the index of the current file. Called with the output file locked */
+        void writeHeaderAndIndex();
+
+        bool enableFileRotation (int64_t maxNumSamplesPerFile, double newSampleRate);
+
+        /** Returns the number of samples that can be written before the current file is full */
+        int limitToCurrentFile (int numSamplesToWrite);
+
+        /** Completes the current file and continues writing to the next file of the sequence */
+        void startNextFile();
+
+        juce::File getSequenceFile (int fileIdx);
+
+        /** Returns the chunk entry as it will appear in the index of the current file. Needs the chunk index locked */
+        MCVChunkIndex::Entry getEntryForCurrentFile (const MCVChunkIndex::Entry& chunk);
+
+        MCVChunkIndex getChunkIndexOfCurrentFile();
+
+        juce::var describeCurrentFile();
+
+        void writeManifest();
+
+        /** Opens a file for writing, discards previous content and skips the space for the header */
+        static std::unique_ptr<juce::FileOutputStream> createOutputStream (const juce::File& file);
+
+        bool chunkStartsAt (int64_t sampleIdx);
+
+        /** Returns the first sample of the next chunk started after the sample passed or -1 if there is none */
+        int64_t getFirstChunkStartAfter (int64_t sampleIdx);
+
         static bool writeRaw (const void** rawArray, int64_t numColsOrChannels, int64_t numRowsOrSamples, bool isComplex, bool isDouble, const juce::File& outputFile);
     };
 }
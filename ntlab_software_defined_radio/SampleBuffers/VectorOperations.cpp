@@ -70,6 +70,14 @@ namespace ntlab
         numElementsRemainingToProcessWithoutSIMD = vectorLength - numElementsToProcessWithSIMD;
     }
 
+    template<>
+    void SIMDHelpers::Partition<int8_t>::forArbitraryLengthVector (const int vectorLength, int& numSIMDVectors, int& numElementsToProcessWithSIMD, int& numElementsRemainingToProcessWithoutSIMD)
+    {
+        numSIMDVectors = vectorLength / simdVectorLengthInt8;
+        numElementsToProcessWithSIMD = numSIMDVectors * simdVectorLengthInt8;
+        numElementsRemainingToProcessWithoutSIMD = vectorLength - numElementsToProcessWithSIMD;
+    }
+
     template<>
     constexpr int SIMDHelpers::VectorLength<double>::numValues() {return simdVectorLengthDouble; }
 
@@ -82,6 +90,9 @@ namespace ntlab
     template<>
     constexpr int SIMDHelpers::VectorLength<int16_t>::numValues() {return simdVectorLengthInt16; }
 
+    template<>
+    constexpr int SIMDHelpers::VectorLength<int8_t>::numValues() {return simdVectorLengthInt8; }
+
 #if NTLAB_USE_AVX2
 
     void ComplexVectorOperations::extractRealPart (const std::complex<float>* complexInVector, float* realOutVector, int length)
@@ -261,6 +272,116 @@ namespace ntlab
 
     }
 
+    // The conversion functions treat the interleaved complex vectors as real vectors of twice the length. Unaligned
+    // loads and stores are as fast as aligned ones on AVX2 hardware if the data happens to be aligned, so there is no
+    // need for an aligned code path here.
+
+    void ComplexVectorOperations::convertToFloat (const std::complex<int16_t>* intInVector, std::complex<float>* floatOutVector, int length)
+    {
+        auto in  = reinterpret_cast<const int16_t*> (intInVector);
+        auto out = reinterpret_cast<float*> (floatOutVector);
+
+        int numSIMDIterations, numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD;
+        SIMDHelpers::Partition<float>::forArbitraryLengthVector (2 * length, numSIMDIterations, numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD);
+
+        const __m256 scaling = _mm256_set1_ps (1.0f / intFullScale<int16_t>());
+
+        for (int i = 0; i < numSIMDIterations; ++i)
+        {
+            __m128i intVec = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (in + (i * SIMDHelpers::simdVectorLengthFloat)));
+            __m256 floatVec = _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (intVec)), scaling);
+
+            _mm256_storeu_ps (out + (i * SIMDHelpers::simdVectorLengthFloat), floatVec);
+        }
+
+        convertToFloatNonSIMD (in + numElementsToProcessWithSIMD, out + numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD);
+    }
+
+    void ComplexVectorOperations::convertToFloat (const std::complex<int8_t>* intInVector, std::complex<float>* floatOutVector, int length)
+    {
+        auto in  = reinterpret_cast<const int8_t*> (intInVector);
+        auto out = reinterpret_cast<float*> (floatOutVector);
+
+        int numSIMDIterations, numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD;
+        SIMDHelpers::Partition<float>::forArbitraryLengthVector (2 * length, numSIMDIterations, numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD);
+
+        const __m256 scaling = _mm256_set1_ps (1.0f / intFullScale<int8_t>());
+
+        for (int i = 0; i < numSIMDIterations; ++i)
+        {
+            __m128i intVec = _mm_loadl_epi64 (reinterpret_cast<const __m128i*> (in + (i * SIMDHelpers::simdVectorLengthFloat)));
+            __m256 floatVec = _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_cvtepi8_epi32 (intVec)), scaling);
+
+            _mm256_storeu_ps (out + (i * SIMDHelpers::simdVectorLengthFloat), floatVec);
+        }
+
+        convertToFloatNonSIMD (in + numElementsToProcessWithSIMD, out + numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD);
+    }
+
+    void ComplexVectorOperations::convertFromFloat (const std::complex<float>* floatInVector, std::complex<int16_t>* intOutVector, int length)
+    {
+        auto in  = reinterpret_cast<const float*> (floatInVector);
+        auto out = reinterpret_cast<int16_t*> (intOutVector);
+
+        int numSIMDIterations, numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD;
+        SIMDHelpers::Partition<int16_t>::forArbitraryLengthVector (2 * length, numSIMDIterations, numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD);
+
+        const __m256 scaling  = _mm256_set1_ps (intFullScale<int16_t>());
+        const __m256 minValue = _mm256_set1_ps (static_cast<float> (std::numeric_limits<int16_t>::min()));
+        const __m256 maxValue = _mm256_set1_ps (static_cast<float> (std::numeric_limits<int16_t>::max()));
+
+        for (int i = 0; i < numSIMDIterations; ++i)
+        {
+            auto inPtr = in + (i * SIMDHelpers::simdVectorLengthInt16);
+
+            // Clamping before the conversion avoids the integer indefinite value for out-of-range floats
+            __m256 lo = _mm256_min_ps (_mm256_max_ps (_mm256_mul_ps (_mm256_loadu_ps (inPtr),     scaling), minValue), maxValue);
+            __m256 hi = _mm256_min_ps (_mm256_max_ps (_mm256_mul_ps (_mm256_loadu_ps (inPtr + 8), scaling), minValue), maxValue);
+
+            // The pack instruction works on 128 bit lanes, so the 64 bit blocks have to be reordered afterwards
+            __m256i packed = _mm256_packs_epi32 (_mm256_cvtps_epi32 (lo), _mm256_cvtps_epi32 (hi));
+            packed = _mm256_permute4x64_epi64 (packed, _MM_SHUFFLE (3, 1, 2, 0));
+
+            _mm256_storeu_si256 (reinterpret_cast<__m256i*> (out + (i * SIMDHelpers::simdVectorLengthInt16)), packed);
+        }
+
+        convertFromFloatNonSIMD (in + numElementsToProcessWithSIMD, out + numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD);
+    }
+
+    void ComplexVectorOperations::convertFromFloat (const std::complex<float>* floatInVector, std::complex<int8_t>* intOutVector, int length)
+    {
+        auto in  = reinterpret_cast<const float*> (floatInVector);
+        auto out = reinterpret_cast<int8_t*> (intOutVector);
+
+        int numSIMDIterations, numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD;
+        SIMDHelpers::Partition<int8_t>::forArbitraryLengthVector (2 * length, numSIMDIterations, numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD);
+
+        const __m256 scaling  = _mm256_set1_ps (intFullScale<int8_t>());
+        const __m256 minValue = _mm256_set1_ps (static_cast<float> (std::numeric_limits<int8_t>::min()));
+        const __m256 maxValue = _mm256_set1_ps (static_cast<float> (std::numeric_limits<int8_t>::max()));
+        const __m256i reorder = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+
+        for (int i = 0; i < numSIMDIterations; ++i)
+        {
+            auto inPtr = in + (i * SIMDHelpers::simdVectorLengthInt8);
+
+            __m256i quarters[4];
+            for (int q = 0; q < 4; ++q)
+            {
+                __m256 scaled = _mm256_min_ps (_mm256_max_ps (_mm256_mul_ps (_mm256_loadu_ps (inPtr + 8 * q), scaling), minValue), maxValue);
+                quarters[q] = _mm256_cvtps_epi32 (scaled);
+            }
+
+            // Both pack instructions work on 128 bit lanes, which leaves the 32 bit blocks interleaved by quarter
+            __m256i packed = _mm256_packs_epi16 (_mm256_packs_epi32 (quarters[0], quarters[1]), _mm256_packs_epi32 (quarters[2], quarters[3]));
+            packed = _mm256_permutevar8x32_epi32 (packed, reorder);
+
+            _mm256_storeu_si256 (reinterpret_cast<__m256i*> (out + (i * SIMDHelpers::simdVectorLengthInt8)), packed);
+        }
+
+        convertFromFloatNonSIMD (in + numElementsToProcessWithSIMD, out + numElementsToProcessWithSIMD, numElementsToProcessWithoutSIMD);
+    }
+
 #elif NTLAB_USE_NEON
 
 #elif NTLAB_NO_SIMD
@@ -285,6 +406,26 @@ namespace ntlab
         absNonSIMD (complexInVector, absOutVector, length);
     }
 
+    forcedinline void ComplexVectorOperations::convertToFloat (const std::complex<int16_t>* intInVector, std::complex<float>* floatOutVector, int length)
+    {
+        convertToFloatNonSIMD (reinterpret_cast<const int16_t*> (intInVector), reinterpret_cast<float*> (floatOutVector), 2 * length);
+    }
+
+    forcedinline void ComplexVectorOperations::convertToFloat (const std::complex<int8_t>* intInVector, std::complex<float>* floatOutVector, int length)
+    {
+        convertToFloatNonSIMD (reinterpret_cast<const int8_t*> (intInVector), reinterpret_cast<float*> (floatOutVector), 2 * length);
+    }
+
+    forcedinline void ComplexVectorOperations::convertFromFloat (const std::complex<float>* floatInVector, std::complex<int16_t>* intOutVector, int length)
+    {
+        convertFromFloatNonSIMD (reinterpret_cast<const float*> (floatInVector), reinterpret_cast<int16_t*> (intOutVector), 2 * length);
+    }
+
+    forcedinline void ComplexVectorOperations::convertFromFloat (const std::complex<float>* floatInVector, std::complex<int8_t>* intOutVector, int length)
+    {
+        convertFromFloatNonSIMD (reinterpret_cast<const float*> (floatInVector), reinterpret_cast<int8_t*> (intOutVector), 2 * length);
+    }
+
 #endif
 
 
@@ -354,6 +495,62 @@ namespace ntlab
                 }
             expect (allValuesEqual);
 
+            beginTest ("Convert sc16 and sc8 to float and back");
+            std::vector<std::complex<int16_t>> sc16Src (vecSize), sc16Dst (vecSize);
+            std::vector<std::complex<int8_t>>  sc8Src  (vecSize), sc8Dst  (vecSize);
+            std::vector<std::complex<float>>   floatDst (vecSize);
+
+            for (int i = 0; i < vecSize; ++i)
+            {
+                sc16Src[i] = std::complex<int16_t> (static_cast<int16_t> (random.nextInt (65536) - 32768), static_cast<int16_t> (random.nextInt (65536) - 32768));
+                sc8Src[i]  = std::complex<int8_t>  (static_cast<int8_t>  (random.nextInt (256) - 128),     static_cast<int8_t>  (random.nextInt (256) - 128));
+            }
+
+            ComplexVectorOperations::convertToFloat (sc16Src.data(), floatDst.data(), vecSize);
+            allValuesEqual = true;
+            for (int i = 0; i < vecSize; ++i)
+                if (!(juce::approximatelyEqual (floatDst[i].real(), sc16Src[i].real() / 32767.0f) && juce::approximatelyEqual (floatDst[i].imag(), sc16Src[i].imag() / 32767.0f)))
+                {
+                    allValuesEqual = false;
+                    break;
+                }
+            expect (allValuesEqual);
+
+            ComplexVectorOperations::convertFromFloat (floatDst.data(), sc16Dst.data(), vecSize);
+            expect (sc16Src == sc16Dst);
+
+            ComplexVectorOperations::convertToFloat (sc8Src.data(), floatDst.data(), vecSize);
+            allValuesEqual = true;
+            for (int i = 0; i < vecSize; ++i)
+                if (!(juce::approximatelyEqual (floatDst[i].real(), sc8Src[i].real() / 127.0f) && juce::approximatelyEqual (floatDst[i].imag(), sc8Src[i].imag() / 127.0f)))
+                {
+                    allValuesEqual = false;
+                    break;
+                }
+            expect (allValuesEqual);
+
+            ComplexVectorOperations::convertFromFloat (floatDst.data(), sc8Dst.data(), vecSize);
+            expect (sc8Src == sc8Dst);
+
+            beginTest ("Saturate out of range float values");
+            for (int i = 0; i < vecSize; ++i)
+                floatDst[i] = std::complex<float> (random.nextBool() ? 1e10f : -1e10f, 1.5f);
+
+            ComplexVectorOperations::convertFromFloat (floatDst.data(), sc16Dst.data(), vecSize);
+            ComplexVectorOperations::convertFromFloat (floatDst.data(), sc8Dst.data(), vecSize);
+            allValuesEqual = true;
+            for (int i = 0; i < vecSize; ++i)
+            {
+                const bool positive = floatDst[i].real() > 0.0f;
+                if ((sc16Dst[i].real() != (positive ? 32767 : -32768)) || (sc16Dst[i].imag() != 32767) ||
+                    (sc8Dst[i].real()  != (positive ? 127 : -128))     || (sc8Dst[i].imag()  != 127))
+                {
+                    allValuesEqual = false;
+                    break;
+                }
+            }
+            expect (allValuesEqual);
+
             beginTest ("Free aligned memory");
             SIMDHelpers::Allocation<std::complex<float>>::freeAlignedVector (complexSrc);
             SIMDHelpers::Allocation<float>::freeAlignedVector (realDst);
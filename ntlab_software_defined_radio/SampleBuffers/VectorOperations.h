@@ -126,6 +126,7 @@ namespace ntlab
         static const int simdVectorLengthFloat = 8;
         static const int simdVectorLengthInt32 = 8;
         static const int simdVectorLengthInt16 = 16;
+        static const int simdVectorLengthInt8 = 32;
 #elif NTLAB_USE_NEON
         static const int simdRequiredAlignmentBytes = 16;
 #else
@@ -134,6 +135,7 @@ namespace ntlab
         static const int simdVectorLengthFloat = 1;
         static const int simdVectorLengthInt32 = 1;
         static const int simdVectorLengthInt16 = 1;
+        static const int simdVectorLengthInt8 = 1;
 #endif
     };
 
@@ -160,6 +162,30 @@ namespace ntlab
 
         static void multiply (const std::complex<float>* a, const std::complex<float>* b, std::complex<float>* result, int length, bool conjugateA = false, bool conjugateB = false);
 
+        /**
+         * Converts interleaved 16 bit integer samples (e.g. the sc16 format used by Ettus devices) to float samples.
+         * The integer full scale range is mapped to [-1, 1] using the same scaling as UHD does.
+         */
+        static void convertToFloat (const std::complex<int16_t>* intInVector, std::complex<float>* floatOutVector, int length);
+
+        /**
+         * Converts interleaved 8 bit integer samples (e.g. the sc8 format used by Ettus devices) to float samples.
+         * The integer full scale range is mapped to [-1, 1] using the same scaling as UHD does.
+         */
+        static void convertToFloat (const std::complex<int8_t>* intInVector, std::complex<float>* floatOutVector, int length);
+
+        /**
+         * Converts float samples to interleaved 16 bit integer samples. This is the inverse of convertToFloat, values
+         * outside [-1, 1] are saturated.
+         */
+        static void convertFromFloat (const std::complex<float>* floatInVector, std::complex<int16_t>* intOutVector, int length);
+
+        /**
+         * Converts float samples to interleaved 8 bit integer samples. This is the inverse of convertToFloat, values
+         * outside [-1, 1] are saturated.
+         */
+        static void convertFromFloat (const std::complex<float>* floatInVector, std::complex<int8_t>* intOutVector, int length);
+
     private:
 
         int calculateNumElementsToProcessWithoutSIMD (int numElementsToProcess, int vectorLength)
@@ -198,6 +224,28 @@ namespace ntlab
             for (int i = 0; i < length; ++i)
                 absOutVector[i] = std::abs (complexInVector[i]);
         }
+
+        template <typename IntType>
+        static constexpr float intFullScale() {return static_cast<float> (std::numeric_limits<IntType>::max()); }
+
+        template <typename IntType>
+        static void convertToFloatNonSIMD (const IntType* intInVector, float* floatOutVector, int numValues)
+        {
+            constexpr float scaling = 1.0f / intFullScale<IntType>();
+
+            for (int i = 0; i < numValues; ++i)
+                floatOutVector[i] = static_cast<float> (intInVector[i]) * scaling;
+        }
+
+        template <typename IntType>
+        static void convertFromFloatNonSIMD (const float* floatInVector, IntType* intOutVector, int numValues)
+        {
+            constexpr float minValue = static_cast<float> (std::numeric_limits<IntType>::min());
+            constexpr float maxValue = static_cast<float> (std::numeric_limits<IntType>::max());
+
+            for (int i = 0; i < numValues; ++i)
+                intOutVector[i] = static_cast<IntType> (std::nearbyint (juce::jlimit (minValue, maxValue, floatInVector[i] * intFullScale<IntType>())));
+        }
     };
 
     struct VectorOperations
@@ -0,0 +1,122 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace ntlab
+{
+    /**
+     * A single producer, single consumer queue of preallocated blocks, intended to pass sample buffers between a
+     * thread talking to the hardware and a thread processing the samples. The producer fills the next free block in
+     * place and pushes it, the consumer reads the oldest block in place and releases it afterwards. All blocks are
+     * created on construction, so using the queue never allocates and never blocks, except for the wait functions.
+     */
+    template <typename BlockType>
+    class SampleBlockQueue : private juce::AbstractFifo
+    {
+    public:
+        /** Creates a queue that holds numBlocks blocks, each one created by calling createBlock */
+        SampleBlockQueue (int numBlocks, const std::function<std::unique_ptr<BlockType>()>& createBlock)
+          : juce::AbstractFifo (numBlocks + 1) // an AbstractFifo can hold one element less than its size
+        {
+            jassert (numBlocks > 0);
+
+            for (int i = 0; i <= numBlocks; ++i)
+                blocks.push_back (createBlock());
+        }
+
+        /** Returns the number of blocks the queue can hold */
+        int getNumBlocks() const { return getTotalSize() - 1; }
+
+        /** Returns the number of blocks pushed but not released yet */
+        int getNumQueuedBlocks() const { return getNumReady(); }
+
+        /** Producer side: Returns the block to be filled next or a nullptr if the queue is full */
+        BlockType* getFreeBlock()
+        {
+            int startIdx1, blockSize1, startIdx2, blockSize2;
+            prepareToWrite (1, startIdx1, blockSize1, startIdx2, blockSize2);
+
+            if (blockSize1 == 1)
+                return blocks[static_cast<size_t> (startIdx1)].get();
+
+            if (blockSize2 == 1)
+                return blocks[static_cast<size_t> (startIdx2)].get();
+
+            return nullptr;
+        }
+
+        /** Producer side: Like getFreeBlock but waits up to timeoutMilliseconds for the consumer to release a block */
+        BlockType* waitForFreeBlock (int timeoutMilliseconds)
+        {
+            auto* block = getFreeBlock();
+
+            if ((block == nullptr) && blockReleased.wait (timeoutMilliseconds))
+                block = getFreeBlock();
+
+            return block;
+        }
+
+        /** Producer side: Hands the block returned by getFreeBlock over to the consumer */
+        void push()
+        {
+            finishedWrite (1);
+            blockPushed.signal();
+        }
+
+        /** Consumer side: Returns the oldest block pushed or a nullptr if the queue is empty */
+        BlockType* getNextBlock()
+        {
+            int startIdx1, blockSize1, startIdx2, blockSize2;
+            prepareToRead (1, startIdx1, blockSize1, startIdx2, blockSize2);
+
+            if (blockSize1 == 1)
+                return blocks[static_cast<size_t> (startIdx1)].get();
+
+            if (blockSize2 == 1)
+                return blocks[static_cast<size_t> (startIdx2)].get();
+
+            return nullptr;
+        }
+
+        /** Consumer side: Like getNextBlock but waits up to timeoutMilliseconds for the producer to push a block */
+        BlockType* waitForNextBlock (int timeoutMilliseconds)
+        {
+            auto* block = getNextBlock();
+
+            if ((block == nullptr) && blockPushed.wait (timeoutMilliseconds))
+                block = getNextBlock();
+
+            return block;
+        }
+
+        /** Consumer side: Hands the block returned by getNextBlock back to the producer */
+        void release()
+        {
+            finishedRead (1);
+            blockReleased.signal();
+        }
+
+    private:
+        std::vector<std::unique_ptr<BlockType>> blocks;
+        juce::WaitableEvent blockPushed, blockReleased;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleBlockQueue)
+    };
+}
@@ -0,0 +1,189 @@
+/*
+This file is part of SoftwareDefinedRadio4JUCE.
+
+SoftwareDefinedRadio4JUCE is free software: you can redistribute it
+and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+SoftwareDefinedRadio4JUCE is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <juce_core/juce_core.h>
+#include "SampleBlockQueue.h"
+
+#ifdef NTLAB_SOFTWARE_DEFINED_RADIO_UNIT_TESTS
+class SampleBlockQueueUnitTests : public juce::UnitTest
+{
+public:
+    SampleBlockQueueUnitTests() : juce::UnitTest ("SampleBlockQueue tests") {};
+
+    void runTest() override
+    {
+        const int numBlocks = 3;
+        auto createBlock = []() { return std::unique_ptr<int> (new int (-1)); };
+
+        beginTest ("Push and pop in order");
+
+        ntlab::SampleBlockQueue<int> queue (numBlocks, createBlock);
+        expectEquals (queue.getNumBlocks(), numBlocks);
+        expectEquals (queue.getNumQueuedBlocks(), 0);
+        expect (queue.getNextBlock() == nullptr);
+
+        // Wrap around the end of the underlying FIFO a few times
+        int nextValueToPush = 0;
+        int nextValueExpected = 0;
+
+        for (int round = 0; round < 5; ++round)
+        {
+            for (int i = 0; i < numBlocks; ++i)
+            {
+                auto* block = queue.getFreeBlock();
+                expect (block != nullptr);
+                *block = nextValueToPush++;
+                queue.push();
+            }
+
+            expectEquals (queue.getNumQueuedBlocks(), numBlocks);
+            expect (queue.getFreeBlock() == nullptr);
+
+            for (int i = 0; i < numBlocks; ++i)
+            {
+                auto* block = queue.getNextBlock();
+                expect (block != nullptr);
+                expectEquals (*block, nextValueExpected++);
+                queue.release();
+            }
+
+            expectEquals (queue.getNumQueuedBlocks(), 0);
+            expect (queue.getNextBlock() == nullptr);
+        }
+
+        beginTest ("Blocks are filled and read in place");
+
+        auto* freeBlock = queue.getFreeBlock();
+        expect (freeBlock == queue.getFreeBlock());
+        *freeBlock = 42;
+        queue.push();
+
+        auto* nextBlock = queue.getNextBlock();
+        expect (nextBlock == freeBlock);
+        expect (nextBlock == queue.getNextBlock());
+        queue.release();
+
+        beginTest ("Waits time out on a full or empty queue");
+
+        ntlab::SampleBlockQueue<int> timeoutQueue (numBlocks, createBlock);
+        const int timeoutMs = 50;
+
+        auto startTime = juce::Time::getMillisecondCounter();
+        expect (timeoutQueue.waitForNextBlock (timeoutMs) == nullptr);
+        expect (juce::Time::getMillisecondCounter() - startTime >= static_cast<juce::uint32> (timeoutMs - 5));
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            expect (timeoutQueue.waitForFreeBlock (timeoutMs) != nullptr);
+            timeoutQueue.push();
+        }
+
+        startTime = juce::Time::getMillisecondCounter();
+        expect (timeoutQueue.waitForFreeBlock (timeoutMs) == nullptr);
+        expect (juce::Time::getMillisecondCounter() - startTime >= static_cast<juce::uint32> (timeoutMs - 5));
+
+        beginTest ("Waits return as soon as the other side acts");
+
+        ntlab::SampleBlockQueue<int> wakeUpQueue (numBlocks, createBlock);
+        const int longTimeoutMs = 10000;
+
+        ProducerThread delayedProducer (wakeUpQueue, 1, 20);
+        delayedProducer.startThread();
+
+        startTime = juce::Time::getMillisecondCounter();
+        auto* pushedBlock = wakeUpQueue.waitForNextBlock (longTimeoutMs);
+        expect (pushedBlock != nullptr);
+        expect (juce::Time::getMillisecondCounter() - startTime < static_cast<juce::uint32> (longTimeoutMs));
+        expect (delayedProducer.waitForThreadToExit (longTimeoutMs));
+
+        if (pushedBlock != nullptr)
+        {
+            expectEquals (*pushedBlock, 0);
+            wakeUpQueue.release();
+        }
+
+        beginTest ("Pass blocks between a producer and a consumer thread");
+
+        ntlab::SampleBlockQueue<int> threadedQueue (numBlocks, createBlock);
+        const int numBlocksToPass = 100000;
+
+        ProducerThread producer (threadedQueue, numBlocksToPass, 0);
+        producer.startThread();
+
+        bool allInOrder = true;
+        int numBlocksReceived = 0;
+
+        while (numBlocksReceived < numBlocksToPass)
+        {
+            auto* block = threadedQueue.waitForNextBlock (longTimeoutMs);
+            if (block == nullptr)
+            {
+                // waitForNextBlock might return early if a push has been signalled while a block was available
+                if (!producer.isThreadRunning() && (threadedQueue.getNumQueuedBlocks() == 0))
+                    break;
+
+                continue;
+            }
+
+            allInOrder &= (*block == numBlocksReceived++);
+            threadedQueue.release();
+        }
+
+        expect (producer.waitForThreadToExit (longTimeoutMs));
+        expect (allInOrder);
+        expectEquals (numBlocksReceived, numBlocksToPass);
+        expectEquals (producer.numBlocksPushed.load(), numBlocksToPass);
+    }
+
+private:
+    /** Pushes the values 0 to numBlocksToPush - 1 into the queue, optionally after a delay */
+    class ProducerThread : public juce::Thread
+    {
+    public:
+        ProducerThread (ntlab::SampleBlockQueue<int>& queueToFill, int numBlocks, int delayMs)
+          : juce::Thread ("SampleBlockQueue test producer"), queue (queueToFill), numBlocksToPush (numBlocks), delayBeforeFirstPushMs (delayMs) {}
+
+        ~ProducerThread() override { stopThread (-1); }
+
+        void run() override
+        {
+            if (delayBeforeFirstPushMs > 0)
+                sleep (delayBeforeFirstPushMs);
+
+            while ((numBlocksPushed < numBlocksToPush) && !threadShouldExit())
+            {
+                auto* block = queue.waitForFreeBlock (100);
+                if (block == nullptr)
+                    continue;
+
+                *block = numBlocksPushed;
+                queue.push();
+                ++numBlocksPushed;
+            }
+        }
+
+        std::atomic<int> numBlocksPushed {0};
+
+    private:
+        ntlab::SampleBlockQueue<int>& queue;
+        const int numBlocksToPush;
+        const int delayBeforeFirstPushMs;
+    };
+};
+
+static SampleBlockQueueUnitTests sampleBlockQueueUnitTests;
+#endif
@@ -19,10 +19,12 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 #include "HardwareDevices/SDRIOEngine.cpp"
 
 #include "HardwareDevices/EttusEngine/UHDReplacement.cpp"
+#include "HardwareDevices/EttusEngine/UHDDeviceTreeCache.cpp"
 #include "HardwareDevices/EttusEngine/UHDEngine.cpp"
 #include "HardwareDevices/HackRFEngine/HackRFReplacement.cpp"
 #include "HardwareDevices/HackRFEngine/HackRFEngine.cpp"
 #include "HardwareDevices/MCVFileEngine/MCVFileEngine.cpp"
+#include "HardwareDevices/MCVFileEngine/MCVSegmentProcessor.cpp"
 
 #if JUCE_MODULE_AVAILABLE_juce_gui_basics
 #include "GUI/UHDConfigComponent.cpp"
@@ -38,6 +40,8 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 
 #include "SampleBuffers/VectorOperations.cpp"
 
+#include "Threading/SampleBlockQueueUnitTests.cpp"
+
 //#include "Matrix/CovarianceMatrix.cpp"
 
 #include "UnitTestHelpers/UnitTestHelpers.cpp"
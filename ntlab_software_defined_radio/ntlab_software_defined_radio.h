@@ -99,8 +99,10 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 #include "HardwareDevices/EttusEngine/UHDReplacement.h"
 #include "HardwareDevices/HackRFEngine/HackRFReplacement.h"
 #endif
+#include "HardwareDevices/EttusEngine/UHDDeviceTreeCache.h"
 #include "HardwareDevices/EttusEngine/UHDEngine.h"
 #include "HardwareDevices/MCVFileEngine/MCVFileEngine.h"
+#include "HardwareDevices/MCVFileEngine/MCVSegmentProcessor.h"
 #include "HardwareDevices/SDRIODeviceCallback.h"
 #include "HardwareDevices/SDRIOEngine.h"
 #include "HardwareDevices/SDRIODeviceManger.h"
@@ -129,8 +131,11 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 #endif
 
 #include "MCVFileFormat/MCVHeader.h"
+#include "MCVFileFormat/MCVChunkIndex.h"
+#include "MCVFileFormat/MCVBlockCodec.h"
 #include "MCVFileFormat/MCVWriter.h"
 #include "MCVFileFormat/MCVReader.h"
+#include "MCVFileFormat/MCVPreTriggerRecorder.h"
 
 #include "PerformanceMeasurement/ProcessingTimeMeasurement.h"
 
@@ -138,6 +143,7 @@ along with SoftwareDefinedRadio4JUCE. If not, see <http://www.gnu.org/licenses/>
 #include "SampleBuffers/SampleBuffers.h"
 
 #include "Threading/RealtimeSetterThreadWithFIFO.h"
+#include "Threading/SampleBlockQueue.h"
 #include "Threading/ChildProcessReplacement.h"
 
 #include "UnitTestHelpers/UnitTestHelpers.h"